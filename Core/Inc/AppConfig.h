@@ -336,5 +336,34 @@
     #define BUZZER_QUEUE_LENGTH 20
 #endif
 
+/*====================
+   EXTERNAL FLASH CONFIG
+ *====================*/
 #define USE_FLASH 1
+#if USE_FLASH
+    #define FLASH_PAGE_WRITERS 2 // page writers open at the same time (ring, time-series and columnar logs, blob store), two pool pages each
+    #define FLASH_BUFFER_POOL_SIZE (2 * FLASH_PAGE_WRITERS + 3) // scratch pages: the writers, a verify read back, two for a job or a lookup
+    #define FLASH_ERASED_POOL_SIZE 8 // number of blocks kept erased in the background for `AllocateBlock`
+    #define FLASH_ERASED_POOL_LOW_WATERMARK 2 // the low watermark callback fires when fewer blocks are left
+    #define FLASH_MAX_PARTITIONS 8 // number of entries of the partition table kept in the metadata snapshot
+    #define FLASH_KV_INDEX_SIZE 64 // slots of the key-value store index, a power of two, up to 3/4 of them hold keys
+    #define FLASH_KV_CACHED_VALUE_SIZE 12 // values up to this size are kept in the index and read without touching the chip
+    #define FLASH_BTREE_PINNED_NODES 4 // pages of RAM per B+-tree for its root and the nodes right below it
+    #define FLASH_BLOB_MAX_EXTENTS 8 // runs of contiguous blocks an object of the blob store can be split into
+    #define FLASH_FS_MAX_FILE_BLOCKS 64 // blocks of a file of the file system, 8 MB with 128 KB blocks
+    #define FLASH_FS_PAGE_PROGRAMS 4 // programs of one page allowed by the chip (NOP), the last page of a file is copied after that
+    #define FLASH_TS_MAX_BLOCKS 128 // blocks of a time-series log, the first time of each one is kept in RAM
+    #define FLASH_TS_ZONE_FIELDS 3 // fields of a time-series record with a min/max zone map, the zones of a block must fit its index page
+    #define FLASH_COLUMN_MAX_COLUMNS 4 // columns of a columnar log, each one and the times have a page buffer of RAM in every log
+    #define FLASH_CODEC_MAX_FIELDS 32 // fields of a record coded by the delta codec, its history keeps a word for each one
+    #define FLASH_QUANT_BATCH 32 // rows of a quantized column sharing a scale per channel, converted together when the batch is full
+    #define FLASH_QUANT_MAX_SCALES 64 // scales of a quantized column page, read on the stack of `read`
+    #define FLASH_DECIMATOR_BLOCK 64 // samples of a DMA transfer of the FMAC decimator, it has two input blocks and a ring of two output blocks
+    #define FLASH_DECIMATOR_CHUNKS 8 // decimated blocks waiting for the logging task, each one takes `FLASH_DECIMATOR_BLOCK` samples
+    #define FLASH_INGEST_RING_SIZE 8192 // bytes of the ISR ingestion ring, a power of two, the records waiting for the flash writer task
+    #define FLASH_INGEST_MAX_PRODUCERS 8 // producers of the ingestion ring, each one has its own policy and counters
+    #define FLASH_INGEST_MAX_RECORD 512 // bytes of a record of the ingestion ring, at most a quarter of the ring
+    #define FLASH_TRACE_MAX_ARGS 8 // argument words of a record of the binary trace log
+    #define FLASH_TRACE_STDOUT 0 // `_write` stores stdout as text records of the trace log instead of printing it
+#endif
 #endif // Content enable
\ No newline at end of file
@@ -1,5 +1,12 @@
 #pragma once
 #include "AppConfig.h"
+#include "flashBlockTable.hpp"
+#include "flashBufferPool.hpp"
+#include "flashDeadline.hpp"
+#include "flashErasedPool.hpp"
+#include "flashScheduler.hpp"
+#include "flashGeometry.hpp"
+#include "flashPartitionTable.hpp"
 #include "quadspi.h"
 #include "stdint-gcc.h"
 
@@ -8,46 +15,12 @@
 // #define MANUFACTURER_ID 0xEF
 // #define DEVICE_ID 0xAA21
 
-/// Mem size in KB
-#define FLASH_SIZE_BYTE 131072U  // 128MB : 128*2^(10)KB
-
-/// page size in KB
-#define PAGE_SIZE_KBYTE 2U  // 2 Kbyte : 1 page
-
-/// Mem block size in KB
-#define BLOCK_SIZE_KBYTE (64 * PAGE_SIZE_KBYTE)  // 128 KB: 64 pages
-
-/// Blocks count
-#define BLOCK_COUNT (FLASH_SIZE_BYTE / BLOCK_SIZE_KBYTE)  // 1023 blocks + 1 resevered
-#define RESERVE_BLOCK_BLOCKADDR 1023
-
-/// Sector count
-#define PAGE_COUNT (FLASH_SIZE_BYTE / PAGE_SIZE_KBYTE)  // 65536 pages
-
-// the number of pages per block
-#define PAGE_PER_BLOCK (PAGE_COUNT / BLOCK_COUNT)  // 64 pages per block
-
-#define PAGE_SIZE_BYTE 2048
-#define ECC_SIZE_BYTE 64
-
-#define JEDECID_EXEPECTED 0xEFAA21
-
-#define blockAddrFilter(A) (A & 0xFFC0000) >> 18
-#define pageAddrFilter(A) (A & 0x3F000) >> 12
-#define byteAddrFilter(A) (A & 0x7FF)
-
 namespace Core
 {
 namespace Drivers
 {
 namespace W25N01
 {
-/**
- * @brief  Calculate the address to save the last address of the non-reserved blocks
- * @param  blockNUM: the non-reserved block number whos last address is to be saved
- */
-inline uint32_t ADDR_STORE_START(uint16_t blockNUM);
-
 static constexpr uint8_t MANUFACTURER_ID = 0xEF;
 static constexpr uint16_t DEVICE_ID      = 0xAA21;
 
@@ -95,32 +68,112 @@ enum RegisterAddress : uint8_t
     STATUS_REGISTER        = 0xC0
 };
 
+/**
+ * @brief The state of the chip, this is returned by all the functions to indicate the state of the chip
+ */
+enum class State
+{
+    OK              = 0,  ///< Chip OK - Execution fine
+    PARAM_ERR       = 1,  ///< Function parameters error
+    ECC_ERR         = 2,  ///< ECC error
+    QSPI_ERR        = 3,  ///< SPI Bus err
+    OBJECT_NOT_INIT = 4,
+    NO_BUFFER       = 5,  ///< All the page buffers of the pool are in use
+    BUSY            = 6   ///< A background operation owns the block or the chip
+};
+
+/**
+ * @brief The long operations that can be run in steps by `Manager::Step`
+ */
+enum class JobKind : uint8_t
+{
+    NONE        = 0,
+    ERASE_CHIP  = 1,
+    ERASE_RANGE = 2,
+    BB_SCAN     = 3,
+    FORMAT      = 4
+};
+
+/**
+ * @brief When the block table is persisted after a write
+ * @note  The data itself is always programmed before the write returns. What can be lost on a power cut is the table update, in which case the
+ *        mount recovers the write offsets from the chip: the data written after the last snapshot is skipped (not returned, not overwritten)
+ *        up to the next page boundary, so what the table describes is always a prefix of the writes
+ */
+enum class Durability : uint8_t
+{
+    DEFAULT = 0,  ///< Use the mode set with `Manager::setDurability`
+    SYNC    = 1,  ///< Save the table after every write
+    GROUP   = 2,  ///< Save the table once the writes since the last save reach N bytes or are older than N ms
+    LAZY    = 3   ///< Only save the table on `Sync` or when another operation saves it
+};
+
+/**
+ * @brief How `Manager::Format` gets rid of the data
+ */
+enum class FormatMode : uint8_t
+{
+    FAST  = 0,  ///< Erase only the blocks that hold data, the call returns once they are all erased
+    QUICK = 1   ///< Mark the written blocks `DIRTY` and return, they are erased in the background or right before their next write, so
+                ///< they can be written as soon as the call returns. Only the block the background pass is erasing answers `State::BUSY`
+};
+
+/**
+ * @brief The progress of the current background operation
+ */
+enum class JobStatus : uint8_t
+{
+    IDLE      = 0,  ///< Nothing has been started
+    RUNNING   = 1,  ///< Advanced by each `Step`
+    PAUSED    = 2,  ///< `Step` returns without touching the chip until `Resume`
+    DONE      = 3,  ///< Finished, `jobResult` is `OK`
+    FAILED    = 4,  ///< Stopped on an error, `jobResult` tells which
+    CANCELLED = 5   ///< Stopped by `Cancel` at a point where the data is consistent
+};
+
+template <typename GEOMETRY>
+class PageWriter;
+template <typename GEOMETRY>
+class Partition;
+template <typename GEOMETRY>
+class RingLog;
+template <typename GEOMETRY>
+class KvStore;
+template <typename GEOMETRY>
+class BTree;
+template <typename GEOMETRY>
+class BlobStore;
+template <typename GEOMETRY>
+class FileSystem;
+template <typename GEOMETRY>
+class TimeSeriesLog;
+template <typename GEOMETRY>
+class ColumnLog;
+
 /**
  * @brief The class that manages the W25N01 external memory, all the API commands are called from this function
- * @param subsections: the number of subsections that the memory is divided into (not implemented)
- * @param nextAddr: The address at which data can be written for each block
+ * @param subsections: the number of equal partitions created on a chip that has none, see `CreatePartition`
+ * @param blocks: The write offset, state and wear of each block, persisted in the metadata journal
  * @param reservedBlock: The block number that is reserved for replacement commands
  * @param kernelMode: This mode is only for the replacement commands and is managed by the class
  * @param isInited: This is to check if the `init` function has been called
+ * @tparam GEOMETRY: the `NandGeometry` of the chip, all the address splitting and bounds checks are derived from it
  */
+template <typename GEOMETRY = DefaultGeometry>
 class Manager
 {
    public:
-    /**
-     * @brief The state of the chip, this is returned by all the functions to indicate the state of the chip
-     */
-    enum class State
-    {
-        OK              = 0,  ///< Chip OK - Execution fine
-        PARAM_ERR       = 1,  ///< Function parameters error
-        ECC_ERR         = 2,  ///< ECC error
-        QSPI_ERR        = 3,  ///< SPI Bus err
-        OBJECT_NOT_INIT = 4
-    };
+    using Geometry = GEOMETRY;
+    using State    = W25N01::State;
+    /// The page sized scratch buffers shared by all the operations on this chip type
+    using PagePool = BufferPool<GEOMETRY::PAGE_SIZE_BYTE, FLASH_BUFFER_POOL_SIZE>;
+    /// The blocks erased ahead of time for `AllocateBlock`
+    using ErasedPool = ErasedBlockPool<FLASH_ERASED_POOL_SIZE>;
 
     /**
      * @brief The constructor for the W25N01 class
-     * @param subsections: the number of subsections that the memory is divided into (not implemented)
+     * @param subsections: when more than 1 and the chip has no partition table yet, `init` divides the user blocks into this many
+     * equal partitions named "part0", "part1"... with the default policies
      */
     Manager(uint16_t subsections = 1);
     /**
@@ -144,8 +197,9 @@ class Manager
      * @param blockNumber: The block number to which the data is to be written
      * @param data: The buffer with the data to be written
      * @param size: The size of the data to be written
+     * @param durability: when the write is made durable, see `Durability`
      */
-    State WriteMemory(uint16_t blockNumber, uint8_t *data, uint16_t size);
+    State WriteMemory(uint16_t blockNumber, uint8_t *data, uint16_t size, Durability durability = Durability::DEFAULT);
     /**
      * @brief This function is responsible for writing data to the memory within the block `blockNumber`, this is more flexible and allows the user to
      * write to any address
@@ -172,19 +226,76 @@ class Manager
      * @param blockNUM: The block number to be erased, if not provided
      * @param canSaveAddr: If the address of the block is to be saved, this is to avoid recursion
      */
-    State EraseBlock(uint32_t blockNUM = RESERVE_BLOCK_BLOCKADDR, bool canSaveAddr = true);
+    State EraseBlock(uint32_t blockNUM = Geometry::RESERVE_BLOCK_BLOCKADDR, bool canSaveAddr = true);
     /**
      * @brief This function is responsible for erasing the range of memory from `start_addr` to `end_addr`, can only erase contigious space withing a
      * block
      * @param start_addr: The start address of the range to be erased
      * @param end_addr: The end address of the range to be erased
+     * @note  runs `StartEraseRange` to completion, `State::BUSY` if another background operation is in progress
      */
     State EraseRange_WithinBlock(uint32_t start_addr, uint32_t end_addr);
     /**
      * @brief This function is responsible for erasing the entire chip
+     * @note  runs `StartEraseChip` to completion (several seconds), prefer the background version where possible
      */
     State EraseChip();
 
+    /**
+     * @brief Discard all the data on the chip without erasing the blocks that are already blank
+     * @note  a block is erased if the block table says it was written, or if the spare area of its first page is not blank (this catches
+     * the writes that did not make it into the metadata). Blocks whose first spare bytes carry a factory bad block mark are marked bad instead
+     * @param mode: `FAST` runs the format to completion, `QUICK` only marks the written blocks `DIRTY` and starts the format in the background
+     */
+    State Format(FormatMode mode = FormatMode::FAST);
+    /**
+     * @brief Start the format of `Format(FormatMode::FAST)` in the background, the format is advanced by `Step`
+     * @note  writes are refused with `State::BUSY` in the blocks the format has not reached yet
+     */
+    State StartFormat();
+    /**
+     * @brief Start erasing the entire chip in the background, the erase is advanced by `Step`
+     * @note  writes are refused with `State::BUSY` until the operation is over
+     */
+    State StartEraseChip();
+    /**
+     * @brief Start erasing the range `[start_addr, end_addr)` within a block in the background, the erase is advanced by `Step`
+     * @note  the block is not accessible (`State::BUSY`) until the operation is over
+     */
+    State StartEraseRange(uint32_t start_addr, uint32_t end_addr);
+    /**
+     * @brief Start the bad block scan of `BB_management` in the background, the scan is advanced by `Step`
+     * @note  the whole chip is not accessible (`State::BUSY`) until the operation is over
+     */
+    State StartBBScan();
+    /**
+     * @brief Advance the background operation for about `budget_us` microseconds
+     * @note  the budget is checked between two units of work, a unit being one block erase command, one relocated page or one scanned block,
+     * so a step can overrun it by the duration of one unit. `Deadline::NO_BUDGET` lifts the limit
+     * @note  the step returns early, without polling, when the chip is still busy with the last unit or the control tick is too close: the
+     * caller gives the CPU away and steps again later
+     * @note  when no operation is in progress, the step refills the pool of erased blocks of `AllocateBlock` instead
+     * @param budget_us: the time the caller can spare before its next deadline
+     * @return the status of the operation after the step
+     */
+    JobStatus Step(uint32_t budget_us);
+    /**
+     * @brief Stop advancing the background operation, e.g. while a high priority read is served. The chip may still finish the command in flight
+     */
+    void Pause();
+    void Resume();
+    /**
+     * @brief Stop the background operation at the next point where the data is consistent, a range erase that has already erased the source block
+     * runs to completion
+     */
+    void Cancel();
+    JobKind jobKind() const { return job.kind; }
+    JobStatus jobStatus() const { return job.status; }
+    /// the error that stopped the operation, `OK` while it runs or after it has finished
+    State jobResult() const { return job.result; }
+    /// the progress of the operation in percent
+    uint8_t jobProgress() const { return job.total == 0 ? 0 : job.done * 100 / job.total; }
+
     /**
      * @brief This function is responsible for reading the JEDEC ID of the memory
      * @param buffer: The buffer to store the Look Up Table data
@@ -211,7 +322,7 @@ class Manager
     State SetWritePin(bool state) const;
 
     /**
-     * @brief This function is responsible for setting the basic settings and initializing the `nextAddr` array
+     * @brief This function is responsible for setting the basic settings and loading the block table from the metadata journal
      */
     State init();
 
@@ -222,15 +333,178 @@ class Manager
 
     /**
      * @brief This function is responsible for finding out the bad blocks (still needs to be tested on a new chip)
+     * @note  runs `StartBBScan` to completion
      */
     State BB_management(); /*#TO DO*/
 
+    /**
+     * @brief The pool from which the operations borrow their page buffers, also available to the layers built on top
+     */
+    static PagePool &pagePool() { return pool; }
+
+    /**
+     * @brief Hand out an erased block to write to, taken from the pool kept erased by `Step`
+     * @note  when the pool is empty, a `FREE` block is looked up or a `DIRTY` one is erased while the caller waits (counted in the pool metrics)
+     * @return the block number, or -1 if there is no block left to write to
+     */
+    int32_t AllocateBlock();
+    /**
+     * @brief The pool of erased blocks, to set its target level and low watermark callback and to read its metrics
+     */
+    ErasedPool &erasedPool() { return erased; }
+
+    /**
+     * @brief Add a partition of `blockCount` blocks after the last one and save the partition table
+     * @note  the blocks are taken from the shared space as they are, the data they hold stays readable through the partition.
+     * Use a `Partition` handle to work with it
+     */
+    State CreatePartition(const char *name, uint16_t blockCount, const PartitionPolicy &policy);
+    /**
+     * @brief Change the policies of a partition and save the partition table
+     */
+    State SetPartitionPolicy(uint8_t index, const PartitionPolicy &policy);
+    /**
+     * @brief Remove all the partitions, their blocks go back to the shared space with their data
+     */
+    State ClearPartitions();
+    const PartitionTable &partitionTable() const { return partitions; }
+
+    /**
+     * @brief Set the durability of the writes that do not ask for one
+     */
+    void setDurability(Durability mode) { defaultDurability = mode == Durability::DEFAULT ? Durability::SYNC : mode; }
+    /**
+     * @brief Set when a group commit saves the table, 0 disables the limit
+     * @param interval_ms: the age of the oldest unsaved `GROUP` write, also checked by `Step` when there are no more writes, whatever the
+     *        default durability and while a background operation runs
+     * @param bytes: the amount of unsaved data
+     */
+    void setGroupCommit(uint32_t interval_ms, uint32_t bytes)
+    {
+        groupInterval_ms = interval_ms;
+        groupBytes       = bytes;
+    }
+    /**
+     * @brief Save the block table now if writes are waiting for it
+     */
+    State Sync();
+
+    /**
+     * @brief How well the writes are batched into table saves
+     */
+    struct CommitStats
+    {
+        uint32_t commits;        ///< snapshots of the table written
+        uint32_t writes;         ///< writes since the start
+        uint32_t maxBatch;       ///< the most writes made durable by one snapshot
+        uint32_t pendingWrites;  ///< writes waiting for the next snapshot
+        uint32_t pendingBytes;   ///< bytes waiting for the next snapshot
+    };
+    const CommitStats &commitStats() const { return commits; }
+
+    /**
+     * @brief Only issue the bus operations in the slack before the next control tick, `nullptr` to issue them right away
+     * @note  the operations then also wait for the chip to be ready outside of the critical sections
+     */
+    void setScheduler(ControlTickScheduler *tickScheduler) { scheduler = tickScheduler; }
+
+    /**
+     * @brief The write offset, state and wear of every block
+     */
+    const BlockTable<Geometry> &blockTable() const { return blocks; }
+
    private:
-    const int subsections;           // divides up the 1024 blocks, Right now does not do anything
-    uint32_t nextAddr[BLOCK_COUNT];  // gives the next byte
+    template <typename>
+    friend class PageWriter;
+    template <typename>
+    friend class Partition;
+    template <typename>
+    friend class RingLog;
+    template <typename>
+    friend class KvStore;
+    template <typename>
+    friend class BTree;
+    template <typename>
+    friend class BlobStore;
+    template <typename>
+    friend class FileSystem;
+    template <typename>
+    friend class TimeSeriesLog;
+    template <typename>
+    friend class ColumnLog;
+
+    static PagePool pool;
+    /// the page of the metadata snapshots and of the mount recovery, kept out of the pool so that they never find it exhausted
+    alignas(4) static uint8_t metadataPage[GEOMETRY::PAGE_SIZE_BYTE];
+
+    /// a metadata snapshot is the raw block table and partition table followed by a footer at the end of its last page
+    static constexpr uint32_t SNAPSHOT_FOOTER_SIZE = 8;
+    static constexpr uint32_t SNAPSHOT_PAGES       = Geometry::pagesFor(BlockTable<Geometry>::size() + PartitionTable::size() + SNAPSHOT_FOOTER_SIZE);
+    static constexpr uint16_t SLOTS_PER_BLOCK      = Geometry::PAGE_PER_BLOCK / SNAPSHOT_PAGES;
+    static constexpr uint32_t SNAPSHOT_MAGIC       = 0x424C4B54;  // "BLKT"
+
+    const int subsections;        // the number of partitions created on a chip without a partition table
+    BlockTable<Geometry> blocks;  // the write offset, state and wear of each block
+    PartitionTable partitions;
+    uint16_t partitionCursor[PartitionTable::MAX_PARTITIONS];  // where the sequential allocation of each partition goes on, 0 until found
     const uint16_t reservedBlock;
     bool kernelMode;
     bool isInited;
+    uint32_t metadataSequence;  // the sequence number of the last snapshot written to the journal
+    uint16_t metadataSlot;      // the journal slot the next snapshot goes to, counted over both metadata blocks
+    ErasedPool erased;
+    uint16_t refillCursor;         // where the refill looks for the next block
+    volatile int32_t refillBlock;  // the block being erased by the refill, -1 if none
+    ControlTickScheduler *scheduler;
+    Durability defaultDurability;
+    uint32_t groupInterval_ms;
+    uint32_t groupBytes;
+    bool groupPending;      // a `GROUP` write waits for the next snapshot
+    TickType_t groupSince;  // the tick of the oldest of them
+    CommitStats commits;
+
+    /**
+     * @brief The progress of moving the data of a block around a removed range, through the reserved block
+     */
+    struct Relocation
+    {
+        enum Phase : uint8_t
+        {
+            ERASE_SPARE,   // erase the reserved block
+            GATHER,        // copy the kept data page by page into the reserved block
+            ERASE_SOURCE,  // erase the block, from here on the data only exists in the reserved block
+            COPY_BACK,     // copy the reserved pages back
+            CLEAN_UP,      // erase the reserved block again
+            FINISHED
+        };
+        Phase phase;
+        uint16_t block;
+        uint32_t startOffset, endOffset, oldEnd;
+        uint32_t cursor;  // the offset being read in GATHER, the page being copied in COPY_BACK
+        uint8_t segment;  // 0 for the data before the range, 1 for the data after it
+        uint16_t fill;    // the number of bytes gathered in the page buffer
+        uint16_t outPage;
+        typename PagePool::Lease page;
+    };
+
+    /**
+     * @brief The background operation advanced by `Step`
+     */
+    struct Job
+    {
+        JobKind kind;
+        volatile JobStatus status;
+        volatile bool cancelRequested;
+        State result;
+        uint32_t cursor;  // the next block to erase or scan
+        bool quick;       // a `FormatMode::QUICK` pass, only the blocks still `DIRTY` are erased
+        uint32_t done, total;
+        Relocation move;
+        uint16_t badBlocks[20];
+        uint8_t badCount;
+        typename PagePool::Lease pattern, buffer;
+    };
+    Job job;
 
     /**
      * @brief This function is called when the write command exceeds a single page
@@ -265,32 +539,140 @@ class Manager
      */
     State SetBufferMode(bool state) const;
 
-    /**
-     * @brief This function is responsible for incrementing the address for write functions
-     * @param blockNum: The block number to which the data is written
-     * @param size: The size of the data written
-     */
-    void incrementAddr(uint16_t blockNum, uint16_t size);
-
     /**
      * @brief This function is responsible for calculating the address of a page
      * @param block: The block number
      * @param page: The page number
      */
-    inline uint16_t pageAligned_calcAddress(uint16_t block, uint16_t page) const;
+    static constexpr uint32_t pageAligned_calcAddress(uint16_t block, uint16_t page) { return Geometry::rowAddress(block, page); }
+
+    /**
+     * @brief Read from the chip without any checks, may cross page boundaries
+     */
+    State readRaw(uint32_t address, uint8_t *buffer, uint32_t size) const;
+    /**
+     * @brief Program `size` bytes at `byte` of a single page without any checks
+     */
+    State programRaw(uint16_t block, uint16_t page, uint16_t byte, const uint8_t *data, uint16_t size) const;
+    /**
+     * @brief Erase a block without any checks and without touching the block table
+     */
+    State eraseRaw(uint16_t block) const;
+    /**
+     * @brief Wait until the chip is ready and `op` fits before the next control tick, does nothing without a scheduler
+     */
+    void waitForSlot(ControlTickScheduler::Operation op) const;
+    /**
+     * @brief Checks if the longest operation of a background unit of work fits before the next control tick, `true` without a scheduler
+     */
+    bool slotOpen() const { return scheduler == nullptr || scheduler->fits(ControlTickScheduler::Operation::PROGRAM); }
+    /**
+     * @brief Checks if a `GROUP` write has waited the whole group commit interval for the table save
+     */
+    bool groupWindowOver() const;
+    /**
+     * @brief Read the start of the spare area of a page
+     */
+    State readSpare(uint16_t block, uint16_t page, uint8_t *buffer, uint16_t size) const;
+    /**
+     * @brief Erase `block` if it is `DIRTY`, so that it can be written again
+     */
+    State eraseIfDirty(uint16_t block);
+    /**
+     * @brief Erase `block` unless it is blank already, for the logs that write their blocks in a ring and erase them ahead
+     * @param wasErased: set if the block was erased
+     * @return `PARAM_ERR` for a bad or reserved block, which is never erased, `BUSY` while a job holds it
+     */
+    State eraseIfUsed(uint16_t block, bool &wasErased);
+
+    /**
+     * @brief Remove the bytes `[startOffset, endOffset)` of `block` and move the data after them down, through the reserved block
+     */
+    State relocate(uint16_t block, uint32_t startOffset, uint32_t endOffset);
+    /**
+     * @brief Prepare `move` for `relocate`, nothing is done on the chip yet
+     */
+    State relocateBegin(Relocation &move, uint16_t block, uint32_t startOffset, uint32_t endOffset);
+    /**
+     * @brief Do one unit of work of a relocation
+     */
+    State relocateStep(Relocation &move);
+
+    /**
+     * @brief Add one block to the pool of erased blocks
+     * @param idle: set to `true` when there is nothing left to do
+     */
+    State refillStep(bool &idle);
+    /**
+     * @brief Check the spare area of a page, which is programmed (ECC bytes) as soon as the page holds data
+     * @param blank: set to `true` if the spare area is blank
+     * @param factoryBad: set to `true` if the block carries a factory bad block mark
+     */
+    State checkSpare(uint16_t block, uint16_t page, bool &blank, bool &factoryBad) const;
+
+    /**
+     * @brief Checks if a background operation that has not finished yet is keeping `block` from being accessed
+     * @param forWrite: `true` for writes and erases, which are also refused during a chip erase
+     */
+    bool isLocked(uint16_t block, bool forWrite) const;
+    /**
+     * @brief Checks if a background operation has been started and has not finished yet
+     */
+    bool jobActive() const { return job.status == JobStatus::RUNNING || job.status == JobStatus::PAUSED; }
+    /**
+     * @brief Do one unit of work of the background operation
+     * @param finished: set to `true` once the operation is over
+     */
+    State jobStep(bool &finished);
+    /**
+     * @brief End the background operation with `status`, give the buffers back and save the block table
+     */
+    void jobFinish(JobStatus status, State result);
+    /**
+     * @brief Start a format pass, `quick` for the one of `FormatMode::QUICK`
+     */
+    State beginFormat(bool quick);
 
     /**
-     * @brief This function is responsible for saving the last address of each block in the reversed block
+     * @brief This function is responsible for saving the block table as a new snapshot in the metadata journal
+     */
+    State saveAddr();
+    /**
+     * @brief Load the block table from the newest complete snapshot of the metadata journal
+     */
+    State loadAddr();
+    /**
+     * @brief Move the write offsets past the data programmed after the last snapshot, so that it is never programmed over
+     */
+    State recoverWriteOffsets();
+    /**
+     * @brief Count a write towards the group commit and save the table if `durability` asks for it
+     */
+    State commitWrite(uint32_t size, Durability durability);
+    /**
+     * @brief Hand out a block of partition `index` according to its allocation and reclaim policies
      */
-    void saveAddr();
+    int32_t allocateIn(uint8_t index);
+    /**
+     * @brief Erase the next dirty block of the partitions that reclaim in the background
+     * @return `false` if there is none
+     */
+    bool reclaimStep(State &state);
 };
 
-inline uint32_t calcAddress(uint16_t block, uint16_t page, uint16_t byte);
+/**
+ * @brief  Pack a block, page and byte number into a linear address of the chip described by `GEOMETRY`
+ */
+template <typename GEOMETRY = DefaultGeometry>
+constexpr uint32_t calcAddress(uint16_t block, uint16_t page, uint16_t byte)
+{
+    return GEOMETRY::calcAddress(block, page, byte);
+}
 
 bool isBusy();
 
-};  // namespace W25N01
-};  // namespace Drivers
-};  // namespace Core
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
 
 #endif
\ No newline at end of file
@@ -0,0 +1,214 @@
+#pragma once
+#include "AppConfig.h"
+#include "flash.hpp"
+#include "flashPartition.hpp"
+#include "stdint-gcc.h"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+/**
+ * @brief A B+-tree of 32 bit keys and values with one node per page, for the keyed datasets too large for an index in RAM (field maps,
+ *        recorded lookup grids)
+ * @note  The nodes are never rewritten in place: an update writes the leaf and its ancestors to new pages after the last one written, and
+ *        the new root is written last with the `ROOT` flag and the next generation number. The mount takes the newest root whose page checks
+ *        out, so an update cut by a power loss leaves the previous tree. The root and the first `PINNED_NODES - 1` of its children are pinned
+ *        in RAM: a lookup reads at most the leaf in a tree of two levels, and in a taller tree one more page for each unpinned node on its path,
+ *        so with the default 4 pins a lookup under the 4th child of the root on reads two pages in a tree of three levels
+ * @note  Each leaf keeps the lowest key of the next leaf instead of its address, which would change with every update of the next leaf. A
+ *        range scan keeps the parent of the leaf and reads the next leaves from its children, one page per leaf, in order for a bulk loaded
+ *        tree. Past the last child it descends again from the root with the key of the next leaf, which reads the unpinned nodes of that
+ *        path and the new parent once more, a few pages per 254 leaves
+ * @note  The blocks are split into two halves. The updates fill the active half, then the live entries are bulk loaded into the other half,
+ *        so the tree must stay smaller than a half. The blocks should be a partition of their own, so that the `Manager` does not hand them out
+ * @tparam GEOMETRY: the `NandGeometry` of the chip
+ */
+template <typename GEOMETRY = DefaultGeometry>
+class BTree
+{
+   public:
+    using Geometry = GEOMETRY;
+
+    static constexpr uint32_t NODE_HEADER_SIZE  = 20;
+    static constexpr uint16_t LEAF_CAPACITY     = (Geometry::PAGE_SIZE_BYTE - NODE_HEADER_SIZE) / 8;
+    static constexpr uint16_t INTERNAL_CAPACITY = (Geometry::PAGE_SIZE_BYTE - NODE_HEADER_SIZE - 4) / 8;
+    static constexpr uint8_t PINNED_NODES       = FLASH_BTREE_PINNED_NODES;
+    static constexpr uint8_t MAX_HEIGHT         = 6;
+
+    /**
+     * @brief Called by `scan` for each entry in order, returns false to stop the scan
+     */
+    using Visitor = bool (*)(uint32_t key, uint32_t value, void *context);
+
+    struct Stats
+    {
+        uint32_t lookups;
+        uint32_t pageReads;     ///< nodes read from the chip, the pinned ones are not counted
+        uint32_t commits;       ///< updates and bulk loads that wrote a new root
+        uint32_t pagesWritten;
+        uint32_t compactions;
+    };
+
+    /**
+     * @param manager: the manager of the chip
+     * @param firstBlock: the first chip block of the tree
+     * @param blockCount: the number of blocks, at least 2, each half holds a copy of the tree
+     */
+    BTree(Manager<GEOMETRY> &manager, uint16_t firstBlock, uint16_t blockCount);
+    /**
+     * @brief A tree over all the blocks of a partition
+     */
+    explicit BTree(Partition<GEOMETRY> &partition) : BTree(partition.manager(), partition.chipBlock(0), partition.blockCount()) {}
+    BTree(const BTree &)            = delete;
+    BTree &operator=(const BTree &) = delete;
+
+    /**
+     * @brief Find the newest root and pin the top of the tree, or write an empty tree if there is none
+     */
+    State mount();
+    /**
+     * @brief The value of `key`
+     * @return `PARAM_ERR` if the key is not in the tree
+     */
+    State find(uint32_t key, uint32_t &value);
+    /**
+     * @brief Add `key` or change its value, writes one page per level of the tree (two for a node that splits)
+     * @param durability: when the block table is saved, see `Durability`
+     */
+    State insert(uint32_t key, uint32_t value, Durability durability = Durability::DEFAULT);
+    /**
+     * @brief Remove `key`, the leaves are not merged, an empty leaf is dropped by the next compaction
+     * @return `PARAM_ERR` if the key is not in the tree
+     */
+    State remove(uint32_t key, Durability durability = Durability::DEFAULT);
+    /**
+     * @brief Visit the entries with `from <= key <= to` in order, takes two pages of the pool
+     */
+    State scan(uint32_t from, uint32_t to, Visitor visitor, void *context = nullptr);
+
+    /**
+     * @brief Start replacing the whole tree with entries given in increasing key order, the leaves are written full and in order
+     * @note  The current tree is still used by `find` and `scan` until `endLoad`, and the updates are refused
+     */
+    State beginLoad();
+    State load(uint32_t key, uint32_t value);
+    /**
+     * @brief Write the upper levels and the root of the loaded tree, which replaces the current one
+     */
+    State endLoad(Durability durability = Durability::DEFAULT);
+    /**
+     * @brief Bulk load the live entries into the other half now, e.g. while the robot is idle, instead of in the update that fills the half
+     */
+    State compact();
+
+    bool isMounted() const { return mounted; }
+    bool isLoading() const { return loading; }
+    uint8_t height() const { return levels; }
+    /// the pages left in the active half for the updates
+    uint32_t freePages() const { return halfStart(active) + halfPages() - head; }
+    const Stats &stats() const { return counters; }
+
+   private:
+    static constexpr uint32_t MAGIC   = 0x45455242;  // "BREE"
+    static constexpr uint32_t NO_PAGE = 0xFFFFFFFF;
+    static constexpr uint8_t ROOT     = 0x01;
+    static constexpr uint8_t HAS_NEXT = 0x02;
+
+    struct NodeHeader
+    {
+        uint32_t magic;
+        uint8_t level;  ///< 0 for a leaf
+        uint8_t flags;
+        uint16_t count;  ///< entries of a leaf, keys of an internal node
+        uint32_t generation;
+        uint32_t link;  ///< a leaf: the lowest key of the next leaf if `HAS_NEXT`, an internal node: a lower bound of the keys under it
+        uint32_t crc;   ///< over the rest of the page
+    };
+    static_assert(sizeof(NodeHeader) == NODE_HEADER_SIZE, "the node header is stored raw");
+
+    struct Leaf
+    {
+        NodeHeader header;
+        uint32_t keys[LEAF_CAPACITY];
+        uint32_t values[LEAF_CAPACITY];
+    };
+    /// `children[i]` holds the keys below `keys[i]`, the last child the keys from `keys[count - 1]` up
+    struct Internal
+    {
+        NodeHeader header;
+        uint32_t keys[INTERNAL_CAPACITY];
+        uint32_t children[INTERNAL_CAPACITY + 1];
+    };
+    static_assert(sizeof(Leaf) <= Geometry::PAGE_SIZE_BYTE && sizeof(Internal) <= Geometry::PAGE_SIZE_BYTE, "a node must fit in a page");
+
+    struct Pin
+    {
+        uint32_t address;
+        alignas(4) uint8_t data[Geometry::PAGE_SIZE_BYTE];
+    };
+
+    Manager<GEOMETRY> &flash;
+    const uint16_t first;
+    const uint16_t count;
+    bool mounted;
+    bool loading;
+    uint8_t active;  // 0 or 1, the half the updates go to
+    uint8_t levels;
+    uint32_t root;  // the pages are numbered from the first page of the first block
+    uint32_t head;  // the next page to write in the active half
+    uint32_t generation;
+    Pin pins[PINNED_NODES];
+    uint8_t pinCount;
+    Stats counters;
+
+    /* the bulk load in progress */
+    typename Manager<GEOMETRY>::PagePool::Lease leafLease;
+    uint32_t loadHead;
+    uint32_t loadFirstLeaf;
+    uint32_t loadLeaves;
+    uint32_t loadLastKey;
+    State loadError;  // the first error of the bulk load, the next calls return it
+
+    uint32_t halfPages() const { return static_cast<uint32_t>(count / 2) * Geometry::PAGE_PER_BLOCK; }
+    uint32_t halfStart(uint8_t half) const { return half * halfPages(); }
+    uint16_t chipBlock(uint32_t page) const { return first + page / Geometry::PAGE_PER_BLOCK; }
+    uint32_t chipAddress(uint32_t page) const { return Geometry::calcAddress(chipBlock(page), page % Geometry::PAGE_PER_BLOCK, 0); }
+
+    /// the first entry of the node with a key `>= key`
+    static uint16_t lowerBound(const uint32_t *keys, uint16_t size, uint32_t key);
+    /// the child of an internal node that holds `key`
+    static uint16_t childOf(const Internal &node, uint32_t key);
+    /// the pinned copy of the node at `page`, `nullptr` if it is not pinned
+    const uint8_t *pinned(uint32_t page) const;
+    /// the node at `page`, pinned or read into `buffer`
+    State visit(uint32_t page, uint8_t *buffer, const uint8_t *&node);
+    /// the leaf that holds `key`, read into `buffer`, and the path to it
+    State descend(uint32_t key, uint8_t *buffer, uint32_t *path, uint16_t *slots);
+    /// write the node in `page` at `cursor`, which must stay below `end`, and move the cursor to the next page, `PARAM_ERR` if the block is
+    /// not written up to the cursor
+    State program(uint8_t *page, uint32_t &cursor, uint32_t end, uint32_t &address, Durability durability);
+    /// the common part of `insert` and `remove`
+    State update(uint32_t key, uint32_t value, bool erase, Durability durability);
+    /// make sure `pages` pages are left in the active half, compacting if needed
+    State reserve(uint32_t pages);
+    /// the newest root of a half that checks out, `address` is `NO_PAGE` if there is none
+    State findRoot(uint8_t half, uint32_t &address, uint32_t &rootGeneration, uint32_t &end);
+    /// move the pin of the node at `page` to its new copy
+    bool repin(uint32_t page, uint32_t newPage, const uint8_t *data);
+    /// read the root and its children into the pins
+    State pinTop();
+    /// write the leaf being loaded with `flags`
+    State flushLeaf(uint8_t flags, Durability durability);
+    static bool compactVisitor(uint32_t key, uint32_t value, void *context);
+};
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
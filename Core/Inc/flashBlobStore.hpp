@@ -0,0 +1,192 @@
+#pragma once
+#include "AppConfig.h"
+#include "flash.hpp"
+#include "flashKvStore.hpp"
+#include "flashPageWriter.hpp"
+#include "flashPartition.hpp"
+#include "stdint-gcc.h"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+/**
+ * @brief A store of named objects of any size (recorded match data, map files), written as a stream and read back as a stream
+ * @note  The data of an object is laid out in extents, runs of contiguous blocks, and each block is filled before the next one is taken. The
+ *        next block is the one after the extent if it is free, so an object only starts a new extent when it runs into a used or bad block,
+ *        and the size hint given to `create` picks a free run long enough for the whole object
+ * @note  The first two blocks hold a `KvStore` catalog mapping each name to the size, CRC and extent list of its object. The catalog
+ *        record is written by `seal`, so an object cut by a power loss is never visible and its blocks are reused, and sealing over an
+ *        existing name replaces the old object at once
+ * @note  The data goes through a `PageWriter`, so the pages are programmed whole whatever the size of the appends. One object is written at a
+ *        time, and the writer keeps a page buffer of the `Manager`'s pool until the seal, two while a full page waits for the chip. The
+ *        blocks should be a partition of their own, so that the `Manager` does not hand them out
+ * @tparam GEOMETRY: the `NandGeometry` of the chip
+ */
+template <typename GEOMETRY = DefaultGeometry>
+class BlobStore
+{
+   private:
+    struct Extent
+    {
+        uint16_t firstBlock;  ///< chip block
+        uint16_t blockCount;
+    };
+    struct Entry
+    {
+        uint32_t size;
+        uint32_t crc;  ///< over the data, checked by the reader at the end of the object
+        uint8_t extentCount;
+        uint8_t reserved[3];
+        Extent extents[FLASH_BLOB_MAX_EXTENTS];
+    };
+
+   public:
+    using Geometry = GEOMETRY;
+
+    static constexpr uint8_t MAX_EXTENTS     = FLASH_BLOB_MAX_EXTENTS;
+    static constexpr uint8_t MAX_NAME_SIZE   = KvStore<GEOMETRY>::MAX_KEY_SIZE;
+    static constexpr uint16_t CATALOG_BLOCKS = 2;
+
+    /**
+     * @brief A streaming reader over one sealed object, it keeps a copy of the extent list and stays usable until the object is removed
+     */
+    class Reader
+    {
+       public:
+        Reader() : flash(nullptr), entry(), offset(0), crc(0), checking(false) {}
+
+        /**
+         * @brief Copy the next bytes of the object into `buffer`
+         * @param length: the number of bytes read, 0 at the end of the object
+         * @return `ECC_ERR` with the last bytes if the object was read from the start and its CRC does not match
+         */
+        State read(uint8_t *buffer, uint32_t capacity, uint32_t &length);
+        /**
+         * @brief Move to `position`, the CRC is only checked by a reader that goes from the start to the end without seeking
+         */
+        State seek(uint32_t position);
+
+        bool isOpen() const { return flash != nullptr; }
+        uint32_t size() const { return entry.size; }
+        uint32_t position() const { return offset; }
+        bool atEnd() const { return offset >= entry.size; }
+
+       private:
+        friend class BlobStore;
+
+        const Manager<GEOMETRY> *flash;
+        Entry entry;
+        uint32_t offset;
+        uint32_t crc;  // of the bytes read so far
+        bool checking;
+    };
+
+    struct Stats
+    {
+        uint32_t sealed;
+        uint32_t removed;
+        uint32_t aborted;       ///< objects dropped before their seal
+        uint32_t bytesWritten;
+        uint32_t extents;       ///< extents started
+        uint32_t blocksReused;  ///< blocks erased before being written again
+    };
+
+    /**
+     * @param manager: the manager of the chip
+     * @param firstBlock: the first chip block of the store, the catalog takes this block and the next one
+     * @param blockCount: the number of blocks including the catalog
+     */
+    BlobStore(Manager<GEOMETRY> &manager, uint16_t firstBlock, uint16_t blockCount);
+    /**
+     * @brief A store over all the blocks of a partition
+     */
+    explicit BlobStore(Partition<GEOMETRY> &partition) : BlobStore(partition.manager(), partition.chipBlock(0), partition.blockCount()) {}
+    BlobStore(const BlobStore &)            = delete;
+    BlobStore &operator=(const BlobStore &) = delete;
+
+    /**
+     * @brief Mount the catalog and find the blocks used by the sealed objects
+     * @note  If a catalog record fails its CRC while the blocks are gathered, the object it held is lost and every block is kept used: the
+     *        objects left stay readable, and the new ones only get the blocks of the objects removed or replaced until the next mount
+     */
+    State mount();
+    /**
+     * @brief Start writing the object `name`, the object it replaces stays readable until the seal
+     * @param sizeHint: the expected size in bytes, 0 if it is not known
+     * @return `BUSY` if another object is being written
+     */
+    State create(const char *name, uint32_t sizeHint = 0);
+    /**
+     * @brief Add `size` bytes at the end of the object being written, the data is not durable until `seal`
+     * @return `NO_BUFFER` if there is no free block left or the object needs more than `MAX_EXTENTS` extents
+     */
+    State append(const void *data, uint32_t size);
+    /**
+     * @brief Write the catalog record of the object being written, which makes it visible, and free the blocks of the object it replaces
+     * @param durability: when the block table is saved, see `Durability`
+     */
+    State seal(Durability durability = Durability::DEFAULT);
+    /**
+     * @brief Drop the object being written, its blocks are free again
+     */
+    void abort();
+    /**
+     * @brief Open a reader at the start of the object `name`
+     * @return `PARAM_ERR` if there is no such object
+     */
+    State openReader(const char *name, Reader &reader);
+    /**
+     * @brief Remove the object `name`, its blocks are erased when they are written again
+     */
+    State remove(const char *name, Durability durability = Durability::DEFAULT);
+
+    bool contains(const char *name) const { return catalog.contains(name); }
+    bool isMounted() const { return mounted; }
+    bool isWriting() const { return writing; }
+    /// the size of the object being written
+    uint32_t writtenSize() const { return pending.size; }
+    uint16_t freeBlocks() const;
+    const Stats &stats() const { return counters; }
+
+   private:
+    Manager<GEOMETRY> &flash;
+    KvStore<GEOMETRY> catalog;
+    PageWriter<GEOMETRY> writer;  // open on the last block of the object being written
+    const uint16_t first;  // the first data block
+    const uint16_t count;  // the number of data blocks
+    bool mounted;
+    bool writing;
+    uint32_t used[(Geometry::BLOCK_COUNT + 31) / 32];  // one bit per data block, set if a sealed object or the object being written holds it
+
+    /* the object being written */
+    char pendingName[MAX_NAME_SIZE + 1];
+    Entry pending;
+    uint16_t hintBlocks;  // the blocks the size hint still expects
+    Stats counters;
+
+    static uint16_t entrySize(const Entry &entry) { return sizeof(Entry) - (MAX_EXTENTS - entry.extentCount) * sizeof(Extent); }
+    bool isUsed(uint16_t block) const { return used[(block - first) / 32] & (1UL << ((block - first) % 32)); }
+    void setUsed(uint16_t block, bool value);
+    /// a block not used by any object, bad and reserved blocks are never free
+    bool isFree(uint16_t block) const;
+    /// mark the blocks of `entry` used or free
+    void markExtents(const Entry &entry, bool value);
+    /// the start of the first free run of `blocks` blocks, or of the longest free run, -1 if no block is free
+    int32_t findRun(uint16_t blocks) const;
+    /// add a block to the object being written, after its last extent if possible, and open the writer on it
+    State grow();
+    /// erase `block` if it has been written and keep the refill away from it
+    State prepare(uint16_t block);
+    static bool markVisitor(const char *key, const uint8_t *value, uint16_t length, void *context);
+};
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
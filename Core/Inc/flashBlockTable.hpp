@@ -0,0 +1,180 @@
+#pragma once
+#include "AppConfig.h"
+#include "flashGeometry.hpp"
+#include "stdint-gcc.h"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+/**
+ * @brief The usage state of a block
+ */
+enum class BlockState : uint8_t
+{
+    FREE      = 0,  ///< Erased, nothing written yet
+    OPEN      = 1,  ///< Partially written, the write offset is the next free byte
+    FULL      = 2,  ///< No space left
+    BAD       = 3,  ///< Marked bad, never handed out
+    RESERVED  = 4,  ///< Used by the driver itself (relocation and metadata)
+    DIRTY     = 5,  ///< Holds discarded data, erased in the background or before the next write
+    ALLOCATED = 6   ///< Erased and handed out by the block allocator, not written yet
+};
+
+/**
+ * @brief The state of every block of the chip, packed into 3 bytes per block: 3 KB for the W25N01GV, 6 KB for the W25N02KV
+ * @note  Each descriptor holds `[16:0]` the payload, `[19:17]` the `BlockState` and `[23:20]` the erase count bucket.
+ *        The payload is the write offset within the block while the block is `OPEN`, and the number of valid pages
+ *        once it is `FULL` (the write offset of a full block is implied). Pages invalidated while the block is still
+ *        open are not counted, so the valid page count is an upper bound
+ * @note  The erase count bucket is an approximate (Morris) counter: bucket `b` stands for about `2^b - 1` erases
+ */
+template <typename GEOMETRY>
+class BlockTable
+{
+   public:
+    static constexpr uint8_t OFFSET_BITS      = GEOMETRY::PAGE_BITS + GEOMETRY::BYTE_BITS;
+    static constexpr uint8_t MAX_ERASE_BUCKET = 15;
+    static_assert(OFFSET_BITS <= 17, "the write offset must fit into the 17 bit payload");
+
+    /**
+     * @brief The packed descriptor of one block
+     */
+    class Descriptor
+    {
+       public:
+        BlockState state() const { return static_cast<BlockState>((word() >> STATE_SHIFT) & 0x7); }
+        /**
+         * @brief The byte offset within the block at which the next write goes, `BLOCK_SIZE_BYTE` when nothing can be written
+         */
+        uint32_t writeOffset() const
+        {
+            switch (state())
+            {
+            case BlockState::FREE:
+            case BlockState::ALLOCATED:
+                return 0;
+            case BlockState::OPEN:
+                return word() & PAYLOAD_MASK;
+            default:
+                return GEOMETRY::BLOCK_SIZE_BYTE;
+            }
+        }
+        uint16_t writePage() const { return writeOffset() >> GEOMETRY::BYTE_BITS; }
+        uint16_t writeByte() const { return writeOffset() & GEOMETRY::BYTE_MASK; }
+        /**
+         * @brief The number of pages holding valid data (an upper bound, see the class notes)
+         */
+        uint16_t validPages() const
+        {
+            switch (state())
+            {
+            case BlockState::OPEN:
+                return GEOMETRY::pagesFor(word() & PAYLOAD_MASK);
+            case BlockState::FULL:
+                return word() & PAYLOAD_MASK;
+            default:
+                return 0;
+            }
+        }
+        uint8_t eraseBucket() const { return word() >> BUCKET_SHIFT; }
+        /// the number of erases the bucket stands for
+        uint32_t eraseCountEstimate() const { return (1UL << eraseBucket()) - 1; }
+        bool isUsable() const { return state() != BlockState::BAD && state() != BlockState::RESERVED; }
+
+       private:
+        friend class BlockTable;
+        static constexpr uint8_t STATE_SHIFT   = 17;
+        static constexpr uint8_t BUCKET_SHIFT  = 20;
+        static constexpr uint32_t PAYLOAD_MASK = (1UL << STATE_SHIFT) - 1;
+
+        uint8_t raw[3];
+
+        uint32_t word() const { return raw[0] | (raw[1] << 8) | (static_cast<uint32_t>(raw[2]) << 16); }
+        void setWord(uint32_t value)
+        {
+            raw[0] = value;
+            raw[1] = value >> 8;
+            raw[2] = value >> 16;
+        }
+        void set(BlockState newState, uint32_t payload)
+        {
+            setWord((word() & ~((1UL << BUCKET_SHIFT) - 1)) | (static_cast<uint32_t>(newState) << STATE_SHIFT) | (payload & PAYLOAD_MASK));
+        }
+        void setBucket(uint8_t bucket) { setWord((word() & ((1UL << BUCKET_SHIFT) - 1)) | (static_cast<uint32_t>(bucket) << BUCKET_SHIFT)); }
+    };
+    static_assert(sizeof(Descriptor) == 3, "the descriptors must be packed into 3 bytes");
+
+    BlockTable();
+
+    const Descriptor &operator[](uint16_t block) const { return table[block]; }
+
+    /**
+     * @brief Forget everything, all the user blocks become `FREE` with an erase bucket of 0
+     */
+    void reset();
+    /**
+     * @brief Move the write offset of `block` forward by `size` bytes after a write, the block becomes `OPEN` or `FULL`
+     */
+    void advance(uint16_t block, uint32_t size);
+    /**
+     * @brief Set the write offset of `block`, the state follows the offset
+     */
+    void setWriteOffset(uint16_t block, uint32_t offset);
+    /**
+     * @brief Record that `block` has been erased, it becomes `FREE` and its erase count bucket may be increased
+     */
+    void markErased(uint16_t block);
+    /**
+     * @brief Record that the data of a written (`OPEN` or `FULL`) block is discarded, it becomes `DIRTY`
+     */
+    void markDirty(uint16_t block);
+    /**
+     * @brief Reserve a `FREE` block for the block allocator, it becomes `ALLOCATED`
+     * @return `false` if the block was not `FREE`
+     */
+    bool allocate(uint16_t block);
+    /**
+     * @brief Give all the `ALLOCATED` blocks back, used when the allocator starts over after a reboot
+     */
+    void releaseAllocated();
+    /**
+     * @brief Record that `block` is bad, it will never be handed out
+     * @return `false` if the block is `RESERVED`, the driver keeps it for itself and it stays so
+     */
+    bool markBad(uint16_t block);
+    /**
+     * @brief Record that `pages` pages of a `FULL` block no longer hold valid data
+     */
+    void invalidatePages(uint16_t block, uint16_t pages);
+
+    /**
+     * @brief Linear search for the first block in `state` at or after `from`, wrapping around once within `[first, end)`
+     * @return the block number or -1 if there is none
+     */
+    int32_t findNext(BlockState state, uint16_t from = 0, uint16_t first = 0, uint16_t end = GEOMETRY::BLOCK_COUNT) const;
+    /**
+     * @brief The number of blocks in `state`
+     */
+    uint16_t count(BlockState state) const;
+
+    /**
+     * @brief The raw table, used to persist it
+     */
+    uint8_t *data() { return table[0].raw; }
+    static constexpr uint32_t size() { return sizeof(Descriptor) * GEOMETRY::BLOCK_COUNT; }
+
+   private:
+    Descriptor table[GEOMETRY::BLOCK_COUNT];
+    uint32_t randomState;  // xorshift state for the erase count buckets
+};
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
@@ -0,0 +1,138 @@
+#pragma once
+#include "AppConfig.h"
+#include "FreeRTOS.h"
+#include "stdint-gcc.h"
+#include "task.h"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+/**
+ * @brief A fixed pool of statically allocated, DMA aligned buffers, borrowed through scoped `Lease` objects
+ * @note  `acquire` never blocks, it returns an invalid lease when the pool is exhausted
+ * @tparam BUFFER_SIZE: the size of each buffer in bytes
+ * @tparam BUFFER_COUNT: the number of buffers in the pool (max 32)
+ */
+template <uint32_t BUFFER_SIZE, uint8_t BUFFER_COUNT>
+class BufferPool
+{
+    static_assert(BUFFER_COUNT > 0 && BUFFER_COUNT <= 32, "the free buffers are tracked in a 32 bit mask");
+
+   public:
+    /**
+     * @brief The ownership of one buffer of the pool, the buffer is given back when the lease goes out of scope
+     */
+    class Lease
+    {
+       public:
+        Lease() : pool(nullptr), index(0) {}
+        Lease(Lease &&other) : pool(other.pool), index(other.index) { other.pool = nullptr; }
+        Lease &operator=(Lease &&other)
+        {
+            if (this != &other)
+            {
+                release();
+                pool       = other.pool;
+                index      = other.index;
+                other.pool = nullptr;
+            }
+            return *this;
+        }
+        Lease(const Lease &)            = delete;
+        Lease &operator=(const Lease &) = delete;
+        ~Lease() { release(); }
+
+        /**
+         * @brief Checks if the lease holds a buffer, `false` if the pool was exhausted
+         */
+        bool valid() const { return pool != nullptr; }
+        /**
+         * @brief The leased buffer, only to be used while `valid()`
+         */
+        uint8_t *data() const { return pool->buffers[index]; }
+        static constexpr uint32_t size() { return BUFFER_SIZE; }
+
+        /**
+         * @brief Give the buffer back to the pool before the end of the scope
+         */
+        void release()
+        {
+            if (pool != nullptr)
+            {
+                pool->giveBack(index);
+                pool = nullptr;
+            }
+        }
+
+       private:
+        friend class BufferPool;
+        Lease(BufferPool *owner, uint8_t bufferIndex) : pool(owner), index(bufferIndex) {}
+
+        BufferPool *pool;
+        uint8_t index;
+    };
+
+    BufferPool() : freeMask(ALL_FREE), inUseCount(0), highWater(0), failedCount(0) {}
+
+    /**
+     * @brief Borrow a buffer from the pool
+     * @return an invalid lease if all the buffers are in use
+     */
+    Lease acquire()
+    {
+        taskENTER_CRITICAL();
+        if (freeMask == 0)
+        {
+            failedCount++;
+            taskEXIT_CRITICAL();
+            return Lease();
+        }
+        uint8_t index = __builtin_ctz(freeMask);
+        freeMask &= ~(1UL << index);
+        if (++inUseCount > highWater)
+        {
+            highWater = inUseCount;
+        }
+        taskEXIT_CRITICAL();
+        return Lease(this, index);
+    }
+
+    /// The number of buffers currently leased
+    uint8_t inUse() const { return inUseCount; }
+    /// The largest number of buffers that were leased at the same time
+    uint8_t highWaterMark() const { return highWater; }
+    /// The number of `acquire` calls that found the pool exhausted
+    uint32_t failedAcquires() const { return failedCount; }
+    static constexpr uint8_t capacity() { return BUFFER_COUNT; }
+
+   private:
+    static constexpr uint32_t ALL_FREE = BUFFER_COUNT == 32 ? 0xFFFFFFFFUL : (1UL << BUFFER_COUNT) - 1;
+
+    alignas(4) uint8_t buffers[BUFFER_COUNT][BUFFER_SIZE];  // word aligned for the DMA
+    volatile uint32_t freeMask;
+    volatile uint8_t inUseCount;
+    uint8_t highWater;
+    uint32_t failedCount;
+
+    void giveBack(uint8_t index)
+    {
+        taskENTER_CRITICAL();
+        freeMask |= 1UL << index;
+        inUseCount--;
+        taskEXIT_CRITICAL();
+    }
+};
+
+template <uint32_t BUFFER_SIZE, uint8_t BUFFER_COUNT>
+constexpr uint32_t BufferPool<BUFFER_SIZE, BUFFER_COUNT>::ALL_FREE;
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
@@ -0,0 +1,239 @@
+#pragma once
+#include "AppConfig.h"
+#include "flash.hpp"
+#include "flashPageWriter.hpp"
+#include "flashPartition.hpp"
+#include "flashQuantCodec.hpp"
+#include "stdint-gcc.h"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+/**
+ * @brief A circular telemetry log stored by column: each column (a signal, or a group of signals read together) of the rows goes to its
+ *        own pages, so a reader of a few columns only reads their pages and the time pages
+ * @note  The rows are buffered in RAM by column, one page per column plus one for the times, and written as a group of pages
+ *        `[times][column 0]...[column n-1]` when a page is full or on `sync`. All the pages of a group hold the same rows, the times page
+ *        is the shared time index of the group. A page holds a header `[magic][schema][group][first time][last time][count][column]
+ *        [columns][crc]` followed by the values of the column
+ * @note  A block holds `PAGE_PER_BLOCK / (columns + 1)` groups, group `n` is in the block `n / groupsPerBlock` of the ring, so the
+ *        pages of a group are found without any index. The first time of each block is kept in RAM, a `seek` picks the block in RAM, the
+ *        group by the headers of its times pages and the row by the times. The columns of about the same width waste the least space,
+ *        the group holds the rows that fit the page of the widest one
+ * @note  A column of floats can be quantized to q15 or q7: its rows are kept as floats in RAM by batches of `QUANT_BATCH`, a full
+ *        batch is converted with a scale per channel. The page of such a column is `[header][scales of each batch][values]`, it holds
+ *        up to 2 or 4 times the rows of a float page, less the scales and the room for the last batch of floats before it is converted
+ * @note  The blocks are written in order like a `RingLog`, the block after the head is erased ahead and the oldest block is dropped
+ *        when the ring is full. The appends after a mount start a new block, so a mount may drop the oldest block. The bad blocks of the
+ *        ring keep their place and number but are stepped over, they are never erased
+ * @note  The page buffers are members of the log, `MAX_COLUMNS + 1` pages of RAM whatever the schema: 10 KB with the default 4 columns
+ *        and 2 KB pages
+ * @tparam GEOMETRY: the `NandGeometry` of the chip
+ */
+template <typename GEOMETRY = DefaultGeometry>
+class ColumnLog
+{
+   public:
+    using Geometry = GEOMETRY;
+
+    static constexpr uint32_t PAGE_HEADER_SIZE = 28;
+    static constexpr uint8_t MAX_COLUMNS       = FLASH_COLUMN_MAX_COLUMNS;
+    static constexpr uint16_t MAX_BLOCKS       = FLASH_TS_MAX_BLOCKS;
+    static constexpr uint16_t QUANT_BATCH      = FLASH_QUANT_BATCH;
+    static constexpr uint16_t MAX_SCALES       = FLASH_QUANT_MAX_SCALES;
+
+    /**
+     * @brief The bytes of the row stored in a column
+     */
+    struct Column
+    {
+        uint16_t offset;
+        uint16_t width;
+        Quantization quantization;  ///< `NONE`, or the coding of a column of `width / 4` floats, at most `MAX_SCALES` of them
+    };
+
+    /**
+     * @brief The layout of the rows, the pages written with another layout are not read back
+     */
+    struct Schema
+    {
+        uint32_t id;          ///< any number naming the layout, e.g. a hash of the field list
+        uint16_t rowSize;     ///< the bytes of the row given to `append`
+        uint8_t columnCount;  ///< from 1 to `MAX_COLUMNS`
+        Column columns[MAX_COLUMNS];
+    };
+
+    /**
+     * @brief A read position, the group and the row in it
+     */
+    class Cursor
+    {
+       public:
+        Cursor() : group(0), row(0) {}
+
+       private:
+        friend class ColumnLog;
+
+        uint32_t group;
+        uint16_t row;
+    };
+
+    struct Stats
+    {
+        uint32_t rows;
+        uint32_t groups;        ///< groups of pages written
+        uint32_t pagesRead;     ///< times and column pages read by `read`
+        uint32_t lostGroups;    ///< groups skipped by `read` because one of their pages was not written
+        uint32_t seeks;
+        uint32_t seekReads;     ///< headers and times read by the seeks
+        uint32_t skippedReads;  ///< times a cursor was overtaken by the tail and moved to the oldest row
+    };
+
+    /**
+     * @param manager: the manager of the chip
+     * @param firstBlock: the first chip block of the ring
+     * @param blockCount: the number of blocks of the ring, from 3 to `MAX_BLOCKS`, at least 3 of them good
+     * @param schema: the layout of the rows and their columns
+     */
+    ColumnLog(Manager<GEOMETRY> &manager, uint16_t firstBlock, uint16_t blockCount, const Schema &schema);
+    /**
+     * @brief A ring over all the blocks of a partition
+     */
+    ColumnLog(Partition<GEOMETRY> &partition, const Schema &schema)
+        : ColumnLog(partition.manager(), partition.chipBlock(0), partition.blockCount(), schema)
+    {
+    }
+
+    /**
+     * @brief Find the blocks of the log and their first times, and start a new block for the appends
+     */
+    State mount();
+    /**
+     * @brief Add a row of `Schema::rowSize` bytes at `time`, its columns are copied to their page buffers
+     * @return `PARAM_ERR` if `time` is before the time of the last row
+     */
+    State append(uint32_t time, const void *row);
+    /**
+     * @brief Write the group being assembled and program it, its rows can be read back and survive a power loss
+     */
+    State sync();
+    /**
+     * @brief Sync and give the page buffers of the writer back
+     */
+    State unmount();
+    /**
+     * @brief Drop all the rows, e.g. when the clock of the caller starts over
+     */
+    State reset();
+
+    /**
+     * @brief Put `cursor` on the oldest row
+     */
+    void begin(Cursor &cursor) const;
+    /**
+     * @brief Put `cursor` on the first row at or after `time`, or on the oldest row if `time` is before it
+     */
+    State seek(uint32_t time, Cursor &cursor);
+    /**
+     * @brief Read up to `capacity` rows from `cursor` and move the cursor after them
+     * @param times: receives the times of the rows, `nullptr` if they are not needed
+     * @param columns: one array per column of the schema receiving `capacity` values of its width, `nullptr` for the columns that are
+     *        not needed, whose pages are not read. A quantized column receives its floats decoded
+     * @param length: the number of rows read, 0 at the end of the log
+     * @note  a page read whole is checked against its CRC, the rows read from the middle of a page rely on the ECC of the chip
+     */
+    State read(Cursor &cursor, uint32_t *times, void *const *columns, uint16_t capacity, uint16_t &length);
+
+    bool isMounted() const { return mounted; }
+    bool isEmpty() const { return tailBlock == headBlock && readableGroups() == 0 && pendingRows == 0; }
+    /// the time of the last row appended, 0 if there is none
+    uint32_t lastTime() const { return last; }
+    /// the rows of a group of pages
+    uint16_t groupRows() const { return rowsPerGroup; }
+    const Schema &schema() const { return layout; }
+    const Stats &stats() const { return counters; }
+
+   private:
+    static constexpr uint32_t MAGIC = 0x534C4F43;  // "COLS"
+
+    struct PageHeader
+    {
+        uint32_t magic;
+        uint32_t schema;
+        uint32_t group;
+        uint32_t first;
+        uint32_t last;
+        uint16_t count;
+        uint8_t column;   ///< 0 for the times, then the columns of the schema
+        uint8_t columns;  ///< the pages of the group
+        uint32_t crc;     ///< over the header before it and the values
+    };
+    static_assert(sizeof(PageHeader) == PAGE_HEADER_SIZE, "the page header is stored raw");
+
+    Manager<GEOMETRY> &flash;
+    PageWriter<GEOMETRY> writer;
+    const uint16_t first;
+    const uint16_t count;
+    const Schema layout;
+    const uint8_t groupPages;  // the columns and the times
+    const uint8_t groupsPerBlock;
+    const uint16_t rowsPerGroup;
+    bool mounted;
+    uint32_t headBlock;    // the block numbers go up with the groups, block `n` is at index `n % count` of the ring
+    uint32_t tailBlock;
+    uint32_t nextGroup;    // the group being assembled
+    uint16_t pendingRows;  // its rows
+    uint32_t last;
+    uint32_t blockFirst[FLASH_TS_MAX_BLOCKS];       // the first time of each block, by ring index
+    uint32_t groupFirst[Geometry::PAGE_PER_BLOCK];  // the first time of each group of the head block
+    alignas(4) uint8_t buffers[FLASH_COLUMN_MAX_COLUMNS + 1][Geometry::PAGE_SIZE_BYTE];  // the times, then the columns
+    Stats counters;
+
+    uint16_t chipBlock(uint32_t block) const { return first + block % count; }
+    /// whether the block at `index` of the ring can hold groups, a bad block is stepped over
+    bool isGood(uint16_t index) const { return flash.blocks[first + index].isUsable(); }
+    uint16_t width(uint8_t page) const { return page == 0 ? 4 : layout.columns[page - 1].width; }
+    bool isQuantized(uint8_t page) const { return page != 0 && layout.columns[page - 1].quantization != Quantization::NONE; }
+    QuantCodec codecOf(uint8_t page) const { return QuantCodec(layout.columns[page - 1].quantization, layout.columns[page - 1].width / 4); }
+    /// the bytes of a row in the page
+    uint16_t storedWidth(uint8_t page) const { return isQuantized(page) ? codecOf(page).rowSize() : width(page); }
+    /// the bytes of the scales of `rows` rows, a float per channel and batch
+    uint16_t scaleBytes(uint8_t page, uint16_t rows) const { return isQuantized(page) ? (rows + QUANT_BATCH - 1) / QUANT_BATCH * width(page) : 0; }
+    /// the offset of the values in the page, after the scales of all the batches of a group
+    uint16_t valuesAt(uint8_t page) const { return PAGE_HEADER_SIZE + scaleBytes(page, rowsPerGroup); }
+    /// the groups of the head block that are programmed and can be read
+    uint16_t readableGroups() const { return (flash.blocks[chipBlock(headBlock)].writeOffset() >> Geometry::BYTE_BITS) / groupPages; }
+    /// the group after the last one that can be read
+    uint32_t endGroup() const { return headBlock * groupsPerBlock + readableGroups(); }
+    /// the chip address of page `page` of group `group`
+    uint32_t addressOf(uint32_t group, uint8_t page, uint32_t byte) const
+    {
+        return Geometry::calcAddress(chipBlock(group / groupsPerBlock), (group % groupsPerBlock) * groupPages + page, byte);
+    }
+    bool isValid(const PageHeader &header, uint32_t group, uint8_t page) const;
+    /// read the header of page `page` of group `group`, `valid` is false if it is not a page of the group
+    State readHeader(uint32_t group, uint8_t page, PageHeader &header, bool &valid);
+    /// read the header of the first page of the block at `index`, `written` is false if it does not start a group of this schema
+    State probe(uint16_t index, bool &written, uint32_t &block, uint32_t &firstTime);
+    /// quantize batch `batch` of the column of page `page`, its `rows` rows of floats
+    void encodeBatch(uint8_t page, uint16_t batch, uint16_t rows);
+    /// read `take` rows of the quantized column of page `page` from `row` to `dest` and check the CRC if `whole`
+    State readQuantized(uint32_t group, uint8_t page, const PageHeader &header, uint16_t row, uint16_t take, bool whole, uint8_t *dest);
+    /// write the pages of the group being assembled
+    State writeGroup();
+    /// move the head to the next good block, erasing it and the block after it
+    State advance();
+    /// erase the block `block` unless it is already blank or bad
+    State eraseIfUsed(uint32_t block);
+};
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
@@ -0,0 +1,25 @@
+#pragma once
+#include "AppConfig.h"
+#include "stdint-gcc.h"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+/**
+ * @brief The CRC-32 of `size` bytes (reflected polynomial 0x04C11DB7, the one of zlib and Ethernet), used to detect torn or corrupted records
+ * @param crc: the CRC of the bytes before `data`, so that a record can be checked in several pieces
+ * @note  Computed by the CRC unit, set up by `MX_CRC_Init`, a word every few cycles: a 2 KB page takes about 12 us at 170 MHz where the
+ *        table took about 150 us. Not for the interrupts, the tasks are held off while it runs
+ */
+uint32_t crc32(const uint8_t *data, uint32_t size, uint32_t crc = 0);
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
@@ -0,0 +1,59 @@
+#pragma once
+#include "AppConfig.h"
+#include "main.h"
+#include "stdint-gcc.h"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+/**
+ * @brief A time budget measured with the DWT cycle counter, used by the resumable operations to know when to yield
+ * @note  `startCycleCounter` has to be called once before the first deadline is created (done by `Manager::init`)
+ */
+class Deadline
+{
+   public:
+    /// a budget that never expires, the operation runs to completion
+    static constexpr uint32_t NO_BUDGET = 0xFFFFFFFF;
+
+    /**
+     * @param budget_us: the time in microseconds from now after which the deadline has expired
+     */
+    explicit Deadline(uint32_t budget_us)
+        : start(DWT->CYCCNT), cycles(budget_us == NO_BUDGET ? 0 : budget_us * (SystemCoreClock / 1000000)), unlimited(budget_us == NO_BUDGET)
+    {
+    }
+
+    bool expired() const { return !unlimited && DWT->CYCCNT - start >= cycles; }
+    /// the number of microseconds since the deadline was created
+    uint32_t elapsed_us() const { return (DWT->CYCCNT - start) / (SystemCoreClock / 1000000); }
+
+    /**
+     * @brief Enable the DWT cycle counter, it is left running if it already is
+     */
+    static void startCycleCounter()
+    {
+        if (!(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk))
+        {
+            CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+            DWT->CYCCNT = 0;
+            DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+        }
+    }
+
+   private:
+    uint32_t start;
+    uint32_t cycles;
+    bool unlimited;
+};
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
@@ -0,0 +1,160 @@
+#pragma once
+#include "AppConfig.h"
+#include "flash.hpp"
+#include "fmac.h"
+#include "main.h"
+#include "stdint-gcc.h"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+/**
+ * @brief A FIR or IIR filter run by the FMAC followed by a decimation, in front of a log of a high rate q15 signal
+ * @note  The samples are pushed one by one (from the ISR of the ADC or of the IMU) into one of two blocks of `BLOCK` samples, a
+ *        full block is given to the input DMA of the FMAC while the other one fills. The output DMA writes the filtered samples
+ *        to a circular buffer of two blocks, its half and full transfer interrupts keep one sample in `factor` and queue them as a
+ *        chunk for the logging task, which drains the queue to the log with `drainTo`. The CPU only touches the kept samples
+ * @note  There is a single FMAC, so a single decimator runs at a time. Its coefficients and its state live in the 256 words of the
+ *        FMAC: `P + Q` coefficients, `P + 4` inputs and `Q + 4` outputs (`1 + 4` for a FIR), which bounds the taps below the limits of
+ *        the FMAC itself
+ * @note  The samples are only pushed by one producer. When the FMAC falls behind, the samples pushed while both blocks are full
+ *        and the chunks decimated while the queue is full are dropped and counted in `Stats`
+ */
+class Decimator
+{
+   public:
+    static constexpr uint16_t BLOCK  = FLASH_DECIMATOR_BLOCK;
+    static constexpr uint8_t CHUNKS  = FLASH_DECIMATOR_CHUNKS;
+    static constexpr uint16_t MEMORY = 256;  // words of the local memory of the FMAC
+
+    enum class Kind : uint8_t
+    {
+        FIR = 0,  ///< `y[n] = sum(b[k] x[n-k]) << gainShift`, from 2 to 123 taps (`2 P + 9` words)
+        IIR = 1   ///< direct form 1, `y[n] = (sum(b[k] x[n-k]) + sum(a[k] y[n-k])) << gainShift`, `Q < P` and `P + Q` up to 124 taps
+    };
+
+    struct Config
+    {
+        Kind kind;
+        const int16_t *feedForward;  ///< the q15 `b` coefficients, `b[0]` first
+        uint8_t feedForwardCount;
+        const int16_t *feedBack;  ///< the q15 `a` coefficients of an IIR from `a[1]`, fewer than `feedForwardCount`
+        uint8_t feedBackCount;
+        uint8_t gainShift;  ///< from 0 to 7, the coefficients of a filter with a gain above 1 are scaled down by `2^gainShift`
+        uint16_t factor;    ///< one filtered sample in `factor` is kept, 1 keeps them all
+    };
+
+    struct Stats
+    {
+        uint32_t inputs;          ///< samples filtered by the FMAC
+        uint32_t outputs;         ///< samples kept and queued
+        uint32_t droppedInputs;   ///< samples pushed while both input blocks were full
+        uint32_t droppedOutputs;  ///< samples kept while the queue was full
+    };
+
+    /**
+     * @param handle: the FMAC, with its DMA channels linked by `MX_FMAC_Init`
+     */
+    explicit Decimator(FMAC_HandleTypeDef *handle);
+
+    /**
+     * @brief Load the filter into the FMAC with a zero history and start it
+     * @return PARAM_ERR if the filter does not fit the FMAC, BUSY if a decimator is already running, QSPI_ERR if the HAL fails
+     */
+    State start(const Config &config);
+    /**
+     * @brief Stop the FMAC, the chunks already queued can still be read
+     */
+    void stop();
+    bool isRunning() const { return running; }
+
+    /**
+     * @brief Push a sample, from the ISR of the producer or from a task
+     * @return false if it is dropped
+     */
+    bool push(int16_t sample);
+
+    /**
+     * @brief Take the oldest queued chunk
+     * @param samples: receives up to `BLOCK` samples
+     * @param index: receives the number of the first sample among all the kept ones since `start`, including the dropped ones
+     * @return the samples read, 0 if the queue is empty
+     */
+    uint16_t read(int16_t *samples, uint32_t &index);
+    /**
+     * @brief Append all the queued samples to `log`, a `TimeSeriesLog` or a `ColumnLog` of records of one int16
+     * @param startTime: the time of the first kept sample
+     * @param period: the time between two kept samples, `factor` times the input period
+     */
+    template <typename LOG>
+    State drainTo(LOG &log, uint32_t startTime, uint32_t period)
+    {
+        int16_t samples[BLOCK];
+        uint32_t index;
+        uint16_t count;
+        while ((count = read(samples, index)) != 0)
+        {
+            for (uint16_t n = 0; n < count; n++)
+            {
+                State state = log.append(startTime + (index + n) * period, &samples[n]);
+                if (state != State::OK)
+                {
+                    return state;
+                }
+            }
+        }
+        return State::OK;
+    }
+
+    const Stats &stats() const { return counters; }
+
+    /**
+     * @brief Called by the callbacks of the HAL, `secondHalf` for the transfer complete of the output DMA
+     */
+    void inputDone();
+    void outputReady(bool secondHalf);
+
+    /// the decimator whose filter is loaded in the FMAC, for the callbacks of the HAL
+    static Decimator *active;
+
+   private:
+    struct Chunk
+    {
+        uint32_t index;
+        uint16_t count;
+        int16_t samples[BLOCK];
+    };
+
+    FMAC_HandleTypeDef *hfmac;
+    bool running;
+    uint16_t factor;
+    uint16_t phase;  // the filtered samples to skip before the next kept one
+    uint32_t kept;   // the samples kept since `start`
+
+    int16_t input[2][BLOCK];
+    uint8_t filling;           // the input block being filled
+    volatile uint16_t filled;  // samples of the block being filled, `BLOCK` while it waits for the DMA
+    volatile bool sending;     // the other block is being transferred
+    uint16_t inputSize;        // kept by the HAL until the transfer is done
+    int16_t output[2 * BLOCK];
+    uint16_t outputSize;
+
+    Chunk chunks[CHUNKS];
+    volatile uint32_t produced;  // chunks queued by `outputReady`
+    volatile uint32_t consumed;  // chunks taken by `read`
+    Stats counters;
+
+    /// give the full block to the input DMA and start filling the other one
+    void send();
+};
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
@@ -0,0 +1,98 @@
+#pragma once
+#include "AppConfig.h"
+#include "stdint-gcc.h"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+/**
+ * @brief The type of a numeric field of a telemetry record
+ */
+enum class FieldType : uint8_t
+{
+    INT8    = 0,
+    UINT8   = 1,
+    INT16   = 2,
+    UINT16  = 3,
+    INT32   = 4,
+    UINT32  = 5,
+    FLOAT32 = 6
+};
+
+/**
+ * @brief The size of a field of type `type`
+ */
+uint8_t fieldSize(FieldType type);
+
+/**
+ * @brief A delta and zigzag varint coding of records of packed numeric fields, for the signals that change little from one sample to
+ *        the next
+ * @note  A keyframe is `[0x01][time:4][record]` as is. Any other record is `varint(time delta << 1)` followed by, for each field,
+ *        the varint of the zigzag of its difference with the previous record, in the width of the field. A field going from 1000 to
+ *        1003 takes one byte instead of four. A float is coded as the difference of its bits, a slow signal keeps its exponent and
+ *        most of its mantissa
+ * @note  A record can only be decoded from the keyframe before it, a keyframe is written every `keyframeInterval` records and when
+ *        the time jumps by 2^31 or more. The state of the coding is a `History`, each encoder and decoder has its own
+ */
+class DeltaCodec
+{
+   public:
+    static constexpr uint8_t MAX_FIELDS = FLASH_CODEC_MAX_FIELDS;
+
+    /**
+     * @brief The previous record of a stream
+     */
+    struct History
+    {
+        uint32_t time;
+        uint16_t sinceKeyframe;  ///< the records since the last keyframe, `NO_HISTORY` before the first one
+        uint32_t values[MAX_FIELDS];
+    };
+    static constexpr uint16_t NO_HISTORY = 0xFFFF;
+
+    DeltaCodec() : types(nullptr), count(0), interval(0), size(0) {}
+    /**
+     * @param fieldTypes: the types of all the fields of the record, in order and packed
+     * @param fieldCount: from 1 to `MAX_FIELDS`
+     * @param keyframeInterval: the records between two keyframes, 0 for a keyframe only at the start of the stream
+     */
+    DeltaCodec(const FieldType *fieldTypes, uint8_t fieldCount, uint16_t keyframeInterval);
+
+    bool isValid() const { return types != nullptr && count != 0 && count <= MAX_FIELDS; }
+    /// the bytes of a record
+    uint16_t recordSize() const { return size; }
+    /// the most bytes `encode` writes for a record
+    uint16_t maxEncodedSize() const;
+
+    /**
+     * @brief Start a new stream, the next record is a keyframe
+     */
+    static void restart(History &history) { history.sinceKeyframe = NO_HISTORY; }
+    /**
+     * @brief Code the record at `time` after the one of `history` into `out`, which must hold `maxEncodedSize` bytes
+     * @return the bytes written
+     */
+    uint16_t encode(History &history, uint32_t time, const uint8_t *record, uint8_t *out) const;
+    /**
+     * @brief Decode the record at `in` after the one of `history` into `record`, or just skip it if `record` is `nullptr`
+     * @return the bytes read, 0 if the record is cut at `available` bytes or does not follow a keyframe
+     */
+    uint16_t decode(History &history, const uint8_t *in, uint16_t available, uint32_t &time, uint8_t *record) const;
+
+   private:
+    const FieldType *types;
+    uint8_t count;
+    uint16_t interval;
+    uint16_t size;
+};
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
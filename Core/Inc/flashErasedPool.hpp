@@ -0,0 +1,150 @@
+#pragma once
+#include "AppConfig.h"
+#include "FreeRTOS.h"
+#include "stdint-gcc.h"
+#include "task.h"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+/**
+ * @brief A ring of block numbers that have been erased ahead of time, refilled in the background and drained by the block allocator
+ * @note  The pool only keeps the block numbers, erasing the blocks and keeping the block table in sync is done by the `Manager`
+ * @tparam CAPACITY: the largest number of blocks the pool can hold
+ */
+template <uint8_t CAPACITY>
+class ErasedBlockPool
+{
+    static_assert(CAPACITY > 0, "the pool needs room for at least one block");
+
+   public:
+    /// called when the number of erased blocks drops below the low watermark
+    using Callback = void (*)(void *context);
+
+    /**
+     * @brief How well the pool keeps up with the writers
+     */
+    struct Metrics
+    {
+        uint32_t allocations;       ///< blocks handed out by the allocator
+        uint32_t poolMisses;        ///< allocations that found the pool empty
+        uint32_t syncErases;        ///< erases a writer had to wait for
+        uint32_t backgroundErases;  ///< erases done while refilling the pool
+        uint32_t lowWatermarkHits;  ///< times the pool dropped below the low watermark
+        uint8_t minLevel;           ///< the lowest number of erased blocks seen since the start
+    };
+
+    ErasedBlockPool(uint8_t lowWatermark = 0)
+        : head(0), count(0), targetLevel(CAPACITY), lowMark(lowWatermark), callback(nullptr), callbackContext(nullptr), stats()
+    {
+        stats.minLevel = CAPACITY;
+    }
+
+    /**
+     * @brief Add an erased block, done by the refill
+     * @return `false` if the pool is full
+     */
+    bool push(uint16_t block)
+    {
+        taskENTER_CRITICAL();
+        if (count == CAPACITY)
+        {
+            taskEXIT_CRITICAL();
+            return false;
+        }
+        ring[(head + count) % CAPACITY] = block;
+        count++;
+        taskEXIT_CRITICAL();
+        return true;
+    }
+
+    /**
+     * @brief Take the oldest erased block out of the pool, fires the low watermark callback when the level crosses it
+     * @return `false` if the pool is empty
+     */
+    bool pop(uint16_t &block)
+    {
+        taskENTER_CRITICAL();
+        if (count == 0)
+        {
+            taskEXIT_CRITICAL();
+            return false;
+        }
+        block = ring[head];
+        head  = (head + 1) % CAPACITY;
+        count--;
+        if (count < stats.minLevel)
+        {
+            stats.minLevel = count;
+        }
+        bool crossed = count + 1 == lowMark;
+        taskEXIT_CRITICAL();
+
+        if (crossed)
+        {
+            stats.lowWatermarkHits++;
+            if (callback != nullptr)
+            {
+                callback(callbackContext);
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Forget all the blocks, done when the block table no longer knows about them (e.g. after a format)
+     */
+    void clear()
+    {
+        taskENTER_CRITICAL();
+        head  = 0;
+        count = 0;
+        taskEXIT_CRITICAL();
+    }
+
+    /// the number of erased blocks ready to be handed out
+    uint8_t level() const { return count; }
+    /// checks if the refill has reached the target level
+    bool satisfied() const { return count >= targetLevel; }
+    static constexpr uint8_t capacity() { return CAPACITY; }
+
+    /**
+     * @brief Set how many blocks the refill keeps erased, at most `CAPACITY`
+     */
+    void setTarget(uint8_t target) { targetLevel = target < CAPACITY ? target : CAPACITY; }
+    uint8_t target() const { return targetLevel; }
+
+    /**
+     * @brief Set the callback fired when the level drops below `lowWatermark`, it runs in the context of the writer that took the block
+     */
+    void setLowWatermarkCallback(uint8_t lowWatermark, Callback cb, void *context = nullptr)
+    {
+        lowMark         = lowWatermark;
+        callback        = cb;
+        callbackContext = context;
+    }
+
+    const Metrics &metrics() const { return stats; }
+    Metrics &metrics() { return stats; }
+
+   private:
+    uint16_t ring[CAPACITY];
+    uint8_t head;
+    volatile uint8_t count;
+    uint8_t targetLevel;
+    uint8_t lowMark;
+    Callback callback;
+    void *callbackContext;
+    Metrics stats;
+};
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
@@ -0,0 +1,241 @@
+#pragma once
+#include "AppConfig.h"
+#include "flash.hpp"
+#include "flashKvStore.hpp"
+#include "flashPartition.hpp"
+#include "stdint-gcc.h"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+/**
+ * @brief How `FileSystem::open` opens a file
+ */
+enum class OpenMode : uint8_t
+{
+    READ   = 0,  ///< An existing file, `write` is refused
+    WRITE  = 1,  ///< A new file, or an existing one truncated to 0 bytes
+    APPEND = 2,  ///< A new or existing file, every `write` goes to the end
+    UPDATE = 3   ///< An existing file, read and written at the position
+};
+
+/**
+ * @brief A small file system of named files (config dumps, match logs, map files) over a set of blocks
+ * @note  A file is a list of whole blocks, byte `n` of the file is at offset `n % BLOCK_SIZE_BYTE` of block `n / BLOCK_SIZE_BYTE` of
+ *        the list. The first two blocks hold a `KvStore` directory mapping each name to its inode (the size and the block list), which is
+ *        only written by `sync` and `close`: the blocks of the last inode are never modified, a write over them copies the block to a new
+ *        one first, and the old block is freed once the new inode is written. A file cut by a power loss is found as it was at its
+ *        last `sync`, and the blocks written since then are free again
+ * @note  Each open file has a page buffer, the pages are programmed whole, except the last page of the file on `sync`. A page is
+ *        programmed at most `PAGE_PROGRAMS` times (the partial programs allowed by the chip), after that the block is copied. The bytes
+ *        appended after a `sync` go in the same page as the synced ones, so a power loss during that program can take the synced bytes of
+ *        the last page with it: a `sync` keeps the file safe up to the start of its last page, and that page only until more bytes are
+ *        appended to it
+ * @note  The RAM used is the directory index plus one `File` per open file. A file must not be open twice if one of them writes. The
+ *        blocks should be a partition of their own, so that the `Manager` does not hand them out
+ * @tparam GEOMETRY: the `NandGeometry` of the chip
+ */
+template <typename GEOMETRY = DefaultGeometry>
+class FileSystem
+{
+   private:
+    struct Inode
+    {
+        uint32_t size;
+        uint16_t blockCount;
+        uint8_t tailPrograms;  ///< the programs of the last page of the file, if the file ends within it
+        uint8_t reserved;
+        uint16_t blocks[FLASH_FS_MAX_FILE_BLOCKS];  ///< chip blocks
+    };
+
+   public:
+    using Geometry = GEOMETRY;
+
+    static constexpr uint8_t MAX_NAME_SIZE    = KvStore<GEOMETRY>::MAX_KEY_SIZE;
+    static constexpr uint16_t MAX_FILE_BLOCKS = FLASH_FS_MAX_FILE_BLOCKS;
+    static constexpr uint32_t MAX_FILE_SIZE   = static_cast<uint32_t>(MAX_FILE_BLOCKS) * Geometry::BLOCK_SIZE_BYTE;
+    static constexpr uint8_t PAGE_PROGRAMS    = FLASH_FS_PAGE_PROGRAMS;
+    static constexpr uint16_t DIRECTORY_BLOCKS = 2;
+
+    /**
+     * @brief Called by `list` for each file, returns false to stop
+     */
+    using Visitor = bool (*)(const char *name, uint32_t size, void *context);
+
+    /**
+     * @brief An open file, with its position and its page buffer
+     */
+    class File
+    {
+       public:
+        File() : fs(nullptr), name(), mode(OpenMode::READ), inode(), committed(), position(0), page(NO_PAGE), onFlash(0), end(0),
+                 dirtyFrom(0), programs(0), copying(false), copyIndex(0), copySource(0), copyEnd(0)
+        {
+        }
+        ~File() { close(); }
+        File(const File &)            = delete;
+        File &operator=(const File &) = delete;
+
+        /**
+         * @brief Copy up to `capacity` bytes from the position into `data` and move the position after them
+         * @param length: the number of bytes read, 0 at the end of the file
+         */
+        State read(void *data, uint32_t capacity, uint32_t &length);
+        /**
+         * @brief Write `size` bytes at the position (at the end in `APPEND` mode) and move the position after them
+         * @note  the data is in the page buffer or programmed, it is part of the file after a power loss once `sync` returns
+         * @return `NO_BUFFER` if the file would be larger than `MAX_FILE_SIZE` or there is no free block left
+         */
+        State write(const void *data, uint32_t size);
+        /**
+         * @brief Move the position, up to the end of the file
+         */
+        State seek(uint32_t offset);
+        /**
+         * @brief Program the page buffer and write the inode, the file survives a power loss as it is now
+         * @note  but for its last page, if the power is lost while the next bytes are programmed after it, see the class notes
+         * @param durability: when the block table is saved with the inode, see `Durability`
+         */
+        State sync(Durability durability = Durability::DEFAULT);
+        /**
+         * @brief Sync the file if it was written and release it
+         */
+        State close(Durability durability = Durability::DEFAULT);
+
+        bool isOpen() const { return fs != nullptr; }
+        uint32_t size() const { return inode.size; }
+        uint32_t tell() const { return position; }
+
+       private:
+        friend class FileSystem;
+        static constexpr uint32_t NO_PAGE = 0xFFFFFFFF;
+
+        FileSystem *fs;
+        char name[MAX_NAME_SIZE + 1];
+        OpenMode mode;
+        Inode inode;      // the file as it is now
+        Inode committed;  // the file as it is in the directory
+        uint32_t position;
+
+        /* the page buffer holds the bytes [0, end) of file page `page`, [0, onFlash) of them are programmed at their place */
+        uint32_t page;
+        uint16_t onFlash;
+        uint16_t end;
+        uint16_t dirtyFrom;  // the first byte changed since the page was loaded or programmed
+        uint8_t programs;    // the programs of the page at its place
+        alignas(4) uint8_t buffer[Geometry::PAGE_SIZE_BYTE];
+
+        /* the block being copied on write: the pages from the write offset of the new block up to `copyEnd` are still in the source */
+        bool copying;
+        uint16_t copyIndex;
+        uint16_t copySource;
+        uint16_t copyEnd;
+
+        /// the chip address of file page `filePage`, which must be on the chip
+        uint32_t locate(uint32_t filePage) const;
+        /// program the page buffer if it was changed
+        State flush();
+        /// put file page `filePage` in the page buffer, flushing the one it holds
+        State load(uint32_t filePage);
+        /// program the page buffer at its place, the block is copied if the place is already programmed
+        State program();
+        /// move the block at `index` to a new block, with the pages before `filePage` copied from it
+        State copyBlock(uint16_t index, uint32_t filePage);
+        /// copy the pages of the source block up to `pageInBlock` to the new block
+        State copyUpTo(uint16_t pageInBlock);
+        /// copy the rest of the source block and free it if no inode holds it
+        State finishCopy();
+    };
+
+    struct Stats
+    {
+        uint32_t commits;       ///< inodes written
+        uint32_t pagesWritten;  ///< pages and partial pages programmed with file data
+        uint32_t pagesCopied;   ///< pages moved by the copies on write
+        uint32_t blockCopies;   ///< blocks copied because a write went over programmed data
+        uint32_t blocksReused;  ///< blocks erased before being written again
+    };
+
+    /**
+     * @param manager: the manager of the chip
+     * @param firstBlock: the first chip block of the file system, the directory takes this block and the next one
+     * @param blockCount: the number of blocks including the directory
+     */
+    FileSystem(Manager<GEOMETRY> &manager, uint16_t firstBlock, uint16_t blockCount);
+    /**
+     * @brief A file system over all the blocks of a partition
+     */
+    explicit FileSystem(Partition<GEOMETRY> &partition) : FileSystem(partition.manager(), partition.chipBlock(0), partition.blockCount()) {}
+    FileSystem(const FileSystem &)            = delete;
+    FileSystem &operator=(const FileSystem &) = delete;
+
+    /**
+     * @brief Mount the directory and find the blocks held by the files, formats the directory on blank blocks
+     * @note  If an inode fails its CRC while the blocks are gathered, the file it held is lost and every block is kept used: the files
+     *        left stay usable, and the new blocks only come from the files removed or rewritten until the next mount
+     */
+    State mount();
+    /**
+     * @brief Open the file `name` into `file`, which must not be open
+     * @return `PARAM_ERR` if the file does not exist in the `READ` and `UPDATE` modes
+     */
+    State open(const char *name, OpenMode mode, File &file);
+    /**
+     * @brief Remove the file `name`, it must not be open
+     */
+    State remove(const char *name, Durability durability = Durability::DEFAULT);
+    /**
+     * @brief The size of the file `name` in the directory
+     */
+    State fileSize(const char *name, uint32_t &size);
+    /**
+     * @brief Visit all the files of the directory, in no particular order
+     */
+    State list(Visitor visitor, void *context = nullptr);
+
+    bool exists(const char *name) const { return directory.contains(name); }
+    bool isMounted() const { return mounted; }
+    uint16_t freeBlocks() const;
+    const Stats &stats() const { return counters; }
+
+   private:
+    Manager<GEOMETRY> &flash;
+    KvStore<GEOMETRY> directory;
+    const uint16_t first;  // the first data block
+    const uint16_t count;  // the number of data blocks
+    bool mounted;
+    uint16_t cursor;                                   // where the search for a free block starts, it goes round the blocks
+    uint32_t used[(Geometry::BLOCK_COUNT + 31) / 32];  // one bit per data block, set if an inode or an open file holds it
+    Stats counters;
+
+    /// the user visitor of `list`
+    struct Listing
+    {
+        Visitor visitor;
+        void *context;
+    };
+
+    static uint16_t inodeSize(const Inode &inode) { return sizeof(Inode) - (MAX_FILE_BLOCKS - inode.blockCount) * sizeof(uint16_t); }
+    static bool holds(const Inode &inode, uint16_t block);
+    bool isUsed(uint16_t block) const { return used[(block - first) / 32] & (1UL << ((block - first) % 32)); }
+    void setUsed(uint16_t block, bool value);
+    bool isFree(uint16_t block) const { return !isUsed(block) && flash.blocks[block].isUsable(); }
+    uint32_t writeOffset(uint16_t block) const { return flash.blocks[block].writeOffset(); }
+    /// a free block, erased and marked used, -1 if there is none
+    int32_t allocate();
+    /// write the inode of `file` and free the blocks the previous one held and the new one does not
+    State commit(File &file, Durability durability);
+    static bool markVisitor(const char *key, const uint8_t *value, uint16_t length, void *context);
+    static bool listVisitor(const char *key, const uint8_t *value, uint16_t length, void *context);
+};
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
@@ -0,0 +1,150 @@
+#pragma once
+#include "AppConfig.h"
+#include "stdint-gcc.h"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+/**
+ * @brief  Compile-time description of the page/block/die layout of a SPI NAND chip of the W25N family
+ * @note   A linear address is packed as `block | page | column`, where the column field also covers the spare (ECC) area
+ *         that starts at `PAGE_SIZE_BYTE`. All the helpers reduce to shifts and masks
+ * @param  BLOCK_BITS_: log2 of the number of blocks
+ * @param  PAGE_BITS_: log2 of the number of pages per block
+ * @param  BYTE_BITS_: log2 of the number of data bytes per page
+ * @param  SPARE_SIZE_BYTE_: the size of the spare area of each page
+ * @param  JEDEC_ID_: the JEDEC ID reported by the chip
+ * @param  DIE_COUNT_: the number of stacked dies
+ */
+template <uint8_t BLOCK_BITS_, uint8_t PAGE_BITS_, uint8_t BYTE_BITS_, uint16_t SPARE_SIZE_BYTE_, uint32_t JEDEC_ID_, uint8_t DIE_COUNT_ = 1>
+struct NandGeometry
+{
+    static constexpr uint8_t BLOCK_BITS  = BLOCK_BITS_;
+    static constexpr uint8_t PAGE_BITS   = PAGE_BITS_;
+    static constexpr uint8_t BYTE_BITS   = BYTE_BITS_;
+    static constexpr uint8_t COLUMN_BITS = BYTE_BITS_ + 1;  // one more bit to reach the spare area
+
+    static constexpr uint32_t PAGE_SIZE_BYTE  = 1UL << BYTE_BITS;
+    static constexpr uint32_t SPARE_SIZE_BYTE = SPARE_SIZE_BYTE_;
+    static constexpr uint32_t PAGE_PER_BLOCK  = 1UL << PAGE_BITS;
+    static constexpr uint32_t BLOCK_COUNT     = 1UL << BLOCK_BITS;
+    static constexpr uint32_t BLOCK_SIZE_BYTE = PAGE_SIZE_BYTE << PAGE_BITS;
+    static constexpr uint32_t PAGE_COUNT      = BLOCK_COUNT << PAGE_BITS;
+    static constexpr uint8_t DIE_COUNT        = DIE_COUNT_;
+    static constexpr uint32_t BLOCKS_PER_DIE  = BLOCK_COUNT / DIE_COUNT_;
+    static constexpr uint32_t JEDEC_ID        = JEDEC_ID_;
+
+    /// the last block is reserved for the driver's relocation
+    static constexpr uint16_t RESERVE_BLOCK_BLOCKADDR = BLOCK_COUNT - 1;
+    /// the two blocks before it hold the driver's metadata journal, used in turns
+    static constexpr uint16_t METADATA_BLOCKADDR = BLOCK_COUNT - 3;
+    /// the blocks `[0, USER_BLOCK_COUNT)` are available to the users
+    static constexpr uint16_t USER_BLOCK_COUNT = METADATA_BLOCKADDR;
+
+    static constexpr uint8_t PAGE_SHIFT  = COLUMN_BITS;
+    static constexpr uint8_t BLOCK_SHIFT = COLUMN_BITS + PAGE_BITS;
+
+    static constexpr uint32_t BYTE_MASK   = PAGE_SIZE_BYTE - 1;
+    static constexpr uint32_t COLUMN_MASK = (1UL << COLUMN_BITS) - 1;
+    static constexpr uint32_t PAGE_MASK   = PAGE_PER_BLOCK - 1;
+
+    static_assert(BLOCK_SHIFT + BLOCK_BITS <= 32, "the linear address must fit into 32 bits");
+    static_assert(SPARE_SIZE_BYTE_ <= PAGE_SIZE_BYTE, "the spare area must be addressable by the extra column bit");
+
+    /**
+     * @brief  Extract the block number of a linear address, high bits are kept so that bounds checks catch them
+     */
+    static constexpr uint32_t blockOf(uint32_t address) { return address >> BLOCK_SHIFT; }
+    /**
+     * @brief  Extract the page number within the block of a linear address
+     */
+    static constexpr uint16_t pageOf(uint32_t address) { return (address >> PAGE_SHIFT) & PAGE_MASK; }
+    /**
+     * @brief  Extract the data byte within the page of a linear address
+     */
+    static constexpr uint16_t byteOf(uint32_t address) { return address & BYTE_MASK; }
+    /**
+     * @brief  Extract the full column (data + spare) of a linear address
+     */
+    static constexpr uint16_t columnOf(uint32_t address) { return address & COLUMN_MASK; }
+    /**
+     * @brief  Checks if a linear address points into the spare area of a page
+     */
+    static constexpr bool isSpare(uint32_t address) { return (address & PAGE_SIZE_BYTE) != 0; }
+
+    /**
+     * @brief  Pack a block, page and byte number into a linear address
+     */
+    static constexpr uint32_t calcAddress(uint32_t block, uint32_t page, uint32_t byte)
+    {
+        return (block << BLOCK_SHIFT) | (page << PAGE_SHIFT) | byte;
+    }
+    /**
+     * @brief  The address of a page as the chip expects it for `PAGE_DATA_READ`, `PROGRAM_EXECUTE` and `BLOCK_ERASE`
+     */
+    static constexpr uint32_t rowAddress(uint32_t block, uint32_t page) { return (block << PAGE_BITS) | page; }
+    /**
+     * @brief  The number of pages needed to hold `size` bytes, rounded up
+     */
+    static constexpr uint32_t pagesFor(uint32_t size) { return (size + BYTE_MASK) >> BYTE_BITS; }
+    /**
+     * @brief  The die on which a block is located
+     */
+    static constexpr uint8_t dieOf(uint32_t block) { return block / BLOCKS_PER_DIE; }
+};
+
+// clang-format off
+template <uint8_t A, uint8_t B, uint8_t C, uint16_t D, uint32_t E, uint8_t F> constexpr uint8_t NandGeometry<A, B, C, D, E, F>::BLOCK_BITS;
+template <uint8_t A, uint8_t B, uint8_t C, uint16_t D, uint32_t E, uint8_t F> constexpr uint8_t NandGeometry<A, B, C, D, E, F>::PAGE_BITS;
+template <uint8_t A, uint8_t B, uint8_t C, uint16_t D, uint32_t E, uint8_t F> constexpr uint8_t NandGeometry<A, B, C, D, E, F>::BYTE_BITS;
+template <uint8_t A, uint8_t B, uint8_t C, uint16_t D, uint32_t E, uint8_t F> constexpr uint8_t NandGeometry<A, B, C, D, E, F>::COLUMN_BITS;
+template <uint8_t A, uint8_t B, uint8_t C, uint16_t D, uint32_t E, uint8_t F> constexpr uint32_t NandGeometry<A, B, C, D, E, F>::PAGE_SIZE_BYTE;
+template <uint8_t A, uint8_t B, uint8_t C, uint16_t D, uint32_t E, uint8_t F> constexpr uint32_t NandGeometry<A, B, C, D, E, F>::SPARE_SIZE_BYTE;
+template <uint8_t A, uint8_t B, uint8_t C, uint16_t D, uint32_t E, uint8_t F> constexpr uint32_t NandGeometry<A, B, C, D, E, F>::PAGE_PER_BLOCK;
+template <uint8_t A, uint8_t B, uint8_t C, uint16_t D, uint32_t E, uint8_t F> constexpr uint32_t NandGeometry<A, B, C, D, E, F>::BLOCK_COUNT;
+template <uint8_t A, uint8_t B, uint8_t C, uint16_t D, uint32_t E, uint8_t F> constexpr uint32_t NandGeometry<A, B, C, D, E, F>::BLOCK_SIZE_BYTE;
+template <uint8_t A, uint8_t B, uint8_t C, uint16_t D, uint32_t E, uint8_t F> constexpr uint32_t NandGeometry<A, B, C, D, E, F>::PAGE_COUNT;
+template <uint8_t A, uint8_t B, uint8_t C, uint16_t D, uint32_t E, uint8_t F> constexpr uint8_t NandGeometry<A, B, C, D, E, F>::DIE_COUNT;
+template <uint8_t A, uint8_t B, uint8_t C, uint16_t D, uint32_t E, uint8_t F> constexpr uint32_t NandGeometry<A, B, C, D, E, F>::BLOCKS_PER_DIE;
+template <uint8_t A, uint8_t B, uint8_t C, uint16_t D, uint32_t E, uint8_t F> constexpr uint32_t NandGeometry<A, B, C, D, E, F>::JEDEC_ID;
+template <uint8_t A, uint8_t B, uint8_t C, uint16_t D, uint32_t E, uint8_t F> constexpr uint16_t NandGeometry<A, B, C, D, E, F>::RESERVE_BLOCK_BLOCKADDR;
+template <uint8_t A, uint8_t B, uint8_t C, uint16_t D, uint32_t E, uint8_t F> constexpr uint16_t NandGeometry<A, B, C, D, E, F>::METADATA_BLOCKADDR;
+template <uint8_t A, uint8_t B, uint8_t C, uint16_t D, uint32_t E, uint8_t F> constexpr uint16_t NandGeometry<A, B, C, D, E, F>::USER_BLOCK_COUNT;
+template <uint8_t A, uint8_t B, uint8_t C, uint16_t D, uint32_t E, uint8_t F> constexpr uint8_t NandGeometry<A, B, C, D, E, F>::PAGE_SHIFT;
+template <uint8_t A, uint8_t B, uint8_t C, uint16_t D, uint32_t E, uint8_t F> constexpr uint8_t NandGeometry<A, B, C, D, E, F>::BLOCK_SHIFT;
+template <uint8_t A, uint8_t B, uint8_t C, uint16_t D, uint32_t E, uint8_t F> constexpr uint32_t NandGeometry<A, B, C, D, E, F>::BYTE_MASK;
+template <uint8_t A, uint8_t B, uint8_t C, uint16_t D, uint32_t E, uint8_t F> constexpr uint32_t NandGeometry<A, B, C, D, E, F>::COLUMN_MASK;
+template <uint8_t A, uint8_t B, uint8_t C, uint16_t D, uint32_t E, uint8_t F> constexpr uint32_t NandGeometry<A, B, C, D, E, F>::PAGE_MASK;
+// clang-format on
+
+/// W25N01GV: 1Gbit, 1024 blocks of 64 pages of (2048 + 64) bytes
+using W25N01GV = NandGeometry<10, 6, 11, 64, 0xEFAA21>;
+/// W25N512GV: 512Mbit, 512 blocks of 64 pages of (2048 + 64) bytes
+using W25N512 = NandGeometry<9, 6, 11, 64, 0xEFAA20>;
+/// W25N02KV: 2Gbit, 2048 blocks of 64 pages of (2048 + 128) bytes
+using W25N02K = NandGeometry<11, 6, 11, 128, 0xEFAA22>;
+
+/// The chip mounted on the board
+#ifndef FLASH_GEOMETRY
+#define FLASH_GEOMETRY W25N01GV
+#endif
+using DefaultGeometry = FLASH_GEOMETRY;
+
+/**
+ * @brief  Explicitly instantiate a geometry dependent class for all the supported chips, unused ones are dropped by `--gc-sections`
+ */
+#define W25N_INSTANTIATE_FOR_ALL_GEOMETRIES(CLASS) \
+    template class CLASS<W25N01GV>;                \
+    template class CLASS<W25N512>;                 \
+    template class CLASS<W25N02K>
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
@@ -0,0 +1,136 @@
+#pragma once
+#include "AppConfig.h"
+#include "flash.hpp"
+#include "main.h"
+#include "stdint-gcc.h"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+/**
+ * @brief What a producer does when its record does not fit in the ring
+ */
+enum class Backpressure : uint8_t
+{
+    DROP_NEWEST = 0,  ///< the new record is dropped, the ring keeps the oldest data
+    DROP_OLDEST = 1   ///< the oldest records are dropped until the new one fits, the ring keeps the latest data
+};
+
+/**
+ * @brief A lock free multi producer, single consumer byte ring between the ISRs (FDCAN, UART DMA, timers) and the flash writer task
+ * @note  A producer reserves room for its record by moving the reserve head with LDREX/STREX, copies the record and commits it. The
+ *        records are only visible to the consumer once every reservation before them is committed: the ring counts the writers in
+ *        progress, and the last one to commit publishes the reserve head. An ISR that interrupts a writer ends before it, so a writer
+ *        only holds back the records of the ISRs that interrupted it. A record that does not fit before the end of the ring is preceded
+ *        by a padding record, so that it is never split
+ * @note  The consumer copies whole records to a chunk and releases them with LDREX/STREX. A producer with `DROP_OLDEST` releases the
+ *        oldest committed records itself, the consumer then sees its release fail and copies the chunk again from the new tail
+ * @note  A producer id must only be used from one context (one ISR, or one task), its counters are not shared. A record is stored in
+ *        flash as `[length:2][producer:1][payload]`
+ */
+class IngestRing
+{
+   public:
+    static constexpr uint32_t SIZE         = FLASH_INGEST_RING_SIZE;
+    static constexpr uint8_t MAX_PRODUCERS = FLASH_INGEST_MAX_PRODUCERS;
+    static constexpr uint16_t MAX_RECORD   = FLASH_INGEST_MAX_RECORD;
+    static constexpr uint8_t RECORD_HEADER = 3;  // bytes of the header of a record drained to flash
+    static_assert((SIZE & (SIZE - 1)) == 0, "the ring size must be a power of two");
+    static_assert(MAX_RECORD <= SIZE / 4, "a record must be at most a quarter of the ring");
+
+    struct ProducerStats
+    {
+        uint32_t records;  ///< records committed
+        uint32_t dropped;  ///< records of this producer that did not fit
+        uint32_t evicted;  ///< older records this producer dropped to make room
+    };
+
+    IngestRing();
+
+    /**
+     * @brief Set the policy of `producer` when the ring is full, `DROP_NEWEST` by default
+     */
+    void setPolicy(uint8_t producer, Backpressure policy);
+
+    /**
+     * @brief Room for a record of `size` bytes, to be filled and followed by `commit`
+     * @return `nullptr` if the record is dropped or `size` is larger than `MAX_RECORD`, `commit` must not be called then
+     */
+    uint8_t *reserve(uint8_t producer, uint16_t size);
+    /**
+     * @brief Make the record reserved last by this context visible to the consumer
+     */
+    void commit() { leave(); }
+    /**
+     * @brief Copy a record into the ring
+     * @return false if it is dropped
+     */
+    bool write(uint8_t producer, const void *data, uint16_t size);
+
+    /**
+     * @brief Move the oldest committed records to `out` as `[length:2][producer:1][payload]` and release them, for the consumer only
+     * @param capacity: at least `MAX_RECORD + RECORD_HEADER`, a page for the flash writer
+     * @return the bytes written to `out`, 0 if the ring is empty
+     */
+    uint16_t drain(uint8_t *out, uint16_t capacity);
+    /**
+     * @brief Drain the ring a chunk at a time into `writer`, a `PageWriter` open on the log block
+     * @param chunk: a buffer of `capacity` bytes for the records
+     */
+    template <typename WRITER>
+    State drainTo(WRITER &writer, uint8_t *chunk, uint16_t capacity)
+    {
+        uint16_t size;
+        while ((size = drain(chunk, capacity)) != 0)
+        {
+            State state = writer.append(chunk, size);
+            if (state != State::OK)
+            {
+                return state;
+            }
+        }
+        return State::OK;
+    }
+
+    /// the bytes reserved and not released yet, headers and padding included
+    uint32_t used() const { return reserved - released; }
+    const ProducerStats &stats(uint8_t producer) const { return counters[producer < MAX_PRODUCERS ? producer : 0]; }
+
+   private:
+    /// the header of a record in the ring, the records are aligned to 4 bytes
+    struct Header
+    {
+        uint16_t length;
+        uint8_t producer;
+        uint8_t flags;
+    };
+    static constexpr uint8_t PADDING = 0x01;
+
+    alignas(4) uint8_t ring[SIZE];
+    volatile uint32_t reserved;   // the reserve head, the end of the last reservation
+    volatile uint32_t committed;  // the end of the records visible to the consumer
+    volatile uint32_t released;   // the tail, the start of the oldest record
+    volatile uint32_t writers;    // reservations in progress
+    Backpressure policies[MAX_PRODUCERS];
+    ProducerStats counters[MAX_PRODUCERS];
+
+    Header *headerAt(uint32_t position) { return reinterpret_cast<Header *>(ring + (position & (SIZE - 1))); }
+    static uint32_t footprint(uint16_t length) { return (sizeof(Header) + length + 3) & ~3UL; }
+    /// count a writer in progress
+    void enter();
+    /// count a writer out, the last one publishes the reserve head
+    void leave();
+    /// release the oldest committed record, false if there is none
+    bool evict(ProducerStats &stats);
+};
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
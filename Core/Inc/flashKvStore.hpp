@@ -0,0 +1,182 @@
+#pragma once
+#include "AppConfig.h"
+#include "flash.hpp"
+#include "flashPartition.hpp"
+#include "stdint-gcc.h"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+/**
+ * @brief A log-structured key-value store over two blocks, for the parameters that are updated from time to time (gains, calibrations, offsets)
+ * @note  Every `put` appends one record `[hash:4][version:4][length:2][key length:1][kind:1][crc:4][key][value]` to the active block, a record
+ *        never crosses a page. An index in RAM maps the hash of each key to the offset of its last record, so a lookup reads one page, and
+ *        the values up to `CACHED_VALUE_SIZE` bytes are kept in the index and read without touching the chip
+ * @note  Each record is one partial program of its page, a page takes `PAGE_PROGRAMS` of them (the NOP of the chip) and the next record
+ *        then starts a new page
+ * @note  When the active block is full the live records are copied to the other block, which ends with a seal record and gets the next
+ *        generation number. The mount takes the newest sealed block, so a compaction cut by a power loss falls back to the previous block,
+ *        and a record torn by a power loss fails its CRC and is dropped with the rest of its page
+ * @note  The index keeps a copy of each key next to its 32 bit hash, so that two keys with the same hash are told apart. The two blocks
+ *        should be a partition of their own, so that the `Manager` does not hand them out
+ * @tparam GEOMETRY: the `NandGeometry` of the chip
+ */
+template <typename GEOMETRY = DefaultGeometry>
+class KvStore
+{
+   public:
+    using Geometry = GEOMETRY;
+
+    static constexpr uint16_t INDEX_SIZE         = FLASH_KV_INDEX_SIZE;
+    static constexpr uint16_t MAX_KEYS           = INDEX_SIZE * 3 / 4;
+    static constexpr uint8_t MAX_KEY_SIZE        = 31;
+    static constexpr uint8_t CACHED_VALUE_SIZE   = FLASH_KV_CACHED_VALUE_SIZE;
+    static constexpr uint32_t BLOCK_HEADER_SIZE  = 8;
+    static constexpr uint32_t RECORD_HEADER_SIZE = 16;
+    static constexpr uint8_t PAGE_PROGRAMS       = FLASH_FS_PAGE_PROGRAMS;
+    /// the largest value of a one character key, a record fits in a page
+    static constexpr uint16_t MAX_VALUE_SIZE = Geometry::PAGE_SIZE_BYTE - RECORD_HEADER_SIZE - 1;
+    static_assert((INDEX_SIZE & (INDEX_SIZE - 1)) == 0, "the index size must be a power of two");
+
+    /**
+     * @brief Called by `forEach` for each key with its value, returns false to stop
+     */
+    using Visitor = bool (*)(const char *key, const uint8_t *value, uint16_t length, void *context);
+
+    struct Stats
+    {
+        uint32_t puts;
+        uint32_t unchangedPuts;   ///< puts of the cached value, nothing was written
+        uint32_t cacheHits;       ///< gets served from the index
+        uint32_t pageReads;       ///< gets that read the record from the chip
+        uint32_t compactions;
+        uint32_t droppedRecords;  ///< records with a bad CRC found by the last mount or compaction
+    };
+
+    /**
+     * @param manager: the manager of the chip
+     * @param firstBlock: the first of the two chip blocks of the store
+     */
+    KvStore(Manager<GEOMETRY> &manager, uint16_t firstBlock);
+    /**
+     * @brief A store on the first two blocks of a partition
+     */
+    explicit KvStore(Partition<GEOMETRY> &partition) : KvStore(partition.manager(), partition.chipBlock(0)) {}
+
+    /**
+     * @brief Build the index from the newest sealed block, or format the store if there is none
+     */
+    State mount();
+    /**
+     * @brief Copy the value of `key` into `buffer`
+     * @param length: the size of the value
+     * @return `PARAM_ERR` if the key is not stored, `NO_BUFFER` if the value does not fit in `capacity`, `ECC_ERR` if the record is corrupted
+     */
+    State get(const char *key, void *buffer, uint16_t capacity, uint16_t &length);
+    /**
+     * @brief Store `size` bytes under `key`, one append unless the value is the cached one. Compacts the store when the block is full
+     * @param durability: when the block table is saved, see `Durability`
+     * @return `NO_BUFFER` if the index or the block is full even after a compaction
+     */
+    State put(const char *key, const void *value, uint16_t size, Durability durability = Durability::DEFAULT);
+    /**
+     * @brief Remove `key`, its records are dropped by the next compaction
+     * @return `PARAM_ERR` if the key is not stored
+     */
+    State remove(const char *key, Durability durability = Durability::DEFAULT);
+    /**
+     * @brief Copy the live records to the other block now, e.g. while the robot is idle, instead of in the `put` that fills the block
+     */
+    State compact();
+    /**
+     * @brief Visit all the keys in no particular order, reads the record of each key from the chip
+     * @note  a record with a bad CRC is skipped and counted in `droppedRecords`
+     */
+    State forEach(Visitor visitor, void *context = nullptr);
+
+    bool contains(const char *key) const;
+    /// the number of times `key` has been written, 0 if it is not stored
+    uint32_t version(const char *key) const;
+    uint16_t keyCount() const { return keys; }
+    bool isMounted() const { return mounted; }
+    const Stats &stats() const { return counters; }
+
+   private:
+    static constexpr uint32_t MAGIC     = 0x5453564B;  // "KVST"
+    static constexpr uint32_t EMPTY     = 0;           // a slot never used, ends the probe sequence
+    static constexpr uint32_t TOMBSTONE = 1;           // a removed key, the probe sequence goes on
+    static constexpr uint32_t BLANK     = 0xFFFFFFFF;
+
+    enum Kind : uint8_t
+    {
+        PUT    = 0x01,
+        REMOVE = 0x02,
+        SEAL   = 0x03
+    };
+
+    struct RecordHeader
+    {
+        uint32_t hash;
+        uint32_t version;
+        uint16_t valueLength;
+        uint8_t keyLength;
+        uint8_t kind;
+        uint32_t crc;  ///< over the header before it, the key and the value
+    };
+    static_assert(sizeof(RecordHeader) == RECORD_HEADER_SIZE, "the record header is stored raw");
+
+    struct Slot
+    {
+        uint32_t hash;
+        uint32_t offset;  ///< of the last record of the key in the active block, or `EMPTY` / `TOMBSTONE`
+        uint32_t version;
+        uint16_t valueLength;
+        uint8_t keyLength;
+        bool cached;
+        uint8_t cache[CACHED_VALUE_SIZE];
+        char key[MAX_KEY_SIZE];
+    };
+
+    Manager<GEOMETRY> &flash;
+    const uint16_t first;
+    bool mounted;
+    uint8_t active;  // 0 or 1, the block the records are appended to
+    uint32_t generation;
+    uint16_t keys;
+    uint16_t used;     // the slots holding a key or a tombstone
+    uint8_t programs;  // the programs the page of the write offset has taken
+    Slot index[INDEX_SIZE];
+    Stats counters;
+
+    uint16_t chipBlock(uint8_t which) const { return first + which; }
+    /// FNV-1a of the key, `length` stops counting after `MAX_KEY_SIZE`
+    static uint32_t hashOf(const char *key, uint8_t &length);
+    /// the slot of the key, -1 if it is not stored
+    int16_t find(uint32_t hash, const char *key, uint8_t keyLength) const;
+    /// the slot for a key that is not stored, the first tombstone or empty slot of its probe sequence
+    int16_t claim(uint32_t hash, const char *key, uint8_t keyLength);
+    void clearIndex();
+    /// write `[header][key][value]` at `dest` and return its size
+    static uint16_t encode(uint8_t *dest, Kind kind, uint32_t hash, uint32_t version, const char *key, uint8_t keyLength, const void *value,
+                           uint16_t size);
+    /// append a record to the active block, compacting first if it does not fit
+    State append(Kind kind, uint32_t hash, uint32_t version, const char *key, uint8_t keyLength, const void *value, uint16_t size,
+                 Durability durability, uint32_t &offset);
+    /// read the generation in the header of `block`, `valid` is false if it has no store header
+    State probe(uint16_t block, bool &valid, uint32_t &blockGeneration);
+    /// add the records of `block` to the index, `sealed` is true if its seal record was found
+    State scan(uint16_t block, bool &sealed);
+    /// erase the other block, copy the live records and the seal into it and make it the active one
+    State rewrite();
+};
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
@@ -0,0 +1,135 @@
+#pragma once
+#include "AppConfig.h"
+#include "flash.hpp"
+#include "stdint-gcc.h"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+/**
+ * @brief A double buffered writer that streams records into one block, the next page is assembled in RAM while the chip programs the last one
+ * @note  A full page is handed to the chip as soon as it is ready, or left pending while the chip is still busy with the page before it. The
+ *        pending page is loaded by the next `reserve`, `append` or `poll` that finds the chip ready, so the caller only waits when it has filled
+ *        a second page before the first one is done, and the throughput is bound by tPROG rather than by tPROG plus the encoding time
+ * @note  The writer holds one page of the pool while it is open. A page is free again once loaded into the chip, so the second page is
+ *        only borrowed while a full page is pending, the writer waits for the chip instead when the pool is empty
+ * @note  Records are never split by `reserve`: one that does not fit in the rest of the page starts the next page, the rest of the page is left
+ *        erased. The block must not be written through the `Manager` while the writer has it open
+ * @note  With `setVerify`, the CRC of a page is taken while the chip programs it, and the page is read back and its CRC compared the next
+ *        time the chip is ready, before the next page is loaded. The read back borrows a third page from the pool, a page is not checked
+ *        when the pool is empty
+ * @tparam GEOMETRY: the `NandGeometry` of the chip
+ */
+template <typename GEOMETRY = DefaultGeometry>
+class PageWriter
+{
+   public:
+    using Geometry = GEOMETRY;
+
+    /**
+     * @brief How much of the encoding overlapped with the programs
+     */
+    struct Stats
+    {
+        uint32_t pages;       ///< pages programmed
+        uint32_t overlapped;  ///< pending pages loaded by `poll` while the caller kept assembling the next one
+        uint32_t stalls;      ///< times the caller had to wait for the chip, both pages full or none left in the pool
+        uint32_t stall_us;    ///< the time spent in those waits
+        uint32_t verified;    ///< pages read back with the CRC they were programmed with
+        uint32_t unchecked;   ///< pages not read back because the pool was empty
+    };
+
+    explicit PageWriter(Manager<GEOMETRY> &manager);
+    ~PageWriter() { close(); }
+    PageWriter(const PageWriter &)            = delete;
+    PageWriter &operator=(const PageWriter &) = delete;
+
+    /**
+     * @brief Start writing at the write offset of `block`, leases a page from the `Manager`'s pool
+     */
+    State open(uint16_t block);
+    /**
+     * @brief Room for a record of `size` bytes in the page being assembled, to be followed by `commit`
+     * @return `nullptr` if the block is full, `size` is larger than a page or a program failed (see `status`)
+     */
+    uint8_t *reserve(uint16_t size);
+    /**
+     * @brief Add the `size` bytes written after `reserve` to the page
+     */
+    void commit(uint16_t size)
+    {
+        pages[filling].end += size;
+        written += size;
+    }
+    /**
+     * @brief Copy `size` bytes into the stream, they can span several pages
+     */
+    State append(const uint8_t *data, uint32_t size);
+    /**
+     * @brief Load the pending page if the chip is ready, never waits
+     */
+    State poll();
+    /**
+     * @brief Program what is left, wait for the chip and give the pages back
+     * @param durability: when the block table is saved, the whole stream counts as one write
+     */
+    State close(Durability durability = Durability::DEFAULT);
+    /**
+     * @brief Read every page back once programmed and compare its CRC, a mismatch (a program torn or gone wrong) stops the writer with
+     *        `ECC_ERR`
+     */
+    void setVerify(bool enabled) { verifying = enabled; }
+
+    bool isOpen() const { return opened; }
+    /// the first program error, the writer stops taking records after it
+    State status() const { return error; }
+    /// the offset in the block after the last committed record, including the bytes not programmed yet
+    uint32_t offset() const { return (static_cast<uint32_t>(pages[filling].page) << Geometry::BYTE_BITS) + pages[filling].end; }
+    const Stats &stats() const { return counters; }
+
+   private:
+    /// one of the two page buffers, holding the bytes `[start, end)` of page `page`, the second one only holds a lease while pending
+    struct Buffer
+    {
+        typename Manager<GEOMETRY>::PagePool::Lease lease;
+        uint16_t page;
+        uint16_t start;
+        uint16_t end;
+    };
+
+    Manager<GEOMETRY> &flash;
+    Buffer pages[2];
+    uint8_t filling;  // the buffer being assembled, the other one is pending when `pending` is set
+    bool pending;
+    bool opened;
+    uint16_t block;
+    uint32_t written;  // the bytes of the stream, for the group commit
+    State error;
+    bool verifying;
+    bool unverified;  // the last page programmed has not been read back yet
+    uint16_t checkPage;
+    uint16_t checkStart;
+    uint16_t checkEnd;
+    uint32_t checkCrc;
+    Stats counters;
+
+    /// hand the page being assembled to the chip, waiting for the pending one first
+    State submit();
+    /// load and program one page, `borrowed` gives its buffer back to the pool once loaded
+    State issue(Buffer &buffer, bool borrowed);
+    /// wait for the chip to finish the last program, counted as a stall
+    void stall();
+    /// read the last page programmed back and compare its CRC, the chip must be ready
+    State verify();
+};
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
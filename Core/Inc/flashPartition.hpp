@@ -0,0 +1,71 @@
+#pragma once
+#include "AppConfig.h"
+#include "flash.hpp"
+#include "stdint-gcc.h"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+/**
+ * @brief A lightweight handle on one partition of a `Manager`, the block numbers and addresses it takes are relative to the partition
+ * @note  The handle only holds the index of the partition, it is cheap to copy and has to be recreated after `Manager::ClearPartitions`
+ * @tparam GEOMETRY: the `NandGeometry` of the chip
+ */
+template <typename GEOMETRY = DefaultGeometry>
+class Partition
+{
+   public:
+    using Geometry = GEOMETRY;
+
+    /**
+     * @param manager: the manager holding the partition table
+     * @param name: the name given to `Manager::CreatePartition`, the handle is not `valid` if there is no such partition
+     */
+    Partition(Manager<GEOMETRY> &manager, const char *name) : flash(&manager), index(manager.partitions.find(name)) {}
+
+    bool valid() const { return index >= 0 && index < flash->partitions.count(); }
+    Manager<GEOMETRY> &manager() const { return *flash; }
+    const PartitionInfo &info() const { return flash->partitions[index]; }
+    uint16_t blockCount() const { return info().blockCount; }
+    /// the block number on the chip of the partition block `block`, for the APIs that work on chip blocks such as `PageWriter`
+    uint16_t chipBlock(uint16_t block) const { return info().firstBlock + block; }
+    /// the write offset of the partition block `block`
+    uint32_t writeOffset(uint16_t block) const { return flash->blocks[chipBlock(block)].writeOffset(); }
+
+    /**
+     * @brief Hand out a block of the partition according to its allocation and reclaim policies
+     * @return the partition block number, or -1 if there is no block left to write to
+     */
+    int32_t AllocateBlock();
+    /**
+     * @brief Append to the partition block `block` with the durability of the partition, see `Manager::WriteMemory`
+     */
+    State WriteMemory(uint16_t block, uint8_t *data, uint16_t size);
+    /**
+     * @brief Read from the partition, the block of `address` is a partition block number, see `Manager::ReadMemory`
+     */
+    State ReadMemory(uint32_t address, uint8_t *buffer, uint16_t size) const;
+    /**
+     * @brief Erase the partition block `block`
+     */
+    State EraseBlock(uint16_t block);
+    /**
+     * @brief Change the policies of the partition, they are saved in the partition table
+     */
+    State setPolicy(const PartitionPolicy &policy) { return flash->SetPartitionPolicy(index, policy); }
+
+   private:
+    Manager<GEOMETRY> *flash;
+    int8_t index;
+};
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
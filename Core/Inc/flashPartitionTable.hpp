@@ -0,0 +1,126 @@
+#pragma once
+#include "AppConfig.h"
+#include "stdint-gcc.h"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+enum class Durability : uint8_t;
+
+/**
+ * @brief How a partition picks the next block to write
+ */
+enum class Allocation : uint8_t
+{
+    SEQUENTIAL   = 0,  ///< The next usable block after the last one handed out, in ring order (logs)
+    WEAR_LEVELED = 1   ///< The usable block with the lowest erase count (stores that rewrite the same data)
+};
+
+/**
+ * @brief How a partition gets its discarded (`DIRTY`) blocks back
+ * @note  after a mount the ring order goes on after the `OPEN` block of the partition, or from its first block if none is open
+ */
+enum class Reclaim : uint8_t
+{
+    ON_DEMAND  = 0,  ///< A dirty block is erased when the allocator picks it
+    BACKGROUND = 1,  ///< `Manager::Step` erases the dirty blocks ahead of time
+    RECYCLE    = 2   ///< Like `ON_DEMAND`, and when no block is left the oldest one in ring order is erased (circular log)
+};
+
+/**
+ * @brief The policies of one partition, kept in the partition table
+ */
+struct PartitionPolicy
+{
+    Allocation allocation;
+    Reclaim reclaim;
+    Durability durability;  ///< the durability of the writes through the partition handle
+};
+
+/**
+ * @brief One entry of the partition table
+ */
+struct PartitionInfo
+{
+    static constexpr uint8_t NAME_SIZE = 8;
+
+    char name[NAME_SIZE];  ///< not null terminated when it uses all the bytes
+    uint16_t firstBlock;
+    uint16_t blockCount;
+    PartitionPolicy policy;
+    uint8_t reserved;
+};
+static_assert(sizeof(PartitionInfo) == 16, "the partition entries are stored raw in the metadata snapshot");
+
+/**
+ * @brief The named block ranges the user blocks are divided into, stored in the metadata snapshot after the block table
+ * @note  The partitions are contiguous from block 0 in the order they were added, the blocks after the last one are shared by
+ *        `Manager::AllocateBlock` and the direct writes
+ */
+class PartitionTable
+{
+   public:
+    static constexpr uint8_t MAX_PARTITIONS = FLASH_MAX_PARTITIONS;
+
+    PartitionTable() { clear(); }
+
+    /**
+     * @brief Remove all the partitions
+     */
+    void clear();
+    /**
+     * @brief Add a partition of `blockCount` blocks right after the last one
+     * @return the index of the partition, -1 if the table is full or the name is empty or taken
+     */
+    int8_t add(const char *name, uint16_t blockCount, const PartitionPolicy &policy);
+    /**
+     * @brief The index of the partition called `name`, -1 if there is none
+     */
+    int8_t find(const char *name) const;
+    /**
+     * @brief The index of the partition holding `block`, -1 if it is in the shared blocks
+     */
+    int8_t owner(uint16_t block) const;
+    /**
+     * @brief Checks the image after it has been read from the chip, an image written before partitions existed is cleared
+     */
+    void validate();
+
+    uint8_t count() const { return image.count; }
+    /// the first block after the partitions
+    uint16_t end() const { return image.count == 0 ? 0 : image.entries[image.count - 1].firstBlock + image.entries[image.count - 1].blockCount; }
+    const PartitionInfo &operator[](uint8_t index) const { return image.entries[index]; }
+    PartitionInfo &operator[](uint8_t index) { return image.entries[index]; }
+
+    /**
+     * @brief The raw image of the table, for the metadata snapshot
+     */
+    uint8_t *data() { return reinterpret_cast<uint8_t *>(&image); }
+    const uint8_t *data() const { return reinterpret_cast<const uint8_t *>(&image); }
+    static constexpr uint32_t size() { return sizeof(Image); }
+
+   private:
+    static constexpr uint32_t MAGIC = 0x54524150;  // "PART"
+
+    struct Image
+    {
+        uint32_t magic;
+        uint8_t count;
+        uint8_t reserved[3];
+        PartitionInfo entries[MAX_PARTITIONS];
+    } image;
+
+    /// compares a null terminated `name` with a stored one
+    static bool sameName(const char *name, const PartitionInfo &entry);
+};
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
@@ -0,0 +1,67 @@
+#pragma once
+#include "AppConfig.h"
+#include "stdint-gcc.h"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+/**
+ * @brief How the float values of a column are stored
+ */
+enum class Quantization : uint8_t
+{
+    NONE = 0,  ///< as is, 4 bytes a value
+    Q15  = 1,  ///< 2 bytes a value, a relative error of 2^-15 of the largest value of the batch
+    Q7   = 2   ///< 1 byte a value, a relative error of 2^-7 of the largest value of the batch
+};
+
+/**
+ * @brief A lossy fixed point coding of batches of float samples, for the signals (currents, IMU rates) that need 8 or 16 bits, not 32
+ * @note  The samples are interleaved, `channels` floats a row. Each channel of a batch gets the scale of its largest absolute value, the
+ *        values are divided by it and converted to q15 or q7 by the CMSIS-DSP kernels, the scales are stored next to the batch. A
+ *        value is read back as `q / 2^15 * scale`, a batch of zeros keeps a scale of 0
+ */
+class QuantCodec
+{
+   public:
+    /**
+     * @param type: `Q15` or `Q7`
+     * @param channels: the floats of a row
+     */
+    QuantCodec(Quantization type, uint16_t channels) : kind(type), count(channels) {}
+
+    bool isValid() const { return (kind == Quantization::Q15 || kind == Quantization::Q7) && count != 0; }
+    /// the bytes of a coded value
+    uint8_t valueSize() const { return kind == Quantization::Q15 ? 2 : 1; }
+    /// the bytes of a coded row
+    uint16_t rowSize() const { return count * valueSize(); }
+    uint16_t channels() const { return count; }
+
+    /**
+     * @brief Code `rows` rows of `values` to `out` and their scales to `scales`, one per channel
+     * @param values: the rows, overwritten by the conversion
+     * @param out: receives `rows * rowSize()` bytes, it may be `values` itself
+     */
+    void encode(float *values, uint16_t rows, float *scales, uint8_t *out) const;
+    /**
+     * @brief Decode `rows` rows coded with `scales` from `in` to `out`
+     * @param out: receives `rows * channels()` floats, it may overlap `in` if it starts at least as far before `in` as
+     *        `rows * (4 * channels() - rowSize())` bytes, the values of `in` are converted in order
+     */
+    void decode(const uint8_t *in, uint16_t rows, const float *scales, float *out) const;
+
+   private:
+    Quantization kind;
+    uint16_t count;
+};
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
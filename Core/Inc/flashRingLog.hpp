@@ -0,0 +1,146 @@
+#pragma once
+#include "AppConfig.h"
+#include "flash.hpp"
+#include "flashPageWriter.hpp"
+#include "flashPartition.hpp"
+#include "stdint-gcc.h"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+/**
+ * @brief A circular log of variable sized records over a fixed set of blocks, the oldest block is erased ahead of the head
+ * @note  Each block starts with a header holding its sequence number, which goes up by one per block. The blocks of the ring are
+ *        written in order, so after a reboot the head is found by a binary search over the block headers instead of a scan, and the
+ *        write offset within the head block comes from the block table (recovered by the mount if it was not saved). The appends after
+ *        a mount start a new block, so that they never follow a record cut short by a power loss. That new block erases one more block
+ *        ahead: the head may hold nothing but a cut short record, so the ring keeps two blocks behind the head for the synced records
+ * @note  A record is `[length:2][~length:2]` followed by the payload, records up to a page never cross a page boundary. The appends
+ *        go through a `PageWriter`, a page is programmed when it is full or on `sync`, so only the synced records survive a power cut
+ * @note  The bad blocks of the ring keep their place and sequence number but are stepped over, they are never erased and take no record.
+ *        The ring keeps a page buffer of the `Manager`'s pool while it is mounted, two while a full page waits for the chip
+ * @tparam GEOMETRY: the `NandGeometry` of the chip
+ */
+template <typename GEOMETRY = DefaultGeometry>
+class RingLog
+{
+   public:
+    using Geometry = GEOMETRY;
+
+    static constexpr uint32_t BLOCK_HEADER_SIZE  = 8;
+    static constexpr uint32_t RECORD_HEADER_SIZE = 4;
+    static constexpr uint8_t PAGE_PROGRAMS       = FLASH_FS_PAGE_PROGRAMS;
+    /// the largest payload, a record cannot span two blocks
+    static constexpr uint32_t MAX_RECORD_SIZE = Geometry::BLOCK_SIZE_BYTE - BLOCK_HEADER_SIZE - RECORD_HEADER_SIZE;
+
+    /**
+     * @brief Where a record is, the block is named by its sequence number so that a cursor overtaken by the tail can be detected
+     */
+    struct Cursor
+    {
+        uint32_t sequence;
+        uint32_t offset;
+    };
+
+    struct Stats
+    {
+        uint32_t appends;
+        uint32_t blockSwitches;
+        uint32_t erasesAhead;   ///< blocks erased in front of the head, each one dropped the oldest block of the log
+        uint32_t mountProbes;   ///< block headers read by the last `mount`
+        uint32_t skippedReads;  ///< times a reader was overtaken by the tail and moved to the oldest record
+        uint32_t paddedPages;   ///< pages left partly blank by `sync` once they had taken `PAGE_PROGRAMS` programs
+    };
+
+    /**
+     * @param manager: the manager of the chip
+     * @param firstBlock: the first chip block of the ring
+     * @param blockCount: the number of blocks of the ring, at least `eraseAhead + 3` of them good
+     * @param eraseAhead: the number of erased blocks kept in front of the head
+     */
+    RingLog(Manager<GEOMETRY> &manager, uint16_t firstBlock, uint16_t blockCount, uint8_t eraseAhead = 1);
+    /**
+     * @brief A ring over all the blocks of a partition
+     */
+    RingLog(Partition<GEOMETRY> &partition, uint8_t eraseAhead = 1)
+        : RingLog(partition.manager(), partition.chipBlock(0), partition.blockCount(), eraseAhead)
+    {
+    }
+
+    /**
+     * @brief Find the head and the tail of the log, or start a new one on blank blocks
+     * @note  the head moves to a new block, which erases the oldest block once the ring is full
+     */
+    State mount();
+    /**
+     * @brief Add a record after the head, O(1): the record is copied into the page being assembled
+     */
+    State append(const uint8_t *data, uint16_t size);
+    /**
+     * @brief Program the records not written yet so that they survive a power cut and can be read back
+     * @note  each sync is one more partial program of the last page, after `PAGE_PROGRAMS` of them (the NOP of the chip) the rest of the
+     *        page is left blank
+     */
+    State sync();
+    /**
+     * @brief Sync and give the page buffers back
+     */
+    State unmount();
+
+    /// the oldest record
+    Cursor begin() const { return Cursor{tailSeq, BLOCK_HEADER_SIZE}; }
+    /**
+     * @brief Read the record at `cursor` and move the cursor to the next one
+     * @param length: the size of the payload, 0 when there is no record left (the cursor stays where it is)
+     * @return `NO_BUFFER` if the payload does not fit in `capacity`
+     */
+    State read(Cursor &cursor, uint8_t *buffer, uint16_t capacity, uint16_t &length);
+
+    bool isMounted() const { return mounted; }
+    uint32_t headSequence() const { return headSeq; }
+    uint32_t tailSequence() const { return tailSeq; }
+    const Stats &stats() const { return counters; }
+
+   private:
+    static constexpr uint32_t MAGIC = 0x474F4C52;  // "RLOG"
+
+    Manager<GEOMETRY> &flash;
+    PageWriter<GEOMETRY> writer;
+    const uint16_t first;
+    const uint16_t count;
+    const uint8_t ahead;
+    bool mounted;
+    uint16_t head;  // the index of the head block in the ring
+    uint32_t headSeq;
+    uint32_t tailSeq;
+    uint16_t syncPage;  // the page of the write offset at the last sync
+    uint8_t programs;   // the programs that page has taken
+    Stats counters;
+
+    uint16_t chipBlock(uint16_t index) const { return first + index; }
+    /// whether the block at `index` can hold records, a bad block is stepped over
+    bool isGood(uint16_t index) const { return flash.blocks[chipBlock(index)].isUsable(); }
+    /// the ring index of the block holding `sequence`
+    uint16_t indexOf(uint32_t sequence) const { return (head + count - (headSeq - sequence) % count) % count; }
+    /// read the header of the block at `index`, `written` is false if it has no valid header
+    State probe(uint16_t index, bool &written, uint32_t &sequence);
+    /// move the head to the next good block, erasing the block `ahead` blocks in front of it
+    State advance();
+    /// erase the block at `index` unless it is already blank or bad
+    State eraseIfUsed(uint16_t index);
+    /// open the writer on the head block, writing its header if it is new
+    State openHead(bool isNew);
+    /// where a record of `total` bytes starting at or after `offset` would go, records up to a page stay within one page
+    static uint32_t placeRecord(uint32_t offset, uint32_t total);
+};
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
@@ -0,0 +1,121 @@
+#pragma once
+#include "AppConfig.h"
+#include "FreeRTOS.h"
+#include "main.h"
+#include "task.h"
+#include "stdint-gcc.h"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+/**
+ * @brief Fits the flash bus operations into the slack between two ticks of a control loop timer
+ * @note  The timer's update interrupt calls `onTick`, which timestamps the tick with the DWT cycle counter and records how late the interrupt ran.
+ *        Before each bus operation the `Manager` asks `fits` whether the operation's worst case footprint (the time the bus, the QSPI/DMA
+ *        interrupts and the critical sections can hold off the control interrupts) ends before the next tick, and waits for the next window
+ *        otherwise. The chip's own busy time (tPROG, tBERS) does not count, the manager waits for it outside of the critical sections
+ * @note  The timer is assumed to be clocked at the core clock (APB prescaler of 1), as TIM16 and TIM20 are in this project
+ */
+class ControlTickScheduler
+{
+   public:
+    /**
+     * @brief The bus operations the scheduler knows the cost of
+     */
+    enum class Operation : uint8_t
+    {
+        READ    = 0,  ///< `PAGE_DATA_READ` (tRD with ECC) and the transfer of one page
+        PROGRAM = 1,  ///< The load of one page and `PROGRAM_EXECUTE`
+        ERASE   = 2,  ///< `BLOCK_ERASE`
+        COUNT
+    };
+
+    /**
+     * @brief How late the control interrupt runs after its timer update event
+     */
+    struct JitterStats
+    {
+        uint32_t ticks;           ///< ticks recorded
+        uint32_t minLatency_us;   ///< shortest delay between the update event and the interrupt
+        uint32_t maxLatency_us;   ///< longest delay between the update event and the interrupt
+        uint32_t sumLatency_us;   ///< for the mean latency
+        uint32_t missedTicks;     ///< periods longer than 1.5 times the nominal period
+        uint32_t histogram[8];    ///< latency buckets of `[0, 1) [1, 2) [2, 4) [4, 8) ... [64, inf)` microseconds
+        uint32_t windowsUsed;     ///< operations issued within the slack
+        uint32_t deferrals;       ///< times an operation had to wait for the next window
+        uint32_t staleFallbacks;  ///< operations issued without a window because the ticks stopped
+    };
+
+    /**
+     * @param timer: the control loop timer, its update interrupt must call `onTick`
+     */
+    explicit ControlTickScheduler(TIM_HandleTypeDef *timer);
+
+    /**
+     * @brief Record a control tick, to be called first thing in the timer's update interrupt
+     */
+    void onTick();
+
+    /**
+     * @brief Checks if `op` can be issued now and end before the next tick
+     * @note  always `true` while the scheduler is disabled, or when no tick has been seen for two periods (the timer is stopped)
+     */
+    bool fits(Operation op) const;
+    /**
+     * @brief Block the calling task until `op` fits, counting the window, the deferral or the fallback in the statistics
+     * @note  the task sleeps until `onTick` wakes it at the start of the next window, the other tasks of any priority run meanwhile. One
+     *        task is woken by the tick, another task waiting at the same time checks again every RTOS tick
+     * @note  returns at once before the RTOS scheduler runs, there is no task to block then
+     */
+    void waitForWindow(Operation op);
+    /**
+     * @brief The time left until the next tick minus the guard time, 0 when the tick is due or late
+     */
+    uint32_t slack_us() const;
+
+    /**
+     * @brief Set the worst case footprint of an operation, an operation longer than the usable window is issued right after a tick
+     */
+    void setCost(Operation op, uint32_t cost_us) { cost[static_cast<uint8_t>(op)] = cost_us; }
+    uint32_t getCost(Operation op) const { return cost[static_cast<uint8_t>(op)]; }
+    /**
+     * @brief Set the margin kept before the next tick, it covers the work the control interrupt does at its start
+     */
+    void setGuard(uint32_t guard_us) { guard = guard_us; }
+    /**
+     * @brief Turn the gating on or off, the jitter statistics are recorded either way so that both modes can be compared
+     */
+    void setEnabled(bool enable) { enabled = enable; }
+    bool isEnabled() const { return enabled; }
+
+    const JitterStats &stats() const { return jitter; }
+    void resetStats();
+
+   private:
+    TIM_HandleTypeDef *htim;
+    volatile uint32_t lastTick;  // DWT cycle count of the last update event
+    volatile bool hasTicked;
+    volatile TaskHandle_t waiter;  // the task blocked in `waitForWindow`, woken by `onTick`
+    uint32_t cost[static_cast<uint8_t>(Operation::COUNT)];
+    uint32_t guard;
+    bool enabled;
+    JitterStats jitter;
+
+    /// read every time, the scheduler may be constructed before the clock is configured
+    static uint32_t cyclesPerUs() { return SystemCoreClock / 1000000; }
+    /// checks if no tick has been seen for two periods
+    bool isStale() const;
+    /// the timer period in core clock cycles, read from the timer so that it follows reconfigurations
+    uint32_t periodCycles() const { return (htim->Instance->ARR + 1) * (htim->Instance->PSC + 1); }
+};
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
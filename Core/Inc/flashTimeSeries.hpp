@@ -0,0 +1,307 @@
+#pragma once
+#include "AppConfig.h"
+#include "flash.hpp"
+#include "flashDeltaCodec.hpp"
+#include "flashPageWriter.hpp"
+#include "flashPartition.hpp"
+#include "stdint-gcc.h"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+/**
+ * @brief A circular log of fixed layout telemetry records stamped with a monotonic time, which can be read back from any time with one
+ *        binary search and a couple of page reads instead of a scan from the start
+ * @note  A page holds a header `[magic][schema][block sequence][first time][last time][count][record size][crc]` followed by the records
+ *        `[time:4][record]`. The last page of each block is an index holding the first time of each of its data pages, and the first time
+ *        of each block is kept in RAM. A `seek` picks the block in RAM, the page in the index and the record in the page
+ * @note  The times are in the unit of the caller (ticks, milliseconds or microseconds), they must not go down. The blocks are written in
+ *        order like a `RingLog`, the block after the head is erased ahead and the oldest block is dropped when the ring is full. The appends
+ *        after a mount start a new block, so a mount may drop the oldest block, and a block closed by a mount has no index, its pages
+ *        are found through their headers. The bad blocks of the ring keep their place and sequence number but are stepped over, they
+ *        are never erased
+ * @note  The records go through a `PageWriter`, so a page is only readable once it is programmed: when it is full or on `sync`. The log keeps
+ *        a page buffer of the `Manager`'s pool while it is mounted (two while a full page waits for the chip), and each `Cursor` keeps one
+ *        while it is in use
+ * @note  The zone maps are the min and max of up to `MAX_FIELDS` numeric fields of the schema, per page after the page header and per
+ *        block and page in the index page. A `scan` reads the index of a block, or the header of a page, and skips the blocks and pages
+ *        whose range cannot match its `Filter`
+ * @note  With `Schema::codecTypes` the records are coded by a `DeltaCodec` instead of stored as they are, each page starts with a
+ *        keyframe so that it is decoded on its own. A page then holds as many records as their codes fit, and is checked whole
+ * @tparam GEOMETRY: the `NandGeometry` of the chip
+ */
+template <typename GEOMETRY = DefaultGeometry>
+class TimeSeriesLog
+{
+   public:
+    using Geometry = GEOMETRY;
+
+    static constexpr uint32_t PAGE_HEADER_SIZE = 28;
+    /// the pages of a block holding records, the last one is the index of the block
+    static constexpr uint16_t DATA_PAGES = Geometry::PAGE_PER_BLOCK - 1;
+    static constexpr uint16_t MAX_BLOCKS = FLASH_TS_MAX_BLOCKS;
+    static constexpr uint8_t MAX_FIELDS  = FLASH_TS_ZONE_FIELDS;
+
+    /**
+     * @brief A field of the record summarised by the zone maps
+     */
+    struct Field
+    {
+        uint16_t offset;  ///< in the record, after the time
+        FieldType type;
+    };
+
+    /**
+     * @brief The layout of the records, the pages written with another layout are not read back
+     */
+    struct Schema
+    {
+        uint32_t id;          ///< any number naming the layout, e.g. a hash of the field list
+        uint16_t recordSize;  ///< the bytes after the time of each record
+        uint8_t fieldCount;   ///< the fields with a zone map, 0 for none
+        Field fields[MAX_FIELDS];
+        const FieldType *codecTypes;  ///< the types of all the fields of the record for the delta coding, `nullptr` to store it as is
+        uint8_t codecFieldCount;
+        uint16_t keyframeInterval;    ///< the coded records between two keyframes, 0 for a keyframe at the start of each page only
+    };
+
+    /**
+     * @brief The records of a `scan`: field `field` of the schema is within [`low`, `high`], both given as `key`s
+     */
+    struct Filter
+    {
+        uint8_t field;
+        uint32_t low;
+        uint32_t high;
+    };
+
+    /**
+     * @brief A read position, it keeps the page it reads from, so it must be given back with `release` or by going out of scope
+     */
+    class Cursor
+    {
+       public:
+        Cursor() : sequence(0), page(0), record(0), count(0), loaded(false), offset(0), history(), masked(false), maskSequence(0), skip(0), filter()
+        {
+        }
+        void release()
+        {
+            lease.release();
+            loaded = false;
+        }
+
+       private:
+        friend class TimeSeriesLog;
+
+        typename Manager<GEOMETRY>::PagePool::Lease lease;  // the page being read
+        uint32_t sequence;
+        uint16_t page;
+        uint16_t record;  // the next record of the page
+        uint16_t count;   // the records of the page
+        bool loaded;
+        uint16_t offset;              // the code of the next record in a coded page
+        DeltaCodec::History history;  // the record before it
+
+        /* the pages of block `maskSequence` that cannot match `filter`, from its index page */
+        bool masked;
+        uint32_t maskSequence;
+        uint64_t skip;
+        Filter filter;
+    };
+
+    struct Stats
+    {
+        uint32_t appends;
+        uint32_t pages;
+        uint32_t recordBytes;   ///< bytes of the records in the pages, after the coding
+        uint32_t seeks;
+        uint32_t seekReads;     ///< pages, index pages and page headers read by the seeks
+        uint32_t skippedReads;  ///< times a cursor was overtaken by the tail and moved to the oldest record
+        uint32_t zoneReads;     ///< index pages and page headers read by the scans
+        uint32_t pagesSkipped;  ///< pages a scan did not read because of their zone map
+    };
+
+    /**
+     * @param manager: the manager of the chip
+     * @param firstBlock: the first chip block of the ring
+     * @param blockCount: the number of blocks of the ring, from 3 to `MAX_BLOCKS`, at least 3 of them good
+     * @param schema: the layout of the records
+     */
+    TimeSeriesLog(Manager<GEOMETRY> &manager, uint16_t firstBlock, uint16_t blockCount, const Schema &schema);
+    /**
+     * @brief A ring over all the blocks of a partition
+     */
+    TimeSeriesLog(Partition<GEOMETRY> &partition, const Schema &schema)
+        : TimeSeriesLog(partition.manager(), partition.chipBlock(0), partition.blockCount(), schema)
+    {
+    }
+
+    /**
+     * @brief Find the blocks of the log and their first times, and start a new block for the appends
+     * @note  the blocks written with another schema are dropped
+     */
+    State mount();
+    /**
+     * @brief Add a record of `Schema::recordSize` bytes at `time`
+     * @return `PARAM_ERR` if `time` is before the time of the last record
+     */
+    State append(uint32_t time, const void *record);
+    /**
+     * @brief Program the page being assembled, its records can be read back and survive a power loss. The rest of the page is left unused
+     */
+    State sync();
+    /**
+     * @brief Sync and give the page buffers back
+     */
+    State unmount();
+    /**
+     * @brief Drop all the records, e.g. when the clock of the caller starts over
+     */
+    State reset();
+
+    /**
+     * @brief Put `cursor` on the oldest record
+     */
+    void begin(Cursor &cursor) const;
+    /**
+     * @brief Put `cursor` on the first record at or after `time`, or on the oldest record if `time` is before it
+     */
+    State seek(uint32_t time, Cursor &cursor);
+    /**
+     * @brief Read the record at `cursor` and move the cursor to the next one
+     * @param valid: false when there is no record left, the cursor stays where it is
+     */
+    State read(Cursor &cursor, uint32_t &time, void *record, bool &valid);
+    /**
+     * @brief Read the next record at or after `cursor` that matches `filter` and move the cursor after it
+     * @param valid: false when there is no matching record left, the cursor is then at the end of the log
+     */
+    State scan(Cursor &cursor, const Filter &filter, uint32_t &time, void *record, bool &valid);
+
+    /**
+     * @brief The bound of a `Filter` for a value of the type of the field, the keys are in the order of the values
+     */
+    static uint32_t key(int32_t value) { return static_cast<uint32_t>(value) ^ 0x80000000; }
+    static uint32_t key(uint32_t value) { return value; }
+    static uint32_t key(float value);
+
+    bool isMounted() const { return mounted; }
+    bool isEmpty() const { return tailSeq == headSeq && headPages == 0 && filling == nullptr; }
+    /// the time of the last record appended, 0 if there is none
+    uint32_t lastTime() const { return last; }
+    const Schema &schema() const { return layout; }
+    const Stats &stats() const { return counters; }
+
+   private:
+    static constexpr uint32_t MAGIC             = 0x53454954;  // "TIES"
+    static constexpr uint32_t INDEX_MAGIC       = 0x58444E49;  // "INDX"
+    static constexpr uint32_t INDEX_HEADER_SIZE = 16;
+    static constexpr uint16_t CODED_PAGE        = 0x8000;  // in the record size of the page header
+
+    /// the range of the keys of a field over a page or a block
+    struct Zone
+    {
+        uint32_t low;
+        uint32_t high;
+    };
+    static_assert(INDEX_HEADER_SIZE + DATA_PAGES * 4 + (DATA_PAGES + 1) * MAX_FIELDS * sizeof(Zone) <= GEOMETRY::PAGE_SIZE_BYTE,
+                  "the index of a block must fit its last page");
+
+    struct PageHeader
+    {
+        uint32_t magic;
+        uint32_t schema;
+        uint32_t sequence;  ///< of the block
+        uint32_t first;
+        uint32_t last;
+        uint16_t count;
+        uint16_t recordSize;
+        uint32_t crc;  ///< over the header before it, the zones and the records
+    };
+    static_assert(sizeof(PageHeader) == PAGE_HEADER_SIZE, "the page header is stored raw");
+
+    struct IndexHeader
+    {
+        uint32_t magic;
+        uint32_t sequence;
+        uint32_t pages;
+        uint32_t crc;  ///< over the header before it, the first times and the zones
+    };
+    static_assert(sizeof(IndexHeader) == INDEX_HEADER_SIZE, "the index header is stored raw");
+
+    Manager<GEOMETRY> &flash;
+    PageWriter<GEOMETRY> writer;
+    const uint16_t first;
+    const uint16_t count;
+    const Schema layout;
+    const uint16_t recordsPerPage;  // the records of a page, at most for a coded page
+    const DeltaCodec codec;
+    bool mounted;
+    uint16_t head;  // the index of the head block in the ring
+    uint32_t headSeq;
+    uint32_t tailSeq;
+    uint32_t last;
+    uint32_t blockFirst[FLASH_TS_MAX_BLOCKS];  // the first time of each block, by ring index
+    uint32_t pageFirst[DATA_PAGES];            // the first time of each page of the head block
+    Zone pageZones[DATA_PAGES][MAX_FIELDS];    // the zones of each page of the head block
+    Zone blockZones[MAX_FIELDS];               // the zones of the head block
+    uint16_t headPages;                        // the pages of the head block handed to the writer
+    uint8_t *filling;                          // the page being assembled, `nullptr` if none
+    uint16_t fillOffset;                       // the bytes of its records, if they are coded
+    DeltaCodec::History history;               // the coding of its last record
+    Stats counters;
+
+    uint16_t chipBlock(uint16_t index) const { return first + index; }
+    /// whether the block at `index` can hold pages, a bad block is stepped over
+    bool isGood(uint16_t index) const { return flash.blocks[chipBlock(index)].isUsable(); }
+    uint16_t indexOf(uint32_t sequence) const { return (head + count - (headSeq - sequence) % count) % count; }
+    uint32_t recordSize() const { return 4 + layout.recordSize; }
+    bool isCoded() const { return layout.codecTypes != nullptr; }
+    /// the record size in the page headers, the coded pages are not read with another schema
+    uint16_t storedSize() const { return layout.recordSize | (isCoded() ? CODED_PAGE : 0); }
+    /// the bytes after the header checked by the CRC of a page of `records` records, up to the end of the page if they are coded
+    uint32_t checkedSize(uint16_t records) const
+    {
+        return isCoded() ? Geometry::PAGE_SIZE_BYTE - PAGE_HEADER_SIZE : recordStart() - PAGE_HEADER_SIZE + records * recordSize();
+    }
+    static uint16_t pageCapacity(const Schema &schema);
+    /// the zones of a page are after its header, then come the records
+    uint32_t recordStart() const { return PAGE_HEADER_SIZE + layout.fieldCount * sizeof(Zone); }
+    /// the index header, the first times, the zones of the block and the zones of each page
+    uint32_t indexSize() const { return INDEX_HEADER_SIZE + DATA_PAGES * 4 + (DATA_PAGES + 1) * layout.fieldCount * sizeof(Zone); }
+    /// the key of field `field` of `record`
+    uint32_t keyOf(uint8_t field, const uint8_t *record) const;
+    /// the pages of the head block that are programmed and can be read
+    uint16_t readablePages() const { return flash.blocks[chipBlock(head)].writeOffset() >> Geometry::BYTE_BITS; }
+    /// read the header of the first page of the block at `index`, `written` is false if it holds no page of this schema
+    State probe(uint16_t index, bool &written, uint32_t &sequence, uint32_t &firstTime);
+    /// write the header of the page being assembled and hand it to the writer
+    void finishPage();
+    /// write the index page of the head block and move the head to the next block
+    State closeBlock();
+    /// move the head to the next good block, erasing it and the block after it
+    State advance();
+    /// erase the block at `index` unless it is already blank or bad
+    State eraseIfUsed(uint16_t index);
+    /// the page of the block `sequence` whose first time is the last one at or before `time`, `scratch` takes the index page
+    State findPage(uint32_t sequence, uint32_t time, uint16_t &page, uint8_t *scratch);
+    /// read page `page` of the block `sequence` into the cursor, `valid` is false if it is not a page of the block
+    State load(Cursor &cursor, bool &valid);
+    /// decode the record at the cursor of a coded page into `record`, or skip it if `record` is `nullptr`
+    State decodeNext(Cursor &cursor, uint32_t &time, uint8_t *record);
+    /// the records of `read` and `scan`, `filter` is `nullptr` for all of them
+    State next(Cursor &cursor, const Filter *filter, uint32_t &time, void *record, bool &valid);
+    /// whether the page at `cursor` cannot match `filter` according to the index of its block or its header
+    State skipPage(Cursor &cursor, const Filter &filter, bool &skip);
+};
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
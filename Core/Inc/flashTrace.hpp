@@ -0,0 +1,102 @@
+#pragma once
+#include <cstring>
+
+#include "AppConfig.h"
+#include "flashIngestRing.hpp"
+#include "flashTraceFormats.h"
+#include "stdint-gcc.h"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+/**
+ * @brief A binary trace log with the formatting deferred to the host
+ * @note  A trace records the ID of its format string (see `flashTraceFormats.h`), the DWT cycle counter and its arguments as raw 32 bit
+ *        words, a few stores into the `IngestRing` instead of the thousands of cycles of `printf`. The ring is drained to flash by the
+ *        writer task with the other producers, the host reads the records back and formats them with the same table
+ * @note  A record is the payload of a ring record of a trace producer: `[id:2][cycles:4][args:4*n]`, the number of arguments follows
+ *        from the length. `FLASH_TRACE_TEXT` records hold text instead of words, stdout when `FLASH_TRACE_STDOUT` is set
+ * @note  The traces may come from any task or ISR. The ring wants one context per producer id, so the traces of the ISRs go under a
+ *        producer id of their own and those of the tasks under another one. The tasks, or ISRs of different priorities, still share an
+ *        id between them, the counters of that id are then only approximate. The cycle counter wraps every 25 s at 170 MHz, the host
+ *        unwraps it along the records
+ */
+class TraceLog
+{
+   public:
+    static constexpr uint8_t MAX_ARGS = FLASH_TRACE_MAX_ARGS;
+    static constexpr uint8_t HEADER   = 6;  // the bytes of the id and of the cycle count
+
+    /**
+     * @param target: the ring drained to flash by the writer task
+     * @param taskId: the producer id of the traces from the tasks
+     * @param isrId: the producer id of the traces from the ISRs, another one than `taskId`
+     */
+    TraceLog(IngestRing &target, uint8_t taskId, uint8_t isrId);
+
+    /**
+     * @brief Make this log the one of `flashTrace` and of stdout
+     */
+    void attach() { global = this; }
+    static TraceLog *attached() { return global; }
+
+    /**
+     * @brief Record the format `id` with `args`, integers, floats or pointers
+     * @return false if the record is dropped
+     */
+    template <typename... ARGS>
+    bool log(uint16_t id, ARGS... args)
+    {
+        static_assert(sizeof...(ARGS) <= MAX_ARGS, "too many arguments for a trace record");
+        const uint32_t words[sizeof...(ARGS) + 1] = {word(args)..., 0};
+        return record(id, words, sizeof...(ARGS));
+    }
+    /**
+     * @brief Record `count` argument words for the format `id`
+     */
+    bool record(uint16_t id, const uint32_t *args, uint8_t count);
+    /**
+     * @brief Record `length` bytes of text as `FLASH_TRACE_TEXT` records, split if they do not fit in one
+     * @return false if a part is dropped
+     */
+    bool text(const char *data, uint32_t length);
+
+   private:
+    IngestRing &ring;
+    uint8_t taskProducer;
+    uint8_t isrProducer;
+
+    static TraceLog *global;
+
+    /// the producer id of the context running the trace
+    uint8_t producer() const;
+
+    static uint32_t word(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+    static uint32_t word(double value) { return word(static_cast<float>(value)); }
+    template <typename T>
+    static uint32_t word(T *pointer)
+    {
+        return reinterpret_cast<uintptr_t>(pointer);
+    }
+    template <typename T>
+    static uint32_t word(T value)
+    {
+        return static_cast<uint32_t>(value);
+    }
+};
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
@@ -0,0 +1,47 @@
+/**
+ * @file flashTraceFormats.h
+ * @brief The format strings of the binary trace log, shared by the firmware and the host decoder
+ * @note  Each entry is `X(ID, "format")`, the ID of a format is its position in the list. The list is only ever appended to, so that the
+ *        logs written by an older firmware can still be decoded. The arguments of a format are 32 bit words: `%d`, `%u`, `%x` and `%c`
+ *        for the integers, `%f` for the floats (stored as float, not double), `%p` for the addresses. `%s` is only valid for
+ *        `FLASH_TRACE_TEXT`, which holds the text itself
+ */
+#ifndef __FLASH_TRACE_FORMATS_H__
+#define __FLASH_TRACE_FORMATS_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* clang-format off */
+#define FLASH_TRACE_FORMATS(X)                                         \
+    X(FLASH_TRACE_TEXT,      "%s")                                     \
+    X(FLASH_TRACE_BOOT,      "boot, reset flags 0x%08x")               \
+    X(FLASH_TRACE_ECC,       "flash: ECC error in block %u page %u")   \
+    X(FLASH_TRACE_BAD_BLOCK, "flash: block %u retired")                \
+    X(FLASH_TRACE_DROPPED,   "ingest: producer %u dropped %u records")
+/* clang-format on */
+
+#define FLASH_TRACE_ID(id, format) id,
+typedef enum
+{
+    FLASH_TRACE_FORMATS(FLASH_TRACE_ID) FLASH_TRACE_COUNT
+} FlashTraceId;
+#undef FLASH_TRACE_ID
+
+/* The table of the format strings, kept in the image for the host decoder */
+extern const char *const flashTraceFormats[FLASH_TRACE_COUNT];
+
+/**
+ * @brief Record `count` argument words for the format `id` in the trace log, for the C sources
+ * @return 0 if the record is dropped or no trace log is attached
+ */
+int flashTrace(uint16_t id, const uint32_t *args, uint8_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FLASH_TRACE_FORMATS_H__ */
@@ -46,14 +46,18 @@ extern "C" {
 
 /* Exported macro ------------------------------------------------------------*/
 /* USER CODE BEGIN EM */
-
+/* Place a function / variable into the zero wait state CCM SRAM (see `.ccmram` in the linker script).
+   The DMA can reach it, but it is kept for the CPU: a DMA buffer there would stall the code fetched from it, keep them in SRAM1 */
+#define CCMRAM_FUNC __attribute__((section(".ccmram.text"), noinline))
+#define CCMRAM_DATA __attribute__((section(".ccmram.data")))
 /* USER CODE END EM */
 
 /* Exported functions prototypes ---------------------------------------------*/
 void Error_Handler(void);
 
 /* USER CODE BEGIN EFP */
-
+/* Timestamps the control tick for the flash scheduler, called from the TIM16 update interrupt */
+void flashControlTick(void);
 /* USER CODE END EFP */
 
 /* Private defines -----------------------------------------------------------*/
@@ -41,7 +41,7 @@ extern QSPI_HandleTypeDef hqspi1;
 void MX_QUADSPI1_Init(void);
 
 /* USER CODE BEGIN Prototypes */
-    HAL_StatusTypeDef BufferCommand(uint16_t pageAddr, uint16_t command);
+    HAL_StatusTypeDef BufferCommand(uint32_t pageAddr, uint16_t command);
 
     HAL_StatusTypeDef PureCommand(uint16_t command);
 
@@ -73,6 +73,8 @@ void TIM7_DAC_IRQHandler(void);
 void DMA2_Channel1_IRQHandler(void);
 void DMA2_Channel2_IRQHandler(void);
 void DMA2_Channel3_IRQHandler(void);
+void DMA2_Channel4_IRQHandler(void);
+void DMA2_Channel5_IRQHandler(void);
 void FDCAN2_IT0_IRQHandler(void);
 void FDCAN2_IT1_IRQHandler(void);
 void FDCAN3_IT0_IRQHandler(void);
@@ -13,17 +13,19 @@
 #include "gpio.h"
 #include "main.h"
 #include "task.h"
+#include "tim.h"
 
 using namespace Core::Drivers;
 
-W25N01::Manager flash;
+W25N01::Manager<> flash;
+W25N01::ControlTickScheduler flashScheduler(&htim16);
 uint8_t buffer[2050];
 uint16_t t_byte = 0, t_page = 0, t_block = 0;
 uint8_t hmm[2050];
 int test      = 0;
 int change    = 0;
 uint32_t bruh = 0;
-W25N01::Manager::State someError;
+W25N01::State someError;
 int trigger = 0;
 int read = 0, write = 0, erase = 0;
 int test1, test2;
@@ -122,7 +124,7 @@ void eraseTask(void *pvPara)
             {
                 continue;
             }
-            flash.EraseRange_WithinBlock(W25N01::calcAddress(t_block, t_page, t_byte + 2045), W25N01::calcAddress(t_block, t_page + 1, t_byte + 10));
+            flash.StartEraseRange(W25N01::calcAddress(t_block, t_page, t_byte + 2045), W25N01::calcAddress(t_block, t_page + 1, t_byte + 10));
 
             erase = 0;
         }
@@ -131,6 +133,26 @@ void eraseTask(void *pvPara)
     }
 }
 
+/**
+ * @brief The flash operations are fitted between the ticks of the TIM16 control loop
+ */
+extern "C" void flashControlTick(void) { flashScheduler.onTick(); }
+
+/**
+ * @brief Advance the long flash operations (format, range erase, bad block scan) 1 ms at a time
+ * @note  the bus operations are only fitted into the control loop slack from here on, the boot time format runs before the kernel
+ */
+void flashJobTask(void *pvPara)
+{
+    flash.setScheduler(&flashScheduler);
+    HAL_TIM_Base_Start_IT(&htim16);
+    while (true)
+    {
+        flash.Step(1000);
+        vTaskDelay(1);
+    }
+}
+
 /**
  * @brief Create user tasks
  */
@@ -142,12 +164,15 @@ StackType_t uxWriteTaskStack[configMINIMAL_STACK_SIZE];
 StaticTask_t xWriteTaskTCB;
 StackType_t uxEraseTaskStack[configMINIMAL_STACK_SIZE];
 StaticTask_t xEraseTaskTCB;
+StackType_t uxFlashJobTaskStack[configMINIMAL_STACK_SIZE];
+StaticTask_t xFlashJobTaskTCB;
 void startUserTasks()
 {
     flash.init();
-    flash.EraseChip();
+    flash.Format(W25N01::FormatMode::QUICK);
     // xTaskCreateStatic(blink, "blink", configMINIMAL_STACK_SIZE, NULL, 0, uxBlinkTaskStack, &xBlinkTaskTCB);
     xTaskCreateStatic(readTask, "readTask", configMINIMAL_STACK_SIZE, NULL, 0, uxReadTaskStack, &xReadTaskTCB);
     xTaskCreateStatic(writeTask, "writeTask", configMINIMAL_STACK_SIZE, NULL, 0, uxWriteTaskStack, &xWriteTaskTCB);
     xTaskCreateStatic(eraseTask, "eraseTask", configMINIMAL_STACK_SIZE, NULL, 0, uxEraseTaskStack, &xEraseTaskTCB);
+    xTaskCreateStatic(flashJobTask, "flashJobTask", configMINIMAL_STACK_SIZE, NULL, 0, uxFlashJobTaskStack, &xFlashJobTaskTCB);
 }
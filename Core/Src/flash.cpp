@@ -3,7 +3,6 @@
 #include <cstring>
 
 #include "FreeRTOS.h"
-#include "math.h"
 #include "task.h"
 
 namespace Core
@@ -13,27 +12,26 @@ namespace Drivers
 {
 namespace W25N01
 {
-uint8_t localBuffer[PAGE_SIZE_BYTE];
-
-inline uint16_t Manager::pageAligned_calcAddress(uint16_t block, uint16_t page) const { return block << 6 | page; }
-inline uint32_t calcAddress(uint16_t block, uint16_t page, uint16_t byte) { return (block << 6 | page) << 12 | byte; }
-
 inline uint32_t min(uint32_t a, uint32_t b) { return a < b ? a : b; }
-int lastAddr = 0;
+inline uint32_t max(uint32_t a, uint32_t b) { return a > b ? a : b; }
 
-inline uint32_t ADDR_STORE_START(uint16_t blockNUM)
+/// copy the bytes of `[start, start + size)` of a snapshot that fall into the page at `pageOffset`
+inline void copyIntoPage(uint8_t *page, uint32_t pageOffset, uint32_t pageSize, const uint8_t *source, uint32_t start, uint32_t size)
 {
-    uint16_t byteAddr = blockNUM * 4;
-    uint16_t pageAddr = PAGE_PER_BLOCK - 2;
-    if (byteAddr >= PAGE_SIZE_BYTE)
+    uint32_t from = max(pageOffset, start);
+    uint32_t to   = min(pageOffset + pageSize, start + size);
+    if (from < to)
     {
-        byteAddr = 0;
-        pageAddr += 1;
+        memcpy(page + from - pageOffset, source + from - start, to - from);
     }
-    return (RESERVE_BLOCK_BLOCKADDR << 18) | (pageAddr << 12) | byteAddr;
 }
 
-bool isBusy()
+template <typename GEOMETRY>
+typename Manager<GEOMETRY>::PagePool Manager<GEOMETRY>::pool;
+template <typename GEOMETRY>
+uint8_t Manager<GEOMETRY>::metadataPage[GEOMETRY::PAGE_SIZE_BYTE];
+
+CCMRAM_FUNC bool isBusy()
 {
     uint8_t status;
     StatusReg_Rx(OPCode::READ_STATUS_REG, RegisterAddress::STATUS_REGISTER, &status);
@@ -41,14 +39,16 @@ bool isBusy()
            hqspi1.RxXferCount != 0;
 }
 
-uint32_t Manager::get_JEDECID() const
+template <typename GEOMETRY>
+uint32_t Manager<GEOMETRY>::get_JEDECID() const
 {
     uint8_t buffer[3] = {0};
     Command_Rx_1DataLine(OPCode::JEDEC_ID, buffer, 3, 8);
     return (buffer[0] << 16) | (buffer[1] << 8) | buffer[2];
 }
 
-Manager::State Manager::SetWritePin(bool state) const
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::SetWritePin(bool state) const
 {
     if (!isInited)
     {
@@ -70,7 +70,8 @@ Manager::State Manager::SetWritePin(bool state) const
     return WriteDisable();
 }
 
-Manager::State Manager::WriteEnable() const
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::WriteEnable() const
 {
     while (isBusy())
         ;
@@ -82,7 +83,8 @@ Manager::State Manager::WriteEnable() const
     return State::OK;
 }
 
-Manager::State Manager::WriteDisable() const
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::WriteDisable() const
 {
     while (isBusy())
         ;
@@ -93,7 +95,8 @@ Manager::State Manager::WriteDisable() const
     return State::OK;
 }
 
-Manager::State Manager::SetBufferMode(bool state) const
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::SetBufferMode(bool state) const
 {
     while (isBusy())
         ;
@@ -121,15 +124,21 @@ Manager::State Manager::SetBufferMode(bool state) const
     return State::OK;
 }
 
-Manager::Manager(uint16_t subsec) : subsections(subsec), reservedBlock(RESERVE_BLOCK_BLOCKADDR), kernelMode(false), isInited(false)
+template <typename GEOMETRY>
+Manager<GEOMETRY>::Manager(uint16_t subsec)
+    : subsections(subsec), partitionCursor(), reservedBlock(Geometry::RESERVE_BLOCK_BLOCKADDR), kernelMode(false), isInited(false), metadataSequence(0),
+      metadataSlot(0), erased(FLASH_ERASED_POOL_LOW_WATERMARK), refillCursor(0), refillBlock(-1), scheduler(nullptr),
+      defaultDurability(Durability::SYNC), groupInterval_ms(100), groupBytes(16 * Geometry::PAGE_SIZE_BYTE), groupPending(false), groupSince(0), commits()
 {
-    for (unsigned int i = 0; i < BLOCK_COUNT; i++)
-    {
-        nextAddr[i] = 0;
-    }
+    job.kind   = JobKind::NONE;
+    job.status = JobStatus::IDLE;
+    job.result = State::OK;
+    job.done   = 0;
+    job.total  = 0;
 }
 
-Manager::State Manager::init()
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::init()
 {
     if (PureCommand(OPCode::DEVICE_RESET) != HAL_OK)
     {
@@ -145,55 +154,48 @@ Manager::State Manager::init()
         return State::QSPI_ERR;
     }
 
-    if (get_JEDECID() != JEDECID_EXEPECTED)
+    if (get_JEDECID() != Geometry::JEDEC_ID)
     {
         return State::QSPI_ERR;
     }
-    isInited = true;
-    State state;
-    uint8_t buffer[4] = {0};
-    setKernelMode(true);
-    for (int i = 0; i < BLOCK_COUNT - 1; i++)
+    Deadline::startCycleCounter();
+    isInited    = true;
+    State state = loadAddr();
+    if (state != State::OK || partitions.count() != 0 || subsections <= 1)
     {
-        state = ReadMemory(ADDR_STORE_START(i), buffer, 4);
-        if (state != State::OK)
-        {
-            i--;
-            continue;
-        }
-        if (buffer[0] == 0xFF)
-        {
-            nextAddr[i] = 0;
-            continue;
-        }
-        nextAddr[i] = buffer[0] << 24 | buffer[1] << 16 | buffer[2] << 8 | buffer[3];
+        return state;
     }
-    setKernelMode(false);
-    return State::OK;
+
+    /* a chip without a partition table, divided as asked in the constructor */
+    PartitionPolicy policy = {Allocation::SEQUENTIAL, Reclaim::ON_DEMAND, Durability::DEFAULT};
+    char name[]            = "part0";
+    for (int i = 0; i < subsections && i < PartitionTable::MAX_PARTITIONS; i++)
+    {
+        name[4] = '0' + i;
+        partitions.add(name, Geometry::USER_BLOCK_COUNT / subsections, policy);
+    }
+    return saveAddr();
 }
 
-bool Manager::PassLegalCheck(uint16_t block, uint16_t size, uint16_t &allowedSize) const
+template <typename GEOMETRY>
+bool Manager<GEOMETRY>::PassLegalCheck(uint16_t block, uint16_t size, uint16_t &allowedSize) const
 {
     allowedSize = size;
-    if (block >= BLOCK_COUNT || (block == reservedBlock && !kernelMode))
+    if (block >= Geometry::BLOCK_COUNT || !blocks[block].isUsable())
     {
         return false;
     }
-    uint16_t curPage = pageAddrFilter(nextAddr[block]);
-    uint16_t curByte = byteAddrFilter(nextAddr[block]);
-    if (curByte + size >= PAGE_SIZE_BYTE)
+    uint32_t curOffset = blocks[block].writeOffset();
+    if (curOffset + size > Geometry::BLOCK_SIZE_BYTE)
     {
-        allowedSize             = PAGE_SIZE_BYTE - curByte;
-        uint16_t numPagesNeeded = std::ceil(((float)size - allowedSize) / ((float)PAGE_SIZE_BYTE));
-        if (curPage + numPagesNeeded >= PAGE_PER_BLOCK)
-        {
-            return false;
-        }
+        return false;
     }
+    allowedSize = min(size, Geometry::PAGE_SIZE_BYTE - (curOffset & Geometry::BYTE_MASK));
     return true;
 }
 
-Manager::State Manager::WriteStatusReg(RegisterAddress reg_addr, uint8_t data) const
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::WriteStatusReg(RegisterAddress reg_addr, uint8_t data) const
 {
     if (!isInited)
     {
@@ -208,7 +210,8 @@ Manager::State Manager::WriteStatusReg(RegisterAddress reg_addr, uint8_t data) c
     return State::OK;
 }
 
-Manager::State Manager::ReadStatusReg(RegisterAddress reg_addr, uint8_t *buffer) const
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::ReadStatusReg(RegisterAddress reg_addr, uint8_t *buffer) const
 {
     if (!isInited)
     {
@@ -221,69 +224,94 @@ Manager::State Manager::ReadStatusReg(RegisterAddress reg_addr, uint8_t *buffer)
     return State::OK;
 }
 
-Manager::State Manager::WriteMemory(uint16_t curBlock, uint8_t *data, uint16_t size)
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::WriteMemory(uint16_t curBlock, uint8_t *data, uint16_t size, Durability durability)
 {
     if (!isInited)
     {
         return State::OBJECT_NOT_INIT;
     }
-    uint32_t curAddr   = nextAddr[curBlock];
-    uint16_t nextBlock = blockAddrFilter(curAddr);
-
-    if (nextBlock)
+    if (isLocked(curBlock, true))
     {
-        return State::PARAM_ERR;
+        return State::BUSY;
+    }
+    if (eraseIfDirty(curBlock) != State::OK)
+    {
+        return State::QSPI_ERR;
     }
-
-    uint16_t curPage      = pageAddrFilter(curAddr);
-    uint16_t nextByte     = byteAddrFilter(curAddr);
     uint16_t sizeWriteNow = size;
-
     if (!PassLegalCheck(curBlock, size, sizeWriteNow))
     {
         return State::PARAM_ERR;
     }
 
+    uint16_t writtenSize = size;
     while (size)
     {
-        taskENTER_CRITICAL();
-        if (WriteEnable() != State::OK)
+        State state = programRaw(curBlock, blocks[curBlock].writePage(), blocks[curBlock].writeByte(), data, sizeWriteNow);
+        if (state != State::OK)
         {
-            taskEXIT_CRITICAL();
-            return State::QSPI_ERR;
+            return state;
         }
+        blocks.advance(curBlock, sizeWriteNow);
 
-        while (isBusy())
-            ;
-        if (Command_Tx_4DataLine(OPCode::QUAD_LOAD_PROGRAM_DATA, data, nextByte, sizeWriteNow) != HAL_OK)
+        size -= sizeWriteNow;
+        data += sizeWriteNow;
+        sizeWriteNow = min(size, Geometry::PAGE_SIZE_BYTE);
+    }
+
+    return commitWrite(writtenSize, durability);
+}
+
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::commitWrite(uint32_t size, Durability durability)
+{
+    commits.writes++;
+    commits.pendingWrites++;
+    commits.pendingBytes += size;
+
+    switch (durability == Durability::DEFAULT ? defaultDurability : durability)
+    {
+    case Durability::GROUP:
+        if (!groupPending)
         {
-            taskEXIT_CRITICAL();
-            return State::QSPI_ERR;
+            groupPending = true;
+            groupSince   = xTaskGetTickCount();
         }
-
-        while (isBusy())
-            ;
-        if (BufferCommand(pageAligned_calcAddress(curBlock, curPage), OPCode::PROGRAM_EXECUTE) != HAL_OK)
+        if ((groupBytes != 0 && commits.pendingBytes >= groupBytes) || groupWindowOver())
         {
-            taskEXIT_CRITICAL();
-            return State::QSPI_ERR;
+            return saveAddr();
         }
-        incrementAddr(curBlock, sizeWriteNow);
-        taskEXIT_CRITICAL();
+        return State::OK;
+    case Durability::LAZY:
+        return State::OK;
+    default:
+        return saveAddr();
+    }
+}
 
-        size -= sizeWriteNow;
-        data += sizeWriteNow;
+template <typename GEOMETRY>
+bool Manager<GEOMETRY>::groupWindowOver() const
+{
+    return groupPending && groupInterval_ms != 0 && xTaskGetTickCount() - groupSince >= pdMS_TO_TICKS(groupInterval_ms);
+}
 
-        curPage      = pageAddrFilter(nextAddr[curBlock]);
-        nextByte     = byteAddrFilter(nextAddr[curBlock]);
-        sizeWriteNow = min(size, PAGE_SIZE_BYTE - nextByte);
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::Sync()
+{
+    if (!isInited)
+    {
+        return State::OBJECT_NOT_INIT;
     }
-
-    saveAddr();
-    return State::OK;
+    if (commits.pendingWrites == 0)
+    {
+        return State::OK;
+    }
+    return saveAddr();
 }
 
-Manager::State Manager::reWrite_WithinBlock(uint32_t address, uint8_t *data, uint16_t size)
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::reWrite_WithinBlock(uint32_t address, uint8_t *data, uint16_t size)
 {
     if (!isInited)
     {
@@ -293,22 +321,33 @@ Manager::State Manager::reWrite_WithinBlock(uint32_t address, uint8_t *data, uin
     {
         return State::PARAM_ERR;
     }
-    uint16_t curBlock  = blockAddrFilter(address);
-    uint16_t curPage   = pageAddrFilter(address);
-    uint16_t startByte = byteAddrFilter(address);
+    uint16_t curBlock = Geometry::blockOf(address);
+    if (isLocked(curBlock, true))
+    {
+        return State::BUSY;
+    }
+    if (eraseIfDirty(curBlock) != State::OK)
+    {
+        return State::QSPI_ERR;
+    }
+    uint32_t offset = (Geometry::pageOf(address) << Geometry::BYTE_BITS) | Geometry::byteOf(address);
+    uint32_t curEnd = blocks[curBlock].writeOffset();
+    if (curEnd > offset && jobActive())  // the relocation needs the reserved block
+    {
+        return State::BUSY;
+    }
 
-    uint32_t pageByteAddr = calcAddress(0, curPage, startByte);
-    if (nextAddr[curBlock] == pageByteAddr)
+    if (curEnd == offset)
     {
         return WriteMemory(curBlock, data, size);
     }
-    else if (nextAddr[curBlock] < pageByteAddr)
+    else if (curEnd < offset)
     {
-        nextAddr[curBlock] = pageByteAddr;
+        blocks.setWriteOffset(curBlock, offset);
         return WriteMemory(curBlock, data, size);
     }
     State state;
-    state = EraseRange_WithinBlock(address, nextAddr[curBlock]);
+    state = relocate(curBlock, offset, curEnd);
     if (state != State::OK)
     {
         return state;
@@ -318,30 +357,30 @@ Manager::State Manager::reWrite_WithinBlock(uint32_t address, uint8_t *data, uin
     return state;
 }
 
-bool Manager::PassAddressCheck(uint32_t address) const
+template <typename GEOMETRY>
+bool Manager<GEOMETRY>::PassAddressCheck(uint32_t address) const
 {
-    uint16_t curBlock = blockAddrFilter(address);
-    if (curBlock >= BLOCK_COUNT)  // checks if the block number being accessed is outside the range
+    uint16_t curBlock = Geometry::blockOf(address);
+    if (curBlock >= Geometry::BLOCK_COUNT)  // checks if the block number being accessed is outside the range
     {
         return false;
     }
-    if (curBlock == reservedBlock && !kernelMode)  // checks if the block being access is the reserved block
+    if (blocks[curBlock].state() == BlockState::BAD)  // checks if the block has been marked bad
     {
         return false;
     }
-
-    uint16_t curPage = pageAddrFilter(address);
-    if (curPage >= PAGE_PER_BLOCK)  // checks if the page being accessed is out of range
+    if (blocks[curBlock].state() == BlockState::RESERVED && !kernelMode)  // checks if the block is one of the driver's own blocks
     {
         return false;
     }
 
-    uint16_t curByte = byteAddrFilter(address);  // checks if the byte being accessed is out of range
-    if (curByte >= PAGE_SIZE_BYTE)
+    uint16_t curPage = Geometry::pageOf(address);
+    if (curPage >= Geometry::PAGE_PER_BLOCK)  // checks if the page being accessed is out of range
     {
         return false;
     }
-    if (address & 0x800)  // checks if the byte falls under the ECC range
+
+    if (Geometry::isSpare(address))  // checks if the byte falls under the ECC range
     {
         return false;
     }
@@ -349,7 +388,8 @@ bool Manager::PassAddressCheck(uint32_t address) const
     return true;
 }
 
-Manager::State Manager::ReadMemory(uint32_t address, uint8_t *buffer, uint16_t size) const
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::ReadMemory(uint32_t address, uint8_t *buffer, uint16_t size) const
 {
     if (!isInited)
     {
@@ -359,13 +399,24 @@ Manager::State Manager::ReadMemory(uint32_t address, uint8_t *buffer, uint16_t s
     {
         return State::PARAM_ERR;
     }
-    uint16_t curBlock    = blockAddrFilter(address);
-    uint16_t curPage     = pageAddrFilter(address);
-    uint16_t startByte   = byteAddrFilter(address);
-    uint16_t sizeReadNow = min(size, PAGE_SIZE_BYTE - startByte);
+    if (isLocked(Geometry::blockOf(address), false))
+    {
+        return State::BUSY;
+    }
+    return readRaw(address, buffer, size);
+}
+
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::readRaw(uint32_t address, uint8_t *buffer, uint32_t size) const
+{
+    uint16_t curBlock    = Geometry::blockOf(address);
+    uint16_t curPage     = Geometry::pageOf(address);
+    uint16_t startByte   = Geometry::byteOf(address);
+    uint16_t sizeReadNow = min(size, Geometry::PAGE_SIZE_BYTE - startByte);
 
     while (size)
     {
+        waitForSlot(ControlTickScheduler::Operation::READ);
         taskENTER_CRITICAL();
         SetBufferMode(true);
         while (isBusy())
@@ -389,306 +440,1151 @@ Manager::State Manager::ReadMemory(uint32_t address, uint8_t *buffer, uint16_t s
         buffer += sizeReadNow;
 
         curPage += 1;
+        if (curPage == Geometry::PAGE_PER_BLOCK)
+        {
+            curPage = 0;
+            curBlock += 1;
+        }
         startByte   = 0;
-        sizeReadNow = min(size, PAGE_SIZE_BYTE - startByte);
+        sizeReadNow = min(size, Geometry::PAGE_SIZE_BYTE - startByte);
     }
 
+    /* the last transfer is still running on the DMA */
+    while (isBusy())
+        ;
     return State::OK;
 }
 
-Manager::State Manager::EraseBlock(uint32_t blockNUM, bool canSaveAddr)
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::programRaw(uint16_t block, uint16_t page, uint16_t byte, const uint8_t *data, uint16_t size) const
 {
-    if (!isInited)
+    waitForSlot(ControlTickScheduler::Operation::PROGRAM);
+    taskENTER_CRITICAL();
+    if (WriteEnable() != State::OK)
     {
-        return State::OBJECT_NOT_INIT;
+        taskEXIT_CRITICAL();
+        return State::QSPI_ERR;
     }
-    if (blockNUM >= BLOCK_COUNT || (blockNUM == reservedBlock && !kernelMode))
+
+    while (isBusy())
+        ;
+    if (Command_Tx_4DataLine(OPCode::QUAD_LOAD_PROGRAM_DATA, const_cast<uint8_t *>(data), byte, size) != HAL_OK)
     {
-        return State::PARAM_ERR;
+        taskEXIT_CRITICAL();
+        return State::QSPI_ERR;
     }
 
     while (isBusy())
         ;
+    if (BufferCommand(pageAligned_calcAddress(block, page), OPCode::PROGRAM_EXECUTE) != HAL_OK)
+    {
+        taskEXIT_CRITICAL();
+        return State::QSPI_ERR;
+    }
+    taskEXIT_CRITICAL();
+    return State::OK;
+}
 
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::eraseRaw(uint16_t block) const
+{
+    waitForSlot(ControlTickScheduler::Operation::ERASE);
+    taskENTER_CRITICAL();
     if (WriteEnable() != State::OK)
     {
+        taskEXIT_CRITICAL();
+        return State::QSPI_ERR;
+    }
+
+    while (isBusy())
+        ;
+    if (BufferCommand(pageAligned_calcAddress(block, 0), OPCode::BLOCK_ERASE) != HAL_OK)
+    {
+        taskEXIT_CRITICAL();
         return State::QSPI_ERR;
     }
+    taskEXIT_CRITICAL();
+    return State::OK;
+}
 
+template <typename GEOMETRY>
+void Manager<GEOMETRY>::waitForSlot(ControlTickScheduler::Operation op) const
+{
+    if (scheduler == nullptr)
+    {
+        return;
+    }
     while (isBusy())
         ;
+    scheduler->waitForWindow(op);
+}
 
-    if (BufferCommand(pageAligned_calcAddress(blockNUM, 0), OPCode::BLOCK_ERASE) != HAL_OK)
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::readSpare(uint16_t block, uint16_t page, uint8_t *buffer, uint16_t size) const
+{
+    waitForSlot(ControlTickScheduler::Operation::READ);
+    taskENTER_CRITICAL();
+    SetBufferMode(true);
+    while (isBusy())
+        ;
+    if (BufferCommand(pageAligned_calcAddress(block, page), OPCode::PAGE_DATA_READ) != HAL_OK)
     {
+        taskEXIT_CRITICAL();
         return State::QSPI_ERR;
     }
 
-    nextAddr[blockNUM] = 0;
-    if (canSaveAddr)
+    while (isBusy())
+        ;
+    if (Command_Rx_2DataLine(OPCode::FAST_READ_DUAL_OUTPUT, buffer, Geometry::PAGE_SIZE_BYTE, size) != HAL_OK)
     {
-        saveAddr();
+        taskEXIT_CRITICAL();
+        return State::QSPI_ERR;
     }
+    taskEXIT_CRITICAL();
+
+    while (isBusy())
+        ;
     return State::OK;
 }
 
-Manager::State Manager::EraseRange_WithinBlock(uint32_t startAddress, uint32_t endAddress)
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::eraseIfDirty(uint16_t block)
 {
-    if (!isInited)
+    if (block >= Geometry::BLOCK_COUNT || blocks[block].state() != BlockState::DIRTY)
     {
-        return State::OBJECT_NOT_INIT;
+        return State::OK;
     }
-    if (startAddress >= endAddress)
+    State state = eraseRaw(block);
+    if (state != State::OK)
     {
-        return State::PARAM_ERR;
+        return state;
     }
-    if (!PassAddressCheck(startAddress) || !PassAddressCheck(endAddress))
+    blocks.markErased(block);
+    erased.metrics().syncErases++;
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::eraseIfUsed(uint16_t block, bool &wasErased)
+{
+    wasErased = false;
+    if (block >= Geometry::BLOCK_COUNT || !blocks[block].isUsable())
     {
         return State::PARAM_ERR;
     }
-    if (blockAddrFilter(startAddress) != blockAddrFilter(endAddress))
+    BlockState blockState = blocks[block].state();
+    if (blockState == BlockState::FREE || blockState == BlockState::ALLOCATED)
     {
-        return State::PARAM_ERR;
+        return State::OK;
     }
-
-    State state;
-    uint32_t curBlock = blockAddrFilter(startAddress);
-    uint8_t pagesAffected[2];
-    pagesAffected[0] = pageAddrFilter(startAddress);
-    pagesAffected[1] = pageAddrFilter(endAddress);
-
-    state = SetWritePin(true);
-    if (state != State::OK)
+    if (isLocked(block, true))
     {
-        return state;
+        return State::BUSY;
     }
-    setKernelMode(true);
-    state = EraseBlock(RESERVE_BLOCK_BLOCKADDR, false);
+    State state = eraseRaw(block);
     if (state != State::OK)
     {
         return state;
     }
-    uint32_t oldSize = nextAddr[curBlock];
+    blocks.markErased(block);
+    wasErased = true;
+    return State::OK;
+}
 
-    for (uint8_t pageIndex = 0; pageIndex < PAGE_PER_BLOCK; pageIndex++)
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::checkSpare(uint16_t block, uint16_t page, bool &blank, bool &factoryBad) const
+{
+    uint8_t spare[Geometry::SPARE_SIZE_BYTE];
+    State state = readSpare(block, page, spare, sizeof(spare));
+    if (state != State::OK)
     {
-        uint16_t size  = 0;
-        uint16_t start = 0;
-        if (pageIndex == pagesAffected[0] && pageIndex == pagesAffected[1])
-        {
-            size  = byteAddrFilter(startAddress);
-            start = 0;
-            if (size != 0)
-            {
-                state = ReadMemory(calcAddress(curBlock, pageIndex, start), localBuffer, size);
-                if (state != State::OK)
-                {
-                    return state;
-                }
-                state = WriteMemory((uint16_t)RESERVE_BLOCK_BLOCKADDR, localBuffer, size);
-                if (state != State::OK)
-                {
-                    return state;
-                }
-            }
-
-            size  = PAGE_SIZE_BYTE - byteAddrFilter(endAddress);
-            start = byteAddrFilter(endAddress);
-
-            if (size != 0)
-            {
-                state = ReadMemory(calcAddress(curBlock, pageIndex, start), localBuffer, size);
-                if (state != State::OK)
-                {
-                    return state;
-                }
-                state = WriteMemory((uint16_t)RESERVE_BLOCK_BLOCKADDR, localBuffer, size);
-                if (state != State::OK)
-                {
-                    return state;
-                }
-            }
-            continue;
-        }
-        else if (pageIndex == pagesAffected[0])
-        {
-            size = byteAddrFilter(startAddress);
-        }
-        else if (pageIndex == pagesAffected[1])
-        {
-            size  = PAGE_SIZE_BYTE - byteAddrFilter(endAddress);
-            start = byteAddrFilter(endAddress);
-        }
-        else
-        {
-            size = PAGE_SIZE_BYTE;
-        }
-        if (size != 0)
-        {
-            State state;
-            state = ReadMemory(calcAddress(curBlock, pageIndex, start), localBuffer, size);
-            if (state != State::OK)
-            {
-                return state;
-            }
-            state = WriteMemory((uint16_t)RESERVE_BLOCK_BLOCKADDR, localBuffer, size);
-            if (state != State::OK)
-            {
-                return state;
-            }
-        }
+        return state;
     }
-    EraseBlock(curBlock);
-
-    for (uint8_t i = 0; i < PAGE_PER_BLOCK; i++)
+    factoryBad = spare[0] != 0xFF;
+    blank      = true;
+    for (unsigned int i = 0; i < sizeof(spare); i++)  // the ECC bytes of each sector are programmed with its data
     {
-        state = ReadMemory(calcAddress(RESERVE_BLOCK_BLOCKADDR, i, 0), localBuffer, 2048);
-        if (state != State::OK)
-        {
-            return state;
-        }
-        state = WriteMemory(curBlock, localBuffer, 2048);
-        if (state != State::OK)
-        {
-            return state;
-        }
+        blank &= spare[i] == 0xFF;
     }
-    state = EraseBlock(RESERVE_BLOCK_BLOCKADDR, false);
-    setKernelMode(false);
-
-    nextAddr[curBlock] = oldSize - (min(endAddress, oldSize) - startAddress);
-    return state;
+    return State::OK;
 }
 
-Manager::State Manager::EraseChip()
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::EraseBlock(uint32_t blockNUM, bool canSaveAddr)
 {
     if (!isInited)
     {
         return State::OBJECT_NOT_INIT;
     }
-    if (WriteEnable() != State::OK)
+    if (blockNUM >= Geometry::BLOCK_COUNT || (blocks[blockNUM].state() == BlockState::RESERVED && !kernelMode))
     {
-        return State::QSPI_ERR;
+        return State::PARAM_ERR;
     }
-
-    for (unsigned int i = 0; i < BLOCK_COUNT; i++)
+    if (isLocked(blockNUM, true) || (blockNUM == Geometry::RESERVE_BLOCK_BLOCKADDR && jobActive()))
     {
-        taskENTER_CRITICAL();
-        if (i == reservedBlock)
-        {
-            setKernelMode(true);
-        }
-        State state = EraseBlock(i, false);
-        switch (state)
-        {
-        default:
-            i--;
-        case State::OK:
-            continue;
-        }
-        if (kernelMode)
-        {
-            setKernelMode(false);
-        }
-        taskEXIT_CRITICAL();
+        return State::BUSY;
     }
 
-    saveAddr();
-    return State::OK;
-}
-
-Manager::State Manager::BB_LUT(uint8_t *buffer) const
-{
-    if (!isInited)
+    State state = eraseRaw(blockNUM);
+    if (state != State::OK)
     {
-        return State::OBJECT_NOT_INIT;
+        return state;
     }
-    while (isBusy())
-        ;
 
-    if (Command_Rx_1DataLine(OPCode::READ_BBM_LUT, buffer, 20, 8) != HAL_OK)
+    blocks.markErased(blockNUM);
+    if (canSaveAddr)
     {
-        return State::QSPI_ERR;
+        return saveAddr();
     }
-
     return State::OK;
 }
 
-Manager::State Manager::getLast_ECC_page_failure(uint32_t &buffer) const
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::EraseRange_WithinBlock(uint32_t startAddress, uint32_t endAddress)
 {
-    while (isBusy())
-        ;
-
-    uint8_t info[2] = {0};
-    if (Command_Rx_1DataLine(OPCode::LAST_ECC_FAILURE_ADDR, info, 2, 8) != HAL_OK)
-    {
-        return State::QSPI_ERR;
-    }
-    buffer            = info[0] << 8 | info[1];
-    uint8_t ECC_Check = 0;
-    if (ReadStatusReg(RegisterAddress::STATUS_REGISTER, &ECC_Check) != State::OK)
+    State state = StartEraseRange(startAddress, endAddress);
+    if (state != State::OK)
     {
-        return State::QSPI_ERR;
+        return state;
     }
-    if (ECC_Check & 64)
+    while (jobActive())
     {
-        return State::ECC_ERR;
+        Step(Deadline::NO_BUDGET);
     }
-    return State::OK;
+    return job.result;
 }
 
-Manager::State Manager::BB_Entry(const uint16_t &badBlockAddr, const uint16_t &goodBlockAddr) const { return State::OK; }
-
-Manager::State Manager::BB_management()
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::StartEraseRange(uint32_t startAddress, uint32_t endAddress)
 {
     if (!isInited)
     {
         return State::OBJECT_NOT_INIT;
     }
-    uint8_t data[PAGE_SIZE_BYTE];
-    uint8_t buffer[PAGE_SIZE_BYTE];
-    for (int a = 0; a < PAGE_SIZE_BYTE; a++)
+    if (startAddress >= endAddress)
     {
-        data[a] = a;
+        return State::PARAM_ERR;
     }
-    uint16_t badBlocks[20] = {0}, j = 0;
-    uint16_t goodBlocks[1024] = {0}, k = 0;
-    for (unsigned int i = 0; i < BLOCK_COUNT; i++)
+    if (!PassAddressCheck(startAddress) || !PassAddressCheck(endAddress))
     {
-        Command_Tx_4DataLine(OPCode::QUAD_LOAD_PROGRAM_DATA, data, 0, PAGE_SIZE_BYTE);
-        BufferCommand(pageAligned_calcAddress(i, 0), OPCode::PROGRAM_EXECUTE);
-        uint32_t addr = 0;
-        State result  = getLast_ECC_page_failure(addr);
-        if (result == State::ECC_ERR && (addr >> 18) == (uint32_t)i)
-        {
-            badBlocks[j++] = i;
-        }
-        ReadMemory(calcAddress(i, 0, 0), buffer, PAGE_SIZE_BYTE);
-        EraseBlock(i, false);
+        return State::PARAM_ERR;
     }
-    for (unsigned int i = 0; i < j; i++)
+    if (Geometry::blockOf(startAddress) != Geometry::blockOf(endAddress))
     {
-        if (BB_Entry(badBlocks[i], goodBlocks[--k]) != State::OK)
-        {
-            return State::QSPI_ERR;
+        return State::PARAM_ERR;
+    }
+    if (jobActive())
+    {
+        return State::BUSY;
+    }
+
+    uint16_t curBlock = Geometry::blockOf(startAddress);
+    State state       = relocateBegin(job.move,
+                                curBlock,
+                                (Geometry::pageOf(startAddress) << Geometry::BYTE_BITS) | Geometry::byteOf(startAddress),
+                                (Geometry::pageOf(endAddress) << Geometry::BYTE_BITS) | Geometry::byteOf(endAddress));
+    if (state != State::OK)
+    {
+        return state;
+    }
+
+    /* the units of `relocateStep`: the three erases, one per gathered page (one at least), one per copied page and the end of the copy */
+    uint32_t pages      = Geometry::pagesFor(job.move.oldEnd - (job.move.endOffset - job.move.startOffset));
+    job.kind            = JobKind::ERASE_RANGE;
+    job.done            = 0;
+    job.total           = job.move.phase == Relocation::FINISHED ? 1 : 3 + (pages ? pages : 1) + pages + 1;
+    job.result          = State::OK;
+    job.cancelRequested = false;
+    job.status          = JobStatus::RUNNING;
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::relocate(uint16_t block, uint32_t startOffset, uint32_t endOffset)
+{
+    Relocation move;
+    State state = relocateBegin(move, block, startOffset, endOffset);
+    while (state == State::OK && move.phase != Relocation::FINISHED)
+    {
+        state = relocateStep(move);
+    }
+    return state;
+}
+
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::relocateBegin(Relocation &move, uint16_t block, uint32_t startOffset, uint32_t endOffset)
+{
+    move.block       = block;
+    move.oldEnd      = blocks[block].writeOffset();
+    move.startOffset = startOffset;
+    move.endOffset   = min(endOffset, move.oldEnd);
+    move.cursor      = 0;
+    move.segment     = 0;
+    move.fill        = 0;
+    move.outPage     = 0;
+    if (move.startOffset >= move.endOffset)
+    {
+        move.endOffset = move.startOffset;
+        move.phase     = Relocation::FINISHED;
+        return State::OK;
+    }
+
+    move.page = pool.acquire();
+    if (!move.page.valid())
+    {
+        return State::NO_BUFFER;
+    }
+    move.phase = Relocation::ERASE_SPARE;
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::relocateStep(Relocation &move)
+{
+    uint8_t *localBuffer = move.page.valid() ? move.page.data() : nullptr;  // given back once the move is over
+    uint32_t newSize     = move.oldEnd - (move.endOffset - move.startOffset);
+    State state          = State::OK;
+
+    switch (move.phase)
+    {
+    case Relocation::ERASE_SPARE:
+        state      = eraseRaw(Geometry::RESERVE_BLOCK_BLOCKADDR);
+        move.phase = Relocation::GATHER;
+        break;
+
+    case Relocation::GATHER:
+    {
+        /* fill one page with `[0, startOffset)` and `[endOffset, oldEnd)` and program it into the reserved block */
+        const uint32_t segments[2][2] = {{0, move.startOffset}, {move.endOffset, move.oldEnd}};
+        while (move.segment < 2)
+        {
+            if (move.cursor >= segments[move.segment][1])  // before the check of a full page, the last page ends the gathering
+            {
+                move.segment++;
+                move.cursor = move.segment < 2 ? segments[move.segment][0] : 0;
+                continue;
+            }
+            if (move.fill == Geometry::PAGE_SIZE_BYTE)
+            {
+                break;
+            }
+            uint16_t chunk = min(min(segments[move.segment][1] - move.cursor, Geometry::PAGE_SIZE_BYTE - (move.cursor & Geometry::BYTE_MASK)),
+                                 Geometry::PAGE_SIZE_BYTE - move.fill);
+            state          = readRaw(Geometry::calcAddress(move.block, move.cursor >> Geometry::BYTE_BITS, move.cursor & Geometry::BYTE_MASK),
+                            localBuffer + move.fill,
+                            chunk);
+            if (state != State::OK)
+            {
+                return state;
+            }
+            move.cursor += chunk;
+            move.fill += chunk;
+        }
+        if (move.fill != 0)
+        {
+            state     = programRaw(Geometry::RESERVE_BLOCK_BLOCKADDR, move.outPage++, 0, localBuffer, move.fill);
+            move.fill = 0;
+        }
+        if (move.segment == 2)
+        {
+            move.phase = Relocation::ERASE_SOURCE;
+        }
+        break;
+    }
+
+    case Relocation::ERASE_SOURCE:
+        state = eraseRaw(move.block);
+        if (state != State::OK)
+        {
+            return state;
+        }
+        blocks.markErased(move.block);
+        move.cursor = 0;
+        move.phase  = Relocation::COPY_BACK;
+        break;
+
+    case Relocation::COPY_BACK:
+        if (move.cursor < move.outPage)
+        {
+            state = readRaw(Geometry::calcAddress(Geometry::RESERVE_BLOCK_BLOCKADDR, move.cursor, 0), localBuffer, Geometry::PAGE_SIZE_BYTE);
+            if (state != State::OK)
+            {
+                return state;
+            }
+            state = programRaw(move.block, move.cursor, 0, localBuffer, min(Geometry::PAGE_SIZE_BYTE, newSize - (move.cursor << Geometry::BYTE_BITS)));
+            move.cursor++;
+            break;
+        }
+        blocks.setWriteOffset(move.block, newSize);
+        move.phase = Relocation::CLEAN_UP;
+        break;
+
+    case Relocation::CLEAN_UP:
+        state = eraseRaw(Geometry::RESERVE_BLOCK_BLOCKADDR);
+        move.page.release();
+        move.phase = Relocation::FINISHED;
+        break;
+
+    case Relocation::FINISHED:
+        break;
+    }
+    return state;
+}
+
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::Format(FormatMode mode)
+{
+    if (!isInited)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    if (jobActive())
+    {
+        return State::BUSY;
+    }
+
+    if (mode == FormatMode::QUICK)
+    {
+        for (uint32_t i = 0; i < Geometry::BLOCK_COUNT; i++)
+        {
+            blocks.markDirty(i);
+        }
+        State state = saveAddr();
+        if (state != State::OK)
+        {
+            return state;
         }
+        return beginFormat(true);
+    }
+
+    State state = beginFormat(false);
+    if (state != State::OK)
+    {
+        return state;
+    }
+    while (jobActive())
+    {
+        Step(Deadline::NO_BUDGET);
+    }
+    return job.result;
+}
+
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::StartFormat()
+{
+    if (!isInited)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    if (jobActive())
+    {
+        return State::BUSY;
     }
+    return beginFormat(false);
+}
+
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::beginFormat(bool quick)
+{
+    job.kind            = JobKind::FORMAT;
+    job.cursor          = 0;
+    job.quick           = quick;
+    job.done            = 0;
+    job.total           = Geometry::BLOCK_COUNT;
+    job.result          = State::OK;
+    job.cancelRequested = false;
+    job.status          = JobStatus::RUNNING;
     return State::OK;
 }
 
-void Manager::incrementAddr(uint16_t blockNum, uint16_t size)
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::EraseChip()
+{
+    State state = StartEraseChip();
+    if (state != State::OK)
+    {
+        return state;
+    }
+    while (jobActive())
+    {
+        Step(Deadline::NO_BUDGET);
+    }
+    return job.result;
+}
+
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::StartEraseChip()
 {
-    uint16_t pageNum  = pageAddrFilter(nextAddr[blockNum]);
-    uint16_t nextByte = byteAddrFilter(nextAddr[blockNum]);
-    nextByte += size;
-    if (nextByte >= PAGE_SIZE_BYTE)
+    if (!isInited)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    if (jobActive())
     {
-        nextByte = 0;
-        pageNum += 1;
+        return State::BUSY;
     }
-    nextAddr[blockNum] = calcAddress(0, pageNum, nextByte);
+
+    job.kind            = JobKind::ERASE_CHIP;
+    job.cursor          = 0;
+    job.done            = 0;
+    job.total           = Geometry::BLOCK_COUNT;
+    job.result          = State::OK;
+    job.cancelRequested = false;
+    job.status          = JobStatus::RUNNING;
+    return State::OK;
 }
 
-void Manager::setKernelMode(bool mode)
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::BB_LUT(uint8_t *buffer) const
+{
+    if (!isInited)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    while (isBusy())
+        ;
+
+    if (Command_Rx_1DataLine(OPCode::READ_BBM_LUT, buffer, 20, 8) != HAL_OK)
+    {
+        return State::QSPI_ERR;
+    }
+
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::getLast_ECC_page_failure(uint32_t &buffer) const
+{
+    while (isBusy())
+        ;
+
+    uint8_t info[2] = {0};
+    if (Command_Rx_1DataLine(OPCode::LAST_ECC_FAILURE_ADDR, info, 2, 8) != HAL_OK)
+    {
+        return State::QSPI_ERR;
+    }
+    buffer            = info[0] << 8 | info[1];
+    uint8_t ECC_Check = 0;
+    if (ReadStatusReg(RegisterAddress::STATUS_REGISTER, &ECC_Check) != State::OK)
+    {
+        return State::QSPI_ERR;
+    }
+    if (ECC_Check & 64)
+    {
+        return State::ECC_ERR;
+    }
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::BB_Entry(const uint16_t &badBlockAddr, const uint16_t &goodBlockAddr) const { return State::OK; }
+
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::BB_management()
+{
+    State state = StartBBScan();
+    if (state != State::OK)
+    {
+        return state;
+    }
+    while (jobActive())
+    {
+        Step(Deadline::NO_BUDGET);
+    }
+    return job.result;
+}
+
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::StartBBScan()
+{
+    if (!isInited)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    if (jobActive())
+    {
+        return State::BUSY;
+    }
+    job.pattern = pool.acquire();
+    job.buffer  = pool.acquire();
+    if (!job.pattern.valid() || !job.buffer.valid())
+    {
+        job.pattern.release();
+        job.buffer.release();
+        return State::NO_BUFFER;
+    }
+    uint8_t *data = job.pattern.data();
+    for (unsigned int a = 0; a < Geometry::PAGE_SIZE_BYTE; a++)
+    {
+        data[a] = a;
+    }
+
+    job.kind            = JobKind::BB_SCAN;
+    job.cursor          = 0;
+    job.badCount        = 0;
+    job.done            = 0;
+    job.total           = Geometry::BLOCK_COUNT;
+    job.result          = State::OK;
+    job.cancelRequested = false;
+    job.status          = JobStatus::RUNNING;
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+JobStatus Manager<GEOMETRY>::Step(uint32_t budget_us)
+{
+    if (!isInited)
+    {
+        return job.status;
+    }
+    /* the group writes are made durable once their window is over even if no write follows them, the writes stay pending on a failure and
+       the commit is tried again at the next step */
+    if (groupWindowOver() && !isBusy() && slotOpen() && saveAddr() != State::OK)
+    {
+        return job.status;
+    }
+    if (!jobActive())
+    {
+        Deadline deadline(budget_us);
+        bool idle = false;
+        while (!idle && !deadline.expired())
+        {
+            if (isBusy() || !slotOpen())
+            {
+                break;
+            }
+            if (refillStep(idle) != State::OK)
+            {
+                break;
+            }
+        }
+        return job.status;
+    }
+    /* a range erase can only be dropped while its source block is still untouched */
+    bool cancellable = job.kind != JobKind::ERASE_RANGE || job.move.phase <= Relocation::GATHER;
+    if (job.cancelRequested && cancellable)
+    {
+        jobFinish(JobStatus::CANCELLED, State::OK);
+        return job.status;
+    }
+
+    Deadline deadline(budget_us);
+    while (job.status == JobStatus::RUNNING && !deadline.expired())
+    {
+        if (isBusy() || !slotOpen())  // the last erase or program is still running on the chip, or the control tick is too close
+        {
+            break;
+        }
+
+        bool finished = false;
+        State state   = jobStep(finished);
+        if (state != State::OK)
+        {
+            jobFinish(JobStatus::FAILED, state);
+            break;
+        }
+        job.done++;
+        if (finished)
+        {
+            jobFinish(JobStatus::DONE, State::OK);
+            break;
+        }
+
+        cancellable = job.kind != JobKind::ERASE_RANGE || job.move.phase <= Relocation::GATHER;
+        if (job.cancelRequested && cancellable)
+        {
+            jobFinish(JobStatus::CANCELLED, State::OK);
+            break;
+        }
+    }
+    return job.status;
+}
+
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::jobStep(bool &finished)
+{
+    State state = State::OK;
+    switch (job.kind)
+    {
+    case JobKind::ERASE_CHIP:
+        state = eraseRaw(job.cursor);
+        if (state != State::OK)
+        {
+            return state;
+        }
+        blocks.markErased(job.cursor);
+        finished = ++job.cursor == Geometry::BLOCK_COUNT;
+        break;
+
+    case JobKind::ERASE_RANGE:
+        state    = relocateStep(job.move);
+        finished = job.move.phase == Relocation::FINISHED;
+        break;
+
+    case JobKind::BB_SCAN:
+    {
+        uint16_t block = job.cursor;
+        state          = programRaw(block, 0, 0, job.pattern.data(), Geometry::PAGE_SIZE_BYTE);
+        if (state != State::OK)
+        {
+            return state;
+        }
+        uint32_t addr  = 0;
+        bool eccFailed = getLast_ECC_page_failure(addr) == State::ECC_ERR && (addr >> Geometry::PAGE_BITS) == block;
+        readRaw(Geometry::calcAddress(block, 0, 0), job.buffer.data(), Geometry::PAGE_SIZE_BYTE);
+        state = eraseRaw(block);
+        if (state != State::OK)
+        {
+            return state;
+        }
+        blocks.markErased(block);
+        if (eccFailed)
+        {
+            job.badBlocks[job.badCount++] = block;
+            blocks.markBad(block);
+        }
+
+        job.cursor++;
+        finished = job.cursor == Geometry::BLOCK_COUNT || job.badCount == sizeof(job.badBlocks) / sizeof(job.badBlocks[0]);
+        if (!finished)
+        {
+            break;
+        }
+
+        /* the replacements are taken from the top of the user blocks downwards, skipping the bad ones */
+        uint16_t goodBlock = Geometry::USER_BLOCK_COUNT;
+        for (unsigned int i = 0; i < job.badCount; i++)
+        {
+            bool isBad = true;
+            while (isBad && goodBlock > 0)
+            {
+                goodBlock--;
+                isBad = false;
+                for (unsigned int b = 0; b < job.badCount; b++)
+                {
+                    isBad |= job.badBlocks[b] == goodBlock;
+                }
+            }
+            if (BB_Entry(job.badBlocks[i], goodBlock) != State::OK)
+            {
+                return State::QSPI_ERR;
+            }
+        }
+        break;
+    }
+
+    case JobKind::FORMAT:
+    {
+        uint16_t block = job.cursor;
+        bool isDirty   = false;
+        switch (blocks[block].state())
+        {
+        case BlockState::OPEN:
+        case BlockState::FULL:
+            /* a quick pass leaves the blocks written since the format alone */
+            isDirty = !job.quick;
+            break;
+        case BlockState::DIRTY:
+            isDirty = true;
+            break;
+        case BlockState::BAD:
+            break;
+        default:
+        {
+            /* only the blocking format looks for the writes the table has missed */
+            if (job.quick)
+            {
+                break;
+            }
+            /* the journal blocks keep the table, everything else is checked for writes the table has missed */
+            if (block == Geometry::METADATA_BLOCKADDR || block == Geometry::METADATA_BLOCKADDR + 1)
+            {
+                break;
+            }
+            bool blank, factoryBad;
+            state = checkSpare(block, 0, blank, factoryBad);
+            if (state != State::OK)
+            {
+                return state;
+            }
+            if (factoryBad)
+            {
+                blocks.markBad(block);
+                break;
+            }
+            isDirty = !blank;
+            break;
+        }
+        }
+        if (isDirty)
+        {
+            state = eraseRaw(block);
+            if (state != State::OK)
+            {
+                return state;
+            }
+            blocks.markErased(block);
+        }
+        finished = ++job.cursor == Geometry::BLOCK_COUNT;
+        break;
+    }
+
+    case JobKind::NONE:
+        finished = true;
+        break;
+    }
+    return state;
+}
+
+template <typename GEOMETRY>
+void Manager<GEOMETRY>::jobFinish(JobStatus status, State result)
+{
+    /* the chip wide operations restart the journal once they have erased the metadata blocks */
+    if ((job.kind == JobKind::ERASE_CHIP || job.kind == JobKind::BB_SCAN) && job.cursor > Geometry::METADATA_BLOCKADDR)
+    {
+        metadataSlot = 0;
+    }
+    job.move.page.release();
+    job.pattern.release();
+    job.buffer.release();
+
+    /* the operation is only over once the table that records it is saved */
+    State saved = saveAddr();
+    if (result == State::OK && saved != State::OK)
+    {
+        result = saved;
+        status = status == JobStatus::DONE ? JobStatus::FAILED : status;
+    }
+    job.result = result;
+    job.status = status;
+}
+
+template <typename GEOMETRY>
+void Manager<GEOMETRY>::Pause()
+{
+    taskENTER_CRITICAL();
+    if (job.status == JobStatus::RUNNING)
+    {
+        job.status = JobStatus::PAUSED;
+    }
+    taskEXIT_CRITICAL();
+}
+
+template <typename GEOMETRY>
+void Manager<GEOMETRY>::Resume()
+{
+    taskENTER_CRITICAL();
+    if (job.status == JobStatus::PAUSED)
+    {
+        job.status = JobStatus::RUNNING;
+    }
+    taskEXIT_CRITICAL();
+}
+
+template <typename GEOMETRY>
+void Manager<GEOMETRY>::Cancel()
+{
+    job.cancelRequested = true;
+}
+
+template <typename GEOMETRY>
+bool Manager<GEOMETRY>::isLocked(uint16_t block, bool forWrite) const
+{
+    if (forWrite && block == refillBlock)
+    {
+        return true;
+    }
+    if (!jobActive())
+    {
+        return false;
+    }
+    switch (job.kind)
+    {
+    case JobKind::ERASE_CHIP:
+        return forWrite;
+    case JobKind::ERASE_RANGE:
+        return block == job.move.block;
+    case JobKind::BB_SCAN:
+        return true;
+    case JobKind::FORMAT:
+        /* a quick pass leaves the written blocks alone, a block still `DIRTY` ahead of it is erased by the write instead */
+        return forWrite && (job.quick ? block == job.cursor : block >= job.cursor);
+    default:
+        return false;
+    }
+}
+
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::refillStep(bool &idle)
+{
+    State state = State::OK;
+    if (erased.satisfied())
+    {
+        idle = !reclaimStep(state);
+        return state;
+    }
+    idle = false;
+
+    /* a free block only needs an erase if a write has not made it into the table */
+    int32_t block = blocks.findNext(BlockState::FREE, refillCursor, partitions.end(), Geometry::USER_BLOCK_COUNT);
+    if (block >= 0)
+    {
+        refillCursor = block + 1;
+        refillBlock  = block;
+        if (!blocks.allocate(block))  // taken by a writer in the meantime
+        {
+            refillBlock = -1;
+            return State::OK;
+        }
+        bool blank, factoryBad;
+        state = checkSpare(block, 0, blank, factoryBad);
+        if (state == State::OK && !blank)
+        {
+            state = eraseRaw(block);
+            erased.metrics().backgroundErases++;
+        }
+        if (state == State::OK)
+        {
+            erased.push(block);
+        }
+        else
+        {
+            blocks.setWriteOffset(block, 0);
+        }
+        refillBlock = -1;
+        return state;
+    }
+
+    block = blocks.findNext(BlockState::DIRTY, refillCursor, partitions.end(), Geometry::USER_BLOCK_COUNT);
+    if (block < 0)  // the shared blocks are all in use, help the partitions instead
+    {
+        idle = !reclaimStep(state);
+        return state;
+    }
+    refillCursor = block + 1;
+    refillBlock  = block;
+    state        = eraseRaw(block);
+    if (state == State::OK)
+    {
+        blocks.markErased(block);
+        blocks.allocate(block);
+        erased.metrics().backgroundErases++;
+        erased.push(block);
+    }
+    refillBlock = -1;
+    return state;
+}
+
+template <typename GEOMETRY>
+int32_t Manager<GEOMETRY>::AllocateBlock()
+{
+    if (!isInited)
+    {
+        return -1;
+    }
+    typename ErasedPool::Metrics &metrics = erased.metrics();
+
+    uint16_t block;
+    while (erased.pop(block))
+    {
+        /* skip the blocks written directly, formatted or given to a partition since they were erased */
+        if (blocks[block].state() == BlockState::ALLOCATED && block >= partitions.end())
+        {
+            metrics.allocations++;
+            return block;
+        }
+    }
+
+    /* the pool could not keep up, the writer has to wait */
+    metrics.poolMisses++;
+    int32_t candidate = blocks.findNext(BlockState::FREE, refillCursor, partitions.end(), Geometry::USER_BLOCK_COUNT);
+    if (candidate >= 0 && blocks.allocate(candidate))
+    {
+        metrics.allocations++;
+        return candidate;
+    }
+    candidate = blocks.findNext(BlockState::DIRTY, refillCursor, partitions.end(), Geometry::USER_BLOCK_COUNT);
+    if (candidate < 0 || isLocked(candidate, true) || candidate == refillBlock)
+    {
+        return -1;
+    }
+    if (eraseRaw(candidate) != State::OK)
+    {
+        return -1;
+    }
+    blocks.markErased(candidate);
+    blocks.allocate(candidate);
+    metrics.syncErases++;
+    metrics.allocations++;
+    return candidate;
+}
+
+template <typename GEOMETRY>
+bool Manager<GEOMETRY>::reclaimStep(State &state)
+{
+    for (uint8_t i = 0; i < partitions.count(); i++)
+    {
+        const PartitionInfo &partition = partitions[i];
+        if (partition.policy.reclaim != Reclaim::BACKGROUND)
+        {
+            continue;
+        }
+        int32_t block = blocks.findNext(BlockState::DIRTY, partition.firstBlock, partition.firstBlock, partition.firstBlock + partition.blockCount);
+        if (block < 0)
+        {
+            continue;
+        }
+        refillBlock = block;
+        state       = eraseRaw(block);
+        if (state == State::OK)
+        {
+            blocks.markErased(block);
+            erased.metrics().backgroundErases++;
+        }
+        refillBlock = -1;
+        return true;
+    }
+    return false;
+}
+
+template <typename GEOMETRY>
+int32_t Manager<GEOMETRY>::allocateIn(uint8_t index)
+{
+    const PartitionInfo &partition = partitions[index];
+    uint16_t first                 = partition.firstBlock;
+    uint16_t end                   = partition.firstBlock + partition.blockCount;
+    uint16_t &cursor               = partitionCursor[index];
+    if (cursor < first || cursor >= end)  // the first allocation since the mount goes on after the block being written
+    {
+        int32_t open = blocks.findNext(BlockState::OPEN, first, first, end);
+        cursor       = open >= 0 ? open + 1 : first;
+    }
+
+    int32_t block = -1;
+    if (partition.policy.allocation == Allocation::WEAR_LEVELED)
+    {
+        /* the least worn erased or discarded block, an erased one first at equal wear */
+        uint8_t bestRank = 0xFF;
+        for (uint16_t i = first; i < end; i++)
+        {
+            BlockState state = blocks[i].state();
+            if (state != BlockState::FREE && state != BlockState::DIRTY)
+            {
+                continue;
+            }
+            uint8_t rank = blocks[i].eraseBucket() * 2 + (state == BlockState::DIRTY);
+            if (rank < bestRank)
+            {
+                bestRank = rank;
+                block    = i;
+            }
+        }
+    }
+    else
+    {
+        block = blocks.findNext(BlockState::FREE, cursor, first, end);
+        if (block < 0)
+        {
+            block = blocks.findNext(BlockState::DIRTY, cursor, first, end);
+        }
+    }
+
+    bool recycled = false;
+    if (block < 0 && partition.policy.reclaim == Reclaim::RECYCLE)
+    {
+        /* the blocks are written in ring order, so the first full one after the cursor holds the oldest data */
+        block    = blocks.findNext(BlockState::FULL, cursor, first, end);
+        recycled = true;
+    }
+    if (block < 0 || isLocked(block, true))
+    {
+        return -1;
+    }
+
+    if (blocks[block].state() != BlockState::FREE)
+    {
+        if (eraseRaw(block) != State::OK)
+        {
+            return -1;
+        }
+        blocks.markErased(block);
+    }
+    blocks.allocate(block);
+    cursor = block + 1;
+    if (recycled && saveAddr() != State::OK)  // the table must not keep pointing at the data that is gone
+    {
+        return -1;
+    }
+    return block;
+}
+
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::CreatePartition(const char *name, uint16_t blockCount, const PartitionPolicy &policy)
+{
+    if (!isInited)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    if (jobActive())
+    {
+        return State::BUSY;
+    }
+    if (partitions.end() + blockCount > Geometry::USER_BLOCK_COUNT)
+    {
+        return State::PARAM_ERR;
+    }
+    int8_t index = partitions.add(name, blockCount, policy);
+    if (index < 0)
+    {
+        return State::PARAM_ERR;
+    }
+
+    /* the blocks the erased pool holds in the new range are not the pool's anymore */
+    const PartitionInfo &partition = partitions[index];
+    for (uint16_t block = partition.firstBlock; block < partition.firstBlock + partition.blockCount; block++)
+    {
+        if (blocks[block].state() == BlockState::ALLOCATED)
+        {
+            blocks.setWriteOffset(block, 0);
+        }
+    }
+    partitionCursor[index] = 0;
+    return saveAddr();
+}
+
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::SetPartitionPolicy(uint8_t index, const PartitionPolicy &policy)
+{
+    if (!isInited)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    if (index >= partitions.count())
+    {
+        return State::PARAM_ERR;
+    }
+    partitions[index].policy = policy;
+    return saveAddr();
+}
+
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::ClearPartitions()
+{
+    if (!isInited)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    if (jobActive())
+    {
+        return State::BUSY;
+    }
+    partitions.clear();
+    memset(partitionCursor, 0, sizeof(partitionCursor));
+    return saveAddr();
+}
+
+template <typename GEOMETRY>
+void Manager<GEOMETRY>::setKernelMode(bool mode)
 {
     kernelMode = mode;
     if (mode)
@@ -701,47 +1597,202 @@ void Manager::setKernelMode(bool mode)
     }
 }
 
-void Manager::saveAddr()
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::saveAddr()
 {
-    State state;
-    EraseBlock(RESERVE_BLOCK_BLOCKADDR, false);
-    for (uint16_t i = 0; i < BLOCK_COUNT; i++)
+    uint8_t *localBuffer = metadataPage;
+
+    uint16_t block     = Geometry::METADATA_BLOCKADDR + metadataSlot / SLOTS_PER_BLOCK;
+    uint16_t firstPage = (metadataSlot % SLOTS_PER_BLOCK) * SNAPSHOT_PAGES;
+    State state        = State::OK;
+    if (firstPage == 0 && (state = eraseRaw(block)) != State::OK)
+    {
+        return state;
+    }
+
+    /* the writes counted from here on are not covered by this snapshot */
+    uint32_t batch        = commits.pendingWrites;
+    bool groupBatch       = groupPending;
+    commits.pendingWrites = 0;
+    commits.pendingBytes  = 0;
+    groupPending          = false;
+
+    /* the footer is in the last page, which is programmed last, so a snapshot only becomes valid once it is complete */
+    uint32_t sequence = metadataSequence + 1;
+    for (uint32_t i = 0; i < SNAPSHOT_PAGES; i++)
     {
-        if (i == RESERVE_BLOCK_BLOCKADDR)
+        uint32_t offset = i << Geometry::BYTE_BITS;
+        memset(localBuffer, 0xFF, Geometry::PAGE_SIZE_BYTE);
+        copyIntoPage(localBuffer, offset, Geometry::PAGE_SIZE_BYTE, blocks.data(), 0, BlockTable<Geometry>::size());
+        copyIntoPage(localBuffer, offset, Geometry::PAGE_SIZE_BYTE, partitions.data(), BlockTable<Geometry>::size(), PartitionTable::size());
+        if (i == SNAPSHOT_PAGES - 1)
+        {
+            uint32_t magic = SNAPSHOT_MAGIC;
+            memcpy(localBuffer + Geometry::PAGE_SIZE_BYTE - SNAPSHOT_FOOTER_SIZE, &sequence, 4);
+            memcpy(localBuffer + Geometry::PAGE_SIZE_BYTE - 4, &magic, 4);
+        }
+        state = programRaw(block, firstPage + i, 0, localBuffer, Geometry::PAGE_SIZE_BYTE);
+        if (state != State::OK)
+        {
+            commits.pendingWrites += batch;
+            groupPending = groupPending || groupBatch;
+            return state;
+        }
+    }
+    while (isBusy())
+        ;
+
+    metadataSequence = sequence;
+    metadataSlot     = (metadataSlot + 1) % (2 * SLOTS_PER_BLOCK);
+    commits.commits++;
+    if (batch > commits.maxBatch)
+    {
+        commits.maxBatch = batch;
+    }
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::loadAddr()
+{
+    uint8_t footer[SNAPSHOT_FOOTER_SIZE];
+    uint32_t bestSequence = 0;
+    int32_t bestSlot      = -1;
+    for (uint16_t slot = 0; slot < 2 * SLOTS_PER_BLOCK; slot++)
+    {
+        uint16_t block    = Geometry::METADATA_BLOCKADDR + slot / SLOTS_PER_BLOCK;
+        uint16_t lastPage = (slot % SLOTS_PER_BLOCK) * SNAPSHOT_PAGES + SNAPSHOT_PAGES - 1;
+        State state       = readRaw(Geometry::calcAddress(block, lastPage, Geometry::PAGE_SIZE_BYTE - SNAPSHOT_FOOTER_SIZE), footer, SNAPSHOT_FOOTER_SIZE);
+        if (state != State::OK)
+        {
+            return state;
+        }
+
+        uint32_t sequence, magic;
+        memcpy(&sequence, footer, 4);
+        memcpy(&magic, footer + 4, 4);
+        if (magic == SNAPSHOT_MAGIC && (bestSlot < 0 || sequence > bestSequence))
+        {
+            bestSequence = sequence;
+            bestSlot     = slot;
+        }
+    }
+
+    if (bestSlot < 0)  // a blank chip or one written by an older driver
+    {
+        blocks.reset();
+        partitions.clear();
+        metadataSequence = 0;
+        metadataSlot     = 0;
+        return recoverWriteOffsets();
+    }
+
+    uint16_t block     = Geometry::METADATA_BLOCKADDR + bestSlot / SLOTS_PER_BLOCK;
+    uint16_t firstPage = (bestSlot % SLOTS_PER_BLOCK) * SNAPSHOT_PAGES;
+    State state        = readRaw(Geometry::calcAddress(block, firstPage, 0), blocks.data(), BlockTable<Geometry>::size());
+    if (state != State::OK)
+    {
+        return state;
+    }
+    state = readRaw(Geometry::calcAddress(block, firstPage + (BlockTable<Geometry>::size() >> Geometry::BYTE_BITS),
+                                          BlockTable<Geometry>::size() & Geometry::BYTE_MASK),
+                    partitions.data(), PartitionTable::size());
+    if (state != State::OK)
+    {
+        return state;
+    }
+    partitions.validate();  // blank in the snapshots written before the partitions
+    blocks.releaseAllocated();  // the erased block pool starts over empty
+    metadataSequence = bestSequence;
+
+    /* skip the slots a torn snapshot has left partially programmed, a new block is erased before it is used anyway */
+    metadataSlot = (bestSlot + 1) % (2 * SLOTS_PER_BLOCK);
+    while (metadataSlot % SLOTS_PER_BLOCK != 0)
+    {
+        uint8_t head[3];
+        block = Geometry::METADATA_BLOCKADDR + metadataSlot / SLOTS_PER_BLOCK;
+        state = readRaw(Geometry::calcAddress(block, (metadataSlot % SLOTS_PER_BLOCK) * SNAPSHOT_PAGES, 0), head, sizeof(head));
+        if (state != State::OK)
+        {
+            return state;
+        }
+        if (head[0] == 0xFF && head[1] == 0xFF && head[2] == 0xFF)
+        {
+            break;
+        }
+        metadataSlot = (metadataSlot + 1) % (2 * SLOTS_PER_BLOCK);
+    }
+    return recoverWriteOffsets();
+}
+
+template <typename GEOMETRY>
+State Manager<GEOMETRY>::recoverWriteOffsets()
+{
+    uint8_t *localBuffer = metadataPage;  // free again before the snapshot at the end
+
+    bool changed = false;
+    for (uint32_t block = 0; block < Geometry::USER_BLOCK_COUNT; block++)
+    {
+        if (blocks[block].state() != BlockState::FREE && blocks[block].state() != BlockState::OPEN)
         {
             continue;
         }
+        uint32_t offset    = blocks[block].writeOffset();
+        uint32_t recovered = offset;
 
-        setKernelMode(true);
-        uint32_t curAddr = nextAddr[i];
-        uint8_t addr[4]  = {(curAddr & 0xFF000000) >> 24, (curAddr & 0xFF0000) >> 16, (curAddr & 0xFF00) >> 8, (curAddr & 0xFF)};
-        if (WriteEnable() != State::OK)
+        /* the rest of a partially written page, a partial program after the snapshot shows up as non blank bytes */
+        uint16_t byte = Geometry::byteOf(offset);
+        if (byte != 0)
         {
-            setKernelMode(false);
-            return;
+            State state = readRaw(Geometry::calcAddress(block, offset >> Geometry::BYTE_BITS, byte), localBuffer, Geometry::PAGE_SIZE_BYTE - byte);
+            if (state != State::OK)
+            {
+                return state;
+            }
+            for (uint32_t i = 0; i < Geometry::PAGE_SIZE_BYTE - byte; i++)
+            {
+                if (localBuffer[i] != 0xFF)
+                {
+                    recovered = (offset | Geometry::BYTE_MASK) + 1;
+                    break;
+                }
+            }
         }
 
-        while (isBusy())
-            ;
-        uint32_t storeAddr = ADDR_STORE_START(i);
-        uint16_t byteAddr  = byteAddrFilter(storeAddr);
-        if (Command_Tx_4DataLine(OPCode::QUAD_LOAD_PROGRAM_DATA, addr, byteAddr, 4) != HAL_OK)
+        /* the following pages are programmed in order, the first blank one ends the written area */
+        for (uint32_t p = Geometry::pagesFor(recovered); p < Geometry::PAGE_PER_BLOCK; p++)
         {
-            setKernelMode(false);
-            return;
+            bool blank, factoryBad;
+            State state = checkSpare(block, p, blank, factoryBad);
+            if (state != State::OK)
+            {
+                return state;
+            }
+            if (p == 0 && factoryBad)
+            {
+                blocks.markBad(block);
+                changed = true;
+                break;
+            }
+            if (blank)
+            {
+                break;
+            }
+            recovered = (p + 1) << Geometry::BYTE_BITS;
         }
-        uint16_t pageAddr = storeAddr >> 12;
-        while (isBusy())
-            ;
-        if (BufferCommand(pageAddr, OPCode::PROGRAM_EXECUTE) != HAL_OK)
+
+        if (recovered != offset && blocks[block].state() != BlockState::BAD)
         {
-            setKernelMode(false);
-            return;
+            blocks.setWriteOffset(block, recovered);
+            changed = true;
         }
-        setKernelMode(false);
     }
+
+    return changed ? saveAddr() : State::OK;
 }
 
+W25N_INSTANTIATE_FOR_ALL_GEOMETRIES(Manager);
+
 }  // namespace W25N01
 }  // namespace Drivers
-}  // namespace Core
\ No newline at end of file
+}  // namespace Core
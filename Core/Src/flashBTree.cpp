@@ -0,0 +1,804 @@
+#include "flashBTree.hpp"
+
+#include <cstddef>
+#include <cstring>
+
+#include "flashCrc.hpp"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+template <typename GEOMETRY>
+BTree<GEOMETRY>::BTree(Manager<GEOMETRY> &manager, uint16_t firstBlock, uint16_t blockCount)
+    : flash(manager), first(firstBlock), count(blockCount), mounted(false), loading(false), active(0), levels(0), root(NO_PAGE), head(0),
+      generation(0), pinCount(0), counters(), leafLease(), loadHead(0), loadFirstLeaf(0), loadLeaves(0), loadLastKey(0), loadError(State::OK)
+{
+}
+
+template <typename GEOMETRY>
+State BTree<GEOMETRY>::mount()
+{
+    if (!flash.isInited)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    if (mounted)
+    {
+        return State::OK;
+    }
+    if (count < 2 || first + count > Geometry::USER_BLOCK_COUNT)
+    {
+        return State::PARAM_ERR;
+    }
+
+    uint32_t roots[2], generations[2], ends[2];
+    int8_t newest = -1;
+    for (uint8_t half = 0; half < 2; half++)
+    {
+        State state = findRoot(half, roots[half], generations[half], ends[half]);
+        if (state != State::OK)
+        {
+            return state;
+        }
+        if (roots[half] != NO_PAGE && (newest < 0 || static_cast<int32_t>(generations[half] - generations[newest]) > 0))
+        {
+            newest = half;
+        }
+    }
+
+    mounted = true;
+    if (newest < 0)  // a new tree: an empty bulk load into the first half
+    {
+        active      = 1;
+        generation  = 0;
+        State state = beginLoad();
+        if (state == State::OK)
+        {
+            state = endLoad(Durability::SYNC);
+        }
+        mounted = state == State::OK;
+        return state;
+    }
+
+    active      = newest;
+    root        = roots[newest];
+    generation  = generations[newest];
+    head        = ends[newest];
+    State state = pinTop();
+    mounted     = state == State::OK;
+    return state;
+}
+
+template <typename GEOMETRY>
+State BTree<GEOMETRY>::find(uint32_t key, uint32_t &value)
+{
+    if (!mounted)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    typename Manager<GEOMETRY>::PagePool::Lease lease = Manager<GEOMETRY>::pagePool().acquire();
+    if (!lease.valid())
+    {
+        return State::NO_BUFFER;
+    }
+    uint32_t path[MAX_HEIGHT];
+    uint16_t slots[MAX_HEIGHT];
+    State state = descend(key, lease.data(), path, slots);
+    if (state != State::OK)
+    {
+        return state;
+    }
+    counters.lookups++;
+
+    const Leaf &leaf = *reinterpret_cast<const Leaf *>(lease.data());
+    uint16_t i       = lowerBound(leaf.keys, leaf.header.count, key);
+    if (i == leaf.header.count || leaf.keys[i] != key)
+    {
+        return State::PARAM_ERR;
+    }
+    value = leaf.values[i];
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State BTree<GEOMETRY>::insert(uint32_t key, uint32_t value, Durability durability)
+{
+    return update(key, value, false, durability);
+}
+
+template <typename GEOMETRY>
+State BTree<GEOMETRY>::remove(uint32_t key, Durability durability)
+{
+    return update(key, 0, true, durability);
+}
+
+template <typename GEOMETRY>
+State BTree<GEOMETRY>::scan(uint32_t from, uint32_t to, Visitor visitor, void *context)
+{
+    if (!mounted)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    typename Manager<GEOMETRY>::PagePool::Lease lease  = Manager<GEOMETRY>::pagePool().acquire();
+    typename Manager<GEOMETRY>::PagePool::Lease parent = Manager<GEOMETRY>::pagePool().acquire();
+    if (!lease.valid() || !parent.valid())
+    {
+        return State::NO_BUFFER;
+    }
+    uint32_t path[MAX_HEIGHT];
+    uint16_t slots[MAX_HEIGHT];
+    const Leaf &leaf      = *reinterpret_cast<const Leaf *>(lease.data());
+    const Internal *above = nullptr;  // the parent of the leaf, its next child is the next leaf
+    uint16_t slot         = 0;
+
+    uint32_t next = from;
+    while (from <= to)
+    {
+        State state;
+        if (above != nullptr && slot < above->header.count)
+        {
+            const uint8_t *node;
+            if ((state = visit(above->children[++slot], lease.data(), node)) == State::OK && node != lease.data())
+            {
+                memcpy(lease.data(), node, Geometry::PAGE_SIZE_BYTE);
+            }
+        }
+        else
+        {
+            /* the first leaf under the next parent is found again from its lowest key, the parent is read once more to keep it */
+            const uint8_t *node;
+            if ((state = descend(next, lease.data(), path, slots)) == State::OK && levels > 1 &&
+                (state = visit(path[1], parent.data(), node)) == State::OK)
+            {
+                above = reinterpret_cast<const Internal *>(node);
+                slot  = slots[1];
+            }
+        }
+        if (state != State::OK)
+        {
+            return state;
+        }
+        for (uint16_t i = lowerBound(leaf.keys, leaf.header.count, next); i < leaf.header.count; i++)
+        {
+            if (leaf.keys[i] > to || !visitor(leaf.keys[i], leaf.values[i], context))
+            {
+                return State::OK;
+            }
+        }
+        if (above != nullptr && slot < above->header.count)
+        {
+            continue;
+        }
+        if (!(leaf.header.flags & HAS_NEXT) || leaf.header.link > to || leaf.header.link <= next)
+        {
+            break;
+        }
+        next = leaf.header.link;
+    }
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State BTree<GEOMETRY>::beginLoad()
+{
+    if (!mounted)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    if (loading)
+    {
+        return State::BUSY;
+    }
+
+    /* the other half is erased, the current tree stays readable until the new root is written */
+    uint8_t target = active ^ 1;
+    for (uint32_t page = halfStart(target); page < halfStart(target) + halfPages(); page += Geometry::PAGE_PER_BLOCK)
+    {
+        if (flash.blocks[chipBlock(page)].state() == BlockState::FREE)
+        {
+            continue;
+        }
+        State state = flash.EraseBlock(chipBlock(page), false);
+        if (state != State::OK)
+        {
+            return state;
+        }
+    }
+
+    leafLease = Manager<GEOMETRY>::pagePool().acquire();
+    if (!leafLease.valid())
+    {
+        return State::NO_BUFFER;
+    }
+    Leaf &leaf             = *reinterpret_cast<Leaf *>(leafLease.data());
+    leaf.header.level      = 0;
+    leaf.header.flags      = 0;
+    leaf.header.count      = 0;
+    leaf.header.generation = generation + 1;
+    leaf.header.link       = 0;
+
+    loadHead      = halfStart(target);
+    loadFirstLeaf = loadHead;
+    loadLeaves    = 0;
+    loadError     = State::OK;
+    loading       = true;
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State BTree<GEOMETRY>::load(uint32_t key, uint32_t value)
+{
+    if (!loading)
+    {
+        return State::PARAM_ERR;
+    }
+    if (loadError != State::OK)
+    {
+        return loadError;
+    }
+    Leaf &leaf = *reinterpret_cast<Leaf *>(leafLease.data());
+    if ((leaf.header.count != 0 || loadLeaves != 0) && key <= loadLastKey)
+    {
+        return State::PARAM_ERR;
+    }
+    if (leaf.header.count == LEAF_CAPACITY)
+    {
+        leaf.header.link = key;
+        if ((loadError = flushLeaf(HAS_NEXT, Durability::LAZY)) != State::OK)
+        {
+            return loadError;
+        }
+        leaf.header.count = 0;
+    }
+    leaf.keys[leaf.header.count]   = key;
+    leaf.values[leaf.header.count] = value;
+    leaf.header.count++;
+    loadLastKey = key;
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State BTree<GEOMETRY>::endLoad(Durability durability)
+{
+    if (!loading)
+    {
+        return State::PARAM_ERR;
+    }
+    State state = loadError;
+    if (state == State::OK)
+    {
+        state = loadLeaves == 0 ? flushLeaf(ROOT, durability) : flushLeaf(0, Durability::LAZY);
+    }
+
+    /* the levels above are built from the lowest key of each node of the level below, the nodes of a level are in consecutive pages */
+    uint32_t end        = halfStart(active ^ 1) + halfPages();
+    uint32_t levelStart = loadFirstLeaf;
+    uint32_t levelCount = loadLeaves;
+    uint8_t level       = 0;
+    Internal &node      = *reinterpret_cast<Internal *>(leafLease.data());
+    while (state == State::OK && levelCount > 1)
+    {
+        level++;
+        uint32_t nextStart = loadHead;
+        uint32_t nextCount = 0;
+        uint32_t address;
+        for (uint32_t i = 0; i < levelCount && state == State::OK; i++)
+        {
+            uint8_t raw[NODE_HEADER_SIZE + 4];
+            if ((state = flash.ReadMemory(chipAddress(levelStart + i), raw, sizeof(raw))) != State::OK)
+            {
+                break;
+            }
+            uint32_t low;
+            memcpy(&low, level == 1 ? raw + NODE_HEADER_SIZE : raw + offsetof(NodeHeader, link), 4);
+
+            if (i != 0 && node.header.count < INTERNAL_CAPACITY)
+            {
+                node.keys[node.header.count]         = low;
+                node.children[node.header.count + 1] = levelStart + i;
+                node.header.count++;
+                continue;
+            }
+            if (i != 0)
+            {
+                if ((state = program(leafLease.data(), loadHead, end, address, Durability::LAZY)) != State::OK)
+                {
+                    break;
+                }
+                nextCount++;
+            }
+            node.header.level      = level;
+            node.header.flags      = 0;
+            node.header.count      = 0;
+            node.header.generation = generation + 1;
+            node.header.link       = low;
+            node.children[0]       = levelStart + i;
+        }
+        if (state == State::OK)
+        {
+            node.header.flags = nextCount == 0 ? ROOT : 0;
+            state             = program(leafLease.data(), loadHead, end, address, nextCount == 0 ? durability : Durability::LAZY);
+            nextCount++;
+        }
+        levelStart = nextStart;
+        levelCount = nextCount;
+    }
+    loading = false;
+    leafLease.release();
+    if (state != State::OK)
+    {
+        return state;
+    }
+
+    active = active ^ 1;
+    root   = loadHead - 1;
+    head   = loadHead;
+    generation++;
+    counters.commits++;
+    return pinTop();
+}
+
+template <typename GEOMETRY>
+State BTree<GEOMETRY>::compact()
+{
+    if (!mounted)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    State state = beginLoad();
+    if (state != State::OK)
+    {
+        return state;
+    }
+    if ((state = scan(0, 0xFFFFFFFF, compactVisitor, this)) != State::OK)
+    {
+        loadError = state;
+    }
+    if ((state = endLoad(Durability::SYNC)) == State::OK)
+    {
+        counters.compactions++;
+    }
+    return state;
+}
+
+template <typename GEOMETRY>
+bool BTree<GEOMETRY>::compactVisitor(uint32_t key, uint32_t value, void *context)
+{
+    /* a refused entry ends the scan early, `endLoad` must not take the entries loaded so far for the whole tree */
+    BTree &tree = *static_cast<BTree *>(context);
+    State state = tree.load(key, value);
+    if (state != State::OK)
+    {
+        tree.loadError = state;
+    }
+    return state == State::OK;
+}
+
+template <typename GEOMETRY>
+uint16_t BTree<GEOMETRY>::lowerBound(const uint32_t *keys, uint16_t size, uint32_t key)
+{
+    uint16_t low = 0;
+    while (size)
+    {
+        uint16_t half = size / 2;
+        if (keys[low + half] < key)
+        {
+            low += half + 1;
+            size -= half + 1;
+        }
+        else
+        {
+            size = half;
+        }
+    }
+    return low;
+}
+
+template <typename GEOMETRY>
+uint16_t BTree<GEOMETRY>::childOf(const Internal &node, uint32_t key)
+{
+    /* the first key above `key`, keys equal to a separator go right */
+    uint16_t i = lowerBound(node.keys, node.header.count, key);
+    return i < node.header.count && node.keys[i] == key ? i + 1 : i;
+}
+
+template <typename GEOMETRY>
+const uint8_t *BTree<GEOMETRY>::pinned(uint32_t page) const
+{
+    for (uint8_t i = 0; i < pinCount; i++)
+    {
+        if (pins[i].address == page)
+        {
+            return pins[i].data;
+        }
+    }
+    return nullptr;
+}
+
+template <typename GEOMETRY>
+State BTree<GEOMETRY>::visit(uint32_t page, uint8_t *buffer, const uint8_t *&node)
+{
+    node = pinned(page);
+    if (node != nullptr)
+    {
+        return State::OK;
+    }
+    node = buffer;
+    counters.pageReads++;
+    return flash.ReadMemory(chipAddress(page), buffer, Geometry::PAGE_SIZE_BYTE);
+}
+
+template <typename GEOMETRY>
+State BTree<GEOMETRY>::descend(uint32_t key, uint8_t *buffer, uint32_t *path, uint16_t *slots)
+{
+    uint32_t page = root;
+    const uint8_t *node;
+    for (uint8_t level = levels - 1; level > 0; level--)
+    {
+        State state = visit(page, buffer, node);
+        if (state != State::OK)
+        {
+            return state;
+        }
+        const Internal &internal = *reinterpret_cast<const Internal *>(node);
+        path[level]              = page;
+        slots[level]             = childOf(internal, key);
+        page                     = internal.children[slots[level]];
+    }
+    path[0]     = page;
+    State state = visit(page, buffer, node);
+    if (state == State::OK && node != buffer)  // a pinned leaf, the callers work on the copy in `buffer`
+    {
+        memcpy(buffer, node, Geometry::PAGE_SIZE_BYTE);
+    }
+    return state;
+}
+
+template <typename GEOMETRY>
+State BTree<GEOMETRY>::program(uint8_t *page, uint32_t &cursor, uint32_t end, uint32_t &address, Durability durability)
+{
+    if (cursor >= end)
+    {
+        return State::NO_BUFFER;
+    }
+    /* the manager writes at the offset of the block, a block out of step with the cursor (a bad block, a write by another user of the
+       blocks) would put the node at another page than the one its parent points to */
+    if (flash.blocks[chipBlock(cursor)].writeOffset() != (cursor % Geometry::PAGE_PER_BLOCK) << Geometry::BYTE_BITS)
+    {
+        return State::PARAM_ERR;
+    }
+    NodeHeader &header = *reinterpret_cast<NodeHeader *>(page);
+    header.magic       = MAGIC;
+    header.crc         = crc32(page + NODE_HEADER_SIZE, Geometry::PAGE_SIZE_BYTE - NODE_HEADER_SIZE, crc32(page, NODE_HEADER_SIZE - 4));
+    State state        = flash.WriteMemory(chipBlock(cursor), page, Geometry::PAGE_SIZE_BYTE, durability);
+    if (state != State::OK)
+    {
+        return state;
+    }
+    address = cursor++;
+    counters.pagesWritten++;
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State BTree<GEOMETRY>::update(uint32_t key, uint32_t value, bool erase, Durability durability)
+{
+    if (!mounted)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    if (loading)
+    {
+        return State::BUSY;
+    }
+    State state = reserve(2 * levels + 1);
+    if (state != State::OK)
+    {
+        return state;
+    }
+    typename Manager<GEOMETRY>::PagePool::Lease lower = Manager<GEOMETRY>::pagePool().acquire();
+    typename Manager<GEOMETRY>::PagePool::Lease upper = Manager<GEOMETRY>::pagePool().acquire();
+    if (!lower.valid() || !upper.valid())
+    {
+        return State::NO_BUFFER;
+    }
+    uint32_t path[MAX_HEIGHT];
+    uint16_t slots[MAX_HEIGHT];
+    if ((state = descend(key, lower.data(), path, slots)) != State::OK)
+    {
+        return state;
+    }
+
+    Leaf &leaf  = *reinterpret_cast<Leaf *>(lower.data());
+    uint16_t i  = lowerBound(leaf.keys, leaf.header.count, key);
+    bool exists = i < leaf.header.count && leaf.keys[i] == key;
+    bool split  = false;
+    if (erase)
+    {
+        if (!exists)
+        {
+            return State::PARAM_ERR;
+        }
+        memmove(&leaf.keys[i], &leaf.keys[i + 1], (leaf.header.count - i - 1) * 4);
+        memmove(&leaf.values[i], &leaf.values[i + 1], (leaf.header.count - i - 1) * 4);
+        leaf.header.count--;
+    }
+    else if (exists)
+    {
+        if (leaf.values[i] == value)
+        {
+            return State::OK;
+        }
+        leaf.values[i] = value;
+    }
+    else
+    {
+        Leaf *target = &leaf;
+        if (leaf.header.count == LEAF_CAPACITY)  // the upper half moves to a new leaf linked after this one
+        {
+            Leaf &right        = *reinterpret_cast<Leaf *>(upper.data());
+            uint16_t keep      = LEAF_CAPACITY / 2;
+            right.header       = leaf.header;
+            right.header.count = LEAF_CAPACITY - keep;
+            memcpy(right.keys, &leaf.keys[keep], right.header.count * 4);
+            memcpy(right.values, &leaf.values[keep], right.header.count * 4);
+            leaf.header.count = keep;
+            leaf.header.link  = right.keys[0];
+            leaf.header.flags |= HAS_NEXT;
+            if (i > keep)
+            {
+                target = &right;
+                i -= keep;
+            }
+            split = true;
+        }
+        memmove(&target->keys[i + 1], &target->keys[i], (target->header.count - i) * 4);
+        memmove(&target->values[i + 1], &target->values[i], (target->header.count - i) * 4);
+        target->keys[i]   = key;
+        target->values[i] = value;
+        target->header.count++;
+    }
+
+    /* from the leaf up, each node is written to a new page and its parent points to it, the root is written last */
+    generation++;
+    uint32_t end       = halfStart(active) + halfPages();
+    uint32_t child     = NO_PAGE;  // the new copy of the node below
+    uint32_t right     = NO_PAGE;  // the node split off it, to be added to the parent after `separator`
+    uint32_t separator = 0;
+    for (uint8_t level = 0; level < levels; level++)
+    {
+        if (level != 0)
+        {
+            const uint8_t *node;
+            if ((state = visit(path[level], lower.data(), node)) != State::OK)
+            {
+                return state;
+            }
+            if (node != lower.data())
+            {
+                memcpy(lower.data(), node, Geometry::PAGE_SIZE_BYTE);
+            }
+            Internal &internal      = *reinterpret_cast<Internal *>(lower.data());
+            uint16_t slot           = slots[level];
+            internal.children[slot] = child;
+            if (!erase && key < internal.header.link)
+            {
+                internal.header.link = key;
+            }
+
+            split = false;
+            if (right != NO_PAGE)
+            {
+                Internal *target = &internal;
+                if (internal.header.count == INTERNAL_CAPACITY)  // the middle key moves up, the keys after it go to a new node
+                {
+                    Internal &next    = *reinterpret_cast<Internal *>(upper.data());
+                    uint16_t middle   = INTERNAL_CAPACITY / 2;
+                    next.header       = internal.header;
+                    next.header.count = INTERNAL_CAPACITY - middle - 1;
+                    next.header.link  = internal.keys[middle];
+                    memcpy(next.keys, &internal.keys[middle + 1], next.header.count * 4);
+                    memcpy(next.children, &internal.children[middle + 1], (next.header.count + 1) * 4);
+                    internal.header.count = middle;
+                    if (slot > middle)
+                    {
+                        target = &next;
+                        slot -= middle + 1;
+                    }
+                    split = true;
+                }
+                memmove(&target->keys[slot + 1], &target->keys[slot], (target->header.count - slot) * 4);
+                memmove(&target->children[slot + 2], &target->children[slot + 1], (target->header.count - slot) * 4);
+                target->keys[slot]         = separator;
+                target->children[slot + 1] = right;
+                target->header.count++;
+            }
+        }
+
+        NodeHeader &header = *reinterpret_cast<NodeHeader *>(lower.data());
+        header.generation  = generation;
+        header.flags &= ~ROOT;
+        uint32_t oldPage = path[level];
+        if (split)
+        {
+            NodeHeader &splitHeader = *reinterpret_cast<NodeHeader *>(upper.data());
+            splitHeader.generation  = generation;
+            splitHeader.flags &= ~ROOT;
+            separator = level == 0 ? reinterpret_cast<Leaf *>(upper.data())->keys[0] : splitHeader.link;
+            if ((state = program(lower.data(), head, end, child, Durability::LAZY)) != State::OK ||
+                (state = program(upper.data(), head, end, right, Durability::LAZY)) != State::OK)
+            {
+                return state;
+            }
+            if (repin(oldPage, child, lower.data()) && pinCount < PINNED_NODES)
+            {
+                pins[pinCount].address = right;
+                memcpy(pins[pinCount++].data, upper.data(), Geometry::PAGE_SIZE_BYTE);
+            }
+        }
+        else
+        {
+            bool top = level == levels - 1;
+            header.flags |= top ? ROOT : 0;
+            if ((state = program(lower.data(), head, end, child, top ? durability : Durability::LAZY)) != State::OK)
+            {
+                return state;
+            }
+            repin(oldPage, child, lower.data());
+            right = NO_PAGE;
+        }
+    }
+
+    if (right != NO_PAGE)  // the root split, the tree grows by one level
+    {
+        Internal &top         = *reinterpret_cast<Internal *>(lower.data());
+        top.header.level      = levels;
+        top.header.flags      = ROOT;
+        top.header.count      = 1;
+        top.header.generation = generation;
+        top.header.link       = 0;
+        top.keys[0]           = separator;
+        top.children[0]       = child;
+        top.children[1]       = right;
+        if ((state = program(lower.data(), head, end, child, durability)) != State::OK)
+        {
+            return state;
+        }
+    }
+    bool grew = right != NO_PAGE;
+    root      = child;
+    counters.commits++;
+    return grew ? pinTop() : State::OK;
+}
+
+template <typename GEOMETRY>
+State BTree<GEOMETRY>::reserve(uint32_t pages)
+{
+    if (freePages() >= pages)
+    {
+        return State::OK;
+    }
+    State state = compact();
+    if (state != State::OK)
+    {
+        return state;
+    }
+    return freePages() >= pages ? State::OK : State::NO_BUFFER;
+}
+
+template <typename GEOMETRY>
+State BTree<GEOMETRY>::findRoot(uint8_t half, uint32_t &address, uint32_t &rootGeneration, uint32_t &end)
+{
+    /* the half is written in order, its end is the write offset of its last written block */
+    address = NO_PAGE;
+    end     = halfStart(half);
+    for (uint32_t page = halfStart(half) + halfPages(); page > halfStart(half); page -= Geometry::PAGE_PER_BLOCK)
+    {
+        uint32_t offset = flash.blocks[chipBlock(page - 1)].writeOffset();
+        if (offset != 0)
+        {
+            end = page - Geometry::PAGE_PER_BLOCK + Geometry::pagesFor(offset);
+            break;
+        }
+    }
+
+    /* the last root written, a root cut short by a power loss fails its CRC and the one before is taken */
+    typename Manager<GEOMETRY>::PagePool::Lease lease = Manager<GEOMETRY>::pagePool().acquire();
+    if (!lease.valid())
+    {
+        return State::NO_BUFFER;
+    }
+    for (uint32_t page = end; page > halfStart(half); page--)
+    {
+        NodeHeader header;
+        State state = flash.ReadMemory(chipAddress(page - 1), reinterpret_cast<uint8_t *>(&header), NODE_HEADER_SIZE);
+        if (state == State::OK && header.magic == MAGIC && (header.flags & ROOT))
+        {
+            state = flash.ReadMemory(chipAddress(page - 1), lease.data(), Geometry::PAGE_SIZE_BYTE);
+            uint32_t crc = crc32(lease.data(), NODE_HEADER_SIZE - 4);
+            crc          = crc32(lease.data() + NODE_HEADER_SIZE, Geometry::PAGE_SIZE_BYTE - NODE_HEADER_SIZE, crc);
+            if (state == State::OK && header.crc == crc)
+            {
+                address        = page - 1;
+                rootGeneration = header.generation;
+                return State::OK;
+            }
+        }
+        if (state != State::OK && state != State::ECC_ERR)
+        {
+            return state;
+        }
+    }
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+bool BTree<GEOMETRY>::repin(uint32_t page, uint32_t newPage, const uint8_t *data)
+{
+    for (uint8_t i = 0; i < pinCount; i++)
+    {
+        if (pins[i].address == page)
+        {
+            pins[i].address = newPage;
+            memcpy(pins[i].data, data, Geometry::PAGE_SIZE_BYTE);
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename GEOMETRY>
+State BTree<GEOMETRY>::pinTop()
+{
+    pinCount    = 0;
+    State state = flash.ReadMemory(chipAddress(root), pins[0].data, Geometry::PAGE_SIZE_BYTE);
+    if (state != State::OK)
+    {
+        return state;
+    }
+    const Internal &top = *reinterpret_cast<const Internal *>(pins[0].data);
+    if (top.header.level >= MAX_HEIGHT)
+    {
+        return State::PARAM_ERR;
+    }
+    pins[0].address = root;
+    pinCount        = 1;
+    levels          = top.header.level + 1;
+
+    for (uint16_t i = 0; levels > 1 && i <= top.header.count && pinCount < PINNED_NODES; i++)
+    {
+        if ((state = flash.ReadMemory(chipAddress(top.children[i]), pins[pinCount].data, Geometry::PAGE_SIZE_BYTE)) != State::OK)
+        {
+            return state;
+        }
+        pins[pinCount++].address = top.children[i];
+    }
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State BTree<GEOMETRY>::flushLeaf(uint8_t flags, Durability durability)
+{
+    Leaf &leaf        = *reinterpret_cast<Leaf *>(leafLease.data());
+    leaf.header.flags = flags;
+    uint32_t address;
+    State state = program(leafLease.data(), loadHead, halfStart(active ^ 1) + halfPages(), address, durability);
+    if (state == State::OK)
+    {
+        loadLeaves++;
+    }
+    return state;
+}
+
+W25N_INSTANTIATE_FOR_ALL_GEOMETRIES(BTree);
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
@@ -0,0 +1,455 @@
+#include "flashBlobStore.hpp"
+
+#include <cstring>
+
+#include "flashCrc.hpp"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+namespace
+{
+/// the most bytes moved by one `ReadMemory`, which takes a 16 bit size
+constexpr uint32_t MAX_TRANSFER = 0x8000;
+}  // namespace
+
+template <typename GEOMETRY>
+State BlobStore<GEOMETRY>::Reader::read(uint8_t *buffer, uint32_t capacity, uint32_t &length)
+{
+    length = 0;
+    if (flash == nullptr)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    while (length < capacity && offset < entry.size)
+    {
+        /* the extent holding the offset, the extent list is short */
+        uint32_t start = 0;
+        uint8_t extent = 0;
+        for (; extent < entry.extentCount; extent++)
+        {
+            uint32_t extentSize = static_cast<uint32_t>(entry.extents[extent].blockCount) * Geometry::BLOCK_SIZE_BYTE;
+            if (offset - start < extentSize)
+            {
+                break;
+            }
+            start += extentSize;
+        }
+        if (extent == entry.extentCount)  // the extents do not cover the size
+        {
+            return State::ECC_ERR;
+        }
+        uint32_t within = offset - start;
+        uint16_t block  = entry.extents[extent].firstBlock + within / Geometry::BLOCK_SIZE_BYTE;
+        within %= Geometry::BLOCK_SIZE_BYTE;
+
+        uint32_t chunk = Geometry::BLOCK_SIZE_BYTE - within;
+        chunk          = chunk < capacity - length ? chunk : capacity - length;
+        chunk          = chunk < entry.size - offset ? chunk : entry.size - offset;
+        chunk          = chunk < MAX_TRANSFER ? chunk : MAX_TRANSFER;
+        State state    = flash->ReadMemory(Geometry::calcAddress(block, within >> Geometry::BYTE_BITS, within & Geometry::BYTE_MASK),
+                                           buffer + length, chunk);
+        if (state != State::OK)
+        {
+            return state;
+        }
+        if (checking)
+        {
+            crc = crc32(buffer + length, chunk, crc);
+        }
+        length += chunk;
+        offset += chunk;
+    }
+    if (checking && offset == entry.size && length != 0 && crc != entry.crc)
+    {
+        return State::ECC_ERR;
+    }
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State BlobStore<GEOMETRY>::Reader::seek(uint32_t position)
+{
+    if (flash == nullptr)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    if (position > entry.size)
+    {
+        return State::PARAM_ERR;
+    }
+    checking = position == 0;
+    crc      = 0;
+    offset   = position;
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+BlobStore<GEOMETRY>::BlobStore(Manager<GEOMETRY> &manager, uint16_t firstBlock, uint16_t blockCount)
+    : flash(manager),
+      catalog(manager, firstBlock),
+      writer(manager),
+      first(firstBlock + CATALOG_BLOCKS),
+      count(blockCount > CATALOG_BLOCKS ? blockCount - CATALOG_BLOCKS : 0),
+      mounted(false),
+      writing(false),
+      used(),
+      pendingName(),
+      pending(),
+      hintBlocks(0),
+      counters()
+{
+}
+
+template <typename GEOMETRY>
+State BlobStore<GEOMETRY>::mount()
+{
+    if (!flash.isInited)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    if (mounted)
+    {
+        return State::OK;
+    }
+    if (count == 0 || first + count > Geometry::USER_BLOCK_COUNT)
+    {
+        return State::PARAM_ERR;
+    }
+    State state = catalog.mount();
+    if (state != State::OK)
+    {
+        return state;
+    }
+
+    /* the blocks no catalog record points to are free, whatever the block table says: they belonged to an object cut before its seal. A
+       record that fails its CRC on this read may point to any of them, so they all stay used but for those of the objects removed later */
+    memset(used, 0, sizeof(used));
+    uint32_t dropped = catalog.stats().droppedRecords;
+    if ((state = catalog.forEach(markVisitor, this)) != State::OK)
+    {
+        return state;
+    }
+    if (catalog.stats().droppedRecords != dropped)
+    {
+        memset(used, 0xFF, sizeof(used));
+    }
+    mounted = true;
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State BlobStore<GEOMETRY>::create(const char *name, uint32_t sizeHint)
+{
+    if (!mounted)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    if (writing)
+    {
+        return State::BUSY;
+    }
+    size_t length = strlen(name);
+    if (length == 0 || length > MAX_NAME_SIZE)
+    {
+        return State::PARAM_ERR;
+    }
+    memcpy(pendingName, name, length + 1);
+    memset(&pending, 0, sizeof(pending));
+    hintBlocks = (sizeHint + Geometry::BLOCK_SIZE_BYTE - 1) / Geometry::BLOCK_SIZE_BYTE;
+    writing    = true;
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State BlobStore<GEOMETRY>::append(const void *data, uint32_t size)
+{
+    if (!writing)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    while (size)
+    {
+        uint32_t room = writer.isOpen() ? Geometry::BLOCK_SIZE_BYTE - writer.offset() : 0;
+        if (room == 0)
+        {
+            State state = grow();
+            if (state != State::OK)
+            {
+                return state;
+            }
+            room = Geometry::BLOCK_SIZE_BYTE;
+        }
+        uint32_t chunk = size < room ? size : room;
+        State state    = writer.append(bytes, chunk);
+        if (state != State::OK)
+        {
+            return state;
+        }
+        pending.crc = crc32(bytes, chunk, pending.crc);
+        pending.size += chunk;
+        counters.bytesWritten += chunk;
+        bytes += chunk;
+        size -= chunk;
+    }
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State BlobStore<GEOMETRY>::seal(Durability durability)
+{
+    if (!writing)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    /* the table is saved with the catalog record */
+    State state = writer.close(Durability::LAZY);
+    if (state != State::OK)
+    {
+        return state;
+    }
+    Entry replaced;
+    uint16_t length;
+    bool replacing = catalog.get(pendingName, &replaced, sizeof(replaced), length) == State::OK;
+
+    if ((state = catalog.put(pendingName, &pending, entrySize(pending), durability)) != State::OK)
+    {
+        return state;
+    }
+    if (replacing)
+    {
+        markExtents(replaced, false);
+    }
+    writing = false;
+    counters.sealed++;
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+void BlobStore<GEOMETRY>::abort()
+{
+    if (!writing)
+    {
+        return;
+    }
+    writer.close(Durability::LAZY);
+    markExtents(pending, false);
+    writing = false;
+    counters.aborted++;
+}
+
+template <typename GEOMETRY>
+State BlobStore<GEOMETRY>::openReader(const char *name, Reader &reader)
+{
+    if (!mounted)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    uint16_t length;
+    State state = catalog.get(name, &reader.entry, sizeof(reader.entry), length);
+    if (state != State::OK)
+    {
+        reader.flash = nullptr;
+        return state;
+    }
+    if (reader.entry.extentCount > MAX_EXTENTS || length != entrySize(reader.entry))
+    {
+        reader.flash = nullptr;
+        return State::ECC_ERR;
+    }
+    reader.flash    = &flash;
+    reader.offset   = 0;
+    reader.crc      = 0;
+    reader.checking = true;
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State BlobStore<GEOMETRY>::remove(const char *name, Durability durability)
+{
+    if (!mounted)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    Entry entry;
+    uint16_t length;
+    State state = catalog.get(name, &entry, sizeof(entry), length);
+    if (state != State::OK)
+    {
+        return state;
+    }
+    if ((state = catalog.remove(name, durability)) != State::OK)
+    {
+        return state;
+    }
+    markExtents(entry, false);
+    counters.removed++;
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+uint16_t BlobStore<GEOMETRY>::freeBlocks() const
+{
+    uint16_t free = 0;
+    for (uint16_t block = first; block < first + count; block++)
+    {
+        free += isFree(block);
+    }
+    return free;
+}
+
+template <typename GEOMETRY>
+void BlobStore<GEOMETRY>::setUsed(uint16_t block, bool value)
+{
+    uint32_t bit = 1UL << ((block - first) % 32);
+    if (value)
+    {
+        used[(block - first) / 32] |= bit;
+    }
+    else
+    {
+        used[(block - first) / 32] &= ~bit;
+    }
+}
+
+template <typename GEOMETRY>
+bool BlobStore<GEOMETRY>::isFree(uint16_t block) const
+{
+    return !isUsed(block) && flash.blocks[block].isUsable();
+}
+
+template <typename GEOMETRY>
+void BlobStore<GEOMETRY>::markExtents(const Entry &entry, bool value)
+{
+    for (uint8_t extent = 0; extent < entry.extentCount && extent < MAX_EXTENTS; extent++)
+    {
+        for (uint16_t n = 0; n < entry.extents[extent].blockCount; n++)
+        {
+            uint16_t block = entry.extents[extent].firstBlock + n;
+            if (block >= first && block < first + count)
+            {
+                setUsed(block, value);
+            }
+        }
+    }
+}
+
+template <typename GEOMETRY>
+int32_t BlobStore<GEOMETRY>::findRun(uint16_t blocks) const
+{
+    int32_t best       = -1;
+    uint16_t bestSize  = 0;
+    uint16_t runStart  = first;
+    uint16_t runLength = 0;
+    for (uint16_t block = first; block < first + count; block++)
+    {
+        if (!isFree(block))
+        {
+            runLength = 0;
+            continue;
+        }
+        if (runLength++ == 0)
+        {
+            runStart = block;
+        }
+        if (runLength >= blocks)
+        {
+            return runStart;
+        }
+        if (runLength > bestSize)
+        {
+            best     = runStart;
+            bestSize = runLength;
+        }
+    }
+    return best;
+}
+
+template <typename GEOMETRY>
+State BlobStore<GEOMETRY>::grow()
+{
+    State state = writer.close(Durability::LAZY);
+    if (state != State::OK)
+    {
+        return state;
+    }
+    if (pending.extentCount)
+    {
+        Extent &last = pending.extents[pending.extentCount - 1];
+        uint16_t next = last.firstBlock + last.blockCount;
+        if (next < first + count && isFree(next))
+        {
+            if ((state = prepare(next)) != State::OK)
+            {
+                return state;
+            }
+            last.blockCount++;
+            return writer.open(next);
+        }
+    }
+    if (pending.extentCount == MAX_EXTENTS)
+    {
+        return State::NO_BUFFER;
+    }
+
+    int32_t start = findRun(hintBlocks ? hintBlocks : 1);
+    if (start < 0)
+    {
+        return State::NO_BUFFER;
+    }
+    if ((state = prepare(start)) != State::OK)
+    {
+        return state;
+    }
+    pending.extents[pending.extentCount++] = Extent{static_cast<uint16_t>(start), 1};
+    counters.extents++;
+    return writer.open(start);
+}
+
+template <typename GEOMETRY>
+State BlobStore<GEOMETRY>::prepare(uint16_t block)
+{
+    if (flash.isLocked(block, true))
+    {
+        return State::BUSY;
+    }
+    BlockState blockState = flash.blocks[block].state();
+    if (blockState != BlockState::FREE && blockState != BlockState::ALLOCATED)
+    {
+        State state = flash.EraseBlock(block, false);
+        if (state != State::OK)
+        {
+            return state;
+        }
+        counters.blocksReused++;
+    }
+    flash.blocks.allocate(block);  // keep the refill away until the block is written
+    setUsed(block, true);
+    hintBlocks = hintBlocks ? hintBlocks - 1 : 0;
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+bool BlobStore<GEOMETRY>::markVisitor(const char *key, const uint8_t *value, uint16_t length, void *context)
+{
+    BlobStore &store = *static_cast<BlobStore *>(context);
+    Entry entry;
+    memset(&entry, 0, sizeof(entry));
+    memcpy(&entry, value, length < sizeof(entry) ? length : sizeof(entry));
+    store.markExtents(entry, true);
+    return true;
+}
+
+W25N_INSTANTIATE_FOR_ALL_GEOMETRIES(BlobStore);
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
@@ -0,0 +1,177 @@
+#include "flashBlockTable.hpp"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+template <typename GEOMETRY>
+BlockTable<GEOMETRY>::BlockTable() : randomState(0x2545F491)
+{
+    reset();
+}
+
+template <typename GEOMETRY>
+void BlockTable<GEOMETRY>::reset()
+{
+    for (uint32_t i = 0; i < GEOMETRY::BLOCK_COUNT; i++)
+    {
+        table[i].setWord(0);
+        if (i >= GEOMETRY::USER_BLOCK_COUNT)
+        {
+            table[i].set(BlockState::RESERVED, 0);
+        }
+    }
+}
+
+template <typename GEOMETRY>
+void BlockTable<GEOMETRY>::advance(uint16_t block, uint32_t size)
+{
+    setWriteOffset(block, table[block].writeOffset() + size);
+}
+
+template <typename GEOMETRY>
+void BlockTable<GEOMETRY>::setWriteOffset(uint16_t block, uint32_t offset)
+{
+    if (!table[block].isUsable())
+    {
+        return;
+    }
+    if (offset == 0)
+    {
+        table[block].set(BlockState::FREE, 0);
+    }
+    else if (offset >= GEOMETRY::BLOCK_SIZE_BYTE)
+    {
+        table[block].set(BlockState::FULL, GEOMETRY::PAGE_PER_BLOCK);
+    }
+    else
+    {
+        table[block].set(BlockState::OPEN, offset);
+    }
+}
+
+template <typename GEOMETRY>
+void BlockTable<GEOMETRY>::markErased(uint16_t block)
+{
+    Descriptor &descriptor = table[block];
+    uint8_t bucket         = descriptor.eraseBucket();
+
+    /* Morris counter: go up one bucket with a probability of 2^-bucket */
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    if (bucket < MAX_ERASE_BUCKET && (randomState & ((1UL << bucket) - 1)) == 0)
+    {
+        descriptor.setBucket(bucket + 1);
+    }
+
+    if (descriptor.isUsable())
+    {
+        descriptor.set(BlockState::FREE, 0);
+    }
+}
+
+template <typename GEOMETRY>
+void BlockTable<GEOMETRY>::markDirty(uint16_t block)
+{
+    if (table[block].state() == BlockState::OPEN || table[block].state() == BlockState::FULL)
+    {
+        table[block].set(BlockState::DIRTY, 0);
+    }
+}
+
+template <typename GEOMETRY>
+bool BlockTable<GEOMETRY>::allocate(uint16_t block)
+{
+    if (table[block].state() != BlockState::FREE)
+    {
+        return false;
+    }
+    table[block].set(BlockState::ALLOCATED, 0);
+    return true;
+}
+
+template <typename GEOMETRY>
+void BlockTable<GEOMETRY>::releaseAllocated()
+{
+    for (uint32_t i = 0; i < GEOMETRY::BLOCK_COUNT; i++)
+    {
+        if (table[i].state() == BlockState::ALLOCATED)
+        {
+            table[i].set(BlockState::FREE, 0);
+        }
+    }
+}
+
+template <typename GEOMETRY>
+bool BlockTable<GEOMETRY>::markBad(uint16_t block)
+{
+    if (table[block].state() == BlockState::RESERVED)
+    {
+        return false;
+    }
+    table[block].set(BlockState::BAD, 0);
+    return true;
+}
+
+template <typename GEOMETRY>
+void BlockTable<GEOMETRY>::invalidatePages(uint16_t block, uint16_t pages)
+{
+    Descriptor &descriptor = table[block];
+    if (descriptor.state() != BlockState::FULL)
+    {
+        return;
+    }
+    uint16_t valid = descriptor.validPages();
+    descriptor.set(BlockState::FULL, valid > pages ? valid - pages : 0);
+}
+
+template <typename GEOMETRY>
+int32_t BlockTable<GEOMETRY>::findNext(BlockState state, uint16_t from, uint16_t first, uint16_t end) const
+{
+    uint32_t target = static_cast<uint32_t>(state) << Descriptor::STATE_SHIFT;
+    if (first >= end)
+    {
+        return -1;
+    }
+    if (from < first || from >= end)
+    {
+        from = first;
+    }
+    for (uint32_t n = 0; n < static_cast<uint32_t>(end - first); n++)
+    {
+        uint32_t i = from + n;
+        if (i >= end)
+        {
+            i -= end - first;
+        }
+        if ((table[i].word() & (0x7UL << Descriptor::STATE_SHIFT)) == target)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+template <typename GEOMETRY>
+uint16_t BlockTable<GEOMETRY>::count(BlockState state) const
+{
+    uint16_t result = 0;
+    for (uint32_t i = 0; i < GEOMETRY::BLOCK_COUNT; i++)
+    {
+        result += table[i].state() == state;
+    }
+    return result;
+}
+
+W25N_INSTANTIATE_FOR_ALL_GEOMETRIES(BlockTable);
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
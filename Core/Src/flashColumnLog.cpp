@@ -0,0 +1,699 @@
+#include "flashColumnLog.hpp"
+
+#include <cstring>
+
+#include "flashCrc.hpp"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+namespace
+{
+/// the rows that fit the page of a quantized column, while its scales fit `MAX_SCALES` and the floats of its last batch fit the page
+template <typename GEOMETRY>
+uint16_t quantizedRows(const typename ColumnLog<GEOMETRY>::Column &column)
+{
+    constexpr uint16_t BATCH = ColumnLog<GEOMETRY>::QUANT_BATCH;
+    QuantCodec codec(column.quantization, column.width / 4);
+    if (!codec.isValid() || column.width % 4 != 0)
+    {
+        return 0;
+    }
+    uint16_t rows = 0;
+    while (true)
+    {
+        uint32_t next    = rows + 1;
+        uint32_t batches = (next + BATCH - 1) / BATCH;
+        /* the floats of a batch are converted when it is full, the last full batch or the last one may end the furthest */
+        uint32_t end = (batches - 1) * BATCH * codec.rowSize() + (next - (batches - 1) * BATCH) * column.width;
+        if (batches >= 2)
+        {
+            uint32_t full = (batches - 2) * BATCH * codec.rowSize() + BATCH * column.width;
+            end           = full > end ? full : end;
+        }
+        if (batches * codec.channels() > ColumnLog<GEOMETRY>::MAX_SCALES ||
+            ColumnLog<GEOMETRY>::PAGE_HEADER_SIZE + batches * column.width + end > GEOMETRY::PAGE_SIZE_BYTE)
+        {
+            return rows;
+        }
+        rows = next;
+    }
+}
+
+/// the rows of a group, those that fit the page of its fullest column
+template <typename GEOMETRY>
+uint16_t rowsOf(uint8_t columnCount, const typename ColumnLog<GEOMETRY>::Column *columns)
+{
+    uint16_t rows = (GEOMETRY::PAGE_SIZE_BYTE - ColumnLog<GEOMETRY>::PAGE_HEADER_SIZE) / 4;  // the times
+    for (uint8_t column = 0; column < columnCount; column++)
+    {
+        uint16_t fit = columns[column].quantization != Quantization::NONE
+                           ? quantizedRows<GEOMETRY>(columns[column])
+                           : (columns[column].width ? (GEOMETRY::PAGE_SIZE_BYTE - ColumnLog<GEOMETRY>::PAGE_HEADER_SIZE) / columns[column].width : 0);
+        rows = fit < rows ? fit : rows;
+    }
+    return rows;
+}
+}  // namespace
+
+template <typename GEOMETRY>
+ColumnLog<GEOMETRY>::ColumnLog(Manager<GEOMETRY> &manager, uint16_t firstBlock, uint16_t blockCount, const Schema &schema)
+    : flash(manager),
+      writer(manager),
+      first(firstBlock),
+      count(blockCount),
+      layout(schema),
+      groupPages(schema.columnCount + 1),
+      groupsPerBlock(Geometry::PAGE_PER_BLOCK / (schema.columnCount + 1)),
+      rowsPerGroup(schema.columnCount <= MAX_COLUMNS ? rowsOf<GEOMETRY>(schema.columnCount, schema.columns) : 0),
+      mounted(false),
+      headBlock(0),
+      tailBlock(0),
+      nextGroup(0),
+      pendingRows(0),
+      last(0),
+      blockFirst(),
+      groupFirst(),
+      counters()
+{
+}
+
+template <typename GEOMETRY>
+State ColumnLog<GEOMETRY>::mount()
+{
+    if (!flash.isInited)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    if (mounted)
+    {
+        return State::OK;
+    }
+    if (count < 3 || count > MAX_BLOCKS || first + count > Geometry::USER_BLOCK_COUNT || layout.columnCount == 0 ||
+        layout.columnCount > MAX_COLUMNS || rowsPerGroup == 0)
+    {
+        return State::PARAM_ERR;
+    }
+    for (uint8_t column = 0; column < layout.columnCount; column++)
+    {
+        if (layout.columns[column].width == 0 || layout.columns[column].offset + layout.columns[column].width > layout.rowSize ||
+            layout.columns[column].quantization > Quantization::Q7)
+        {
+            return State::PARAM_ERR;
+        }
+    }
+
+    uint16_t good = 0;
+    for (uint16_t index = 0; index < count; index++)
+    {
+        good += isGood(index);
+    }
+    if (good < 3)
+    {
+        return State::PARAM_ERR;
+    }
+
+    /* the head is the block with the highest number, the first time of every block goes to RAM on the way. The bad blocks take a
+       number like the others, they are only stepped over */
+    bool found = false;
+    State state;
+    for (uint16_t index = 0; index < count; index++)
+    {
+        if (!isGood(index))
+        {
+            continue;
+        }
+        bool written;
+        uint32_t block;
+        if ((state = probe(index, written, block, blockFirst[index])) != State::OK)
+        {
+            return state;
+        }
+        if (written && (!found || block > headBlock))
+        {
+            found     = true;
+            headBlock = block;
+        }
+    }
+
+    mounted     = true;
+    pendingRows = 0;
+    last        = 0;
+    if (!found)
+    {
+        tailBlock = 0;
+        nextGroup = 0;
+        return advance();
+    }
+
+    /* the blocks before the head belong to the log as long as their numbers and times follow on */
+    tailBlock          = headBlock;
+    uint32_t nextFirst = blockFirst[headBlock % count];
+    for (uint16_t n = 1; n < count && n <= headBlock; n++)
+    {
+        uint16_t index = (headBlock - n) % count;
+        if (!isGood(index))
+        {
+            continue;
+        }
+        bool written;
+        uint32_t block;
+        uint32_t firstTime;
+        if ((state = probe(index, written, block, firstTime)) != State::OK)
+        {
+            return state;
+        }
+        if (!written || block != headBlock - n || firstTime > nextFirst)
+        {
+            break;
+        }
+        tailBlock = block;
+        nextFirst = firstTime;
+    }
+
+    /* the time of the last row, from the last group of the head block */
+    uint32_t low  = headBlock * groupsPerBlock;
+    uint32_t high = low + groupsPerBlock - 1;
+    while (low < high)
+    {
+        uint32_t middle = (low + high + 1) / 2;
+        PageHeader header;
+        bool valid;
+        if ((state = readHeader(middle, 0, header, valid)) != State::OK)
+        {
+            return state;
+        }
+        if (valid)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+    PageHeader header;
+    bool valid;
+    if ((state = readHeader(low, 0, header, valid)) != State::OK)
+    {
+        return state;
+    }
+    last = valid ? header.last : blockFirst[headBlock % count];
+
+    /* the last group of the head block may have been cut short by a power loss, the appends go on in a new block */
+    nextGroup = (headBlock + 1) * groupsPerBlock;
+    return advance();
+}
+
+template <typename GEOMETRY>
+State ColumnLog<GEOMETRY>::append(uint32_t time, const void *row)
+{
+    if (!mounted)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    if (time < last)
+    {
+        return State::PARAM_ERR;
+    }
+    const uint8_t *source = static_cast<const uint8_t *>(row);
+    memcpy(buffers[0] + PAGE_HEADER_SIZE + pendingRows * 4, &time, 4);
+    uint16_t batch = pendingRows / QUANT_BATCH;
+    for (uint8_t column = 0; column < layout.columnCount; column++)
+    {
+        const Column &field = layout.columns[column];
+        uint8_t page        = column + 1;
+        if (isQuantized(page))  // the floats of the batch wait after the values converted so far
+        {
+            uint8_t *batchStart = buffers[page] + valuesAt(page) + batch * QUANT_BATCH * storedWidth(page);
+            memcpy(batchStart + (pendingRows % QUANT_BATCH) * field.width, source + field.offset, field.width);
+        }
+        else
+        {
+            memcpy(buffers[page] + PAGE_HEADER_SIZE + pendingRows * field.width, source + field.offset, field.width);
+        }
+    }
+    pendingRows++;
+    last = time;
+    counters.rows++;
+    for (uint8_t page = 1; page < groupPages && pendingRows % QUANT_BATCH == 0; page++)
+    {
+        if (isQuantized(page))
+        {
+            encodeBatch(page, batch, QUANT_BATCH);
+        }
+    }
+    return pendingRows == rowsPerGroup ? writeGroup() : State::OK;
+}
+
+template <typename GEOMETRY>
+State ColumnLog<GEOMETRY>::sync()
+{
+    if (!mounted)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    State state = pendingRows ? writeGroup() : State::OK;
+    if (state != State::OK || nextGroup % groupsPerBlock == 0)  // the group filled the block, the head moved on
+    {
+        return state;
+    }
+    if ((state = writer.close(Durability::LAZY)) != State::OK)
+    {
+        return state;
+    }
+    return writer.open(chipBlock(headBlock));
+}
+
+template <typename GEOMETRY>
+State ColumnLog<GEOMETRY>::unmount()
+{
+    if (!mounted)
+    {
+        return State::OK;
+    }
+    State state = pendingRows ? writeGroup() : State::OK;
+    if (state != State::OK)
+    {
+        return state;
+    }
+    mounted = false;
+    return writer.close(Durability::LAZY);
+}
+
+template <typename GEOMETRY>
+State ColumnLog<GEOMETRY>::reset()
+{
+    if (!mounted)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    pendingRows = 0;
+    State state = writer.close(Durability::LAZY);
+    if (state != State::OK)
+    {
+        return state;
+    }
+    /* the old blocks are erased, the mount would take them back otherwise */
+    for (uint16_t n = 0; n < count; n++)
+    {
+        if ((state = eraseIfUsed(headBlock + n)) != State::OK)
+        {
+            return state;
+        }
+    }
+    tailBlock = headBlock + 1;
+    nextGroup = (headBlock + 1) * groupsPerBlock;
+    last      = 0;
+    return advance();
+}
+
+template <typename GEOMETRY>
+void ColumnLog<GEOMETRY>::begin(Cursor &cursor) const
+{
+    cursor.group = tailBlock * groupsPerBlock;
+    cursor.row   = 0;
+}
+
+template <typename GEOMETRY>
+State ColumnLog<GEOMETRY>::seek(uint32_t time, Cursor &cursor)
+{
+    if (!mounted)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    counters.seeks++;
+    begin(cursor);
+    uint32_t end = endGroup();
+    if (end <= cursor.group)
+    {
+        return State::OK;
+    }
+
+    /* the last block whose first time is at or before `time`, a bad block is judged by the first good block after it */
+    uint32_t low  = tailBlock;
+    uint32_t high = (end - 1) / groupsPerBlock;
+    while (low < high && !isGood(low % count))
+    {
+        low++;
+    }
+    if (!isGood(low % count) || blockFirst[low % count] > time)
+    {
+        return State::OK;
+    }
+    while (low != high)
+    {
+        uint32_t middle = low + (high - low + 1) / 2;
+        uint32_t probed = middle;
+        while (probed != high && !isGood(probed % count))
+        {
+            probed++;
+        }
+        if (isGood(probed % count) && blockFirst[probed % count] <= time)
+        {
+            low = probed;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+
+    /* its last group whose first time is at or before `time`, the first times of the head block are in RAM */
+    uint32_t block = low;
+    low            = block * groupsPerBlock;
+    high           = (block + 1) * groupsPerBlock < end ? (block + 1) * groupsPerBlock - 1 : end - 1;
+    State state;
+    while (low != high)
+    {
+        uint32_t middle = (low + high + 1) / 2;
+        bool before;
+        if (block == headBlock)
+        {
+            before = groupFirst[middle % groupsPerBlock] <= time;
+        }
+        else
+        {
+            PageHeader header;
+            bool valid;
+            if ((state = readHeader(middle, 0, header, valid)) != State::OK)
+            {
+                return state;
+            }
+            counters.seekReads++;
+            before = valid && header.first <= time;
+        }
+        if (before)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+    cursor.group = low;
+
+    /* the first row of the group at or after `time`, if there is none the cursor goes on with the next group */
+    PageHeader header;
+    bool valid;
+    if ((state = readHeader(cursor.group, 0, header, valid)) != State::OK || !valid)
+    {
+        return state;
+    }
+    counters.seekReads++;
+    if (header.last < time)
+    {
+        cursor.group++;
+        return State::OK;
+    }
+    uint16_t lowRow  = 0;
+    uint16_t highRow = header.count;
+    while (lowRow < highRow)
+    {
+        uint16_t middle = (lowRow + highRow) / 2;
+        uint32_t rowTime;
+        if ((state = flash.ReadMemory(addressOf(cursor.group, 0, PAGE_HEADER_SIZE + middle * 4), reinterpret_cast<uint8_t *>(&rowTime), 4)) !=
+            State::OK)
+        {
+            return state;
+        }
+        counters.seekReads++;
+        if (rowTime < time)
+        {
+            lowRow = middle + 1;
+        }
+        else
+        {
+            highRow = middle;
+        }
+    }
+    cursor.row = lowRow;
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State ColumnLog<GEOMETRY>::read(Cursor &cursor, uint32_t *times, void *const *columns, uint16_t capacity, uint16_t &length)
+{
+    length = 0;
+    if (!mounted)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    State state;
+    while (length < capacity)
+    {
+        if (cursor.group < tailBlock * groupsPerBlock)  // the block has been erased since
+        {
+            begin(cursor);
+            counters.skippedReads++;
+        }
+        if (cursor.group >= endGroup())
+        {
+            return State::OK;
+        }
+        if (!isGood(cursor.group / groupsPerBlock % count))  // a bad block holds no group, the head is never one
+        {
+            cursor.group = (cursor.group / groupsPerBlock + 1) * groupsPerBlock;
+            cursor.row   = 0;
+            continue;
+        }
+
+        /* the headers of the pages to read first, a group cut by a power loss is skipped whole */
+        PageHeader headers[FLASH_COLUMN_MAX_COLUMNS + 1];
+        bool valid = true;
+        for (uint8_t page = 0; page < groupPages && valid; page++)
+        {
+            if (page == 0 || columns[page - 1] != nullptr)
+            {
+                if ((state = readHeader(cursor.group, page, headers[page], valid)) != State::OK)
+                {
+                    return state;
+                }
+                valid = valid && headers[page].count == headers[0].count;
+            }
+        }
+        if (!valid || cursor.row >= headers[0].count)
+        {
+            counters.lostGroups += !valid;
+            cursor.group++;
+            cursor.row = 0;
+            continue;
+        }
+
+        uint16_t take = headers[0].count - cursor.row < capacity - length ? headers[0].count - cursor.row : capacity - length;
+        bool whole    = cursor.row == 0 && take == headers[0].count;
+        for (uint8_t page = 0; page < groupPages; page++)
+        {
+            uint8_t *dest = page == 0 ? reinterpret_cast<uint8_t *>(times) : static_cast<uint8_t *>(columns[page - 1]);
+            if (dest == nullptr)
+            {
+                continue;
+            }
+            dest += length * width(page);
+            if (isQuantized(page))
+            {
+                if ((state = readQuantized(cursor.group, page, headers[page], cursor.row, take, whole, dest)) != State::OK)
+                {
+                    return state;
+                }
+                counters.pagesRead++;
+                continue;
+            }
+            if ((state = flash.ReadMemory(addressOf(cursor.group, page, PAGE_HEADER_SIZE + cursor.row * width(page)), dest, take * width(page))) !=
+                State::OK)
+            {
+                return state;
+            }
+            counters.pagesRead++;
+            uint32_t crc = whole ? crc32(dest, take * width(page), crc32(reinterpret_cast<uint8_t *>(&headers[page]), PAGE_HEADER_SIZE - 4)) : 0;
+            if (whole && crc != headers[page].crc)
+            {
+                return State::ECC_ERR;
+            }
+        }
+        length += take;
+        cursor.row += take;
+        if (cursor.row == headers[0].count)
+        {
+            cursor.group++;
+            cursor.row = 0;
+        }
+    }
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State ColumnLog<GEOMETRY>::readQuantized(uint32_t group, uint8_t page, const PageHeader &header, uint16_t row, uint16_t take, bool whole,
+                                         uint8_t *dest)
+{
+    /* the scales of the batches of the rows, then the values at the end of `dest` so that they are decoded in place */
+    QuantCodec codec    = codecOf(page);
+    uint16_t firstBatch = row / QUANT_BATCH;
+    uint16_t batches    = (row + take - 1) / QUANT_BATCH - firstBatch + 1;
+    float scales[FLASH_QUANT_MAX_SCALES];
+    uint8_t *values = dest + take * (width(page) - codec.rowSize());
+    State state     = flash.ReadMemory(addressOf(group, page, PAGE_HEADER_SIZE + firstBatch * width(page)), reinterpret_cast<uint8_t *>(scales),
+                                       batches * width(page));
+    if (state != State::OK ||
+        (state = flash.ReadMemory(addressOf(group, page, valuesAt(page) + row * codec.rowSize()), values, take * codec.rowSize())) != State::OK)
+    {
+        return state;
+    }
+    if (whole)
+    {
+        uint32_t crc = crc32(reinterpret_cast<const uint8_t *>(&header), PAGE_HEADER_SIZE - 4);
+        crc          = crc32(values, take * codec.rowSize(), crc32(reinterpret_cast<uint8_t *>(scales), batches * width(page), crc));
+        if (crc != header.crc)
+        {
+            return State::ECC_ERR;
+        }
+    }
+
+    for (uint16_t done = 0, batch = 0; done < take; batch++)
+    {
+        uint16_t rows = (firstBatch + batch + 1) * QUANT_BATCH - (row + done);
+        rows          = rows < take - done ? rows : take - done;
+        codec.decode(values + done * codec.rowSize(), rows, scales + batch * codec.channels(), reinterpret_cast<float *>(dest + done * width(page)));
+        done += rows;
+    }
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+bool ColumnLog<GEOMETRY>::isValid(const PageHeader &header, uint32_t group, uint8_t page) const
+{
+    return header.magic == MAGIC && header.schema == layout.id && header.group == group && header.column == page &&
+           header.columns == groupPages && header.count != 0 && header.count <= rowsPerGroup;
+}
+
+template <typename GEOMETRY>
+State ColumnLog<GEOMETRY>::readHeader(uint32_t group, uint8_t page, PageHeader &header, bool &valid)
+{
+    State state = flash.ReadMemory(addressOf(group, page, 0), reinterpret_cast<uint8_t *>(&header), PAGE_HEADER_SIZE);
+    valid       = state == State::OK && isValid(header, group, page);
+    return state;
+}
+
+template <typename GEOMETRY>
+State ColumnLog<GEOMETRY>::probe(uint16_t index, bool &written, uint32_t &block, uint32_t &firstTime)
+{
+    PageHeader header;
+    State state = flash.readRaw(Geometry::calcAddress(first + index, 0, 0), reinterpret_cast<uint8_t *>(&header), PAGE_HEADER_SIZE);
+    block       = header.group / groupsPerBlock;
+    written     = state == State::OK && header.group % groupsPerBlock == 0 && block % count == index && isValid(header, header.group, 0);
+    firstTime   = header.first;
+    return state;
+}
+
+template <typename GEOMETRY>
+void ColumnLog<GEOMETRY>::encodeBatch(uint8_t page, uint16_t batch, uint16_t rows)
+{
+    uint8_t *values = buffers[page] + valuesAt(page) + batch * QUANT_BATCH * storedWidth(page);
+    codecOf(page).encode(reinterpret_cast<float *>(values), rows, reinterpret_cast<float *>(buffers[page] + PAGE_HEADER_SIZE + batch * width(page)),
+                         values);
+}
+
+template <typename GEOMETRY>
+State ColumnLog<GEOMETRY>::writeGroup()
+{
+    for (uint8_t page = 1; page < groupPages && pendingRows % QUANT_BATCH != 0; page++)
+    {
+        if (isQuantized(page))
+        {
+            encodeBatch(page, pendingRows / QUANT_BATCH, pendingRows % QUANT_BATCH);
+        }
+    }
+    uint32_t firstTime;
+    uint32_t lastTime;
+    memcpy(&firstTime, buffers[0] + PAGE_HEADER_SIZE, 4);
+    memcpy(&lastTime, buffers[0] + PAGE_HEADER_SIZE + (pendingRows - 1) * 4, 4);
+    for (uint8_t page = 0; page < groupPages; page++)
+    {
+        uint8_t *buffer   = buffers[page];
+        uint32_t used     = valuesAt(page) + pendingRows * storedWidth(page);
+        PageHeader header = {MAGIC, layout.id, nextGroup, firstTime, lastTime, pendingRows, page, groupPages, 0};
+        memcpy(buffer, &header, PAGE_HEADER_SIZE);
+        memset(buffer + used, 0xFF, Geometry::PAGE_SIZE_BYTE - used);
+        /* the scales of the batches not written are left out, a read of the whole page reads those of its rows */
+        header.crc = crc32(buffer + PAGE_HEADER_SIZE, scaleBytes(page, pendingRows), crc32(buffer, PAGE_HEADER_SIZE - 4));
+        header.crc = crc32(buffer + valuesAt(page), pendingRows * storedWidth(page), header.crc);
+        memcpy(buffer + PAGE_HEADER_SIZE - 4, &header.crc, 4);
+        State state = writer.append(buffer, Geometry::PAGE_SIZE_BYTE);
+        if (state != State::OK)
+        {
+            return state;
+        }
+    }
+    if (nextGroup % groupsPerBlock == 0)
+    {
+        blockFirst[headBlock % count] = firstTime;
+    }
+    groupFirst[nextGroup % groupsPerBlock] = firstTime;
+    nextGroup++;
+    pendingRows = 0;
+    counters.groups++;
+    return nextGroup % groupsPerBlock == 0 ? advance() : State::OK;
+}
+
+template <typename GEOMETRY>
+State ColumnLog<GEOMETRY>::advance()
+{
+    State state = writer.close(Durability::LAZY);
+    if (state != State::OK)
+    {
+        return state;
+    }
+    headBlock = nextGroup / groupsPerBlock;
+
+    /* the block after the head is erased while the head fills, it takes the place of the oldest block. The head steps over the bad
+       blocks */
+    if ((state = eraseIfUsed(headBlock + 1)) != State::OK)
+    {
+        return state;
+    }
+    while (!isGood(headBlock % count))
+    {
+        headBlock++;
+        if ((state = eraseIfUsed(headBlock + 1)) != State::OK)
+        {
+            return state;
+        }
+    }
+    nextGroup = headBlock * groupsPerBlock;
+    if ((state = eraseIfUsed(headBlock)) != State::OK)
+    {
+        return state;
+    }
+    if (headBlock - tailBlock >= static_cast<uint32_t>(count - 1))
+    {
+        tailBlock = headBlock - (count - 2);
+    }
+
+    /* the table must not say that the erased blocks still hold data */
+    if ((state = flash.saveAddr()) != State::OK)
+    {
+        return state;
+    }
+    return writer.open(chipBlock(headBlock));
+}
+
+template <typename GEOMETRY>
+State ColumnLog<GEOMETRY>::eraseIfUsed(uint32_t block)
+{
+    bool wasErased;
+    return isGood(block % count) ? flash.eraseIfUsed(chipBlock(block), wasErased) : State::OK;
+}
+
+W25N_INSTANTIATE_FOR_ALL_GEOMETRIES(ColumnLog);
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
@@ -0,0 +1,46 @@
+#include "flashCrc.hpp"
+
+#include <cstring>
+
+#include "FreeRTOS.h"
+#include "crc.h"
+#include "task.h"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+uint32_t crc32(const uint8_t *data, uint32_t size, uint32_t crc)
+{
+    /* the unit shifts MSB first, the zlib state is the bit reversal of its register: the seed is reversed into INIT, the input is
+       reversed by the unit and so is the output (`MX_CRC_Init`). The tasks take turns, the interrupts never use the unit */
+    vTaskSuspendAll();
+    CRC->INIT = __RBIT(~crc);
+    CRC->CR   = (CRC->CR & ~CRC_CR_REV_IN) | CRC_CR_REV_IN | CRC_CR_RESET;  // a word is reversed whole, its first byte in memory goes first
+    while (size >= 4)
+    {
+        uint32_t word;
+        memcpy(&word, data, 4);
+        CRC->DR = word;
+        data += 4;
+        size -= 4;
+    }
+    CRC->CR = (CRC->CR & ~CRC_CR_REV_IN) | CRC_CR_REV_IN_0;  // then a byte at a time, back to the reversal by byte of `MX_CRC_Init`
+    while (size--)
+    {
+        *reinterpret_cast<volatile uint8_t *>(&CRC->DR) = *data++;
+    }
+    crc = ~CRC->DR;
+    xTaskResumeAll();
+    return crc;
+}
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
@@ -0,0 +1,255 @@
+#include "flashDecimator.hpp"
+
+#include <cstring>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+namespace
+{
+constexpr uint8_t HEADROOM = 4;  // words of the input and output buffers of the FMAC beyond the history, the slack of the DMA
+}  // namespace
+
+Decimator *Decimator::active = nullptr;
+
+Decimator::Decimator(FMAC_HandleTypeDef *handle)
+    : hfmac(handle),
+      running(false),
+      factor(1),
+      phase(0),
+      kept(0),
+      filling(0),
+      filled(0),
+      sending(false),
+      inputSize(0),
+      outputSize(0),
+      produced(0),
+      consumed(0)
+{
+    memset(&counters, 0, sizeof(counters));
+}
+
+State Decimator::start(const Config &config)
+{
+    if (active != nullptr)
+    {
+        return State::BUSY;
+    }
+
+    bool iir   = config.kind == Kind::IIR;
+    uint8_t p  = config.feedForwardCount;
+    uint8_t q  = iir ? config.feedBackCount : 0;
+    uint8_t x1 = p + HEADROOM;
+    uint8_t y  = (iir ? q : 1) + HEADROOM;
+    if (config.feedForward == nullptr || p < 2 || p > (iir ? 64 : 127) || (iir && (config.feedBack == nullptr || q == 0 || q >= p)) ||
+        config.gainShift > 7 || config.factor == 0 || p + q + x1 + y > MEMORY)
+    {
+        return State::PARAM_ERR;
+    }
+
+    /* the coefficients first, then the input history, then the output history */
+    FMAC_FilterConfigTypeDef filter;
+    filter.CoeffBaseAddress  = 0;
+    filter.CoeffBufferSize   = p + q;
+    filter.InputBaseAddress  = p + q;
+    filter.InputBufferSize   = x1;
+    filter.InputThreshold    = FMAC_THRESHOLD_1;
+    filter.OutputBaseAddress = p + q + x1;
+    filter.OutputBufferSize  = y;
+    filter.OutputThreshold   = FMAC_THRESHOLD_1;
+    filter.pCoeffB           = const_cast<int16_t *>(config.feedForward);
+    filter.CoeffBSize        = p;
+    filter.pCoeffA           = iir ? const_cast<int16_t *>(config.feedBack) : nullptr;
+    filter.CoeffASize        = q;
+    filter.InputAccess       = FMAC_BUFFER_ACCESS_DMA;
+    filter.OutputAccess      = FMAC_BUFFER_ACCESS_DMA;
+    filter.Clip              = FMAC_CLIP_ENABLED;
+    filter.Filter            = iir ? FMAC_FUNC_IIR_DIRECT_FORM_1 : FMAC_FUNC_CONVO_FIR;
+    filter.P                 = p;
+    filter.Q                 = q;
+    filter.R                 = config.gainShift;
+    if (HAL_FMAC_FilterConfig(hfmac, &filter) != HAL_OK)
+    {
+        return State::QSPI_ERR;
+    }
+
+    /* a zero history, the first outputs are those of a filter that has seen silence */
+    int16_t zeros[127];
+    memset(zeros, 0, sizeof(zeros));
+    if (HAL_FMAC_FilterPreload(hfmac, zeros, p - 1, iir ? zeros : nullptr, q) != HAL_OK)
+    {
+        return State::QSPI_ERR;
+    }
+
+    factor   = config.factor;
+    phase    = 0;
+    kept     = 0;
+    filling  = 0;
+    filled   = 0;
+    sending  = false;
+    produced = 0;
+    consumed = 0;
+    memset(&counters, 0, sizeof(counters));
+    outputSize = 2 * BLOCK;
+    active     = this;
+    running    = true;
+    if (HAL_FMAC_FilterStart(hfmac, output, &outputSize) != HAL_OK)
+    {
+        active  = nullptr;
+        running = false;
+        return State::QSPI_ERR;
+    }
+    return State::OK;
+}
+
+void Decimator::stop()
+{
+    if (!running)
+    {
+        return;
+    }
+    running = false;
+    HAL_FMAC_FilterStop(hfmac);
+    /* the HAL leaves the channels running, the output one is circular */
+    HAL_DMA_Abort(hfmac->hdmaIn);
+    HAL_DMA_Abort(hfmac->hdmaOut);
+    active = nullptr;
+}
+
+CCMRAM_FUNC bool Decimator::push(int16_t sample)
+{
+    if (!running || filled == BLOCK)
+    {
+        counters.droppedInputs++;
+        return false;
+    }
+    input[filling][filled] = sample;
+    filled                 = filled + 1;
+    if (filled == BLOCK)
+    {
+        /* the input DMA may end in between, `inputDone` then sends the block itself */
+        UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+        if (!sending && filled == BLOCK)
+        {
+            send();
+        }
+        taskEXIT_CRITICAL_FROM_ISR(mask);
+    }
+    return true;
+}
+
+void Decimator::send()
+{
+    sending   = true;
+    inputSize = BLOCK;
+    if (HAL_FMAC_AppendFilterData(hfmac, input[filling], &inputSize) != HAL_OK)
+    {
+        sending = false;
+        counters.droppedInputs += BLOCK;
+    }
+    filling ^= 1;
+    filled = 0;
+}
+
+void Decimator::inputDone()
+{
+    sending = false;
+    counters.inputs += BLOCK;
+    if (running && filled == BLOCK)
+    {
+        send();
+    }
+}
+
+CCMRAM_FUNC void Decimator::outputReady(bool secondHalf)
+{
+    const int16_t *filtered = output + (secondHalf ? BLOCK : 0);
+    bool full               = produced - consumed >= CHUNKS;
+    Chunk &chunk            = chunks[produced % CHUNKS];
+    uint32_t first          = kept;
+    uint16_t count          = 0;
+    for (uint32_t n = phase; n < BLOCK; n += factor)
+    {
+        if (!full)
+        {
+            chunk.samples[count] = filtered[n];
+        }
+        count++;
+    }
+    /* the phase of the next block, `factor` may be larger than a block */
+    phase = static_cast<uint16_t>((phase + static_cast<uint32_t>(count) * factor) - BLOCK);
+    kept += count;
+
+    if (count == 0)
+    {
+        return;
+    }
+    if (full)
+    {
+        counters.droppedOutputs += count;
+        return;
+    }
+    chunk.index = first;
+    chunk.count = count;
+    counters.outputs += count;
+    __COMPILER_BARRIER();  // the chunk is written before it is published
+    produced = produced + 1;
+}
+
+uint16_t Decimator::read(int16_t *samples, uint32_t &index)
+{
+    if (produced == consumed)
+    {
+        return 0;
+    }
+    __COMPILER_BARRIER();
+    const Chunk &chunk = chunks[consumed % CHUNKS];
+    memcpy(samples, chunk.samples, chunk.count * sizeof(int16_t));
+    index          = chunk.index;
+    uint16_t count = chunk.count;
+    consumed       = consumed + 1;
+    return count;
+}
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+using Core::Drivers::W25N01::Decimator;
+
+extern "C" void HAL_FMAC_GetDataCallback(FMAC_HandleTypeDef *handle)
+{
+    (void)handle;
+    if (Decimator::active != nullptr)
+    {
+        Decimator::active->inputDone();
+    }
+}
+
+extern "C" void HAL_FMAC_HalfOutputDataReadyCallback(FMAC_HandleTypeDef *handle)
+{
+    (void)handle;
+    if (Decimator::active != nullptr)
+    {
+        Decimator::active->outputReady(false);
+    }
+}
+
+extern "C" void HAL_FMAC_OutputDataReadyCallback(FMAC_HandleTypeDef *handle)
+{
+    (void)handle;
+    if (Decimator::active != nullptr)
+    {
+        Decimator::active->outputReady(true);
+    }
+}
+
+#endif
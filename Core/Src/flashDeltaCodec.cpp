@@ -0,0 +1,194 @@
+#include "flashDeltaCodec.hpp"
+
+#include <cstring>
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+namespace
+{
+constexpr uint8_t KEYFRAME = 0x01;  // a delta record starts with an even byte
+
+uint8_t putVarint(uint32_t value, uint8_t *out)
+{
+    uint8_t length = 0;
+    while (value >= 0x80)
+    {
+        out[length++] = static_cast<uint8_t>(value) | 0x80;
+        value >>= 7;
+    }
+    out[length++] = static_cast<uint8_t>(value);
+    return length;
+}
+
+/// the bytes read, 0 if the varint is cut or longer than 32 bits
+uint8_t getVarint(const uint8_t *in, uint16_t available, uint32_t &value)
+{
+    value = 0;
+    for (uint8_t length = 0; length < 5 && length < available; length++)
+    {
+        value |= static_cast<uint32_t>(in[length] & 0x7F) << (7 * length);
+        if (!(in[length] & 0x80))
+        {
+            return length + 1;
+        }
+    }
+    return 0;
+}
+
+/// the difference of two values of `bytes` bytes, sign extended and zigzagged so that the small differences of both signs are small
+uint32_t zigzag(uint32_t value, uint32_t previous, uint8_t bytes)
+{
+    uint8_t shift = 32 - 8 * bytes;
+    int32_t delta = static_cast<int32_t>((value - previous) << shift) >> shift;
+    return (static_cast<uint32_t>(delta) << 1) ^ static_cast<uint32_t>(delta >> 31);
+}
+
+uint32_t unzigzag(uint32_t code, uint32_t previous, uint8_t bytes)
+{
+    uint32_t delta = (code >> 1) ^ (0U - (code & 1));
+    uint32_t value = previous + delta;
+    return bytes == 4 ? value : value & ((1UL << (8 * bytes)) - 1);
+}
+}  // namespace
+
+uint8_t fieldSize(FieldType type)
+{
+    switch (type)
+    {
+        case FieldType::INT8:
+        case FieldType::UINT8:
+            return 1;
+        case FieldType::INT16:
+        case FieldType::UINT16:
+            return 2;
+        default:
+            return 4;
+    }
+}
+
+DeltaCodec::DeltaCodec(const FieldType *fieldTypes, uint8_t fieldCount, uint16_t keyframeInterval)
+    : types(fieldTypes), count(fieldCount), interval(keyframeInterval), size(0)
+{
+    for (uint8_t field = 0; field < count && field < MAX_FIELDS; field++)
+    {
+        size += fieldSize(types[field]);
+    }
+}
+
+uint16_t DeltaCodec::maxEncodedSize() const
+{
+    /* a varint takes one byte per 7 bits: 2, 3 and 5 bytes for the zigzags of 8, 16 and 32 bits */
+    uint16_t delta = 5;
+    for (uint8_t field = 0; field < count; field++)
+    {
+        delta += fieldSize(types[field]) + 1;
+    }
+    uint16_t keyframe = 5 + size;
+    return delta > keyframe ? delta : keyframe;
+}
+
+uint16_t DeltaCodec::encode(History &history, uint32_t time, const uint8_t *record, uint8_t *out) const
+{
+    uint32_t elapsed = time - history.time;
+    bool keyframe    = history.sinceKeyframe == NO_HISTORY || (interval && history.sinceKeyframe >= interval) || elapsed >= 0x80000000;
+    uint16_t length  = 0;
+    if (keyframe)
+    {
+        out[length++] = KEYFRAME;
+        memcpy(out + length, &time, 4);
+        memcpy(out + length + 4, record, size);
+        length += 4 + size;
+        history.sinceKeyframe = 0;
+    }
+    else
+    {
+        length += putVarint(elapsed << 1, out);
+        history.sinceKeyframe++;
+    }
+
+    for (uint8_t field = 0; field < count; field++)
+    {
+        uint8_t bytes  = fieldSize(types[field]);
+        uint32_t value = 0;
+        memcpy(&value, record, bytes);
+        if (!keyframe)
+        {
+            length += putVarint(zigzag(value, history.values[field], bytes), out + length);
+        }
+        history.values[field] = value;
+        record += bytes;
+    }
+    history.time = time;
+    return length;
+}
+
+uint16_t DeltaCodec::decode(History &history, const uint8_t *in, uint16_t available, uint32_t &time, uint8_t *record) const
+{
+    if (available == 0)
+    {
+        return 0;
+    }
+    uint16_t length = 0;
+    bool keyframe   = in[0] == KEYFRAME;
+    if (keyframe)
+    {
+        if (available < 5 + size)
+        {
+            return 0;
+        }
+        memcpy(&time, in + 1, 4);
+        length = 5;
+    }
+    else
+    {
+        uint32_t elapsed;
+        if (history.sinceKeyframe == NO_HISTORY || (length = getVarint(in, available, elapsed)) == 0)
+        {
+            return 0;
+        }
+        time = history.time + (elapsed >> 1);
+    }
+
+    for (uint8_t field = 0; field < count; field++)
+    {
+        uint8_t bytes  = fieldSize(types[field]);
+        uint32_t value = 0;
+        if (keyframe)
+        {
+            memcpy(&value, in + length, bytes);
+            length += bytes;
+        }
+        else
+        {
+            uint32_t code;
+            uint8_t used = getVarint(in + length, available - length, code);
+            if (used == 0)
+            {
+                return 0;
+            }
+            length += used;
+            value = unzigzag(code, history.values[field], bytes);
+        }
+        if (record != nullptr)
+        {
+            memcpy(record, &value, bytes);
+            record += bytes;
+        }
+        history.values[field] = value;
+    }
+    history.time          = time;
+    history.sinceKeyframe = keyframe ? 0 : history.sinceKeyframe + 1;
+    return length;
+}
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
@@ -0,0 +1,629 @@
+#include "flashFileSystem.hpp"
+
+#include <cstring>
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+template <typename GEOMETRY>
+State FileSystem<GEOMETRY>::File::read(void *data, uint32_t capacity, uint32_t &length)
+{
+    length = 0;
+    if (fs == nullptr)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    uint8_t *bytes = static_cast<uint8_t *>(data);
+    while (length < capacity && position < inode.size)
+    {
+        uint32_t filePage = position / Geometry::PAGE_SIZE_BYTE;
+        uint32_t byte     = position % Geometry::PAGE_SIZE_BYTE;
+        uint32_t chunk    = Geometry::PAGE_SIZE_BYTE - byte;
+        chunk             = chunk < capacity - length ? chunk : capacity - length;
+        chunk             = chunk < inode.size - position ? chunk : inode.size - position;
+        if (filePage == page)
+        {
+            memcpy(bytes + length, buffer + byte, chunk);
+        }
+        else
+        {
+            State state = fs->flash.ReadMemory(locate(filePage) + byte, bytes + length, chunk);
+            if (state != State::OK)
+            {
+                return state;
+            }
+        }
+        length += chunk;
+        position += chunk;
+    }
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State FileSystem<GEOMETRY>::File::write(const void *data, uint32_t size)
+{
+    if (fs == nullptr)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    if (mode == OpenMode::READ)
+    {
+        return State::PARAM_ERR;
+    }
+    if (mode == OpenMode::APPEND)
+    {
+        position = inode.size;
+    }
+    if (size > MAX_FILE_SIZE - position)
+    {
+        return State::NO_BUFFER;
+    }
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    while (size)
+    {
+        uint32_t filePage = position / Geometry::PAGE_SIZE_BYTE;
+        uint16_t byte     = position % Geometry::PAGE_SIZE_BYTE;
+        State state       = load(filePage);
+        if (state != State::OK)
+        {
+            return state;
+        }
+        uint16_t chunk = Geometry::PAGE_SIZE_BYTE - byte;
+        chunk          = chunk < size ? chunk : size;
+        memcpy(buffer + byte, bytes, chunk);
+        dirtyFrom = byte < dirtyFrom ? byte : dirtyFrom;
+        end       = byte + chunk > end ? byte + chunk : end;
+        position += chunk;
+        inode.size = position > inode.size ? position : inode.size;
+        bytes += chunk;
+        size -= chunk;
+
+        /* a full page is programmed right away, the buffer keeps it until the next page is loaded */
+        if (end == Geometry::PAGE_SIZE_BYTE && (state = flush()) != State::OK)
+        {
+            return state;
+        }
+    }
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State FileSystem<GEOMETRY>::File::seek(uint32_t offset)
+{
+    if (fs == nullptr)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    if (offset > inode.size)
+    {
+        return State::PARAM_ERR;
+    }
+    position = offset;
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State FileSystem<GEOMETRY>::File::sync(Durability durability)
+{
+    if (fs == nullptr)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    if (mode == OpenMode::READ)
+    {
+        return State::OK;
+    }
+    State state = flush();
+    if (state != State::OK || (state = finishCopy()) != State::OK)
+    {
+        return state;
+    }
+    if (memcmp(&inode, &committed, sizeof(Inode)) == 0)
+    {
+        return State::OK;
+    }
+    return fs->commit(*this, durability);
+}
+
+template <typename GEOMETRY>
+State FileSystem<GEOMETRY>::File::close(Durability durability)
+{
+    if (fs == nullptr)
+    {
+        return State::OK;
+    }
+    State state = sync(durability);
+    if (state != State::OK)
+    {
+        /* the blocks written since the last sync are lost, give them back */
+        for (uint16_t index = 0; index < inode.blockCount; index++)
+        {
+            if (!holds(committed, inode.blocks[index]))
+            {
+                fs->setUsed(inode.blocks[index], false);
+            }
+        }
+        if (copying && !holds(committed, copySource))
+        {
+            fs->setUsed(copySource, false);
+        }
+    }
+    fs      = nullptr;
+    page    = NO_PAGE;
+    copying = false;
+    return state;
+}
+
+template <typename GEOMETRY>
+uint32_t FileSystem<GEOMETRY>::File::locate(uint32_t filePage) const
+{
+    uint16_t index = filePage / Geometry::PAGE_PER_BLOCK;
+    uint16_t inner = filePage % Geometry::PAGE_PER_BLOCK;
+    uint16_t block = inode.blocks[index];
+    if (copying && index == copyIndex && inner >= Geometry::pagesFor(fs->writeOffset(block)))
+    {
+        block = copySource;
+    }
+    return Geometry::calcAddress(block, inner, 0);
+}
+
+template <typename GEOMETRY>
+State FileSystem<GEOMETRY>::File::flush()
+{
+    if (page == NO_PAGE || dirtyFrom >= end)
+    {
+        return State::OK;
+    }
+    return program();
+}
+
+template <typename GEOMETRY>
+State FileSystem<GEOMETRY>::File::load(uint32_t filePage)
+{
+    if (filePage == page)
+    {
+        return State::OK;
+    }
+    State state = flush();
+    if (state != State::OK)
+    {
+        return state;
+    }
+
+    uint32_t start = filePage * Geometry::PAGE_SIZE_BYTE;
+    uint32_t size  = inode.size > start ? inode.size - start : 0;
+    page           = NO_PAGE;
+    end            = size < Geometry::PAGE_SIZE_BYTE ? size : Geometry::PAGE_SIZE_BYTE;
+    onFlash        = end;
+    dirtyFrom      = end;
+    /* only the last page of the file can take more programs */
+    programs = end == 0 ? 0 : end < Geometry::PAGE_SIZE_BYTE ? inode.tailPrograms : PAGE_PROGRAMS;
+    if (end != 0 && (state = fs->flash.ReadMemory(locate(filePage), buffer, end)) != State::OK)
+    {
+        return state;
+    }
+    page = filePage;
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State FileSystem<GEOMETRY>::File::program()
+{
+    uint16_t index = page / Geometry::PAGE_PER_BLOCK;
+    uint16_t inner = page % Geometry::PAGE_PER_BLOCK;
+    State state    = State::OK;
+    if (index == inode.blockCount)
+    {
+        int32_t block = fs->allocate();
+        if (block < 0)
+        {
+            return State::NO_BUFFER;
+        }
+        inode.blocks[inode.blockCount++] = static_cast<uint16_t>(block);
+    }
+    if (copying && index != copyIndex && (state = finishCopy()) != State::OK)
+    {
+        return state;
+    }
+
+    /* a page of the block being copied that is still in the source is programmed whole in the new block */
+    uint16_t block  = inode.blocks[index];
+    uint16_t placed = onFlash;
+    if (copying && inner >= Geometry::pagesFor(fs->writeOffset(block)))
+    {
+        placed = 0;
+        if ((state = copyUpTo(inner)) != State::OK)
+        {
+            return state;
+        }
+    }
+
+    /* the rest of the page goes after the bytes already programmed, unless they changed or it would be one program too many */
+    if (fs->writeOffset(block) == (static_cast<uint32_t>(inner) << Geometry::BYTE_BITS) + placed && dirtyFrom >= placed &&
+        (placed == 0 || programs < PAGE_PROGRAMS))
+    {
+        if ((state = fs->flash.WriteMemory(block, buffer + placed, end - placed, Durability::LAZY)) != State::OK)
+        {
+            return state;
+        }
+        programs = placed == 0 ? 1 : programs + 1;
+    }
+    else
+    {
+        if ((state = copyBlock(index, page)) != State::OK)
+        {
+            return state;
+        }
+        programs = 1;
+    }
+    onFlash   = end;
+    dirtyFrom = end;
+    if (end < Geometry::PAGE_SIZE_BYTE)
+    {
+        inode.tailPrograms = programs;
+    }
+    fs->counters.pagesWritten++;
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State FileSystem<GEOMETRY>::File::copyBlock(uint16_t index, uint32_t filePage)
+{
+    State state = finishCopy();
+    if (state != State::OK)
+    {
+        return state;
+    }
+    int32_t block = fs->allocate();
+    if (block < 0)
+    {
+        return State::NO_BUFFER;
+    }
+    uint32_t start      = static_cast<uint32_t>(index) * Geometry::BLOCK_SIZE_BYTE;
+    uint32_t size       = inode.size - start < Geometry::BLOCK_SIZE_BYTE ? inode.size - start : Geometry::BLOCK_SIZE_BYTE;
+    copying             = true;
+    copyIndex           = index;
+    copySource          = inode.blocks[index];
+    copyEnd             = Geometry::pagesFor(size);
+    inode.blocks[index] = static_cast<uint16_t>(block);
+    fs->counters.blockCopies++;
+
+    if ((state = copyUpTo(filePage % Geometry::PAGE_PER_BLOCK)) != State::OK)
+    {
+        return state;
+    }
+    return fs->flash.WriteMemory(block, buffer, end, Durability::LAZY);
+}
+
+template <typename GEOMETRY>
+State FileSystem<GEOMETRY>::File::copyUpTo(uint16_t pageInBlock)
+{
+    uint16_t block = inode.blocks[copyIndex];
+    uint16_t inner = Geometry::pagesFor(fs->writeOffset(block));
+    if (inner >= pageInBlock || inner >= copyEnd)
+    {
+        return State::OK;
+    }
+    typename Manager<GEOMETRY>::PagePool::Lease lease = Manager<GEOMETRY>::pagePool().acquire();
+    if (!lease.valid())
+    {
+        return State::NO_BUFFER;
+    }
+    for (; inner < pageInBlock && inner < copyEnd; inner++)
+    {
+        /* the last page of the file is copied up to the end of the file, so that it can take more programs */
+        uint32_t start = static_cast<uint32_t>(copyIndex) * Geometry::BLOCK_SIZE_BYTE + (static_cast<uint32_t>(inner) << Geometry::BYTE_BITS);
+        uint16_t size  = inode.size - start < Geometry::PAGE_SIZE_BYTE ? inode.size - start : Geometry::PAGE_SIZE_BYTE;
+        State state    = fs->flash.ReadMemory(Geometry::calcAddress(copySource, inner, 0), lease.data(), size);
+        if (state != State::OK || (state = fs->flash.WriteMemory(block, lease.data(), size, Durability::LAZY)) != State::OK)
+        {
+            return state;
+        }
+        if (size < Geometry::PAGE_SIZE_BYTE)
+        {
+            inode.tailPrograms = 1;
+        }
+        fs->counters.pagesCopied++;
+    }
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State FileSystem<GEOMETRY>::File::finishCopy()
+{
+    if (!copying)
+    {
+        return State::OK;
+    }
+    State state = copyUpTo(copyEnd);
+    if (state != State::OK)
+    {
+        return state;
+    }
+    copying = false;
+    if (!holds(committed, copySource))  // written since the last sync, no inode on the chip holds it
+    {
+        fs->setUsed(copySource, false);
+    }
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+FileSystem<GEOMETRY>::FileSystem(Manager<GEOMETRY> &manager, uint16_t firstBlock, uint16_t blockCount)
+    : flash(manager),
+      directory(manager, firstBlock),
+      first(firstBlock + DIRECTORY_BLOCKS),
+      count(blockCount > DIRECTORY_BLOCKS ? blockCount - DIRECTORY_BLOCKS : 0),
+      mounted(false),
+      cursor(0),
+      used(),
+      counters()
+{
+}
+
+template <typename GEOMETRY>
+State FileSystem<GEOMETRY>::mount()
+{
+    if (!flash.isInited)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    if (mounted)
+    {
+        return State::OK;
+    }
+    if (count == 0 || first + count > Geometry::USER_BLOCK_COUNT)
+    {
+        return State::PARAM_ERR;
+    }
+    State state = directory.mount();
+    if (state != State::OK)
+    {
+        return state;
+    }
+
+    /* the blocks no inode holds are free, whatever the block table says: they were written after the last sync of their file. An inode
+       that fails its CRC on this read may hold any of them, so they all stay used but for those of the files removed or rewritten later */
+    memset(used, 0, sizeof(used));
+    uint32_t dropped = directory.stats().droppedRecords;
+    if ((state = directory.forEach(markVisitor, this)) != State::OK)
+    {
+        return state;
+    }
+    if (directory.stats().droppedRecords != dropped)
+    {
+        memset(used, 0xFF, sizeof(used));
+    }
+    mounted = true;
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State FileSystem<GEOMETRY>::open(const char *name, OpenMode mode, File &file)
+{
+    if (!mounted)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    size_t nameLength = strlen(name);
+    if (file.isOpen() || nameLength == 0 || nameLength > MAX_NAME_SIZE)
+    {
+        return State::PARAM_ERR;
+    }
+    memset(&file.committed, 0, sizeof(Inode));
+    uint16_t length;
+    State state = directory.get(name, &file.committed, sizeof(Inode), length);
+    bool exists = state == State::OK;
+    if (!exists && state != State::PARAM_ERR)
+    {
+        return state;
+    }
+    if (exists && (file.committed.blockCount > MAX_FILE_BLOCKS || length != inodeSize(file.committed)))
+    {
+        return State::ECC_ERR;
+    }
+    if (!exists && (mode == OpenMode::READ || mode == OpenMode::UPDATE))
+    {
+        return State::PARAM_ERR;
+    }
+
+    memcpy(file.name, name, nameLength + 1);
+    file.fs       = this;
+    file.mode     = mode;
+    file.inode    = file.committed;
+    file.position = mode == OpenMode::APPEND ? file.inode.size : 0;
+    file.page     = File::NO_PAGE;
+    file.copying  = false;
+    if (mode == OpenMode::WRITE)
+    {
+        memset(&file.inode, 0, sizeof(Inode));
+    }
+
+    /* a new file and a truncation are in the directory at once */
+    if ((!exists && mode != OpenMode::READ) || (mode == OpenMode::WRITE && file.committed.size != 0))
+    {
+        if ((state = commit(file, Durability::DEFAULT)) != State::OK)
+        {
+            file.fs = nullptr;
+            return state;
+        }
+    }
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State FileSystem<GEOMETRY>::remove(const char *name, Durability durability)
+{
+    if (!mounted)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    Inode inode;
+    uint16_t length;
+    State state = directory.get(name, &inode, sizeof(inode), length);
+    if (state != State::OK)
+    {
+        return state;
+    }
+    if ((state = directory.remove(name, durability)) != State::OK)
+    {
+        return state;
+    }
+    for (uint16_t index = 0; index < inode.blockCount && index < MAX_FILE_BLOCKS; index++)
+    {
+        setUsed(inode.blocks[index], false);
+    }
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State FileSystem<GEOMETRY>::fileSize(const char *name, uint32_t &size)
+{
+    if (!mounted)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    Inode inode;
+    uint16_t length;
+    State state = directory.get(name, &inode, sizeof(inode), length);
+    size        = state == State::OK ? inode.size : 0;
+    return state;
+}
+
+template <typename GEOMETRY>
+State FileSystem<GEOMETRY>::list(Visitor visitor, void *context)
+{
+    if (!mounted)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    Listing listing = {visitor, context};
+    return directory.forEach(listVisitor, &listing);
+}
+
+template <typename GEOMETRY>
+uint16_t FileSystem<GEOMETRY>::freeBlocks() const
+{
+    uint16_t free = 0;
+    for (uint16_t block = first; block < first + count; block++)
+    {
+        free += isFree(block);
+    }
+    return free;
+}
+
+template <typename GEOMETRY>
+bool FileSystem<GEOMETRY>::holds(const Inode &inode, uint16_t block)
+{
+    for (uint16_t index = 0; index < inode.blockCount; index++)
+    {
+        if (inode.blocks[index] == block)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename GEOMETRY>
+void FileSystem<GEOMETRY>::setUsed(uint16_t block, bool value)
+{
+    if (block < first || block >= first + count)
+    {
+        return;
+    }
+    uint32_t bit = 1UL << ((block - first) % 32);
+    if (value)
+    {
+        used[(block - first) / 32] |= bit;
+    }
+    else
+    {
+        used[(block - first) / 32] &= ~bit;
+    }
+}
+
+template <typename GEOMETRY>
+int32_t FileSystem<GEOMETRY>::allocate()
+{
+    /* round robin over the blocks, so that the files that are rewritten often do not wear the same blocks */
+    for (uint16_t n = 0; n < count; n++)
+    {
+        uint16_t block = first + (cursor + n) % count;
+        if (!isFree(block) || flash.isLocked(block, true))
+        {
+            continue;
+        }
+        BlockState blockState = flash.blocks[block].state();
+        if (blockState != BlockState::FREE && blockState != BlockState::ALLOCATED)
+        {
+            if (flash.EraseBlock(block, false) != State::OK)
+            {
+                continue;
+            }
+            counters.blocksReused++;
+        }
+        flash.blocks.allocate(block);  // keep the refill away until the block is written
+        setUsed(block, true);
+        cursor = (block - first + 1) % count;
+        return block;
+    }
+    return -1;
+}
+
+template <typename GEOMETRY>
+State FileSystem<GEOMETRY>::commit(File &file, Durability durability)
+{
+    /* the data was written lazily, the table is saved with the inode */
+    State state = directory.put(file.name, &file.inode, inodeSize(file.inode), durability);
+    if (state != State::OK)
+    {
+        return state;
+    }
+    for (uint16_t index = 0; index < file.committed.blockCount; index++)
+    {
+        if (!holds(file.inode, file.committed.blocks[index]))
+        {
+            setUsed(file.committed.blocks[index], false);
+        }
+    }
+    file.committed = file.inode;
+    counters.commits++;
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+bool FileSystem<GEOMETRY>::markVisitor(const char *key, const uint8_t *value, uint16_t length, void *context)
+{
+    FileSystem &fs = *static_cast<FileSystem *>(context);
+    Inode inode;
+    memset(&inode, 0, sizeof(inode));
+    memcpy(&inode, value, length < sizeof(inode) ? length : sizeof(inode));
+    for (uint16_t index = 0; index < inode.blockCount && index < MAX_FILE_BLOCKS; index++)
+    {
+        fs.setUsed(inode.blocks[index], true);
+    }
+    return true;
+}
+
+template <typename GEOMETRY>
+bool FileSystem<GEOMETRY>::listVisitor(const char *key, const uint8_t *value, uint16_t length, void *context)
+{
+    Listing &listing = *static_cast<Listing *>(context);
+    uint32_t size    = 0;
+    memcpy(&size, value, length < sizeof(size) ? length : sizeof(size));
+    return listing.visitor(key, size, listing.context);
+}
+
+W25N_INSTANTIATE_FOR_ALL_GEOMETRIES(FileSystem);
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
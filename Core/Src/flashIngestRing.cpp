@@ -0,0 +1,209 @@
+#include "flashIngestRing.hpp"
+
+#include <cstring>
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+IngestRing::IngestRing() : reserved(0), committed(0), released(0), writers(0)
+{
+    for (uint8_t producer = 0; producer < MAX_PRODUCERS; producer++)
+    {
+        policies[producer] = Backpressure::DROP_NEWEST;
+    }
+    memset(counters, 0, sizeof(counters));
+}
+
+void IngestRing::setPolicy(uint8_t producer, Backpressure policy)
+{
+    if (producer < MAX_PRODUCERS)
+    {
+        policies[producer] = policy;
+    }
+}
+
+CCMRAM_FUNC void IngestRing::enter()
+{
+    uint32_t count;
+    do
+    {
+        count = __LDREXW(&writers);
+    } while (__STREXW(count + 1, &writers));
+}
+
+CCMRAM_FUNC void IngestRing::leave()
+{
+    /* `reserved` is read inside the exclusive section: when the count drops to 0 without an interrupt in between, every reservation
+     * before `head` is complete */
+    uint32_t count;
+    uint32_t head;
+    do
+    {
+        count = __LDREXW(&writers);
+        head  = reserved;
+    } while (__STREXW(count - 1, &writers));
+    if (count != 1)
+    {
+        return;
+    }
+
+    /* a writer that started after the count dropped may have published a later head already, the head never goes back */
+    __DMB();
+    uint32_t current;
+    do
+    {
+        current = __LDREXW(&committed);
+        if (static_cast<int32_t>(head - current) <= 0)
+        {
+            __CLREX();
+            return;
+        }
+    } while (__STREXW(head, &committed));
+}
+
+CCMRAM_FUNC bool IngestRing::evict(ProducerStats &stats)
+{
+    uint32_t tail;
+    bool padding;
+    do
+    {
+        tail = __LDREXW(&released);
+        if (tail == committed)
+        {
+            __CLREX();
+            return false;
+        }
+        padding = headerAt(tail)->flags & PADDING;
+    } while (__STREXW(tail + footprint(headerAt(tail)->length), &released));
+    if (!padding)
+    {
+        stats.evicted++;
+    }
+    return true;
+}
+
+CCMRAM_FUNC uint8_t *IngestRing::reserve(uint8_t producer, uint16_t size)
+{
+    if (producer >= MAX_PRODUCERS || size > MAX_RECORD)
+    {
+        return nullptr;
+    }
+    ProducerStats &stats = counters[producer];
+    uint32_t total       = footprint(size);
+
+    enter();
+    uint32_t head;
+    uint32_t padding;
+    while (true)
+    {
+        head = __LDREXW(&reserved);
+        /* a record that would cross the end of the ring starts at its beginning, after a padding record */
+        uint32_t left = SIZE - (head & (SIZE - 1));
+        padding       = left < total ? left : 0;
+        if (head + padding + total - released > SIZE)
+        {
+            __CLREX();
+            if (policies[producer] == Backpressure::DROP_OLDEST && evict(stats))
+            {
+                continue;
+            }
+            stats.dropped++;
+            leave();
+            return nullptr;
+        }
+        if (__STREXW(head + padding + total, &reserved) == 0)
+        {
+            break;
+        }
+    }
+
+    if (padding != 0)
+    {
+        Header *pad   = headerAt(head);
+        pad->length   = padding - sizeof(Header);
+        pad->producer = producer;
+        pad->flags    = PADDING;
+        head += padding;
+    }
+    Header *header   = headerAt(head);
+    header->length   = size;
+    header->producer = producer;
+    header->flags    = 0;
+    stats.records++;
+    return reinterpret_cast<uint8_t *>(header + 1);
+}
+
+CCMRAM_FUNC bool IngestRing::write(uint8_t producer, const void *data, uint16_t size)
+{
+    uint8_t *record = reserve(producer, size);
+    if (record == nullptr)
+    {
+        return false;
+    }
+    memcpy(record, data, size);
+    commit();
+    return true;
+}
+
+uint16_t IngestRing::drain(uint8_t *out, uint16_t capacity)
+{
+    while (true)
+    {
+        uint32_t tail = released;
+        uint32_t end  = committed;
+        __DMB();
+
+        /* the records are copied before they are released, a producer dropping the oldest ones may overwrite them meanwhile: the
+         * release then fails and the copy is thrown away. A torn header is bounded so that the copy stays in the ring and in `out` */
+        uint32_t position = tail;
+        uint16_t used     = 0;
+        while (position != end)
+        {
+            const Header *header = headerAt(position);
+            uint16_t length      = header->length;
+            uint32_t total       = footprint(length);
+            if (total > end - position || total > SIZE - (position & (SIZE - 1)))
+            {
+                break;
+            }
+            if (!(header->flags & PADDING))
+            {
+                if (used + RECORD_HEADER + length > capacity)
+                {
+                    break;
+                }
+                memcpy(out + used, &length, 2);
+                out[used + 2] = header->producer;
+                memcpy(out + used + RECORD_HEADER, header + 1, length);
+                used += RECORD_HEADER + length;
+            }
+            position += total;
+        }
+        if (position == tail)
+        {
+            return 0;
+        }
+
+        __DMB();
+        if (__LDREXW(&released) != tail)
+        {
+            __CLREX();
+            continue;
+        }
+        if (__STREXW(position, &released) == 0 && used != 0)
+        {
+            return used;
+        }
+    }
+}
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
@@ -0,0 +1,606 @@
+#include "flashKvStore.hpp"
+
+#include <cstring>
+
+#include "flashCrc.hpp"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+template <typename GEOMETRY>
+KvStore<GEOMETRY>::KvStore(Manager<GEOMETRY> &manager, uint16_t firstBlock)
+    : flash(manager), first(firstBlock), mounted(false), active(0), generation(0), keys(0), used(0), programs(0), index(), counters()
+{
+}
+
+template <typename GEOMETRY>
+State KvStore<GEOMETRY>::mount()
+{
+    if (!flash.isInited)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    if (mounted)
+    {
+        return State::OK;
+    }
+    if (first + 2 > Geometry::USER_BLOCK_COUNT)
+    {
+        return State::PARAM_ERR;
+    }
+    counters.droppedRecords = 0;
+
+    bool valid[2];
+    uint32_t generations[2];
+    State state = State::OK;
+    for (uint8_t which = 0; which < 2; which++)
+    {
+        if ((state = probe(chipBlock(which), valid[which], generations[which])) != State::OK)
+        {
+            return state;
+        }
+    }
+
+    /* the newest block first, it is only used if its compaction went through to the seal */
+    uint8_t newest = valid[1] && (!valid[0] || static_cast<int32_t>(generations[1] - generations[0]) > 0) ? 1 : 0;
+    for (uint8_t n = 0; n < 2; n++)
+    {
+        uint8_t which = newest ^ n;
+        if (!valid[which])
+        {
+            continue;
+        }
+        bool sealed = false;
+        clearIndex();
+        if ((state = scan(chipBlock(which), sealed)) != State::OK)
+        {
+            return state;
+        }
+        if (sealed)
+        {
+            active     = which;
+            generation = generations[which];
+            programs   = PAGE_PROGRAMS;  // the programs the last page has taken are not known, the next record starts a new page
+            mounted    = true;
+            return State::OK;
+        }
+    }
+
+    /* a new store: an empty compaction into block 0 */
+    clearIndex();
+    active     = 1;
+    generation = valid[newest] ? generations[newest] : 0;
+    mounted    = true;
+    if ((state = rewrite()) != State::OK)
+    {
+        mounted = false;
+    }
+    return state;
+}
+
+template <typename GEOMETRY>
+State KvStore<GEOMETRY>::get(const char *key, void *buffer, uint16_t capacity, uint16_t &length)
+{
+    length = 0;
+    if (!mounted)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    uint8_t keyLength;
+    uint32_t hash = hashOf(key, keyLength);
+    int16_t found = find(hash, key, keyLength);
+    if (found < 0)
+    {
+        return State::PARAM_ERR;
+    }
+    const Slot &slot = index[found];
+    if (slot.valueLength > capacity)
+    {
+        return State::NO_BUFFER;
+    }
+    if (slot.cached)
+    {
+        memcpy(buffer, slot.cache, slot.valueLength);
+        length = slot.valueLength;
+        counters.cacheHits++;
+        return State::OK;
+    }
+
+    typename Manager<GEOMETRY>::PagePool::Lease lease = Manager<GEOMETRY>::pagePool().acquire();
+    if (!lease.valid())
+    {
+        return State::NO_BUFFER;
+    }
+    uint16_t total = RECORD_HEADER_SIZE + keyLength + slot.valueLength;
+    State state    = flash.ReadMemory(
+        Geometry::calcAddress(chipBlock(active), slot.offset >> Geometry::BYTE_BITS, slot.offset & Geometry::BYTE_MASK), lease.data(), total);
+    if (state != State::OK)
+    {
+        return state;
+    }
+    counters.pageReads++;
+
+    RecordHeader header;
+    memcpy(&header, lease.data(), RECORD_HEADER_SIZE);
+    if (header.crc != crc32(lease.data() + RECORD_HEADER_SIZE, total - RECORD_HEADER_SIZE, crc32(lease.data(), RECORD_HEADER_SIZE - 4)))
+    {
+        return State::ECC_ERR;
+    }
+    memcpy(buffer, lease.data() + RECORD_HEADER_SIZE + keyLength, slot.valueLength);
+    length = slot.valueLength;
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State KvStore<GEOMETRY>::put(const char *key, const void *value, uint16_t size, Durability durability)
+{
+    if (!mounted)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    uint8_t keyLength;
+    uint32_t hash = hashOf(key, keyLength);
+    if (keyLength == 0 || keyLength > MAX_KEY_SIZE || RECORD_HEADER_SIZE + keyLength + size > Geometry::PAGE_SIZE_BYTE)
+    {
+        return State::PARAM_ERR;
+    }
+    int16_t found = find(hash, key, keyLength);
+    if (found >= 0 && index[found].cached && index[found].valueLength == size && memcmp(index[found].cache, value, size) == 0)
+    {
+        counters.unchangedPuts++;
+        return State::OK;
+    }
+    if (found < 0)
+    {
+        if (keys >= MAX_KEYS)
+        {
+            return State::NO_BUFFER;
+        }
+        if (used >= MAX_KEYS)  // too many tombstones, the compaction leaves them behind
+        {
+            State state = compact();
+            if (state != State::OK)
+            {
+                return state;
+            }
+        }
+    }
+
+    uint32_t version = found >= 0 ? index[found].version + 1 : 1;
+    uint32_t offset;
+    State state = append(Kind::PUT, hash, version, key, keyLength, value, size, durability, offset);
+    if (state != State::OK)
+    {
+        return state;
+    }
+
+    /* a compaction rebuilds the index, look the slot up again */
+    if ((found = find(hash, key, keyLength)) < 0)
+    {
+        found = claim(hash, key, keyLength);
+    }
+    Slot &slot       = index[found];
+    slot.offset      = offset;
+    slot.version     = version;
+    slot.valueLength = size;
+    slot.keyLength   = keyLength;
+    slot.cached      = size <= CACHED_VALUE_SIZE;
+    if (slot.cached)
+    {
+        memcpy(slot.cache, value, size);
+    }
+    counters.puts++;
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State KvStore<GEOMETRY>::remove(const char *key, Durability durability)
+{
+    if (!mounted)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    uint8_t keyLength;
+    uint32_t hash = hashOf(key, keyLength);
+    int16_t found = find(hash, key, keyLength);
+    if (found < 0)
+    {
+        return State::PARAM_ERR;
+    }
+    uint32_t offset;
+    State state = append(Kind::REMOVE, hash, index[found].version + 1, key, keyLength, nullptr, 0, durability, offset);
+    if (state != State::OK)
+    {
+        return state;
+    }
+    if ((found = find(hash, key, keyLength)) >= 0)
+    {
+        index[found].offset = TOMBSTONE;
+        keys--;
+    }
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State KvStore<GEOMETRY>::compact()
+{
+    if (!mounted)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    return rewrite();
+}
+
+template <typename GEOMETRY>
+State KvStore<GEOMETRY>::forEach(Visitor visitor, void *context)
+{
+    if (!mounted)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    typename Manager<GEOMETRY>::PagePool::Lease lease = Manager<GEOMETRY>::pagePool().acquire();
+    if (!lease.valid())
+    {
+        return State::NO_BUFFER;
+    }
+    for (const Slot &slot : index)
+    {
+        if (slot.offset == EMPTY || slot.offset == TOMBSTONE)
+        {
+            continue;
+        }
+        uint16_t total   = RECORD_HEADER_SIZE + slot.keyLength + slot.valueLength;
+        uint32_t address = Geometry::calcAddress(chipBlock(active), slot.offset >> Geometry::BYTE_BITS, slot.offset & Geometry::BYTE_MASK);
+        State state      = flash.ReadMemory(address, lease.data(), total);
+        if (state != State::OK)
+        {
+            return state;
+        }
+        counters.pageReads++;
+
+        RecordHeader header;
+        memcpy(&header, lease.data(), RECORD_HEADER_SIZE);
+        if (header.crc != crc32(lease.data() + RECORD_HEADER_SIZE, total - RECORD_HEADER_SIZE, crc32(lease.data(), RECORD_HEADER_SIZE - 4)))
+        {
+            counters.droppedRecords++;
+            continue;
+        }
+        char key[MAX_KEY_SIZE + 1];
+        memcpy(key, lease.data() + RECORD_HEADER_SIZE, slot.keyLength);
+        key[slot.keyLength] = '\0';
+        if (!visitor(key, lease.data() + RECORD_HEADER_SIZE + slot.keyLength, slot.valueLength, context))
+        {
+            break;
+        }
+    }
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+bool KvStore<GEOMETRY>::contains(const char *key) const
+{
+    uint8_t keyLength;
+    uint32_t hash = hashOf(key, keyLength);
+    return find(hash, key, keyLength) >= 0;
+}
+
+template <typename GEOMETRY>
+uint32_t KvStore<GEOMETRY>::version(const char *key) const
+{
+    uint8_t keyLength;
+    uint32_t hash = hashOf(key, keyLength);
+    int16_t found = find(hash, key, keyLength);
+    return found < 0 ? 0 : index[found].version;
+}
+
+template <typename GEOMETRY>
+uint32_t KvStore<GEOMETRY>::hashOf(const char *key, uint8_t &length)
+{
+    uint32_t hash = 2166136261UL;
+    length        = 0;
+    while (key[length] != '\0' && length <= MAX_KEY_SIZE)
+    {
+        hash ^= static_cast<uint8_t>(key[length++]);
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+template <typename GEOMETRY>
+int16_t KvStore<GEOMETRY>::find(uint32_t hash, const char *key, uint8_t keyLength) const
+{
+    /* two keys with the same hash take two slots of the probe sequence, the key itself tells them apart */
+    for (uint16_t n = 0, i = hash & (INDEX_SIZE - 1); n < INDEX_SIZE; n++, i = (i + 1) & (INDEX_SIZE - 1))
+    {
+        if (index[i].offset == EMPTY)
+        {
+            return -1;
+        }
+        if (index[i].offset != TOMBSTONE && index[i].hash == hash && index[i].keyLength == keyLength &&
+            memcmp(index[i].key, key, keyLength) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+template <typename GEOMETRY>
+int16_t KvStore<GEOMETRY>::claim(uint32_t hash, const char *key, uint8_t keyLength)
+{
+    uint16_t i = hash & (INDEX_SIZE - 1);
+    while (index[i].offset != EMPTY && index[i].offset != TOMBSTONE)
+    {
+        i = (i + 1) & (INDEX_SIZE - 1);
+    }
+    if (index[i].offset == EMPTY)
+    {
+        used++;
+    }
+    index[i].hash      = hash;
+    index[i].keyLength = keyLength;
+    memcpy(index[i].key, key, keyLength);
+    keys++;
+    return i;
+}
+
+template <typename GEOMETRY>
+void KvStore<GEOMETRY>::clearIndex()
+{
+    for (Slot &slot : index)
+    {
+        slot.offset = EMPTY;
+    }
+    keys = 0;
+    used = 0;
+}
+
+template <typename GEOMETRY>
+uint16_t KvStore<GEOMETRY>::encode(uint8_t *dest, Kind kind, uint32_t hash, uint32_t version, const char *key, uint8_t keyLength,
+                                   const void *value, uint16_t size)
+{
+    RecordHeader header = {hash, version, size, keyLength, kind, 0};
+    memcpy(dest, &header, RECORD_HEADER_SIZE);
+    memcpy(dest + RECORD_HEADER_SIZE, key, keyLength);
+    if (size)
+    {
+        memcpy(dest + RECORD_HEADER_SIZE + keyLength, value, size);
+    }
+    header.crc = crc32(dest + RECORD_HEADER_SIZE, keyLength + size, crc32(dest, RECORD_HEADER_SIZE - 4));
+    memcpy(dest + RECORD_HEADER_SIZE - 4, &header.crc, 4);
+    return RECORD_HEADER_SIZE + keyLength + size;
+}
+
+template <typename GEOMETRY>
+State KvStore<GEOMETRY>::append(Kind kind, uint32_t hash, uint32_t version, const char *key, uint8_t keyLength, const void *value,
+                                uint16_t size, Durability durability, uint32_t &offset)
+{
+    uint16_t total = RECORD_HEADER_SIZE + keyLength + size;
+    for (uint8_t attempt = 0;; attempt++)
+    {
+        /* a record never crosses a page, so that a lookup reads one page, and starts a new page once the last one has taken all the
+         * programs the chip allows */
+        offset        = flash.blocks[chipBlock(active)].writeOffset();
+        uint16_t byte = offset & Geometry::BYTE_MASK;
+        if (byte + total > Geometry::PAGE_SIZE_BYTE || (byte != 0 && programs >= PAGE_PROGRAMS))
+        {
+            offset = (offset | Geometry::BYTE_MASK) + 1;
+        }
+        if (offset + total <= Geometry::BLOCK_SIZE_BYTE)
+        {
+            break;
+        }
+        if (attempt == 1)
+        {
+            return State::NO_BUFFER;
+        }
+        State state = rewrite();
+        if (state != State::OK)
+        {
+            return state;
+        }
+    }
+
+    typename Manager<GEOMETRY>::PagePool::Lease lease = Manager<GEOMETRY>::pagePool().acquire();
+    if (!lease.valid())
+    {
+        return State::NO_BUFFER;
+    }
+    encode(lease.data(), kind, hash, version, key, keyLength, value, size);
+    uint16_t block = chipBlock(active);
+    if (offset != flash.blocks[block].writeOffset())
+    {
+        flash.blocks.setWriteOffset(block, offset);
+    }
+    State state = flash.WriteMemory(block, lease.data(), total, durability);
+    if (state == State::OK)
+    {
+        programs = (offset & Geometry::BYTE_MASK) == 0 ? 1 : programs + 1;
+    }
+    return state;
+}
+
+template <typename GEOMETRY>
+State KvStore<GEOMETRY>::probe(uint16_t block, bool &valid, uint32_t &blockGeneration)
+{
+    uint8_t header[BLOCK_HEADER_SIZE];
+    State state = flash.ReadMemory(Geometry::calcAddress(block, 0, 0), header, BLOCK_HEADER_SIZE);
+    uint32_t magic;
+    memcpy(&magic, header, 4);
+    memcpy(&blockGeneration, header + 4, 4);
+    valid = state == State::OK && magic == MAGIC;
+    return state;
+}
+
+template <typename GEOMETRY>
+State KvStore<GEOMETRY>::scan(uint16_t block, bool &sealed)
+{
+    typename Manager<GEOMETRY>::PagePool::Lease lease = Manager<GEOMETRY>::pagePool().acquire();
+    if (!lease.valid())
+    {
+        return State::NO_BUFFER;
+    }
+    uint8_t *page = lease.data();
+    uint32_t end  = flash.blocks[block].writeOffset();
+    sealed        = false;
+
+    for (uint16_t pageNumber = 0; pageNumber < Geometry::pagesFor(end); pageNumber++)
+    {
+        State state = flash.ReadMemory(Geometry::calcAddress(block, pageNumber, 0), page, Geometry::PAGE_SIZE_BYTE);
+        if (state != State::OK)
+        {
+            return state;
+        }
+
+        /* the rest of a page is skipped after its first blank or broken record */
+        uint32_t position = pageNumber == 0 ? BLOCK_HEADER_SIZE : 0;
+        while (position + RECORD_HEADER_SIZE <= Geometry::PAGE_SIZE_BYTE)
+        {
+            RecordHeader header;
+            memcpy(&header, page + position, RECORD_HEADER_SIZE);
+            if (header.hash == BLANK && header.valueLength == 0xFFFF)
+            {
+                break;
+            }
+            uint32_t total = RECORD_HEADER_SIZE + header.keyLength + header.valueLength;
+            if (header.kind < Kind::PUT || header.kind > Kind::SEAL || header.keyLength > MAX_KEY_SIZE || position + total > Geometry::PAGE_SIZE_BYTE ||
+                header.crc != crc32(page + position + RECORD_HEADER_SIZE, total - RECORD_HEADER_SIZE, crc32(page + position, RECORD_HEADER_SIZE - 4)))
+            {
+                counters.droppedRecords++;
+                break;
+            }
+
+            const char *key = reinterpret_cast<const char *>(page + position + RECORD_HEADER_SIZE);
+            int16_t found   = header.kind == Kind::SEAL ? -1 : find(header.hash, key, header.keyLength);
+            if (header.kind == Kind::SEAL)
+            {
+                sealed = true;
+            }
+            else if (header.kind == Kind::REMOVE)
+            {
+                if (found >= 0)
+                {
+                    index[found].offset = TOMBSTONE;
+                    keys--;
+                }
+            }
+            else
+            {
+                if (found < 0)
+                {
+                    if (keys >= MAX_KEYS || used >= INDEX_SIZE - 1)
+                    {
+                        return State::NO_BUFFER;
+                    }
+                    found = claim(header.hash, key, header.keyLength);
+                }
+                Slot &slot       = index[found];
+                slot.offset      = (static_cast<uint32_t>(pageNumber) << Geometry::BYTE_BITS) + position;
+                slot.version     = header.version;
+                slot.valueLength = header.valueLength;
+                slot.keyLength   = header.keyLength;
+                slot.cached      = header.valueLength <= CACHED_VALUE_SIZE;
+                if (slot.cached)
+                {
+                    memcpy(slot.cache, page + position + RECORD_HEADER_SIZE + header.keyLength, header.valueLength);
+                }
+            }
+            position += total;
+        }
+    }
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State KvStore<GEOMETRY>::rewrite()
+{
+    uint16_t source = chipBlock(active);
+    uint16_t target = chipBlock(active ^ 1);
+    if (flash.isLocked(target, true))
+    {
+        return State::BUSY;
+    }
+    State state = flash.EraseBlock(target, false);
+    if (state != State::OK)
+    {
+        return state;
+    }
+    flash.blocks.allocate(target);  // keep the refill away until the header is written
+
+    typename Manager<GEOMETRY>::PagePool::Lease lease = Manager<GEOMETRY>::pagePool().acquire();
+    if (!lease.valid())
+    {
+        return State::NO_BUFFER;
+    }
+    uint8_t *page           = lease.data();
+    uint32_t nextGeneration = generation + 1;
+    uint32_t magic          = MAGIC;
+    memcpy(page, &magic, 4);
+    memcpy(page + 4, &nextGeneration, 4);
+    uint32_t fill = BLOCK_HEADER_SIZE;
+
+    /* the live records are assembled a page at a time, each page is one program */
+    for (const Slot &slot : index)
+    {
+        if (slot.offset == EMPTY || slot.offset == TOMBSTONE)
+        {
+            continue;
+        }
+        uint16_t total = RECORD_HEADER_SIZE + slot.keyLength + slot.valueLength;
+        if (fill + total > Geometry::PAGE_SIZE_BYTE)
+        {
+            if ((state = flash.WriteMemory(target, page, fill, Durability::LAZY)) != State::OK)
+            {
+                return state;
+            }
+            flash.blocks.setWriteOffset(target, (flash.blocks[target].writeOffset() | Geometry::BYTE_MASK) + 1);
+            fill = 0;
+        }
+        uint32_t address = Geometry::calcAddress(source, slot.offset >> Geometry::BYTE_BITS, slot.offset & Geometry::BYTE_MASK);
+        if ((state = flash.ReadMemory(address, page + fill, total)) != State::OK)
+        {
+            return state;
+        }
+        fill += total;
+    }
+
+    /* the seal makes the block the one the mount picks, the table is saved with it */
+    if (fill + RECORD_HEADER_SIZE > Geometry::PAGE_SIZE_BYTE)
+    {
+        if ((state = flash.WriteMemory(target, page, fill, Durability::LAZY)) != State::OK)
+        {
+            return state;
+        }
+        flash.blocks.setWriteOffset(target, (flash.blocks[target].writeOffset() | Geometry::BYTE_MASK) + 1);
+        fill = 0;
+    }
+    fill += encode(page + fill, Kind::SEAL, 0, nextGeneration, "", 0, nullptr, 0);
+    if ((state = flash.WriteMemory(target, page, fill, Durability::SYNC)) != State::OK)
+    {
+        return state;
+    }
+    lease.release();
+
+    active     = active ^ 1;
+    generation = nextGeneration;
+    programs   = 1;  // the last page is programmed once, with the seal
+    counters.compactions++;
+
+    /* the index now points into the new block */
+    bool sealed = false;
+    clearIndex();
+    return scan(target, sealed);
+}
+
+W25N_INSTANTIATE_FOR_ALL_GEOMETRIES(KvStore);
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
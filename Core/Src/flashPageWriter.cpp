@@ -0,0 +1,285 @@
+#include "flashPageWriter.hpp"
+
+#include <cstring>
+
+#include "flashCrc.hpp"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+template <typename GEOMETRY>
+PageWriter<GEOMETRY>::PageWriter(Manager<GEOMETRY> &manager)
+    : flash(manager),
+      pages(),
+      filling(0),
+      pending(false),
+      opened(false),
+      block(0),
+      written(0),
+      error(State::OK),
+      verifying(false),
+      unverified(false),
+      checkPage(0),
+      checkStart(0),
+      checkEnd(0),
+      checkCrc(0),
+      counters()
+{
+}
+
+template <typename GEOMETRY>
+State PageWriter<GEOMETRY>::open(uint16_t blockNumber)
+{
+    if (!flash.isInited)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    if (opened || blockNumber >= Geometry::USER_BLOCK_COUNT)
+    {
+        return State::PARAM_ERR;
+    }
+    if (flash.isLocked(blockNumber, true))
+    {
+        return State::BUSY;
+    }
+    if (flash.eraseIfDirty(blockNumber) != State::OK)
+    {
+        return State::QSPI_ERR;
+    }
+    const typename BlockTable<Geometry>::Descriptor &descriptor = flash.blocks[blockNumber];
+    if (!descriptor.isUsable() || descriptor.writeOffset() >= Geometry::BLOCK_SIZE_BYTE)
+    {
+        return State::PARAM_ERR;
+    }
+
+    pages[0].lease = Manager<GEOMETRY>::pagePool().acquire();
+    if (!pages[0].lease.valid())
+    {
+        return State::NO_BUFFER;
+    }
+    flash.blocks.allocate(blockNumber);  // keep the refill away from a free block
+
+    block          = blockNumber;
+    filling        = 0;
+    pending        = false;
+    written        = 0;
+    error          = State::OK;
+    unverified     = false;
+    pages[0].page  = descriptor.writePage();
+    pages[0].start = descriptor.writeByte();
+    pages[0].end   = pages[0].start;
+    opened         = true;
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+uint8_t *PageWriter<GEOMETRY>::reserve(uint16_t size)
+{
+    if (!opened || error != State::OK || size > Geometry::PAGE_SIZE_BYTE || poll() != State::OK)
+    {
+        return nullptr;
+    }
+    Buffer *buffer = &pages[filling];
+    if (buffer->end + size > Geometry::PAGE_SIZE_BYTE)
+    {
+        if (buffer->end == buffer->start)  // nothing of this page assembled yet, start the record on the next one
+        {
+            buffer->page++;
+            buffer->start = 0;
+            buffer->end   = 0;
+        }
+        else if (submit() != State::OK)
+        {
+            return nullptr;
+        }
+        buffer = &pages[filling];
+    }
+    if (buffer->page >= Geometry::PAGE_PER_BLOCK)
+    {
+        return nullptr;
+    }
+    return buffer->lease.data() + buffer->end;
+}
+
+template <typename GEOMETRY>
+State PageWriter<GEOMETRY>::append(const uint8_t *data, uint32_t size)
+{
+    while (size)
+    {
+        uint32_t room = Geometry::PAGE_SIZE_BYTE - pages[filling].end;
+        if (room == 0)  // the page is full, the next chunk goes into a new one
+        {
+            room = Geometry::PAGE_SIZE_BYTE;
+        }
+        uint16_t chunk = size < room ? size : room;
+        uint8_t *dest  = reserve(chunk);
+        if (dest == nullptr)
+        {
+            return error != State::OK ? error : State::PARAM_ERR;
+        }
+        memcpy(dest, data, chunk);
+        commit(chunk);
+        data += chunk;
+        size -= chunk;
+    }
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State PageWriter<GEOMETRY>::poll()
+{
+    if (pending && !isBusy() && flash.slotOpen())
+    {
+        pending = false;
+        counters.overlapped++;
+        return issue(pages[filling ^ 1], true);
+    }
+    return error;
+}
+
+template <typename GEOMETRY>
+State PageWriter<GEOMETRY>::submit()
+{
+    if (pending)  // both pages are full, wait for the chip
+    {
+        stall();
+        pending = false;
+        if (issue(pages[filling ^ 1], true) != State::OK)
+        {
+            return error;
+        }
+    }
+
+    /* the page is in the chip once loaded, its buffer is assembled again right away. While the chip is still busy, the next page is
+     * assembled in a second buffer borrowed until the pending one is loaded, or the writer waits when the pool is empty */
+    Buffer &full = pages[filling];
+    Buffer &next = pages[filling ^ 1];
+    if ((isBusy() || !flash.slotOpen()) && (next.lease = Manager<GEOMETRY>::pagePool().acquire()).valid())
+    {
+        pending = true;
+        filling ^= 1;
+    }
+    else
+    {
+        stall();
+        if (issue(full, false) != State::OK)
+        {
+            return error;
+        }
+    }
+
+    pages[filling].page  = full.page + 1;
+    pages[filling].start = 0;
+    pages[filling].end   = 0;
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+void PageWriter<GEOMETRY>::stall()
+{
+    if (!isBusy())
+    {
+        return;
+    }
+    Deadline wait(Deadline::NO_BUDGET);
+    while (isBusy())
+        ;
+    counters.stalls++;
+    counters.stall_us += wait.elapsed_us();
+}
+
+template <typename GEOMETRY>
+State PageWriter<GEOMETRY>::issue(Buffer &buffer, bool borrowed)
+{
+    if (unverified && (error = verify()) != State::OK)
+    {
+        return error;
+    }
+    error = flash.programRaw(block, buffer.page, buffer.start, buffer.lease.data() + buffer.start, buffer.end - buffer.start);
+    if (error == State::OK)
+    {
+        flash.blocks.setWriteOffset(block, (static_cast<uint32_t>(buffer.page) << Geometry::BYTE_BITS) + buffer.end);
+        counters.pages++;
+        if (verifying)  // while the chip programs, the buffer may be assembled again before the page is read back
+        {
+            unverified = true;
+            checkPage  = buffer.page;
+            checkStart = buffer.start;
+            checkEnd   = buffer.end;
+            checkCrc   = crc32(buffer.lease.data() + buffer.start, buffer.end - buffer.start);
+        }
+    }
+    if (borrowed)
+    {
+        buffer.lease.release();
+    }
+    return error;
+}
+
+template <typename GEOMETRY>
+State PageWriter<GEOMETRY>::verify()
+{
+    unverified = false;
+    typename Manager<GEOMETRY>::PagePool::Lease lease = Manager<GEOMETRY>::pagePool().acquire();
+    if (!lease.valid())
+    {
+        counters.unchecked++;
+        return State::OK;
+    }
+    uint16_t size = checkEnd - checkStart;
+    State state   = flash.readRaw(Geometry::calcAddress(block, checkPage, checkStart), lease.data(), size);
+    if (state == State::OK && crc32(lease.data(), size) != checkCrc)
+    {
+        state = State::ECC_ERR;
+    }
+    counters.verified += state == State::OK;
+    return state;
+}
+
+template <typename GEOMETRY>
+State PageWriter<GEOMETRY>::close(Durability durability)
+{
+    if (!opened)
+    {
+        return State::OK;
+    }
+    if (error == State::OK && pages[filling].end != pages[filling].start)
+    {
+        submit();
+    }
+    if (error == State::OK && pending)
+    {
+        while (isBusy())
+            ;
+        pending = false;
+        issue(pages[filling ^ 1], true);
+    }
+    while (isBusy())
+        ;
+    if (error == State::OK && unverified)
+    {
+        error = verify();
+    }
+
+    pages[0].lease.release();
+    pages[1].lease.release();
+    opened = false;
+    if (error != State::OK)
+    {
+        return error;
+    }
+    return flash.commitWrite(written, durability);
+}
+
+W25N_INSTANTIATE_FOR_ALL_GEOMETRIES(PageWriter);
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
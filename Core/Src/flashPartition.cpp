@@ -0,0 +1,66 @@
+#include "flashPartition.hpp"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+template <typename GEOMETRY>
+int32_t Partition<GEOMETRY>::AllocateBlock()
+{
+    if (!flash->isInited || !valid())
+    {
+        return -1;
+    }
+    int32_t block = flash->allocateIn(index);
+    return block < 0 ? -1 : block - info().firstBlock;
+}
+
+template <typename GEOMETRY>
+State Partition<GEOMETRY>::WriteMemory(uint16_t block, uint8_t *data, uint16_t size)
+{
+    if (!valid() || block >= blockCount())
+    {
+        return State::PARAM_ERR;
+    }
+    return flash->WriteMemory(chipBlock(block), data, size, info().policy.durability);
+}
+
+template <typename GEOMETRY>
+State Partition<GEOMETRY>::ReadMemory(uint32_t address, uint8_t *buffer, uint16_t size) const
+{
+    if (!valid() || size == 0)
+    {
+        return State::PARAM_ERR;
+    }
+    /* the read must end within the partition */
+    uint32_t offset    = (static_cast<uint32_t>(Geometry::pageOf(address)) << Geometry::BYTE_BITS) + Geometry::byteOf(address);
+    uint32_t lastBlock = Geometry::blockOf(address) + (offset + size - 1) / Geometry::BLOCK_SIZE_BYTE;
+    if (Geometry::byteOf(address) >= Geometry::PAGE_SIZE_BYTE || lastBlock >= blockCount())
+    {
+        return State::PARAM_ERR;
+    }
+    return flash->ReadMemory(Geometry::calcAddress(chipBlock(Geometry::blockOf(address)), Geometry::pageOf(address), Geometry::byteOf(address)),
+                             buffer, size);
+}
+
+template <typename GEOMETRY>
+State Partition<GEOMETRY>::EraseBlock(uint16_t block)
+{
+    if (!valid() || block >= blockCount())
+    {
+        return State::PARAM_ERR;
+    }
+    return flash->EraseBlock(chipBlock(block));
+}
+
+W25N_INSTANTIATE_FOR_ALL_GEOMETRIES(Partition);
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
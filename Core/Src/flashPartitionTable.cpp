@@ -0,0 +1,83 @@
+#include "flashPartitionTable.hpp"
+
+#include <cstring>
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+void PartitionTable::clear()
+{
+    memset(&image, 0xFF, sizeof(image));
+    image.magic = MAGIC;
+    image.count = 0;
+}
+
+int8_t PartitionTable::add(const char *name, uint16_t blockCount, const PartitionPolicy &policy)
+{
+    if (image.count == MAX_PARTITIONS || name == nullptr || blockCount == 0)
+    {
+        return -1;
+    }
+    size_t length = strlen(name);
+    if (length == 0 || length > PartitionInfo::NAME_SIZE || find(name) >= 0)
+    {
+        return -1;
+    }
+    PartitionInfo &entry = image.entries[image.count];
+    memset(entry.name, 0, PartitionInfo::NAME_SIZE);
+    memcpy(entry.name, name, length);
+    entry.firstBlock = end();
+    entry.blockCount = blockCount;
+    entry.policy     = policy;
+    entry.reserved   = 0xFF;
+    return image.count++;
+}
+
+int8_t PartitionTable::find(const char *name) const
+{
+    for (uint8_t i = 0; i < image.count; i++)
+    {
+        if (sameName(name, image.entries[i]))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int8_t PartitionTable::owner(uint16_t block) const
+{
+    for (uint8_t i = 0; i < image.count; i++)
+    {
+        const PartitionInfo &entry = image.entries[i];
+        if (block >= entry.firstBlock && block < entry.firstBlock + entry.blockCount)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void PartitionTable::validate()
+{
+    if (image.magic != MAGIC || image.count > MAX_PARTITIONS)
+    {
+        clear();
+    }
+}
+
+bool PartitionTable::sameName(const char *name, const PartitionInfo &entry)
+{
+    return strncmp(name, entry.name, PartitionInfo::NAME_SIZE) == 0 && (strlen(name) <= PartitionInfo::NAME_SIZE);
+}
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
@@ -0,0 +1,110 @@
+#include "flashQuantCodec.hpp"
+
+#include <cstring>
+
+#include "arm_math.h"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+namespace
+{
+constexpr uint16_t CHUNK = 64;  // values converted through the stack at a time, so that the input and the output may overlap
+}  // namespace
+
+void QuantCodec::encode(float *values, uint16_t rows, float *scales, uint8_t *out) const
+{
+    uint32_t total = static_cast<uint32_t>(rows) * count;
+    if (total == 0)
+    {
+        return;
+    }
+
+    /* the scale of each channel is its largest absolute value, the values are brought to [-1, 1] */
+    if (count == 1)
+    {
+        float32_t high;
+        float32_t low;
+        uint32_t index;
+        arm_max_f32(values, rows, &high, &index);
+        arm_min_f32(values, rows, &low, &index);
+        scales[0] = high > -low ? high : -low;
+        arm_scale_f32(values, scales[0] > 0.0f ? 1.0f / scales[0] : 0.0f, values, rows);
+    }
+    else
+    {
+        for (uint16_t channel = 0; channel < count; channel++)
+        {
+            float largest = 0.0f;
+            for (uint32_t n = channel; n < total; n += count)
+            {
+                float magnitude = values[n] < 0.0f ? -values[n] : values[n];
+                largest         = magnitude > largest ? magnitude : largest;
+            }
+            scales[channel] = largest;
+            float inverse   = largest > 0.0f ? 1.0f / largest : 0.0f;
+            for (uint32_t n = channel; n < total; n += count)
+            {
+                values[n] *= inverse;
+            }
+        }
+    }
+
+    /* the output is never after the input, a chunk is converted before it is copied over the floats it came from */
+    uint8_t size = valueSize();
+    for (uint32_t n = 0; n < total; n += CHUNK)
+    {
+        uint32_t length = total - n < CHUNK ? total - n : CHUNK;
+        q15_t chunk[CHUNK];
+        if (kind == Quantization::Q15)
+        {
+            arm_float_to_q15(values + n, chunk, length);
+        }
+        else
+        {
+            arm_float_to_q7(values + n, reinterpret_cast<q7_t *>(chunk), length);
+        }
+        memcpy(out + n * size, chunk, length * size);
+    }
+}
+
+void QuantCodec::decode(const uint8_t *in, uint16_t rows, const float *scales, float *out) const
+{
+    uint32_t total = static_cast<uint32_t>(rows) * count;
+    uint8_t size   = valueSize();
+    for (uint32_t n = 0; n < total; n += CHUNK)
+    {
+        uint32_t length = total - n < CHUNK ? total - n : CHUNK;
+        q15_t chunk[CHUNK];
+        memcpy(chunk, in + n * size, length * size);
+        if (kind == Quantization::Q15)
+        {
+            arm_q15_to_float(chunk, out + n, length);
+        }
+        else
+        {
+            arm_q7_to_float(reinterpret_cast<q7_t *>(chunk), out + n, length);
+        }
+    }
+
+    if (count == 1)
+    {
+        arm_scale_f32(out, scales[0], out, rows);
+        return;
+    }
+    for (uint32_t n = 0; n < total; n++)
+    {
+        out[n] *= scales[n % count];
+    }
+}
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
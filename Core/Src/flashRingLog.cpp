@@ -0,0 +1,426 @@
+#include "flashRingLog.hpp"
+
+#include <cstring>
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+template <typename GEOMETRY>
+RingLog<GEOMETRY>::RingLog(Manager<GEOMETRY> &manager, uint16_t firstBlock, uint16_t blockCount, uint8_t eraseAhead)
+    : flash(manager), writer(manager), first(firstBlock), count(blockCount), ahead(eraseAhead), mounted(false), head(0), headSeq(0), tailSeq(0),
+      syncPage(0), programs(0), counters()
+{
+}
+
+template <typename GEOMETRY>
+State RingLog<GEOMETRY>::mount()
+{
+    if (!flash.isInited)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    if (mounted)
+    {
+        return State::OK;
+    }
+    if (ahead == 0 || count < ahead + 3 || first + count > Geometry::USER_BLOCK_COUNT)
+    {
+        return State::PARAM_ERR;
+    }
+    uint16_t good = 0;
+    for (uint16_t index = 0; index < count; index++)
+    {
+        good += isGood(index);
+    }
+    if (good < ahead + 3)
+    {
+        return State::PARAM_ERR;
+    }
+    counters.mountProbes = 0;
+
+    /* the blank blocks are the ones in front of the head and the head itself until its first page is programmed, so one of the first
+       `ahead + 2` good blocks holds data unless the log is new. The bad blocks take a sequence number like the others, they are only
+       stepped over */
+    bool written      = false;
+    uint32_t sequence = 0;
+    uint16_t start    = 0;
+    State state       = State::OK;
+    for (uint16_t probed = 0; start < count && probed <= ahead + 1; start++)
+    {
+        if (!isGood(start))
+        {
+            continue;
+        }
+        probed++;
+        if ((state = probe(start, written, sequence)) != State::OK)
+        {
+            return state;
+        }
+        if (written)
+        {
+            break;
+        }
+    }
+
+    mounted = true;
+    if (!written)
+    {
+        head = 0;
+        while (!isGood(head))
+        {
+            head++;
+        }
+        headSeq = 1;
+        tailSeq = 1;
+        for (uint16_t n = 0; n <= ahead; n++)
+        {
+            if ((state = eraseIfUsed((head + n) % count)) != State::OK)
+            {
+                return state;
+            }
+        }
+        if ((state = flash.saveAddr()) != State::OK)
+        {
+            return state;
+        }
+        return openHead(true);
+    }
+
+    /* from `start` the sequence numbers go up to the head, then come the erased blocks and the older ones. A bad block is judged by
+       the first good block after it, which keeps the search monotone */
+    uint32_t startSeq = sequence;
+    uint16_t low      = start;
+    uint16_t high     = count - 1;
+    headSeq           = startSeq;
+    while (low < high)
+    {
+        uint16_t middle = (low + high + 1) / 2;
+        uint16_t probed = middle;
+        while (probed < high && !isGood(probed))
+        {
+            probed++;
+        }
+        written = false;
+        if (isGood(probed) && (state = probe(probed, written, sequence)) != State::OK)
+        {
+            return state;
+        }
+        if (written && sequence >= startSeq)
+        {
+            low     = probed;
+            headSeq = sequence;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+    head = low;
+
+    /* the tail is the first block holding data after the erased ones in front of the head */
+    tailSeq = headSeq;
+    for (uint16_t n = 1; n < count; n++)
+    {
+        uint16_t index = (head + n) % count;
+        if (index == start)
+        {
+            tailSeq = startSeq;
+            break;
+        }
+        if (!isGood(index))
+        {
+            continue;
+        }
+        if ((state = probe(index, written, sequence)) != State::OK)
+        {
+            return state;
+        }
+        if (written)
+        {
+            tailSeq = sequence;
+            break;
+        }
+    }
+
+    /* a record spanning pages may have been cut short by a power loss, the appends go on in a new block so that none lands inside it */
+    return advance();
+}
+
+template <typename GEOMETRY>
+State RingLog<GEOMETRY>::append(const uint8_t *data, uint16_t size)
+{
+    if (!mounted)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    if (size == 0 || size > MAX_RECORD_SIZE)
+    {
+        return State::PARAM_ERR;
+    }
+    uint32_t total = RECORD_HEADER_SIZE + size;
+    if (placeRecord(writer.offset(), total) + total > Geometry::BLOCK_SIZE_BYTE)
+    {
+        State state = advance();
+        if (state != State::OK)
+        {
+            return state;
+        }
+    }
+
+    uint8_t header[RECORD_HEADER_SIZE] = {static_cast<uint8_t>(size), static_cast<uint8_t>(size >> 8), static_cast<uint8_t>(~size),
+                                          static_cast<uint8_t>(~size >> 8)};
+    uint8_t *dest = writer.reserve(total <= Geometry::PAGE_SIZE_BYTE ? total : RECORD_HEADER_SIZE);
+    if (dest == nullptr)
+    {
+        return writer.status() != State::OK ? writer.status() : State::PARAM_ERR;
+    }
+    memcpy(dest, header, RECORD_HEADER_SIZE);
+    if (total <= Geometry::PAGE_SIZE_BYTE)
+    {
+        memcpy(dest + RECORD_HEADER_SIZE, data, size);
+        writer.commit(total);
+    }
+    else
+    {
+        writer.commit(RECORD_HEADER_SIZE);
+        State state = writer.append(data, size);
+        if (state != State::OK)
+        {
+            return state;
+        }
+    }
+    counters.appends++;
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State RingLog<GEOMETRY>::sync()
+{
+    if (!mounted)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    State state = writer.close(Durability::LAZY);
+    if (state != State::OK)
+    {
+        return state;
+    }
+    uint16_t block  = chipBlock(head);
+    uint32_t offset = flash.blocks[block].writeOffset();
+
+    /* each sync programs the page of the write offset once more, once it has taken the programs the chip allows the rest of it is left
+     * blank and the appends go on in the next page */
+    uint16_t page = offset >> Geometry::BYTE_BITS;
+    programs      = (offset & Geometry::BYTE_MASK) == 0 ? 0 : page == syncPage ? programs + 1 : 1;
+    syncPage      = page;
+    if (programs >= PAGE_PROGRAMS)
+    {
+        offset = (offset | Geometry::BYTE_MASK) + 1;
+        flash.blocks.setWriteOffset(block, offset);
+        counters.paddedPages++;
+    }
+    if (offset >= Geometry::BLOCK_SIZE_BYTE)
+    {
+        return advance();
+    }
+    return openHead(false);
+}
+
+template <typename GEOMETRY>
+State RingLog<GEOMETRY>::unmount()
+{
+    if (!mounted)
+    {
+        return State::OK;
+    }
+    mounted = false;
+    return writer.close(Durability::LAZY);
+}
+
+template <typename GEOMETRY>
+State RingLog<GEOMETRY>::read(Cursor &cursor, uint8_t *buffer, uint16_t capacity, uint16_t &length)
+{
+    length = 0;
+    if (!mounted)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    while (true)
+    {
+        if (static_cast<int32_t>(cursor.sequence - tailSeq) < 0)  // the block has been erased since
+        {
+            cursor = begin();
+            counters.skippedReads++;
+        }
+        if (static_cast<int32_t>(cursor.sequence - headSeq) > 0)
+        {
+            return State::OK;
+        }
+
+        if (!isGood(indexOf(cursor.sequence)))  // a bad block holds no record, the head is never one
+        {
+            cursor.sequence++;
+            cursor.offset = BLOCK_HEADER_SIZE;
+            continue;
+        }
+        uint16_t block = chipBlock(indexOf(cursor.sequence));
+        if ((cursor.offset & Geometry::BYTE_MASK) + RECORD_HEADER_SIZE > Geometry::PAGE_SIZE_BYTE)  // a header never crosses a page
+        {
+            cursor.offset = (cursor.offset | Geometry::BYTE_MASK) + 1;
+        }
+        if (cursor.offset + RECORD_HEADER_SIZE > flash.blocks[block].writeOffset())
+        {
+            if (cursor.sequence == headSeq)  // the records still in the writer's pages are not readable yet
+            {
+                return State::OK;
+            }
+            cursor.sequence++;
+            cursor.offset = BLOCK_HEADER_SIZE;
+            continue;
+        }
+
+        uint8_t header[RECORD_HEADER_SIZE];
+        State state = flash.ReadMemory(Geometry::calcAddress(block, cursor.offset >> Geometry::BYTE_BITS, cursor.offset & Geometry::BYTE_MASK), header,
+                                       RECORD_HEADER_SIZE);
+        if (state != State::OK)
+        {
+            return state;
+        }
+        uint16_t size  = header[0] | (header[1] << 8);
+        uint16_t check = header[2] | (header[3] << 8);
+        if ((size ^ check) != 0xFFFF)  // the end of a page left blank
+        {
+            cursor.offset = (cursor.offset | Geometry::BYTE_MASK) + 1;
+            continue;
+        }
+        if (size > capacity)
+        {
+            return State::NO_BUFFER;
+        }
+
+        uint32_t payload = cursor.offset + RECORD_HEADER_SIZE;
+        if (payload + size > flash.blocks[block].writeOffset())  // cut short by a power loss, nothing follows it in this block
+        {
+            cursor.offset = Geometry::BLOCK_SIZE_BYTE;
+            continue;
+        }
+        state = flash.ReadMemory(Geometry::calcAddress(block, payload >> Geometry::BYTE_BITS, payload & Geometry::BYTE_MASK), buffer, size);
+        if (state != State::OK)
+        {
+            return state;
+        }
+        cursor.offset = payload + size;
+        length        = size;
+        return State::OK;
+    }
+}
+
+template <typename GEOMETRY>
+State RingLog<GEOMETRY>::probe(uint16_t index, bool &written, uint32_t &sequence)
+{
+    uint8_t header[BLOCK_HEADER_SIZE];
+    State state = flash.readRaw(Geometry::calcAddress(chipBlock(index), 0, 0), header, BLOCK_HEADER_SIZE);
+    counters.mountProbes++;
+    uint32_t magic;
+    memcpy(&magic, header, 4);
+    memcpy(&sequence, header + 4, 4);
+    written = state == State::OK && magic == MAGIC;
+    return state;
+}
+
+template <typename GEOMETRY>
+State RingLog<GEOMETRY>::advance()
+{
+    State state = writer.close(Durability::LAZY);
+    if (state != State::OK)
+    {
+        return state;
+    }
+    counters.blockSwitches++;
+
+    /* the new head is normally blank already, the block `ahead` further takes the place of the oldest one. The head steps over the
+       bad blocks, each one still moves the blocks erased ahead by one */
+    do
+    {
+        head = (head + 1) % count;
+        headSeq++;
+        if ((state = eraseIfUsed((head + ahead) % count)) != State::OK)
+        {
+            return state;
+        }
+    } while (!isGood(head));
+    if ((state = eraseIfUsed(head)) != State::OK)
+    {
+        return state;
+    }
+    if (headSeq - tailSeq >= static_cast<uint32_t>(count - ahead))
+    {
+        tailSeq = headSeq - (count - ahead - 1);
+    }
+
+    /* the table must not say that the erased blocks still hold data */
+    if ((state = flash.saveAddr()) != State::OK)
+    {
+        return state;
+    }
+    return openHead(true);
+}
+
+template <typename GEOMETRY>
+State RingLog<GEOMETRY>::eraseIfUsed(uint16_t index)
+{
+    if (!isGood(index))
+    {
+        return State::OK;
+    }
+    bool wasErased;
+    State state = flash.eraseIfUsed(chipBlock(index), wasErased);  // the chip erases while the next records are assembled
+    counters.erasesAhead += wasErased;
+    return state;
+}
+
+template <typename GEOMETRY>
+State RingLog<GEOMETRY>::openHead(bool isNew)
+{
+    State state = writer.open(chipBlock(head));
+    if (state != State::OK || !isNew)
+    {
+        return state;
+    }
+    syncPage = 0xFFFF;
+    programs = 0;
+    uint8_t *header = writer.reserve(BLOCK_HEADER_SIZE);
+    if (header == nullptr)
+    {
+        return State::PARAM_ERR;
+    }
+    uint32_t magic = MAGIC;
+    memcpy(header, &magic, 4);
+    memcpy(header + 4, &headSeq, 4);
+    writer.commit(BLOCK_HEADER_SIZE);
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+uint32_t RingLog<GEOMETRY>::placeRecord(uint32_t offset, uint32_t total)
+{
+    uint32_t inPage = total <= Geometry::PAGE_SIZE_BYTE ? total : RECORD_HEADER_SIZE;  // a larger record only keeps its header in one page
+    if ((offset & Geometry::BYTE_MASK) + inPage > Geometry::PAGE_SIZE_BYTE)
+    {
+        offset = (offset | Geometry::BYTE_MASK) + 1;
+    }
+    return offset;
+}
+
+W25N_INSTANTIATE_FOR_ALL_GEOMETRIES(RingLog);
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
@@ -0,0 +1,141 @@
+#include "flashScheduler.hpp"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+ControlTickScheduler::ControlTickScheduler(TIM_HandleTypeDef *timer)
+    : htim(timer), lastTick(0), hasTicked(false), waiter(nullptr), guard(50), enabled(true)
+{
+    /* the worst cases of the W25N01GV at the QSPI clock of this project */
+    cost[static_cast<uint8_t>(Operation::READ)]    = 150;
+    cost[static_cast<uint8_t>(Operation::PROGRAM)] = 150;
+    cost[static_cast<uint8_t>(Operation::ERASE)]   = 20;
+    resetStats();
+}
+
+CCMRAM_FUNC void ControlTickScheduler::onTick()
+{
+    uint32_t now     = DWT->CYCCNT;
+    uint32_t latency = htim->Instance->CNT * (htim->Instance->PSC + 1);  // the counter restarted from 0 at the update event
+    uint32_t update  = now - latency;
+
+    if (hasTicked && update - lastTick > periodCycles() + periodCycles() / 2)
+    {
+        jitter.missedTicks++;
+    }
+    lastTick  = update;
+    hasTicked = true;
+
+    uint32_t latency_us = latency / cyclesPerUs();
+    jitter.ticks++;
+    jitter.sumLatency_us += latency_us;
+    if (latency_us < jitter.minLatency_us)
+    {
+        jitter.minLatency_us = latency_us;
+    }
+    if (latency_us > jitter.maxLatency_us)
+    {
+        jitter.maxLatency_us = latency_us;
+    }
+    uint8_t bucket = latency_us == 0 ? 0 : 32 - __builtin_clz(latency_us);
+    jitter.histogram[bucket < 7 ? bucket : 7]++;
+
+    /* a new window opens, the task waiting for it is woken */
+    TaskHandle_t task = waiter;
+    if (task != nullptr)
+    {
+        BaseType_t woken = pdFALSE;
+        waiter           = nullptr;
+        vTaskNotifyGiveFromISR(task, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+}
+
+bool ControlTickScheduler::isStale() const { return !hasTicked || DWT->CYCCNT - lastTick >= 2 * periodCycles(); }
+
+uint32_t ControlTickScheduler::slack_us() const
+{
+    uint32_t elapsed = DWT->CYCCNT - lastTick;
+    uint32_t period  = periodCycles();
+    uint32_t margin  = guard * cyclesPerUs();
+    if (!hasTicked || elapsed + margin >= period)
+    {
+        return 0;
+    }
+    return (period - elapsed - margin) / cyclesPerUs();
+}
+
+bool ControlTickScheduler::fits(Operation op) const
+{
+    if (!enabled || isStale())
+    {
+        return true;
+    }
+    uint32_t elapsed = DWT->CYCCNT - lastTick;
+    uint32_t period  = periodCycles();
+    uint32_t margin  = guard * cyclesPerUs();
+    uint32_t need    = cost[static_cast<uint8_t>(op)] * cyclesPerUs();
+
+    if (need + margin >= period)  // can never end before the next tick, issue it at the very start of a window
+    {
+        return elapsed < margin;
+    }
+    return elapsed < period && period - elapsed >= need + margin;
+}
+
+void ControlTickScheduler::waitForWindow(Operation op)
+{
+    if (!enabled || xTaskGetSchedulerState() != taskSCHEDULER_RUNNING)
+    {
+        return;
+    }
+    if (isStale())
+    {
+        jitter.staleFallbacks++;
+        return;
+    }
+    if (!fits(op))
+    {
+        jitter.deferrals++;
+        /* the wait is bounded by one RTOS tick, the control timer may stop meanwhile or another task may hold the wake up. A late
+         * notification only costs one more check */
+        TaskHandle_t self = xTaskGetCurrentTaskHandle();
+        while (!fits(op))
+        {
+            taskENTER_CRITICAL();
+            if (waiter == nullptr)
+            {
+                waiter = self;
+            }
+            taskEXIT_CRITICAL();
+            ulTaskNotifyTake(pdTRUE, 1);
+        }
+        taskENTER_CRITICAL();
+        if (waiter == self)
+        {
+            waiter = nullptr;
+        }
+        taskEXIT_CRITICAL();
+    }
+    jitter.windowsUsed++;
+}
+
+void ControlTickScheduler::resetStats()
+{
+    jitter               = JitterStats();
+    jitter.minLatency_us = 0xFFFFFFFF;
+}
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
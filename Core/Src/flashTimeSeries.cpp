@@ -0,0 +1,907 @@
+#include "flashTimeSeries.hpp"
+
+#include <cstring>
+
+#include "flashCrc.hpp"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+template <typename GEOMETRY>
+TimeSeriesLog<GEOMETRY>::TimeSeriesLog(Manager<GEOMETRY> &manager, uint16_t firstBlock, uint16_t blockCount, const Schema &schema)
+    : flash(manager),
+      writer(manager),
+      first(firstBlock),
+      count(blockCount),
+      layout(schema),
+      recordsPerPage(pageCapacity(schema)),
+      codec(schema.codecTypes, schema.codecFieldCount, schema.keyframeInterval),
+      mounted(false),
+      head(0),
+      headSeq(0),
+      tailSeq(0),
+      last(0),
+      blockFirst(),
+      pageFirst(),
+      pageZones(),
+      blockZones(),
+      headPages(0),
+      filling(nullptr),
+      fillOffset(0),
+      history(),
+      counters()
+{
+}
+
+template <typename GEOMETRY>
+State TimeSeriesLog<GEOMETRY>::mount()
+{
+    if (!flash.isInited)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    if (mounted)
+    {
+        return State::OK;
+    }
+    if (count < 3 || count > MAX_BLOCKS || first + count > Geometry::USER_BLOCK_COUNT || recordsPerPage == 0)
+    {
+        return State::PARAM_ERR;
+    }
+    for (uint8_t field = 0; field < layout.fieldCount; field++)
+    {
+        if (layout.fields[field].offset + fieldSize(layout.fields[field].type) > layout.recordSize)
+        {
+            return State::PARAM_ERR;
+        }
+    }
+    if (isCoded() && (!codec.isValid() || codec.recordSize() != layout.recordSize ||
+                      recordStart() + codec.maxEncodedSize() > Geometry::PAGE_SIZE_BYTE))
+    {
+        return State::PARAM_ERR;
+    }
+
+    uint16_t good = 0;
+    for (uint16_t index = 0; index < count; index++)
+    {
+        good += isGood(index);
+    }
+    if (good < 3)
+    {
+        return State::PARAM_ERR;
+    }
+
+    /* the head is the block with the newest sequence number, the first time of every block goes to RAM on the way. The bad blocks
+       take a sequence number like the others, they are only stepped over */
+    bool found = false;
+    State state;
+    for (uint16_t index = 0; index < count; index++)
+    {
+        if (!isGood(index))
+        {
+            continue;
+        }
+        bool written;
+        uint32_t sequence;
+        if ((state = probe(index, written, sequence, blockFirst[index])) != State::OK)
+        {
+            return state;
+        }
+        if (written && (!found || static_cast<int32_t>(sequence - headSeq) > 0))
+        {
+            found   = true;
+            head    = index;
+            headSeq = sequence;
+        }
+    }
+
+    mounted   = true;
+    headPages = 0;
+    filling   = nullptr;
+    last      = 0;
+    if (!found)
+    {
+        head    = count - 1;
+        tailSeq = headSeq + 1;
+        return advance();
+    }
+
+    /* the blocks before the head belong to the log as long as their sequence numbers and times follow on */
+    tailSeq            = headSeq;
+    uint32_t nextFirst = blockFirst[head];
+    for (uint16_t n = 1; n < count; n++)
+    {
+        uint16_t index = (head + count - n) % count;
+        if (!isGood(index))
+        {
+            continue;
+        }
+        bool written;
+        uint32_t sequence;
+        uint32_t firstTime;
+        if ((state = probe(index, written, sequence, firstTime)) != State::OK)
+        {
+            return state;
+        }
+        if (!written || sequence != headSeq - n || firstTime > nextFirst)
+        {
+            break;
+        }
+        tailSeq   = sequence;
+        nextFirst = firstTime;
+    }
+
+    /* the time of the last record, from the last page of the head block */
+    uint16_t page;
+    {
+        typename Manager<GEOMETRY>::PagePool::Lease scratch = Manager<GEOMETRY>::pagePool().acquire();
+        if (!scratch.valid())
+        {
+            return State::NO_BUFFER;
+        }
+        if ((state = findPage(headSeq, 0xFFFFFFFF, page, scratch.data())) != State::OK)
+        {
+            return state;
+        }
+    }
+    PageHeader header;
+    if ((state = flash.readRaw(Geometry::calcAddress(chipBlock(head), page, 0), reinterpret_cast<uint8_t *>(&header), PAGE_HEADER_SIZE)) !=
+        State::OK)
+    {
+        return state;
+    }
+    last = header.magic == MAGIC && header.sequence == headSeq ? header.last : blockFirst[head];
+
+    /* the last page of the head block may have been cut short by a power loss, the appends go on in a new block */
+    return advance();
+}
+
+template <typename GEOMETRY>
+State TimeSeriesLog<GEOMETRY>::append(uint32_t time, const void *record)
+{
+    if (!mounted)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    if (time < last)
+    {
+        return State::PARAM_ERR;
+    }
+    if (filling == nullptr)
+    {
+        if (headPages == DATA_PAGES)
+        {
+            State state = closeBlock();
+            if (state != State::OK)
+            {
+                return state;
+            }
+        }
+        if ((filling = writer.reserve(Geometry::PAGE_SIZE_BYTE)) == nullptr)
+        {
+            return writer.status() != State::OK ? writer.status() : State::PARAM_ERR;
+        }
+        PageHeader &header = *reinterpret_cast<PageHeader *>(filling);
+        header             = PageHeader{MAGIC, layout.id, headSeq, time, time, 0, storedSize(), 0};
+        Zone *zones        = reinterpret_cast<Zone *>(filling + PAGE_HEADER_SIZE);
+        for (uint8_t field = 0; field < layout.fieldCount; field++)
+        {
+            zones[field] = Zone{0xFFFFFFFF, 0};
+        }
+        fillOffset = 0;
+        DeltaCodec::restart(history);
+    }
+
+    PageHeader &header = *reinterpret_cast<PageHeader *>(filling);
+    const uint8_t *raw = static_cast<const uint8_t *>(record);
+    bool full;
+    if (isCoded())
+    {
+        uint16_t length = codec.encode(history, time, raw, filling + recordStart() + fillOffset);
+        fillOffset += length;
+        counters.recordBytes += length;
+        full = recordStart() + fillOffset + codec.maxEncodedSize() > Geometry::PAGE_SIZE_BYTE || header.count + 1 == recordsPerPage;
+    }
+    else
+    {
+        uint8_t *dest = filling + recordStart() + header.count * recordSize();
+        memcpy(dest, &time, 4);
+        memcpy(dest + 4, raw, layout.recordSize);
+        counters.recordBytes += recordSize();
+        full = header.count + 1 == recordsPerPage;
+    }
+    Zone *zones = reinterpret_cast<Zone *>(filling + PAGE_HEADER_SIZE);
+    for (uint8_t field = 0; field < layout.fieldCount; field++)
+    {
+        uint32_t value    = keyOf(field, raw);
+        zones[field].low  = value < zones[field].low ? value : zones[field].low;
+        zones[field].high = value > zones[field].high ? value : zones[field].high;
+    }
+    header.count++;
+    header.last = time;
+    last        = time;
+    counters.appends++;
+    if (full)
+    {
+        finishPage();
+    }
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State TimeSeriesLog<GEOMETRY>::sync()
+{
+    if (!mounted)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    if (filling != nullptr)
+    {
+        finishPage();
+    }
+    if (headPages == DATA_PAGES)
+    {
+        return closeBlock();
+    }
+    State state = writer.close(Durability::LAZY);
+    if (state != State::OK)
+    {
+        return state;
+    }
+    return writer.open(chipBlock(head));
+}
+
+template <typename GEOMETRY>
+State TimeSeriesLog<GEOMETRY>::unmount()
+{
+    if (!mounted)
+    {
+        return State::OK;
+    }
+    if (filling != nullptr)
+    {
+        finishPage();
+    }
+    mounted = false;
+    return writer.close(Durability::LAZY);
+}
+
+template <typename GEOMETRY>
+State TimeSeriesLog<GEOMETRY>::reset()
+{
+    if (!mounted)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    filling     = nullptr;  // the page being assembled was never committed to the writer
+    State state = writer.close(Durability::LAZY);
+    if (state != State::OK)
+    {
+        return state;
+    }
+    /* the old blocks are erased, the mount would take them back otherwise */
+    for (uint16_t index = 0; index < count; index++)
+    {
+        if ((state = eraseIfUsed(index)) != State::OK)
+        {
+            return state;
+        }
+    }
+    head      = count - 1;
+    tailSeq   = headSeq + 1;
+    headPages = 0;
+    last      = 0;
+    return advance();
+}
+
+template <typename GEOMETRY>
+void TimeSeriesLog<GEOMETRY>::begin(Cursor &cursor) const
+{
+    cursor.sequence = tailSeq;
+    cursor.page     = 0;
+    cursor.record   = 0;
+    cursor.loaded   = false;
+}
+
+template <typename GEOMETRY>
+State TimeSeriesLog<GEOMETRY>::seek(uint32_t time, Cursor &cursor)
+{
+    if (!mounted)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    counters.seeks++;
+    begin(cursor);
+
+    /* the last block whose first time is at or before `time`, the head block counts once one of its pages is programmed. A bad block
+       is judged by the first good block after it */
+    uint32_t low  = tailSeq;
+    uint32_t high = readablePages() > 0 ? headSeq : headSeq - 1;
+    while (static_cast<int32_t>(high - low) > 0 && !isGood(indexOf(low)))
+    {
+        low++;
+    }
+    if (static_cast<int32_t>(high - low) < 0 || !isGood(indexOf(low)) || blockFirst[indexOf(low)] > time)
+    {
+        return State::OK;
+    }
+    while (low != high)
+    {
+        uint32_t middle = low + (high - low + 1) / 2;
+        uint32_t probed = middle;
+        while (probed != high && !isGood(indexOf(probed)))
+        {
+            probed++;
+        }
+        if (isGood(indexOf(probed)) && blockFirst[indexOf(probed)] <= time)
+        {
+            low = probed;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+    if (!cursor.lease.valid() && !(cursor.lease = Manager<GEOMETRY>::pagePool().acquire()).valid())
+    {
+        return State::NO_BUFFER;
+    }
+    cursor.sequence = low;
+    State state     = findPage(low, time, cursor.page, cursor.lease.data());
+    if (state != State::OK)
+    {
+        return state;
+    }
+
+    /* the first record of the page at or after `time`, if there is none the cursor goes on with the next page */
+    bool valid;
+    if ((state = load(cursor, valid)) != State::OK || !valid)
+    {
+        return state;
+    }
+    counters.seekReads++;
+    if (isCoded())  // the codes are walked, the record before the one found is kept in the history of the cursor
+    {
+        while (cursor.record < cursor.count)
+        {
+            uint16_t offset            = cursor.offset;
+            DeltaCodec::History before = cursor.history;
+            uint32_t recordTime;
+            if ((state = decodeNext(cursor, recordTime, nullptr)) != State::OK)
+            {
+                return state;
+            }
+            if (recordTime >= time)
+            {
+                cursor.record--;
+                cursor.offset  = offset;
+                cursor.history = before;
+                break;
+            }
+        }
+        return State::OK;
+    }
+    uint16_t lowRecord  = 0;
+    uint16_t highRecord = cursor.count;
+    while (lowRecord < highRecord)
+    {
+        uint16_t middle = (lowRecord + highRecord) / 2;
+        uint32_t recordTime;
+        memcpy(&recordTime, cursor.lease.data() + recordStart() + middle * recordSize(), 4);
+        if (recordTime < time)
+        {
+            lowRecord = middle + 1;
+        }
+        else
+        {
+            highRecord = middle;
+        }
+    }
+    cursor.record = lowRecord;
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State TimeSeriesLog<GEOMETRY>::read(Cursor &cursor, uint32_t &time, void *record, bool &valid)
+{
+    return next(cursor, nullptr, time, record, valid);
+}
+
+template <typename GEOMETRY>
+State TimeSeriesLog<GEOMETRY>::scan(Cursor &cursor, const Filter &filter, uint32_t &time, void *record, bool &valid)
+{
+    if (filter.field >= layout.fieldCount)
+    {
+        valid = false;
+        return State::PARAM_ERR;
+    }
+    return next(cursor, &filter, time, record, valid);
+}
+
+template <typename GEOMETRY>
+uint32_t TimeSeriesLog<GEOMETRY>::key(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+    return bits & 0x80000000 ? ~bits : bits | 0x80000000;  // the negative floats are ordered backwards
+}
+
+template <typename GEOMETRY>
+State TimeSeriesLog<GEOMETRY>::probe(uint16_t index, bool &written, uint32_t &sequence, uint32_t &firstTime)
+{
+    PageHeader header;
+    State state = flash.readRaw(Geometry::calcAddress(chipBlock(index), 0, 0), reinterpret_cast<uint8_t *>(&header), PAGE_HEADER_SIZE);
+    written     = state == State::OK && header.magic == MAGIC && header.schema == layout.id && header.recordSize == storedSize() &&
+              header.count != 0 && header.count <= recordsPerPage;
+    sequence  = header.sequence;
+    firstTime = header.first;
+    return state;
+}
+
+template <typename GEOMETRY>
+void TimeSeriesLog<GEOMETRY>::finishPage()
+{
+    PageHeader &header = *reinterpret_cast<PageHeader *>(filling);
+    uint32_t used      = recordStart() + (isCoded() ? fillOffset : header.count * recordSize());
+    memset(filling + used, 0xFF, Geometry::PAGE_SIZE_BYTE - used);
+    header.crc = crc32(filling + PAGE_HEADER_SIZE, checkedSize(header.count), crc32(filling, PAGE_HEADER_SIZE - 4));
+    if (headPages == 0)
+    {
+        blockFirst[head] = header.first;
+    }
+    const Zone *zones = reinterpret_cast<const Zone *>(filling + PAGE_HEADER_SIZE);
+    for (uint8_t field = 0; field < layout.fieldCount; field++)
+    {
+        pageZones[headPages][field] = zones[field];
+        blockZones[field].low       = zones[field].low < blockZones[field].low ? zones[field].low : blockZones[field].low;
+        blockZones[field].high      = zones[field].high > blockZones[field].high ? zones[field].high : blockZones[field].high;
+    }
+    pageFirst[headPages++] = header.first;
+    writer.commit(Geometry::PAGE_SIZE_BYTE);
+    filling = nullptr;
+    counters.pages++;
+}
+
+template <typename GEOMETRY>
+State TimeSeriesLog<GEOMETRY>::closeBlock()
+{
+    uint8_t *page = writer.reserve(Geometry::PAGE_SIZE_BYTE);
+    if (page == nullptr)
+    {
+        return writer.status() != State::OK ? writer.status() : State::PARAM_ERR;
+    }
+    /* [header][first time of each page][zones of the block][zones of each page] */
+    uint32_t zonesSize = layout.fieldCount * sizeof(Zone);
+    uint8_t *zones     = page + INDEX_HEADER_SIZE + DATA_PAGES * 4;
+    memset(page, 0xFF, Geometry::PAGE_SIZE_BYTE);
+    memcpy(page + INDEX_HEADER_SIZE, pageFirst, headPages * 4);
+    memcpy(zones, blockZones, zonesSize);
+    for (uint16_t n = 0; n < headPages; n++)
+    {
+        memcpy(zones + (n + 1) * zonesSize, pageZones[n], zonesSize);
+    }
+    IndexHeader header = {INDEX_MAGIC, headSeq, headPages, 0};
+    memcpy(page, &header, INDEX_HEADER_SIZE);
+    header.crc = crc32(page + INDEX_HEADER_SIZE, indexSize() - INDEX_HEADER_SIZE, crc32(page, INDEX_HEADER_SIZE - 4));
+    memcpy(page + INDEX_HEADER_SIZE - 4, &header.crc, 4);
+    writer.commit(Geometry::PAGE_SIZE_BYTE);
+    return advance();
+}
+
+template <typename GEOMETRY>
+State TimeSeriesLog<GEOMETRY>::advance()
+{
+    State state = writer.close(Durability::LAZY);
+    if (state != State::OK)
+    {
+        return state;
+    }
+    headPages = 0;
+    for (uint8_t field = 0; field < layout.fieldCount; field++)
+    {
+        blockZones[field] = Zone{0xFFFFFFFF, 0};
+    }
+
+    /* the block after the head is erased while the head fills, it takes the place of the oldest block. The head steps over the bad
+       blocks */
+    do
+    {
+        head = (head + 1) % count;
+        headSeq++;
+        if ((state = eraseIfUsed((head + 1) % count)) != State::OK)
+        {
+            return state;
+        }
+    } while (!isGood(head));
+    if ((state = eraseIfUsed(head)) != State::OK)
+    {
+        return state;
+    }
+    if (headSeq - tailSeq >= static_cast<uint32_t>(count - 1))
+    {
+        tailSeq = headSeq - (count - 2);
+    }
+
+    /* the table must not say that the erased blocks still hold data */
+    if ((state = flash.saveAddr()) != State::OK)
+    {
+        return state;
+    }
+    return writer.open(chipBlock(head));
+}
+
+template <typename GEOMETRY>
+State TimeSeriesLog<GEOMETRY>::eraseIfUsed(uint16_t index)
+{
+    bool wasErased;
+    return isGood(index) ? flash.eraseIfUsed(chipBlock(index), wasErased) : State::OK;
+}
+
+template <typename GEOMETRY>
+uint32_t TimeSeriesLog<GEOMETRY>::keyOf(uint8_t field, const uint8_t *record) const
+{
+    const uint8_t *source = record + layout.fields[field].offset;
+    switch (layout.fields[field].type)
+    {
+        case FieldType::INT8:
+            return key(static_cast<int32_t>(static_cast<int8_t>(source[0])));
+        case FieldType::UINT8:
+            return source[0];
+        case FieldType::INT16:
+        {
+            int16_t value;
+            memcpy(&value, source, 2);
+            return key(static_cast<int32_t>(value));
+        }
+        case FieldType::UINT16:
+        {
+            uint16_t value;
+            memcpy(&value, source, 2);
+            return value;
+        }
+        case FieldType::INT32:
+        {
+            int32_t value;
+            memcpy(&value, source, 4);
+            return key(value);
+        }
+        case FieldType::FLOAT32:
+        {
+            float value;
+            memcpy(&value, source, 4);
+            return key(value);
+        }
+        default:
+        {
+            uint32_t value;
+            memcpy(&value, source, 4);
+            return value;
+        }
+    }
+}
+
+template <typename GEOMETRY>
+State TimeSeriesLog<GEOMETRY>::findPage(uint32_t sequence, uint32_t time, uint16_t &page, uint8_t *scratch)
+{
+    page = 0;
+    if (sequence == headSeq && headPages != 0)  // the first times of the head block are in RAM
+    {
+        uint16_t pages = readablePages();
+        while (page + 1 < pages && pageFirst[page + 1] <= time)
+        {
+            page++;
+        }
+        return State::OK;
+    }
+
+    /* the index page of the block, one read */
+    uint16_t block = chipBlock(indexOf(sequence));
+    State state    = flash.ReadMemory(Geometry::calcAddress(block, DATA_PAGES, 0), scratch, indexSize());
+    if (state != State::OK)
+    {
+        return state;
+    }
+    counters.seekReads++;
+    IndexHeader header;
+    memcpy(&header, scratch, INDEX_HEADER_SIZE);
+    if (header.magic == INDEX_MAGIC && header.sequence == sequence && header.pages <= DATA_PAGES &&
+        header.crc == crc32(scratch + INDEX_HEADER_SIZE, indexSize() - INDEX_HEADER_SIZE, crc32(scratch, INDEX_HEADER_SIZE - 4)))
+    {
+        uint16_t low  = 0;
+        uint16_t high = header.pages ? header.pages - 1 : 0;
+        while (low < high)
+        {
+            uint16_t middle = (low + high + 1) / 2;
+            uint32_t firstTime;
+            memcpy(&firstTime, scratch + INDEX_HEADER_SIZE + middle * 4, 4);
+            if (firstTime <= time)
+            {
+                low = middle;
+            }
+            else
+            {
+                high = middle - 1;
+            }
+        }
+        page = low;
+        return State::OK;
+    }
+
+    /* a block closed by a mount has no index, its page headers are searched instead */
+    uint16_t low  = 0;
+    uint16_t high = DATA_PAGES - 1;
+    while (low < high)
+    {
+        uint16_t middle = (low + high + 1) / 2;
+        PageHeader pageHeader;
+        if ((state = flash.ReadMemory(Geometry::calcAddress(block, middle, 0), reinterpret_cast<uint8_t *>(&pageHeader), PAGE_HEADER_SIZE)) !=
+            State::OK)
+        {
+            return state;
+        }
+        counters.seekReads++;
+        if (pageHeader.magic == MAGIC && pageHeader.sequence == sequence && pageHeader.first <= time)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+    page = low;
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State TimeSeriesLog<GEOMETRY>::load(Cursor &cursor, bool &valid)
+{
+    valid         = false;
+    cursor.count  = 0;
+    cursor.loaded = false;
+    if (!cursor.lease.valid() && !(cursor.lease = Manager<GEOMETRY>::pagePool().acquire()).valid())
+    {
+        return State::NO_BUFFER;
+    }
+    uint8_t *page = cursor.lease.data();
+    State state   = flash.ReadMemory(Geometry::calcAddress(chipBlock(indexOf(cursor.sequence)), cursor.page, 0), page, Geometry::PAGE_SIZE_BYTE);
+    if (state != State::OK)
+    {
+        return state;
+    }
+    const PageHeader &header = *reinterpret_cast<const PageHeader *>(page);
+    valid = header.magic == MAGIC && header.schema == layout.id && header.sequence == cursor.sequence && header.recordSize == storedSize() &&
+            header.count != 0 && header.count <= recordsPerPage &&
+            header.crc == crc32(page + PAGE_HEADER_SIZE, checkedSize(header.count), crc32(page, PAGE_HEADER_SIZE - 4));
+    if (!valid)
+    {
+        return State::OK;
+    }
+    cursor.count  = header.count;
+    cursor.loaded = true;
+
+    /* the codes of a coded page are walked from its keyframe up to the record of the cursor */
+    uint16_t target = cursor.record < cursor.count ? cursor.record : cursor.count;
+    cursor.offset   = 0;
+    cursor.record   = isCoded() ? 0 : cursor.record;
+    DeltaCodec::restart(cursor.history);
+    while (cursor.record < target)
+    {
+        uint32_t time;
+        if ((state = decodeNext(cursor, time, nullptr)) != State::OK)
+        {
+            cursor.loaded = false;
+            valid         = false;
+            return state;
+        }
+    }
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State TimeSeriesLog<GEOMETRY>::next(Cursor &cursor, const Filter *filter, uint32_t &time, void *record, bool &valid)
+{
+    valid = false;
+    if (!mounted)
+    {
+        return State::OBJECT_NOT_INIT;
+    }
+    while (true)
+    {
+        if (static_cast<int32_t>(cursor.sequence - tailSeq) < 0)  // the block has been erased since
+        {
+            begin(cursor);
+            counters.skippedReads++;
+        }
+        if (static_cast<int32_t>(cursor.sequence - headSeq) > 0)
+        {
+            return State::OK;
+        }
+        if (!isGood(indexOf(cursor.sequence)))  // a bad block holds no page, the head is never one
+        {
+            cursor.sequence++;
+            cursor.page   = 0;
+            cursor.record = 0;
+            continue;
+        }
+        if (!cursor.loaded)
+        {
+            if (cursor.sequence == headSeq && cursor.page >= readablePages())  // the records still in the writer's pages are not readable yet
+            {
+                return State::OK;
+            }
+            bool loaded = false;
+            if (cursor.page < DATA_PAGES)
+            {
+                bool skip = false;
+                State state;
+                if (filter != nullptr && (state = skipPage(cursor, *filter, skip)) != State::OK)
+                {
+                    return state;
+                }
+                if (skip)
+                {
+                    cursor.page++;
+                    counters.pagesSkipped++;
+                    continue;
+                }
+                if ((state = load(cursor, loaded)) != State::OK)
+                {
+                    return state;
+                }
+            }
+            if (!loaded)  // the end of the pages of a block
+            {
+                if (cursor.sequence == headSeq)
+                {
+                    return State::OK;
+                }
+                cursor.sequence++;
+                cursor.page   = 0;
+                cursor.record = 0;
+                continue;
+            }
+        }
+        while (cursor.record < cursor.count)
+        {
+            const uint8_t *values;
+            if (isCoded())
+            {
+                State state = decodeNext(cursor, time, static_cast<uint8_t *>(record));
+                if (state != State::OK)
+                {
+                    return state;
+                }
+                values = static_cast<const uint8_t *>(record);
+            }
+            else
+            {
+                const uint8_t *source = cursor.lease.data() + recordStart() + cursor.record++ * recordSize();
+                memcpy(&time, source, 4);
+                values = source + 4;
+            }
+            if (filter != nullptr)
+            {
+                uint32_t value = keyOf(filter->field, values);
+                if (value < filter->low || value > filter->high)
+                {
+                    continue;
+                }
+            }
+            if (!isCoded())
+            {
+                memcpy(record, values, layout.recordSize);
+            }
+            valid = true;
+            return State::OK;
+        }
+        cursor.page++;
+        cursor.record = 0;
+        cursor.loaded = false;
+    }
+}
+
+template <typename GEOMETRY>
+State TimeSeriesLog<GEOMETRY>::skipPage(Cursor &cursor, const Filter &filter, bool &skip)
+{
+    skip            = false;
+    uint16_t block  = chipBlock(indexOf(cursor.sequence));
+    uint32_t size   = layout.fieldCount * sizeof(Zone);
+    uint32_t offset = filter.field * sizeof(Zone);
+    bool sameFilter = cursor.filter.field == filter.field && cursor.filter.low == filter.low && cursor.filter.high == filter.high;
+    State state;
+
+    /* the index of a closed block has the zones of the block and of all its pages, it is read once per block */
+    if (cursor.sequence != headSeq && (cursor.maskSequence != cursor.sequence || !sameFilter))
+    {
+        if (!cursor.lease.valid() && !(cursor.lease = Manager<GEOMETRY>::pagePool().acquire()).valid())
+        {
+            return State::NO_BUFFER;
+        }
+        uint8_t *index = cursor.lease.data();
+        if ((state = flash.ReadMemory(Geometry::calcAddress(block, DATA_PAGES, 0), index, indexSize())) != State::OK)
+        {
+            return state;
+        }
+        counters.zoneReads++;
+        IndexHeader header;
+        memcpy(&header, index, INDEX_HEADER_SIZE);
+        uint32_t crc = crc32(index + INDEX_HEADER_SIZE, indexSize() - INDEX_HEADER_SIZE, crc32(index, INDEX_HEADER_SIZE - 4));
+        cursor.maskSequence = cursor.sequence;
+        cursor.filter       = filter;
+        cursor.masked       = header.magic == INDEX_MAGIC && header.sequence == cursor.sequence && header.pages <= DATA_PAGES && header.crc == crc;
+        cursor.skip         = ~0ULL;  // the pages past the last one are skipped too
+
+        /* a block whose range cannot match is skipped whole, otherwise the pages whose range can match are read */
+        const uint8_t *zones = index + INDEX_HEADER_SIZE + DATA_PAGES * 4 + offset;
+        Zone zone;
+        memcpy(&zone, zones, sizeof(Zone));
+        for (uint16_t n = 0; cursor.masked && zone.high >= filter.low && zone.low <= filter.high && n < header.pages; n++)
+        {
+            Zone pageZone;
+            memcpy(&pageZone, zones + (n + 1) * size, sizeof(Zone));
+            if (pageZone.high >= filter.low && pageZone.low <= filter.high)
+            {
+                cursor.skip &= ~(1ULL << n);
+            }
+        }
+    }
+    if (cursor.sequence != headSeq && cursor.masked)
+    {
+        skip = cursor.skip & (1ULL << cursor.page);
+        return State::OK;
+    }
+
+    /* the head block and the blocks closed by a mount have no index, the zones of the page are read after its header */
+    uint8_t header[PAGE_HEADER_SIZE + MAX_FIELDS * sizeof(Zone)];
+    if ((state = flash.ReadMemory(Geometry::calcAddress(block, cursor.page, 0), header, PAGE_HEADER_SIZE + size)) != State::OK)
+    {
+        return state;
+    }
+    counters.zoneReads++;
+    PageHeader pageHeader;
+    Zone zone;
+    memcpy(&pageHeader, header, PAGE_HEADER_SIZE);
+    memcpy(&zone, header + PAGE_HEADER_SIZE + offset, sizeof(Zone));
+    skip = pageHeader.magic == MAGIC && pageHeader.sequence == cursor.sequence && (zone.high < filter.low || zone.low > filter.high);
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+State TimeSeriesLog<GEOMETRY>::decodeNext(Cursor &cursor, uint32_t &time, uint8_t *record)
+{
+    uint32_t start  = recordStart() + cursor.offset;
+    uint16_t length = codec.decode(cursor.history, cursor.lease.data() + start, Geometry::PAGE_SIZE_BYTE - start, time, record);
+    if (length == 0)  // the page passed its CRC, it was written wrong
+    {
+        return State::ECC_ERR;
+    }
+    cursor.offset += length;
+    cursor.record++;
+    return State::OK;
+}
+
+template <typename GEOMETRY>
+uint16_t TimeSeriesLog<GEOMETRY>::pageCapacity(const Schema &schema)
+{
+    if (schema.fieldCount > MAX_FIELDS)
+    {
+        return 0;
+    }
+    uint32_t space = Geometry::PAGE_SIZE_BYTE - PAGE_HEADER_SIZE - schema.fieldCount * sizeof(Zone);
+    /* the shortest code of a record is a byte for its time and one per field */
+    return schema.codecTypes == nullptr ? space / (4 + schema.recordSize) : space / (1 + schema.codecFieldCount);
+}
+
+W25N_INSTANTIATE_FOR_ALL_GEOMETRIES(TimeSeriesLog);
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
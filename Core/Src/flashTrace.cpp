@@ -0,0 +1,93 @@
+#include "flashTrace.hpp"
+
+#include "main.h"
+
+#if USE_FLASH
+
+#define FLASH_TRACE_FORMAT(id, format) format,
+extern "C" __attribute__((used)) const char *const flashTraceFormats[FLASH_TRACE_COUNT] = {FLASH_TRACE_FORMATS(FLASH_TRACE_FORMAT)};
+#undef FLASH_TRACE_FORMAT
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+TraceLog *TraceLog::global = nullptr;
+
+TraceLog::TraceLog(IngestRing &target, uint8_t taskId, uint8_t isrId) : ring(target), taskProducer(taskId), isrProducer(isrId) {}
+
+CCMRAM_FUNC uint8_t TraceLog::producer() const { return __get_IPSR() != 0 ? isrProducer : taskProducer; }
+
+CCMRAM_FUNC bool TraceLog::record(uint16_t id, const uint32_t *args, uint8_t count)
+{
+    if (count > MAX_ARGS)
+    {
+        return false;
+    }
+    uint32_t cycles = DWT->CYCCNT;
+    uint8_t *data   = ring.reserve(producer(), HEADER + 4 * count);
+    if (data == nullptr)
+    {
+        return false;
+    }
+    memcpy(data, &id, 2);
+    memcpy(data + 2, &cycles, 4);
+    memcpy(data + HEADER, args, 4 * count);
+    ring.commit();
+    return true;
+}
+
+bool TraceLog::text(const char *data, uint32_t length)
+{
+    uint32_t cycles = DWT->CYCCNT;
+    uint16_t id     = FLASH_TRACE_TEXT;
+    bool stored     = true;
+    while (length != 0)
+    {
+        uint16_t part  = length < IngestRing::MAX_RECORD - HEADER ? length : IngestRing::MAX_RECORD - HEADER;
+        uint8_t *entry = ring.reserve(producer(), HEADER + part);
+        if (entry != nullptr)
+        {
+            memcpy(entry, &id, 2);
+            memcpy(entry + 2, &cycles, 4);
+            memcpy(entry + HEADER, data, part);
+            ring.commit();
+        }
+        stored = stored && entry != nullptr;
+        data += part;
+        length -= part;
+    }
+    return stored;
+}
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+using Core::Drivers::W25N01::TraceLog;
+
+extern "C" int flashTrace(uint16_t id, const uint32_t *args, uint8_t count)
+{
+    TraceLog *log = TraceLog::attached();
+    return log != nullptr && log->record(id, args, count);
+}
+
+#if FLASH_TRACE_STDOUT
+/**
+ * @brief Called by `_write` in syscalls.c, stdout goes to the trace log when one is attached and to `__io_putchar` otherwise
+ */
+extern "C" int flashTraceWrite(char *ptr, int len)
+{
+    TraceLog *log = TraceLog::attached();
+    if (log == nullptr)
+    {
+        return 0;
+    }
+    log->text(ptr, len);
+    return 1;
+}
+#endif
+
+#endif
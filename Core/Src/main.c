@@ -19,8 +19,10 @@
 /* Includes ------------------------------------------------------------------*/
 #include "main.h"
 #include "cordic.h"
+#include "crc.h"
 #include "dma.h"
 #include "fdcan.h"
+#include "fmac.h"
 #include "quadspi.h"
 #include "spi.h"
 #include "tim.h"
@@ -149,6 +151,8 @@ int main(void)
   MX_USART1_UART_Init();
   MX_TIM20_Init();
   MX_QUADSPI1_Init();
+  MX_CRC_Init();
+  MX_FMAC_Init();
   /* USER CODE BEGIN 2 */
   extern void startRTOS(void);
   startRTOS();   
@@ -229,7 +233,9 @@ void SystemClock_Config(void)
 void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
 {
   /* USER CODE BEGIN Callback 0 */
-
+  if (htim->Instance == TIM16) {
+    flashControlTick();
+  }
   /* USER CODE END Callback 0 */
   if (htim->Instance == TIM7) {
     HAL_IncTick();
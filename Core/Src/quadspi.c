@@ -177,7 +177,7 @@ void HAL_QSPI_MspDeInit(QSPI_HandleTypeDef* qspiHandle)
 }
 
 /* USER CODE BEGIN 1 */
-HAL_StatusTypeDef BufferCommand(uint16_t pageAddr, uint16_t command)
+CCMRAM_FUNC HAL_StatusTypeDef BufferCommand(uint32_t pageAddr, uint16_t command)
 {
     QSPI_CommandTypeDef sCommand = {0};
     sCommand.InstructionMode     = QSPI_INSTRUCTION_1_LINE;
@@ -203,7 +203,7 @@ HAL_StatusTypeDef BufferCommand(uint16_t pageAddr, uint16_t command)
     return HAL_OK;
 }
 
-HAL_StatusTypeDef PureCommand(uint16_t command)
+CCMRAM_FUNC HAL_StatusTypeDef PureCommand(uint16_t command)
 {
     QSPI_CommandTypeDef sCommand = {0};
     sCommand.InstructionMode     = QSPI_INSTRUCTION_1_LINE;
@@ -230,7 +230,7 @@ HAL_StatusTypeDef PureCommand(uint16_t command)
     return HAL_OK;
 }
 
-HAL_StatusTypeDef Command_Rx_1DataLine_addr(uint16_t command, uint8_t *buffer, uint16_t addr, uint16_t size)
+CCMRAM_FUNC HAL_StatusTypeDef Command_Rx_1DataLine_addr(uint16_t command, uint8_t *buffer, uint16_t addr, uint16_t size)
 {
     QSPI_CommandTypeDef sCommand = {0};
 
@@ -264,7 +264,7 @@ HAL_StatusTypeDef Command_Rx_1DataLine_addr(uint16_t command, uint8_t *buffer, u
     return HAL_OK;
 }
 
-HAL_StatusTypeDef Command_Rx_1DataLine(uint16_t command, uint8_t *buffer, uint16_t size, uint16_t dummyCycle)
+CCMRAM_FUNC HAL_StatusTypeDef Command_Rx_1DataLine(uint16_t command, uint8_t *buffer, uint16_t size, uint16_t dummyCycle)
 {
     QSPI_CommandTypeDef sCommand = {0};
     sCommand.InstructionMode     = QSPI_INSTRUCTION_1_LINE;
@@ -297,7 +297,7 @@ HAL_StatusTypeDef Command_Rx_1DataLine(uint16_t command, uint8_t *buffer, uint16
     return HAL_OK;
 }
 
-HAL_StatusTypeDef Command_Rx_2DataLine(uint16_t command, uint8_t *buffer, uint16_t addr, uint16_t size)
+CCMRAM_FUNC HAL_StatusTypeDef Command_Rx_2DataLine(uint16_t command, uint8_t *buffer, uint16_t addr, uint16_t size)
 {
     QSPI_CommandTypeDef sCommand = {0};
     sCommand.InstructionMode     = QSPI_INSTRUCTION_1_LINE;
@@ -330,7 +330,7 @@ HAL_StatusTypeDef Command_Rx_2DataLine(uint16_t command, uint8_t *buffer, uint16
     return HAL_OK;
 }
 
-HAL_StatusTypeDef Command_Tx_4DataLine(uint16_t command, uint8_t *buffer, uint16_t addr, uint16_t size)
+CCMRAM_FUNC HAL_StatusTypeDef Command_Tx_4DataLine(uint16_t command, uint8_t *buffer, uint16_t addr, uint16_t size)
 {
     QSPI_CommandTypeDef sCommand = {0};
     sCommand.InstructionMode     = QSPI_INSTRUCTION_1_LINE;
@@ -364,7 +364,7 @@ HAL_StatusTypeDef Command_Tx_4DataLine(uint16_t command, uint8_t *buffer, uint16
     return HAL_OK;
 }
 
-HAL_StatusTypeDef StatusReg_Tx(uint16_t command, uint16_t regAddr, uint8_t data)
+CCMRAM_FUNC HAL_StatusTypeDef StatusReg_Tx(uint16_t command, uint16_t regAddr, uint8_t data)
 {
     QSPI_CommandTypeDef sCommand = {0};
     sCommand.InstructionMode     = QSPI_INSTRUCTION_1_LINE;
@@ -393,7 +393,7 @@ HAL_StatusTypeDef StatusReg_Tx(uint16_t command, uint16_t regAddr, uint8_t data)
     return HAL_OK;
 }
 
-HAL_StatusTypeDef StatusReg_Rx(uint16_t command, uint16_t regAddr, uint8_t *buffer)
+CCMRAM_FUNC HAL_StatusTypeDef StatusReg_Rx(uint16_t command, uint16_t regAddr, uint8_t *buffer)
 {
     QSPI_CommandTypeDef sCommand = {0};
     sCommand.InstructionMode     = QSPI_INSTRUCTION_1_LINE;
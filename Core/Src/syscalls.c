@@ -34,6 +34,8 @@
 /* Variables */
 extern int __io_putchar(int ch) __attribute__((weak));
 extern int __io_getchar(void) __attribute__((weak));
+/* Defined by the flash trace log when FLASH_TRACE_STDOUT is set, returns 0 when stdout must still be printed */
+extern int flashTraceWrite(char *ptr, int len) __attribute__((weak));
 
 
 char *__env[1] = { 0 };
@@ -82,6 +84,11 @@ __attribute__((weak)) int _write(int file, char *ptr, int len)
   (void)file;
   int DataIdx;
 
+  if (flashTraceWrite != NULL && flashTraceWrite(ptr, len))
+  {
+    return len;
+  }
+
   for (DataIdx = 0; DataIdx < len; DataIdx++)
   {
     __io_putchar(*ptr++);
@@ -0,0 +1,34 @@
+#include "flashCrc.hpp"
+
+#if USE_FLASH
+
+namespace Core
+{
+namespace Drivers
+{
+namespace W25N01
+{
+namespace
+{
+/* the host has no CRC unit, the same CRC-32 a nibble at a time */
+constexpr uint32_t NIBBLE_TABLE[16] = {0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+                                       0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+}  // namespace
+
+uint32_t crc32(const uint8_t *data, uint32_t size, uint32_t crc)
+{
+    crc = ~crc;
+    while (size--)
+    {
+        crc ^= *data++;
+        crc = (crc >> 4) ^ NIBBLE_TABLE[crc & 0x0F];
+        crc = (crc >> 4) ^ NIBBLE_TABLE[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+}  // namespace W25N01
+}  // namespace Drivers
+}  // namespace Core
+
+#endif
@@ -0,0 +1,77 @@
+#include "arm_math.h"
+
+namespace
+{
+/* the kernels of the Cortex-M4 build without ARM_MATH_ROUNDING: the conversions to fixed point truncate and saturate */
+int32_t saturate(int32_t value, int32_t low, int32_t high) { return value < low ? low : value > high ? high : value; }
+}  // namespace
+
+extern "C" {
+void arm_max_f32(const float32_t *pSrc, uint32_t blockSize, float32_t *pResult, uint32_t *pIndex)
+{
+    *pResult = pSrc[0];
+    *pIndex  = 0;
+    for (uint32_t i = 1; i < blockSize; i++)
+    {
+        if (pSrc[i] > *pResult)
+        {
+            *pResult = pSrc[i];
+            *pIndex  = i;
+        }
+    }
+}
+
+void arm_min_f32(const float32_t *pSrc, uint32_t blockSize, float32_t *pResult, uint32_t *pIndex)
+{
+    *pResult = pSrc[0];
+    *pIndex  = 0;
+    for (uint32_t i = 1; i < blockSize; i++)
+    {
+        if (pSrc[i] < *pResult)
+        {
+            *pResult = pSrc[i];
+            *pIndex  = i;
+        }
+    }
+}
+
+void arm_scale_f32(const float32_t *pSrc, float32_t scale, float32_t *pDst, uint32_t blockSize)
+{
+    for (uint32_t i = 0; i < blockSize; i++)
+    {
+        pDst[i] = pSrc[i] * scale;
+    }
+}
+
+void arm_float_to_q15(const float32_t *pSrc, q15_t *pDst, uint32_t blockSize)
+{
+    for (uint32_t i = 0; i < blockSize; i++)
+    {
+        pDst[i] = static_cast<q15_t>(saturate(static_cast<int32_t>(pSrc[i] * 32768.0f), -32768, 32767));
+    }
+}
+
+void arm_float_to_q7(const float32_t *pSrc, q7_t *pDst, uint32_t blockSize)
+{
+    for (uint32_t i = 0; i < blockSize; i++)
+    {
+        pDst[i] = static_cast<q7_t>(saturate(static_cast<int32_t>(pSrc[i] * 128.0f), -128, 127));
+    }
+}
+
+void arm_q15_to_float(const q15_t *pSrc, float32_t *pDst, uint32_t blockSize)
+{
+    for (uint32_t i = 0; i < blockSize; i++)
+    {
+        pDst[i] = static_cast<float32_t>(pSrc[i]) / 32768.0f;
+    }
+}
+
+void arm_q7_to_float(const q7_t *pSrc, float32_t *pDst, uint32_t blockSize)
+{
+    for (uint32_t i = 0; i < blockSize; i++)
+    {
+        pDst[i] = static_cast<float32_t>(pSrc[i]) / 128.0f;
+    }
+}
+}
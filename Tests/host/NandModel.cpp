@@ -0,0 +1,293 @@
+#include "NandModel.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "flash.hpp"
+#include "quadspi.h"
+#include "task.h"
+
+using Core::Drivers::W25N01::DefaultGeometry;
+using Core::Drivers::W25N01::OPCode;
+using Core::Drivers::W25N01::RegisterAddress;
+
+extern "C" {
+QSPI_HandleTypeDef hqspi1;
+DMA_HandleTypeDef hdma_quadspi;
+DWT_Type hostDwt{};
+CoreDebug_Type hostCoreDebug{};
+uint32_t SystemCoreClock = 170000000;
+}
+
+namespace Tests
+{
+namespace NandModel
+{
+namespace
+{
+constexpr uint32_t PAGE_SIZE       = DefaultGeometry::PAGE_SIZE_BYTE;
+constexpr uint32_t RAW_SIZE        = PAGE_SIZE + DefaultGeometry::SPARE_SIZE_BYTE;
+constexpr uint32_t PAGES_PER_BLOCK = DefaultGeometry::PAGE_PER_BLOCK;
+constexpr uint32_t SECTOR_SIZE     = 512;
+constexpr uint32_t SECTOR_SPARE    = 16;         // the spare bytes of a sector, its ECC bytes start at 8
+constexpr uint32_t STEP_CYCLES     = 50 * 170;   // a bus operation, at 170 MHz
+constexpr uint32_t BUSY_CYCLES     = 250 * 170;  // tPP, the chip reports busy for as long after a program
+
+struct Page
+{
+    std::vector<uint8_t> data;
+    uint8_t programs;
+};
+
+std::unordered_map<uint32_t, Page> pages;  // by row, a row not in the map is erased
+std::unordered_set<uint32_t> badBlocks;
+std::vector<uint8_t> cache(RAW_SIZE, 0xFF);
+uint8_t registers[3] = {0x00, 0x18, 0x00};
+bool writeEnabled    = false;
+uint32_t busyUntil   = 0;
+uint32_t stepCount   = 0;
+uint32_t cutStep     = 0;
+bool cut             = false;
+uint32_t programCount;
+uint8_t maxPrograms;
+uint32_t overwriteCount;
+uint32_t badEraseCount;
+TickType_t ticks;
+
+Page &pageAt(uint32_t row)
+{
+    Page &page = pages[row];
+    if (page.data.empty())
+    {
+        page.data.assign(RAW_SIZE, 0xFF);
+        page.programs = 0;
+    }
+    return page;
+}
+
+/// count a bus operation, false if the power is cut before it
+bool step()
+{
+    hostDwt.CYCCNT += STEP_CYCLES;
+    if (cut)
+    {
+        return false;
+    }
+    stepCount++;
+    cut = cutStep != 0 && stepCount >= cutStep;
+    return !cut;
+}
+
+void program(uint32_t row)
+{
+    if (!writeEnabled)
+    {
+        printf("nand: program of row %u without the write latch\n", static_cast<unsigned>(row));
+        return;
+    }
+    /* the chip programs the ECC bytes of every sector holding data */
+    for (uint32_t sector = 0; sector < PAGE_SIZE / SECTOR_SIZE; sector++)
+    {
+        for (uint32_t i = 0; i < SECTOR_SIZE; i++)
+        {
+            if (cache[sector * SECTOR_SIZE + i] != 0xFF)
+            {
+                cache[PAGE_SIZE + sector * SECTOR_SPARE + 8] = 0x5A;
+                break;
+            }
+        }
+    }
+    Page &page = pageAt(row);
+    for (uint32_t i = 0; i < PAGE_SIZE; i++)
+    {
+        if (cache[i] != 0xFF && (page.data[i] & cache[i]) != cache[i])
+        {
+            overwriteCount++;
+            break;
+        }
+    }
+    for (uint32_t i = 0; i < RAW_SIZE; i++)
+    {
+        page.data[i] &= cache[i];
+    }
+    page.programs++;
+    maxPrograms  = page.programs > maxPrograms ? page.programs : maxPrograms;
+    writeEnabled = false;
+    busyUntil    = hostDwt.CYCCNT + BUSY_CYCLES;
+    programCount++;
+}
+
+void erase(uint32_t row)
+{
+    if (!writeEnabled)
+    {
+        printf("nand: erase of row %u without the write latch\n", static_cast<unsigned>(row));
+        return;
+    }
+    writeEnabled = false;
+    if (badBlocks.count(row / PAGES_PER_BLOCK) != 0)
+    {
+        badEraseCount++;
+        return;
+    }
+    uint32_t first = row - row % PAGES_PER_BLOCK;
+    for (uint32_t page = first; page < first + PAGES_PER_BLOCK; page++)
+    {
+        pages.erase(page);
+    }
+}
+
+uint8_t &registerAt(uint16_t address) { return registers[((address >> 4) - 0xA) % 3]; }
+}  // namespace
+
+void wipe()
+{
+    pages.clear();
+    for (uint32_t block : badBlocks)
+    {
+        pageAt(block * PAGES_PER_BLOCK).data[PAGE_SIZE] = 0x00;
+    }
+    programCount   = 0;
+    maxPrograms    = 0;
+    overwriteCount = 0;
+    badEraseCount  = 0;
+}
+
+void markBad(uint32_t block) { badBlocks.insert(block); }
+void clearBad() { badBlocks.clear(); }
+
+void reboot()
+{
+    cache.assign(RAW_SIZE, 0xFF);
+    writeEnabled       = false;
+    busyUntil          = hostDwt.CYCCNT;
+    stepCount          = 0;
+    cutStep            = 0;
+    cut                = false;
+    hqspi1.State       = HAL_QSPI_STATE_READY;
+    hqspi1.hdma        = &hdma_quadspi;
+    hdma_quadspi.State = HAL_DMA_STATE_READY;
+}
+
+void cutAt(uint32_t count) { cutStep = count == 0 ? 0 : stepCount + count; }
+bool isCut() { return cut; }
+uint32_t steps() { return stepCount; }
+uint32_t programs() { return programCount; }
+uint8_t maxPagePrograms() { return maxPrograms; }
+uint32_t overwrites() { return overwriteCount; }
+uint32_t badErases() { return badEraseCount; }
+
+}  // namespace NandModel
+}  // namespace Tests
+
+using namespace Tests::NandModel;
+
+extern "C" {
+HAL_StatusTypeDef BufferCommand(uint32_t pageAddr, uint16_t command)
+{
+    if (!step())
+    {
+        return HAL_OK;
+    }
+    switch (command)
+    {
+    case OPCode::PAGE_DATA_READ:
+        cache = pageAt(pageAddr).data;
+        break;
+    case OPCode::PROGRAM_EXECUTE:
+        program(pageAddr);
+        break;
+    case OPCode::BLOCK_ERASE:
+        erase(pageAddr);
+        break;
+    default:
+        break;
+    }
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef PureCommand(uint16_t command)
+{
+    if (!step())
+    {
+        return HAL_OK;
+    }
+    writeEnabled = command == OPCode::WRITE_ENABLE;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef Command_Rx_1DataLine_addr(uint16_t, uint8_t *buffer, uint16_t, uint16_t size)
+{
+    memset(buffer, 0, size);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef Command_Rx_1DataLine(uint16_t command, uint8_t *buffer, uint16_t size, uint16_t)
+{
+    memset(buffer, 0, size);
+    if (command == OPCode::JEDEC_ID && size >= 3)
+    {
+        buffer[0] = (DefaultGeometry::JEDEC_ID >> 16) & 0xFF;
+        buffer[1] = (DefaultGeometry::JEDEC_ID >> 8) & 0xFF;
+        buffer[2] = DefaultGeometry::JEDEC_ID & 0xFF;
+    }
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef Command_Rx_2DataLine(uint16_t, uint8_t *buffer, uint16_t addr, uint16_t size)
+{
+    if (!step() || addr + size > RAW_SIZE)
+    {
+        memset(buffer, 0xFF, size);
+        return HAL_OK;
+    }
+    memcpy(buffer, &cache[addr], size);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef Command_Tx_4DataLine(uint16_t command, uint8_t *buffer, uint16_t addr, uint16_t size)
+{
+    if (!step() || addr + size > RAW_SIZE)
+    {
+        return HAL_OK;
+    }
+    if (command == OPCode::QUAD_LOAD_PROGRAM_DATA)
+    {
+        cache.assign(RAW_SIZE, 0xFF);
+    }
+    memcpy(&cache[addr], buffer, size);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef StatusReg_Tx(uint16_t, uint16_t regAddr, uint8_t data)
+{
+    registerAt(regAddr) = data;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef StatusReg_Rx(uint16_t, uint16_t regAddr, uint8_t *buffer)
+{
+    if (regAddr != RegisterAddress::STATUS_REGISTER)
+    {
+        *buffer = registerAt(regAddr);
+        return HAL_OK;
+    }
+    hostDwt.CYCCNT += 170;
+    bool busy = !cut && static_cast<int32_t>(busyUntil - hostDwt.CYCCNT) > 0;
+    *buffer   = (writeEnabled ? 0x02 : 0x00) | (busy ? 0x01 : 0x00);
+    return HAL_OK;
+}
+
+TickType_t xTaskGetTickCount(void) { return ticks++; }
+TaskHandle_t xTaskGetCurrentTaskHandle(void) { return &ticks; }
+BaseType_t xTaskGetSchedulerState(void) { return taskSCHEDULER_RUNNING; }
+uint32_t ulTaskNotifyTake(BaseType_t, TickType_t)
+{
+    hostDwt.CYCCNT += 20 * 170;
+    return 0;
+}
+void vTaskNotifyGiveFromISR(TaskHandle_t, BaseType_t *) {}
+}
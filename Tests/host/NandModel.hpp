@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+
+namespace Tests
+{
+/**
+ * @brief A model of the W25N01 behind the command helpers of quadspi.c, for the host build of the flash driver
+ * @note  The pages are programmed the way the NAND does it: the bits only go from 1 to 0, an erase sets the whole block back to 0xFF and
+ *        the chip fills in the ECC bytes of each sector it programs. The model counts the partial programs of each page since its erase,
+ *        the driver must stay within `FLASH_FS_PAGE_PROGRAMS` of them
+ * @note  Every bus operation (a page read, a load, a program, an erase, a read of the cache) counts as one step. `cutAt` cuts the power
+ *        before a step: that operation and every one after it has no effect until `reboot`, the reads then return 0xFF. A program or an
+ *        erase is done whole or not at all, the torn states of a cell are left to the ECC and the CRCs of the records
+ */
+namespace NandModel
+{
+/**
+ * @brief Forget every page, the chip is erased but for the bad block marks
+ */
+void wipe();
+/**
+ * @brief Give `block` a factory bad block mark, in the spare area of its first page. The model never erases it
+ */
+void markBad(uint32_t block);
+/**
+ * @brief Remove the bad block marks, with the next `wipe`
+ */
+void clearBad();
+/**
+ * @brief Power the chip back on: the page cache, the write latch and the cut are cleared, the pages are kept
+ */
+void reboot();
+/**
+ * @brief Cut the power before the `step`th bus operation from now, 0 to never cut it
+ */
+void cutAt(uint32_t step);
+/// true once the power is cut
+bool isCut();
+
+/// the bus operations since the last reboot
+uint32_t steps();
+/// the program operations since the chip was wiped
+uint32_t programs();
+/// the most partial programs a page took between two erases since the chip was wiped
+uint8_t maxPagePrograms();
+/// the programs since the chip was wiped which loaded data over programmed bytes, the bits the driver meant to leave at 1 stayed 0
+uint32_t overwrites();
+/// the erases of a bad block since the chip was wiped
+uint32_t badErases();
+
+}  // namespace NandModel
+}  // namespace Tests
@@ -0,0 +1,542 @@
+/**
+ * @file PowerCut.cpp
+ * @brief Cuts the power of the NAND model before every bus operation of a workload, reboots and checks what the driver recovers
+ * @note  Each suite runs its workload once per cut point, from the first bus operation to the last one, then boots again on the pages
+ *        the cut left behind:
+ *        - `Manager`, for each durability: the data of the writes made durable reads back, the recovered write offset of the block is
+ *          at or past it and never past the page the last write ended in, the bytes in between are the ones written or blank, and a
+ *          write after the reboot lands at the recovered offset without programming over any data (`loadAddr`, `recoverWriteOffsets`)
+ *        - `RingLog`: the records read back are whole and in order, every synced one is there, and the log takes appends again, also
+ *          with a bad block in the ring, which is never erased
+ *        - `KvStore`: every key holds the value of its last durable put or of the put the cut interrupted, and the store takes puts again
+ *        - `BlobStore`: every name holds its last durable object or the one the cut interrupted, whole and with its CRC, and the store
+ *          takes a new object
+ *        - `FileSystem`: a file appended to and a file written over in place are each found as they were at their last durable `sync` or
+ *          at the one the cut interrupted, and the file system takes writes again
+ *        Every suite also checks that no page took more than `FLASH_FS_PAGE_PROGRAMS` partial programs for the stores which promise it
+ */
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+#include "NandModel.hpp"
+#include "flash.hpp"
+#include "flashBlobStore.hpp"
+#include "flashFileSystem.hpp"
+#include "flashKvStore.hpp"
+#include "flashRingLog.hpp"
+
+using namespace Core::Drivers::W25N01;
+using Tests::NandModel::cutAt;
+using Tests::NandModel::isCut;
+
+namespace
+{
+using Flash    = Manager<DefaultGeometry>;
+using Geometry = DefaultGeometry;
+
+constexpr uint16_t DATA_BLOCK  = 3;
+constexpr uint16_t RING_BLOCK  = 100;
+constexpr uint16_t RING_BLOCKS = 4;  // the records wrap around once
+constexpr uint16_t KV_BLOCK    = 200;
+constexpr uint8_t KV_KEYS      = 8;
+constexpr uint16_t BLOB_BLOCK  = 300;
+constexpr uint16_t BLOB_BLOCKS = 8;  // the catalog and 6 data blocks
+constexpr uint8_t BLOB_NAMES   = 3;
+constexpr uint16_t FS_BLOCK    = 400;
+constexpr uint16_t FS_BLOCKS   = 8;  // the directory and 6 data blocks
+constexpr uint32_t FS_IMAGE    = 5000;
+
+alignas(Flash) uint8_t flashStorage[sizeof(Flash)];
+alignas(RingLog<>) uint8_t ringStorage[sizeof(RingLog<>)];
+alignas(KvStore<>) uint8_t kvStorage[sizeof(KvStore<>)];
+alignas(BlobStore<>) uint8_t blobStorage[sizeof(BlobStore<>)];
+alignas(FileSystem<>) uint8_t fsStorage[sizeof(FileSystem<>)];
+uint8_t stream[Geometry::BLOCK_SIZE_BYTE];
+uint8_t buffer[2 * Geometry::PAGE_SIZE_BYTE];  // a page of the block or a record of the log
+
+/**
+ * @brief The pass and fail count of a suite
+ */
+struct Suite
+{
+    const char *name;
+    uint32_t runs;
+    uint32_t failures;
+
+    /// count a failed check, print the first ones
+    void check(bool passed, uint32_t cut, const char *what)
+    {
+        if (!passed && ++failures <= 5)
+        {
+            printf("  %s: cut before operation %u: %s\n", name, static_cast<unsigned>(cut), what);
+        }
+    }
+    bool report() const
+    {
+        printf("%-14s %6u cuts, %u failures\n", name, static_cast<unsigned>(runs), static_cast<unsigned>(failures));
+        return failures == 0;
+    }
+};
+
+/**
+ * @brief Power the chip on and mount the driver on the pages left by the previous run
+ */
+Flash &boot()
+{
+    Tests::NandModel::reboot();
+    Flash *flash = new (flashStorage) Flash();
+    flash->init();
+    return *flash;
+}
+
+uint16_t writeSize(uint32_t index) { return 150 + 37 * index; }
+
+/**
+ * @brief Write a stream to `DATA_BLOCK` with `mode`, cut the power before the `cut`th operation, reboot and check the block
+ * @return false once the workload ends before the cut
+ */
+bool managerRun(Suite &suite, Durability mode, uint32_t cut)
+{
+    Tests::NandModel::wipe();
+    Flash &flash = boot();
+    flash.setDurability(mode);
+    flash.setGroupCommit(0, 2000);
+
+    cutAt(cut);
+    uint32_t written = 0;  // the bytes of the writes issued
+    uint32_t durable = 0;  // the bytes covered by a snapshot
+    for (uint32_t i = 0; i < 20 && !isCut(); i++)
+    {
+        State state = flash.WriteMemory(DATA_BLOCK, stream + written, writeSize(i));
+        written += writeSize(i);
+        if (state == State::OK && !isCut() && flash.commitStats().pendingWrites == 0)
+        {
+            durable = written;
+        }
+    }
+    if (!isCut())
+    {
+        flash.~Flash();
+        return false;
+    }
+    flash.~Flash();
+
+    Flash &recovered = boot();
+    uint32_t offset  = recovered.blockTable()[DATA_BLOCK].writeOffset();
+    uint32_t end     = (written + Geometry::BYTE_MASK) & ~Geometry::BYTE_MASK;  // a torn page is skipped whole
+    bool passed      = offset >= durable && offset <= end;
+    for (uint32_t at = 0; passed && at < offset && at < written; at += Geometry::PAGE_SIZE_BYTE)
+    {
+        uint32_t stop = offset < written ? offset : written;
+        uint16_t size = stop - at < Geometry::PAGE_SIZE_BYTE ? stop - at : Geometry::PAGE_SIZE_BYTE;
+        recovered.ReadMemory(Geometry::calcAddress(DATA_BLOCK, at >> Geometry::BYTE_BITS, 0), buffer, size);
+        for (uint32_t i = 0; i < size; i++)
+        {
+            bool blank = buffer[i] == 0xFF && at + i >= durable;
+            passed &= buffer[i] == stream[at + i] || blank;
+        }
+    }
+    suite.check(passed, cut, "the recovered offset does not match the durable data");
+
+    /* the next write goes at the recovered offset, on erased bytes */
+    uint32_t overwrites = Tests::NandModel::overwrites();
+    uint8_t marker[50];
+    memset(marker, 0xA5, sizeof(marker));
+    if (offset + sizeof(marker) <= Geometry::BLOCK_SIZE_BYTE)
+    {
+        State state = recovered.WriteMemory(DATA_BLOCK, marker, sizeof(marker));
+        recovered.ReadMemory(Geometry::calcAddress(DATA_BLOCK, offset >> Geometry::BYTE_BITS, Geometry::byteOf(offset)), buffer, sizeof(marker));
+        bool landed = state == State::OK && memcmp(buffer, marker, sizeof(marker)) == 0 && Tests::NandModel::overwrites() == overwrites;
+        suite.check(landed, cut, "the write after the reboot does not land on erased bytes at the recovered offset");
+    }
+    recovered.~Flash();
+    return true;
+}
+
+uint16_t recordSize(uint32_t id) { return id % 97 == 0 ? 3000 : 20 + (id * 37) % 300; }
+
+void fillRecord(uint32_t id)
+{
+    memset(buffer, static_cast<uint8_t>(id), recordSize(id));
+    memcpy(buffer, &id, sizeof(id));
+}
+
+/**
+ * @brief Append records to a `RingLog` of `RING_BLOCKS` good blocks, syncing every 25th, cut the power before the `cut`th operation
+ *        and read the log back after the reboot
+ * @param withBad: one more block in the middle of the ring is bad, the ring must step over it and never erase it
+ * @return false once the workload ends before the cut
+ */
+bool ringRun(Suite &suite, uint32_t cut, bool withBad)
+{
+    uint16_t blocks = withBad ? RING_BLOCKS + 1 : RING_BLOCKS;
+    Tests::NandModel::clearBad();
+    if (withBad)
+    {
+        Tests::NandModel::markBad(RING_BLOCK + 2);
+    }
+    Tests::NandModel::wipe();
+    Flash *flash   = &boot();
+    RingLog<> *log = new (ringStorage) RingLog<>(*flash, RING_BLOCK, blocks);
+    log->mount();
+
+    cutAt(cut);
+    int32_t synced = -1;
+    uint32_t id    = 0;
+    for (; id < 3000 && !isCut(); id++)
+    {
+        fillRecord(id);
+        log->append(buffer, recordSize(id));
+        if (id % 25 == 24 && log->sync() == State::OK && !isCut())
+        {
+            synced = id;
+        }
+    }
+    bool wasCut = isCut();
+    log->~RingLog<>();
+    flash->~Flash();
+    if (!wasCut)
+    {
+        return false;
+    }
+
+    flash                    = &boot();
+    log                      = new (ringStorage) RingLog<>(*flash, RING_BLOCK, blocks);
+    bool passed              = log->mount() == State::OK;
+    RingLog<>::Cursor cursor = log->begin();
+    uint16_t length;
+    int32_t last = -1;
+    while (passed && log->read(cursor, buffer, sizeof(buffer), length) == State::OK && length != 0)
+    {
+        uint32_t read;
+        memcpy(&read, buffer, sizeof(read));
+        bool whole = length == recordSize(read) && buffer[length - 1] == static_cast<uint8_t>(read);
+        passed     = whole && (last < 0 || read == static_cast<uint32_t>(last) + 1);
+        last       = read;
+    }
+    suite.check(passed && last >= synced, cut, "the records read back are torn, out of order or miss a synced one");
+
+    uint32_t next = last + 1;
+    fillRecord(next);
+    bool appended = log->append(buffer, recordSize(next)) == State::OK && log->sync() == State::OK;
+    cursor        = log->begin();
+    while (appended && log->read(cursor, buffer, sizeof(buffer), length) == State::OK && length != 0)
+    {
+        memcpy(&last, buffer, sizeof(last));
+    }
+    suite.check(appended && static_cast<uint32_t>(last) == next, cut, "the log does not take appends after the reboot");
+    suite.check(Tests::NandModel::badErases() == 0, cut, "the log erased its bad block");
+    log->~RingLog<>();
+    flash->~Flash();
+    return true;
+}
+
+void keyName(char *key, uint32_t index) { snprintf(key, 8, "c%u", static_cast<unsigned>(index % KV_KEYS)); }
+uint16_t valueSize(uint32_t value) { return value % 3 ? 40 : 8; }
+
+/**
+ * @brief Put values under `KV_KEYS` keys of a `KvStore` with `Durability::SYNC`, cut the power before the `cut`th operation and get
+ *        them back after the reboot
+ * @return false once the workload ends before the cut
+ */
+bool kvRun(Suite &suite, uint32_t cut)
+{
+    Tests::NandModel::wipe();
+    Flash *flash  = &boot();
+    KvStore<> *kv = new (kvStorage) KvStore<>(*flash, KV_BLOCK);
+    kv->mount();
+
+    cutAt(cut);
+    uint32_t durable[KV_KEYS] = {0};
+    uint32_t attempt[KV_KEYS] = {0};
+    char key[8];
+    uint8_t value[40];
+    for (uint32_t i = 1; i < 400 && !isCut(); i++)
+    {
+        keyName(key, i);
+        memset(value, static_cast<uint8_t>(i), sizeof(value));
+        memcpy(value, &i, sizeof(i));
+        attempt[i % KV_KEYS] = i;
+        if (kv->put(key, value, valueSize(i), Durability::SYNC) == State::OK && !isCut())
+        {
+            durable[i % KV_KEYS] = i;
+        }
+    }
+    bool wasCut = isCut();
+    kv->~KvStore<>();
+    flash->~Flash();
+    if (!wasCut)
+    {
+        return false;
+    }
+
+    flash       = &boot();
+    kv          = new (kvStorage) KvStore<>(*flash, KV_BLOCK);
+    bool passed = kv->mount() == State::OK;
+    for (uint32_t k = 0; passed && k < KV_KEYS; k++)
+    {
+        keyName(key, k);
+        uint16_t length;
+        uint32_t read = 0;
+        State state   = kv->get(key, value, sizeof(value), length);
+        if (state == State::OK)
+        {
+            memcpy(&read, value, sizeof(read));
+            passed = length == valueSize(read) && value[length - 1] == static_cast<uint8_t>(read);
+        }
+        passed &= durable[k] == 0 || (state == State::OK && (read == durable[k] || read == attempt[k]));
+    }
+    suite.check(passed, cut, "a key lost its durable value or holds a torn one");
+
+    uint32_t after = 7;
+    suite.check(kv->put("after", &after, sizeof(after)) == State::OK, cut, "the store does not take puts after the reboot");
+    kv->~KvStore<>();
+    flash->~Flash();
+    return true;
+}
+
+uint32_t blobSize(uint32_t version) { return 1500 + 700 * (version % 5); }
+
+/**
+ * @brief Read the object `name` of `store` back and find which version it is
+ * @return false if the object is torn, fails its CRC or is none of `versions`
+ */
+bool readBlob(BlobStore<> &store, const char *name, const uint32_t *versions, uint8_t count, uint32_t &found)
+{
+    BlobStore<>::Reader reader;
+    if (store.openReader(name, reader) != State::OK)
+    {
+        return false;
+    }
+    static uint8_t object[8 * 1024];
+    uint32_t length;
+    if (reader.read(object, sizeof(object), length) != State::OK)
+    {
+        return false;
+    }
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (versions[i] != 0 && length == blobSize(versions[i]) && memcmp(object, stream + versions[i], length) == 0)
+        {
+            found = versions[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Seal objects under `BLOB_NAMES` names of a `BlobStore` with `Durability::SYNC`, each one replacing the previous one of its
+ *        name, cut the power before the `cut`th operation and read them back after the reboot
+ * @return false once the workload ends before the cut
+ */
+bool blobRun(Suite &suite, uint32_t cut)
+{
+    Tests::NandModel::wipe();
+    Flash *flash      = &boot();
+    BlobStore<> *blob = new (blobStorage) BlobStore<>(*flash, BLOB_BLOCK, BLOB_BLOCKS);
+    blob->mount();
+
+    cutAt(cut);
+    uint32_t durable[BLOB_NAMES] = {0};
+    uint32_t attempt[BLOB_NAMES] = {0};
+    char name[8];
+    for (uint32_t i = 1; i <= 12 && !isCut(); i++)
+    {
+        keyName(name, i % BLOB_NAMES);
+        attempt[i % BLOB_NAMES] = i;
+        uint32_t half           = blobSize(i) / 2;
+        if (blob->create(name, blobSize(i)) == State::OK && blob->append(stream + i, half) == State::OK &&
+            blob->append(stream + i + half, blobSize(i) - half) == State::OK && blob->seal(Durability::SYNC) == State::OK && !isCut())
+        {
+            durable[i % BLOB_NAMES] = i;
+        }
+    }
+    bool wasCut = isCut();
+    blob->~BlobStore<>();
+    flash->~Flash();
+    if (!wasCut)
+    {
+        return false;
+    }
+
+    flash       = &boot();
+    blob        = new (blobStorage) BlobStore<>(*flash, BLOB_BLOCK, BLOB_BLOCKS);
+    bool passed = blob->mount() == State::OK;
+    for (uint8_t n = 0; passed && n < BLOB_NAMES; n++)
+    {
+        keyName(name, n);
+        uint32_t versions[2] = {durable[n], attempt[n]};
+        uint32_t found;
+        passed = durable[n] == 0 && !blob->contains(name) ? true : readBlob(*blob, name, versions, 2, found);
+    }
+    suite.check(passed, cut, "an object lost its durable version or reads back torn");
+
+    const uint32_t after = 40;
+    uint32_t found;
+    bool created = blob->create("after", blobSize(after)) == State::OK && blob->append(stream + after, blobSize(after)) == State::OK &&
+                   blob->seal() == State::OK && readBlob(*blob, "after", &after, 1, found);
+    suite.check(created, cut, "the store does not take an object after the reboot");
+    blob->~BlobStore<>();
+    flash->~Flash();
+    return true;
+}
+
+/**
+ * @brief Read the whole file `name` into `object`
+ * @return false if the file cannot be opened or read
+ */
+bool readFile(FileSystem<> &fs, const char *name, uint8_t *object, uint32_t capacity, uint32_t &length)
+{
+    static FileSystem<>::File file;
+    if (fs.open(name, OpenMode::READ, file) != State::OK)
+    {
+        return false;
+    }
+    bool read = file.read(object, capacity, length) == State::OK;
+    file.close();
+    return read;
+}
+
+/**
+ * @brief Append to one file of a `FileSystem` and write over a second one in place, syncing both every third write with
+ *        `Durability::SYNC`, cut the power before the `cut`th operation and read them back after the reboot
+ * @return false once the workload ends before the cut
+ */
+bool fsRun(Suite &suite, uint32_t cut)
+{
+    static FileSystem<>::File log, image;
+    static uint8_t current[FS_IMAGE], durable[FS_IMAGE], attempt[FS_IMAGE], object[16 * 1024];
+    Tests::NandModel::wipe();
+    Flash *flash     = &boot();
+    FileSystem<> *fs = new (fsStorage) FileSystem<>(*flash, FS_BLOCK, FS_BLOCKS);
+    fs->mount();
+    memcpy(current, stream + 3000, FS_IMAGE);
+    fs->open("image", OpenMode::WRITE, image);
+    image.write(current, FS_IMAGE);
+    image.sync(Durability::SYNC);
+    memcpy(durable, current, FS_IMAGE);
+    memcpy(attempt, current, FS_IMAGE);
+    fs->open("log", OpenMode::APPEND, log);
+
+    cutAt(cut);
+    uint32_t written = 0, synced = 0, syncing = 0;
+    for (uint32_t i = 0; i < 24 && !isCut(); i++)
+    {
+        log.write(stream + written, writeSize(i));
+        written += writeSize(i);
+        uint32_t at = (i * 311) % (FS_IMAGE - 100);
+        memcpy(current + at, stream + 1000 + i, 100);
+        image.seek(at);
+        image.write(current + at, 100);
+        if (i % 3 == 2)
+        {
+            syncing = written;
+            memcpy(attempt, current, FS_IMAGE);
+            if (log.sync(Durability::SYNC) == State::OK && !isCut())
+            {
+                synced = written;
+            }
+            if (image.sync(Durability::SYNC) == State::OK && !isCut())
+            {
+                memcpy(durable, current, FS_IMAGE);
+            }
+        }
+    }
+    bool wasCut = isCut();
+    log.~File();
+    image.~File();
+    new (&log) FileSystem<>::File();
+    new (&image) FileSystem<>::File();
+    fs->~FileSystem<>();
+    flash->~Flash();
+    if (!wasCut)
+    {
+        return false;
+    }
+
+    flash = &boot();
+    fs    = new (fsStorage) FileSystem<>(*flash, FS_BLOCK, FS_BLOCKS);
+    uint32_t length;
+    bool passed = fs->mount() == State::OK && readFile(*fs, "log", object, sizeof(object), length);
+    passed &= (length == synced || length == syncing) && memcmp(object, stream, length) == 0;
+    suite.check(passed, cut, "the appended file lost its synced bytes or holds unsynced ones");
+    passed = readFile(*fs, "image", object, sizeof(object), length) && length == FS_IMAGE &&
+             (memcmp(object, durable, FS_IMAGE) == 0 || memcmp(object, attempt, FS_IMAGE) == 0);
+    suite.check(passed, cut, "the file written in place is not as it was at a sync");
+
+    bool appended = fs->open("log", OpenMode::APPEND, log) == State::OK && log.write(stream, 300) == State::OK && log.close() == State::OK &&
+                    readFile(*fs, "log", object, sizeof(object), length) && memcmp(object + length - 300, stream, 300) == 0;
+    suite.check(appended, cut, "the file system does not take writes after the reboot");
+    fs->~FileSystem<>();
+    flash->~Flash();
+    return true;
+}
+
+}  // namespace
+
+int main()
+{
+    for (uint32_t i = 0; i < sizeof(stream); i++)
+    {
+        stream[i] = (i * 7 + 1) % 251;
+    }
+
+    bool passed                   = true;
+    const Durability modes[]      = {Durability::SYNC, Durability::GROUP, Durability::LAZY};
+    const char *const modeNames[] = {"Manager SYNC", "Manager GROUP", "Manager LAZY"};
+    for (uint8_t m = 0; m < 3; m++)
+    {
+        Suite suite{modeNames[m], 0, 0};
+        for (uint32_t cut = 1; managerRun(suite, modes[m], cut); cut++)
+        {
+            suite.runs++;
+        }
+        passed &= suite.report();
+    }
+
+    uint8_t ringPrograms = 0;
+    for (uint8_t withBad = 0; withBad < 2; withBad++)
+    {
+        Suite ring{withBad ? "RingLog bad" : "RingLog", 0, 0};
+        for (uint32_t cut = 1; ringRun(ring, cut, withBad); cut++)
+        {
+            ring.runs++;
+            ringPrograms = Tests::NandModel::maxPagePrograms() > ringPrograms ? Tests::NandModel::maxPagePrograms() : ringPrograms;
+        }
+        passed &= ring.report();
+    }
+    Tests::NandModel::clearBad();
+
+    Suite kv{"KvStore", 0, 0};
+    uint8_t kvPrograms = 0;
+    for (uint32_t cut = 1; kvRun(kv, cut); cut++)
+    {
+        kv.runs++;
+        kvPrograms = Tests::NandModel::maxPagePrograms() > kvPrograms ? Tests::NandModel::maxPagePrograms() : kvPrograms;
+    }
+    passed &= kv.report();
+
+    Suite blob{"BlobStore", 0, 0};
+    for (uint32_t cut = 1; blobRun(blob, cut); cut++)
+    {
+        blob.runs++;
+    }
+    passed &= blob.report();
+
+    Suite fs{"FileSystem", 0, 0};
+    uint8_t fsPrograms = 0;
+    for (uint32_t cut = 1; fsRun(fs, cut); cut++)
+    {
+        fs.runs++;
+        fsPrograms = Tests::NandModel::maxPagePrograms() > fsPrograms ? Tests::NandModel::maxPagePrograms() : fsPrograms;
+    }
+    passed &= fs.report();
+
+    printf("most partial programs of a page: RingLog %u, KvStore %u, FileSystem %u, at most %u\n", ringPrograms, kvPrograms, fsPrograms,
+           FLASH_FS_PAGE_PROGRAMS);
+    passed &= ringPrograms <= FLASH_FS_PAGE_PROGRAMS && kvPrograms <= FLASH_FS_PAGE_PROGRAMS && fsPrograms <= FLASH_FS_PAGE_PROGRAMS;
+    printf(passed ? "PASS\n" : "FAIL\n");
+    return passed ? 0 : 1;
+}
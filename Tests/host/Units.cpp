@@ -0,0 +1,440 @@
+/**
+ * @file Units.cpp
+ * @brief Runs the flash driver on the NAND model through the cases the power cut harness does not reach, each case on a wiped chip
+ * @note  - `BlockTable::markBad`: a `RESERVED` block stays so
+ *        - `FormatMode::QUICK`: a block ahead of the background pass takes a write as soon as the format returns, and keeps it
+ *        - `StartEraseRange`: the progress ends at 100 % exactly, with the kept data a whole number of pages or not, none of it or
+ *          a range past the written end, and the data around the range is moved down
+ *        - group commit: `Step` saves the table once a `GROUP` write has waited the whole interval, with a `LAZY` default and while
+ *          a background operation runs, and leaves the `LAZY` writes alone
+ *        - `BTree`: the leaves and the root split, the entries survive a compaction and a remount, and a range scan of a bulk loaded tree
+ *          of three levels reads each leaf once
+ *        - `DeltaCodec`: the records of every field type come back from their keyframes and deltas, also across a jump of the time
+ *        - `QuantCodec`: q15 and q7 batches come back within one step of their scale, coded in place and decoded over their own bytes
+ *        - `IngestRing`: the records come out whole and in order while the ring wraps with padding records, and a full ring drops the
+ *          newest record or evicts the oldest ones by the policy of the producer
+ */
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+#include "NandModel.hpp"
+#include "flash.hpp"
+#include "flashBTree.hpp"
+#include "flashDeltaCodec.hpp"
+#include "flashIngestRing.hpp"
+#include "flashQuantCodec.hpp"
+
+using namespace Core::Drivers::W25N01;
+
+namespace
+{
+using Flash    = Manager<DefaultGeometry>;
+using Geometry = DefaultGeometry;
+
+alignas(Flash) uint8_t flashStorage[sizeof(Flash)];
+uint8_t data[4 * Geometry::PAGE_SIZE_BYTE];
+uint8_t buffer[Geometry::PAGE_SIZE_BYTE];
+uint32_t failures = 0;
+
+/// count a failed check and print it
+void check(bool passed, const char *what)
+{
+    if (!passed)
+    {
+        failures++;
+        printf("  %s\n", what);
+    }
+}
+
+/**
+ * @brief Power the chip on and mount the driver on the pages left by the previous case
+ */
+Flash &boot()
+{
+    Tests::NandModel::reboot();
+    Flash *flash = new (flashStorage) Flash();
+    flash->init();
+    return *flash;
+}
+
+void reservedStaysReserved()
+{
+    static BlockTable<Geometry> table;
+    table.reset();
+    check(table.markBad(Geometry::USER_BLOCK_COUNT - 1) && table[Geometry::USER_BLOCK_COUNT - 1].state() == BlockState::BAD,
+          "mark bad: a user block is not marked bad");
+    check(!table.markBad(Geometry::RESERVE_BLOCK_BLOCKADDR) && table[Geometry::RESERVE_BLOCK_BLOCKADDR].state() == BlockState::RESERVED,
+          "mark bad: the reserved block was marked bad");
+}
+
+void quickFormat()
+{
+    Tests::NandModel::wipe();
+    Flash &flash = boot();
+    memset(data, 0x3C, sizeof(buffer));
+    flash.WriteMemory(600, data, sizeof(buffer));
+
+    check(flash.Format(FormatMode::QUICK) == State::OK, "quick format: the format does not start");
+    check(flash.WriteMemory(600, data, sizeof(buffer)) == State::OK, "quick format: a block ahead of the pass refuses a write");
+    while (flash.Step(Deadline::NO_BUDGET) == JobStatus::RUNNING)
+    {
+    }
+    flash.ReadMemory(Geometry::calcAddress(600, 0, 0), buffer, sizeof(buffer));
+    check(flash.jobStatus() == JobStatus::DONE && memcmp(buffer, data, sizeof(buffer)) == 0, "quick format: the pass erased the block written after it");
+    check(flash.blockTable()[600].writeOffset() == sizeof(buffer), "quick format: the block does not hold one page");
+    flash.~Flash();
+}
+/**
+ * @brief Write `written` bytes to a block, erase `[start, end)` of it in the background and check the progress and the data kept
+ */
+void eraseRange(uint32_t written, uint32_t start, uint32_t end)
+{
+    constexpr uint16_t BLOCK = 700;
+    Tests::NandModel::wipe();
+    Flash &flash = boot();
+    for (uint32_t i = 0; i < sizeof(data); i++)
+    {
+        data[i] = static_cast<uint8_t>(i * 7 + i / 251);
+    }
+    for (uint32_t at = 0; at < written; at += Geometry::PAGE_SIZE_BYTE)
+    {
+        flash.WriteMemory(BLOCK, data + at, written - at < Geometry::PAGE_SIZE_BYTE ? written - at : Geometry::PAGE_SIZE_BYTE);
+    }
+
+    char what[96];
+    snprintf(what, sizeof(what), "erase range: %u bytes, [%u, %u)", static_cast<unsigned>(written), static_cast<unsigned>(start),
+             static_cast<unsigned>(end));
+    bool started = flash.StartEraseRange(Geometry::calcAddress(BLOCK, start >> Geometry::BYTE_BITS, Geometry::byteOf(start)),
+                                         Geometry::calcAddress(BLOCK, end >> Geometry::BYTE_BITS, Geometry::byteOf(end))) == State::OK;
+    uint8_t most = 0;
+    while (started && flash.Step(Deadline::NO_BUDGET) == JobStatus::RUNNING)
+    {
+        most = flash.jobProgress() > most ? flash.jobProgress() : most;
+    }
+    if (!started || flash.jobStatus() != JobStatus::DONE || most > 100 || flash.jobProgress() != 100)
+    {
+        printf("  %s: progress %u at the end, at most %u\n", what, flash.jobProgress(), most);
+        check(false, "erase range: the progress does not end at 100 %");
+    }
+
+    uint32_t kept = end < written ? written - (end - start) : (start < written ? start : written);
+    bool moved    = flash.blockTable()[BLOCK].writeOffset() == kept;
+    for (uint32_t at = 0; moved && at < kept; at += Geometry::PAGE_SIZE_BYTE)
+    {
+        uint16_t size = kept - at < Geometry::PAGE_SIZE_BYTE ? kept - at : Geometry::PAGE_SIZE_BYTE;
+        flash.ReadMemory(Geometry::calcAddress(BLOCK, at >> Geometry::BYTE_BITS, 0), buffer, size);
+        for (uint32_t i = 0; i < size; i++)
+        {
+            uint32_t from = at + i < start ? at + i : at + i + (end - start);
+            moved &= buffer[i] == data[from];
+        }
+    }
+    check(moved, what);
+    flash.~Flash();
+}
+void groupCommit()
+{
+    Tests::NandModel::wipe();
+    Flash &flash = boot();
+    flash.setDurability(Durability::LAZY);
+    flash.setGroupCommit(5, 0);
+    memset(data, 0x5A, Geometry::PAGE_SIZE_BYTE);
+
+    flash.WriteMemory(10, data, Geometry::PAGE_SIZE_BYTE);
+    uint32_t commits = flash.commitStats().commits;
+    for (uint8_t i = 0; i < 50; i++)
+    {
+        flash.Step(Deadline::NO_BUDGET);
+    }
+    check(flash.commitStats().commits == commits, "group commit: a step saved the table for a lazy write");
+
+    flash.Sync();
+    flash.WriteMemory(11, data, Geometry::PAGE_SIZE_BYTE, Durability::GROUP);
+    flash.StartEraseChip();
+    while (flash.commitStats().pendingWrites != 0 && flash.Step(1) == JobStatus::RUNNING)  // one erase per step
+    {
+    }
+    check(flash.commitStats().pendingWrites == 0 && flash.jobStatus() == JobStatus::RUNNING,
+          "group commit: the interval ran out during a background operation without a table save");
+    flash.Cancel();
+    while (flash.Step(Deadline::NO_BUDGET) == JobStatus::RUNNING)
+    {
+    }
+    flash.~Flash();
+}
+
+using Tree = BTree<Geometry>;
+alignas(Tree) uint8_t treeStorage[sizeof(Tree)];
+
+struct Scanned
+{
+    uint32_t count;
+    uint32_t last;
+};
+
+/// `scan` visitor: the keys come in increasing order and hold half their key
+bool countInOrder(uint32_t key, uint32_t value, void *context)
+{
+    Scanned &scanned = *static_cast<Scanned *>(context);
+    if (value != key / 2 || (scanned.count != 0 && key <= scanned.last))
+    {
+        return false;
+    }
+    scanned.count++;
+    scanned.last = key;
+    return true;
+}
+
+/**
+ * @brief Mount the tree of blocks `[800, 832)` again after a reboot
+ */
+Tree &remountTree(Flash *&flash)
+{
+    flash->Sync();
+    reinterpret_cast<Tree *>(treeStorage)->~Tree();
+    flash->~Flash();
+    flash     = &boot();
+    Tree &tree = *new (treeStorage) Tree(*flash, 800, 32);
+    check(tree.mount() == State::OK, "btree: the remount fails");
+    return tree;
+}
+
+/**
+ * @brief Splits the leaves and the root with updates, compacts and remounts, then bulk loads a tree of three levels and scans it
+ */
+void bTree()
+{
+    Tests::NandModel::wipe();
+    Flash *flash = &boot();
+    flash->setDurability(Durability::LAZY);
+    Tree *tree = new (treeStorage) Tree(*flash, 800, 32);
+    uint32_t value;
+    check(tree->mount() == State::OK && tree->height() == 1 && tree->find(2, value) == State::PARAM_ERR, "btree: an empty tree");
+
+    /* the keys go in from both ends so that the leaves split on either side */
+    constexpr uint32_t KEYS = 3 * Tree::LEAF_CAPACITY;
+    bool inserted           = true;
+    for (uint32_t i = 0; i < KEYS; i++)
+    {
+        uint32_t key = i % 2 ? 2 * (KEYS - i) : 2 * i + 2;
+        inserted &= tree->insert(key, key / 2) == State::OK;
+    }
+    for (uint32_t key = 4; key <= 2 * KEYS; key += 8)
+    {
+        inserted &= tree->remove(key) == State::OK;
+    }
+    check(inserted && tree->height() == 2, "btree: the updates do not split the root");
+    uint32_t compactions = tree->stats().compactions;
+    check(compactions != 0 && tree->compact() == State::OK && tree->stats().compactions == compactions + 1, "btree: the compactions fail");
+
+    tree         = &remountTree(flash);
+    bool found   = tree->height() == 2;
+    for (uint32_t key = 2; key <= 2 * KEYS; key += 2)
+    {
+        State state = tree->find(key, value);
+        found &= key % 8 == 4 ? state == State::PARAM_ERR : state == State::OK && value == key / 2;
+    }
+    check(found, "btree: a key is lost or a removed key is back after the compaction and the remount");
+
+    /* 4 nodes above the leaves, the last one is not pinned: the scan must read each leaf once, not descend again for each one */
+    constexpr uint32_t LEAVES = 4 * (Tree::INTERNAL_CAPACITY + 1);
+    constexpr uint32_t LOADED = LEAVES * Tree::LEAF_CAPACITY;
+    bool loaded               = tree->beginLoad() == State::OK;
+    for (uint32_t i = 1; i <= LOADED; i++)
+    {
+        loaded &= tree->load(2 * i, i) == State::OK;
+    }
+    check(loaded && tree->endLoad() == State::OK && tree->height() == 3, "btree: the bulk load fails");
+    tree           = &remountTree(flash);
+    uint32_t reads = tree->stats().pageReads;
+    Scanned scanned = {};
+    check(tree->scan(2, 2 * LOADED, countInOrder, &scanned) == State::OK && scanned.count == LOADED,
+          "btree: the scan misses entries or visits them out of order");
+    check(tree->stats().pageReads - reads <= LEAVES + 4, "btree: the scan reads more than one page per leaf");
+    reads = tree->stats().pageReads;
+    check(tree->find(2 * LOADED, value) == State::OK && value == LOADED && tree->stats().pageReads - reads == 2,
+          "btree: a lookup under an unpinned node does not read it and the leaf");
+    tree->~Tree();
+    flash->~Flash();
+}
+
+/**
+ * @brief Encode a stream of records of every field type and decode it back, from a keyframe every 5 records and across a time jump
+ */
+void deltaCodec()
+{
+    static const FieldType TYPES[] = {FieldType::INT8,  FieldType::UINT8,  FieldType::INT16,  FieldType::UINT16,
+                                      FieldType::INT32, FieldType::UINT32, FieldType::FLOAT32};
+    constexpr uint8_t FIELDS       = sizeof(TYPES) / sizeof(TYPES[0]);
+    constexpr uint16_t RECORDS     = 40;
+    DeltaCodec codec(TYPES, FIELDS, 5);
+    check(codec.isValid() && codec.recordSize() == 1 + 1 + 2 + 2 + 4 + 4 + 4, "delta codec: the record size");
+
+    static uint8_t records[RECORDS][18];
+    static uint8_t coded[RECORDS * 32];
+    uint32_t times[RECORDS];
+    uint32_t used = 0;
+    DeltaCodec::History history;
+    DeltaCodec::restart(history);
+    for (uint16_t n = 0; n < RECORDS; n++)
+    {
+        /* slow signals around the wrap of each width, and a time jump of more than 2^31 in the middle */
+        int8_t int8     = static_cast<int8_t>(120 + 3 * n);
+        uint8_t uint8   = static_cast<uint8_t>(250 + n);
+        int16_t int16   = static_cast<int16_t>(-3 * n);
+        uint16_t uint16 = static_cast<uint16_t>(65530 + 2 * n);
+        int32_t int32   = 1000 - 7 * n;
+        uint32_t uint32 = 0xFFFFFFF0U + n;
+        float float32   = 20.0f + 0.01f * n;
+        uint8_t *record = records[n];
+        memcpy(record, &int8, 1);
+        memcpy(record + 1, &uint8, 1);
+        memcpy(record + 2, &int16, 2);
+        memcpy(record + 4, &uint16, 2);
+        memcpy(record + 6, &int32, 4);
+        memcpy(record + 10, &uint32, 4);
+        memcpy(record + 14, &float32, 4);
+        times[n] = n == RECORDS / 2 ? times[n - 1] + 0x90000000U : (n == 0 ? 0xFFFFFF00U : times[n - 1] + 10);
+        used += codec.encode(history, times[n], record, coded + used);
+    }
+    check(used < RECORDS * codec.recordSize(), "delta codec: the slow signals do not get shorter");
+
+    bool decoded = true;
+    uint32_t at  = 0;
+    DeltaCodec::restart(history);
+    for (uint16_t n = 0; decoded && n < RECORDS; n++)
+    {
+        uint8_t record[18];
+        uint32_t time;
+        uint16_t length = codec.decode(history, coded + at, used - at, time, record);
+        decoded         = length != 0 && time == times[n] && memcmp(record, records[n], sizeof(record)) == 0;
+        at += length;
+    }
+    check(decoded && at == used, "delta codec: a record does not come back");
+
+    uint32_t time;
+    DeltaCodec::restart(history);
+    uint16_t first = codec.decode(history, coded, used, time, nullptr);
+    check(first != 0 && codec.decode(history, coded + first, 1, time, nullptr) == 0, "delta codec: a cut record is decoded");
+    DeltaCodec::restart(history);
+    check(codec.decode(history, coded + first, used - first, time, nullptr) == 0, "delta codec: a delta is decoded without its keyframe");
+}
+
+/**
+ * @brief Code a batch of 3 channels with `type` in place, decode it over its own bytes and check each value against its scale
+ */
+void quantCodec(Quantization type)
+{
+    constexpr uint16_t ROWS     = 100;
+    constexpr uint16_t CHANNELS = 3;
+    QuantCodec codec(type, CHANNELS);
+    static float values[ROWS * CHANNELS];
+    static float expected[ROWS * CHANNELS];
+    for (uint16_t n = 0; n < ROWS * CHANNELS; n++)
+    {
+        uint16_t channel = n % CHANNELS;
+        expected[n]      = channel == 2 ? 0.0f : (channel + 1) * 40.0f * sinf(0.05f * n);  // the last channel is all zeros
+    }
+    memcpy(values, expected, sizeof(values));
+
+    float scales[CHANNELS];
+    uint8_t *bytes = reinterpret_cast<uint8_t *>(values);
+    codec.encode(values, ROWS, scales, bytes);
+    /* the coded rows are moved to the end of the buffer, the floats are decoded from there to its start */
+    uint32_t size = ROWS * codec.rowSize();
+    memmove(bytes + sizeof(values) - size, bytes, size);
+    codec.decode(bytes + sizeof(values) - size, ROWS, scales, values);
+
+    float step  = type == Quantization::Q15 ? 1.0f / 32768.0f : 1.0f / 128.0f;
+    bool within = scales[2] == 0.0f;
+    for (uint16_t n = 0; n < ROWS * CHANNELS; n++)
+    {
+        within &= fabsf(values[n] - expected[n]) <= 1.01f * step * scales[n % CHANNELS];
+    }
+    check(within, type == Quantization::Q15 ? "quant codec: a q15 value is off by more than a step" : "quant codec: a q7 value is off by more than a step");
+}
+
+/// the byte `index` of the payload of record `n`
+uint8_t ingestByte(uint32_t n, uint16_t index) { return static_cast<uint8_t>(n * 31 + index); }
+uint16_t ingestSize(uint32_t n) { return 1 + (n * 53) % 300; }
+
+/**
+ * @brief Drain `ring` and check that the records come out whole, from producer `n % 3`, in order from record `next`
+ * @return false if a record is wrong
+ */
+bool drainIngest(IngestRing &ring, uint32_t &next)
+{
+    static uint8_t chunk[Geometry::PAGE_SIZE_BYTE];
+    uint16_t size;
+    bool passed = true;
+    while ((size = ring.drain(chunk, sizeof(chunk))) != 0)
+    {
+        for (uint16_t at = 0; passed && at < size; next++)
+        {
+            uint16_t length;
+            memcpy(&length, chunk + at, 2);
+            passed = length == ingestSize(next) && chunk[at + 2] == next % 3;
+            for (uint16_t i = 0; passed && i < length; i++)
+            {
+                passed = chunk[at + IngestRing::RECORD_HEADER + i] == ingestByte(next, i);
+            }
+            at += IngestRing::RECORD_HEADER + length;
+        }
+    }
+    return passed;
+}
+
+void ingestRing()
+{
+    static IngestRing ring;
+    uint8_t payload[IngestRing::MAX_RECORD];
+
+    /* about 10 times the ring in records of odd sizes, drained at irregular points, the records cross the end of the ring */
+    uint32_t next = 0;
+    bool passed   = true;
+    for (uint32_t n = 0; n < 600; n++)
+    {
+        for (uint16_t i = 0; i < ingestSize(n); i++)
+        {
+            payload[i] = ingestByte(n, i);
+        }
+        passed &= ring.write(n % 3, payload, ingestSize(n));
+        if (n % 7 == 6 && ring.used() > IngestRing::SIZE / 3)
+        {
+            passed &= drainIngest(ring, next);
+        }
+    }
+    passed &= drainIngest(ring, next) && next == 600 && ring.used() == 0;
+    check(passed, "ingest ring: a record is lost, torn or out of order across the wrap");
+
+    /* a full ring drops the new record of a `DROP_NEWEST` producer, a `DROP_OLDEST` one evicts the oldest records for it */
+    uint32_t n = 1000;
+    for (; ring.write(n % 3, payload, 0) && n < 1000 + IngestRing::SIZE; n++)
+    {
+    }
+    check(n < 1000 + IngestRing::SIZE && ring.stats(n % 3).dropped == 1, "ingest ring: a full ring takes a record");
+    ring.setPolicy(1, Backpressure::DROP_OLDEST);
+    check(ring.write(1, payload, 100) && ring.stats(1).evicted != 0, "ingest ring: a drop oldest producer does not evict");
+}
+}  // namespace
+
+int main()
+{
+    reservedStaysReserved();
+    quickFormat();
+    const uint32_t PAGE = Geometry::PAGE_SIZE_BYTE;
+    eraseRange(3 * PAGE + 100, PAGE / 2, PAGE + 10);  // the kept data ends inside a page
+    eraseRange(3 * PAGE, PAGE, 2 * PAGE);              // the kept data is two whole pages
+    eraseRange(2 * PAGE, 0, 2 * PAGE);                 // nothing is kept
+    eraseRange(PAGE, 2 * PAGE, 3 * PAGE);              // the range is past the written end
+    groupCommit();
+    bTree();
+    deltaCodec();
+    quantCodec(Quantization::Q15);
+    quantCodec(Quantization::Q7);
+    ingestRing();
+    printf(failures == 0 ? "units: PASS\n" : "units: %u failures\n", static_cast<unsigned>(failures));
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,5 @@
+/**
+ * @file Config.h
+ * @brief Stands in for the `Config.h` of RM2024-Core, `AppConfig.h` holds every setting the flash driver reads
+ */
+#pragma once
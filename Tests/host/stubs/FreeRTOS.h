@@ -0,0 +1,21 @@
+/**
+ * @file FreeRTOS.h
+ * @brief The few FreeRTOS types and macros the flash driver uses, for the host build of the driver
+ * @note  The host runs a single task: the critical sections are empty and a yield returns at once
+ */
+#pragma once
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef void *TaskHandle_t;
+
+#define pdFALSE                        0
+#define pdTRUE                         1
+#define configTICK_RATE_HZ             1000
+#define pdMS_TO_TICKS(ms)              ((TickType_t)(ms) * configTICK_RATE_HZ / 1000)
+#define taskENTER_CRITICAL()           ((void)0)
+#define taskEXIT_CRITICAL()            ((void)0)
+#define taskYIELD()                    ((void)0)
+#define portYIELD_FROM_ISR(woken)      ((void)(woken))
@@ -0,0 +1,33 @@
+/**
+ * @file HostTarget.h
+ * @brief Included before every source of the host build: the core registers the driver reads are moved to plain memory
+ * @note  `DWT->CYCCNT` is the clock of the model, each bus operation moves it forward by the time it takes on the chip
+ * @note  The exclusive accesses of the lock free `IngestRing` are plain loads and stores, the host build runs in a single thread
+ */
+#pragma once
+#include "stm32g4xx_hal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern DWT_Type hostDwt;
+extern CoreDebug_Type hostCoreDebug;
+
+static inline uint32_t __LDREXW(volatile uint32_t *addr) { return *addr; }
+static inline uint32_t __STREXW(uint32_t value, volatile uint32_t *addr)
+{
+    *addr = value;
+    return 0;
+}
+static inline void __CLREX(void) {}
+
+#ifdef __cplusplus
+}
+#endif
+
+#undef DWT
+#undef CoreDebug
+#define DWT       (&hostDwt)
+#define CoreDebug (&hostCoreDebug)
+#define __DMB()   __sync_synchronize()
@@ -0,0 +1,26 @@
+/**
+ * @file arm_math.h
+ * @brief The CMSIS-DSP kernels the flash driver uses, implemented by HostDsp.cpp on the host
+ */
+#pragma once
+#include <stdint.h>
+
+typedef float float32_t;
+typedef int16_t q15_t;
+typedef int8_t q7_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void arm_max_f32(const float32_t *pSrc, uint32_t blockSize, float32_t *pResult, uint32_t *pIndex);
+void arm_min_f32(const float32_t *pSrc, uint32_t blockSize, float32_t *pResult, uint32_t *pIndex);
+void arm_scale_f32(const float32_t *pSrc, float32_t scale, float32_t *pDst, uint32_t blockSize);
+void arm_float_to_q15(const float32_t *pSrc, q15_t *pDst, uint32_t blockSize);
+void arm_float_to_q7(const float32_t *pSrc, q7_t *pDst, uint32_t blockSize);
+void arm_q15_to_float(const q15_t *pSrc, float32_t *pDst, uint32_t blockSize);
+void arm_q7_to_float(const q7_t *pSrc, float32_t *pDst, uint32_t blockSize);
+
+#ifdef __cplusplus
+}
+#endif
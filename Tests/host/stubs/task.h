@@ -0,0 +1,23 @@
+/**
+ * @file task.h
+ * @brief The task functions the flash driver uses, implemented by the NAND model on the host
+ */
+#pragma once
+#include "FreeRTOS.h"
+
+#define taskSCHEDULER_NOT_STARTED 1
+#define taskSCHEDULER_RUNNING     2
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+BaseType_t xTaskGetSchedulerState(void);
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticksToWait);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higherPriorityTaskWoken);
+
+#ifdef __cplusplus
+}
+#endif